@@ -67,6 +67,7 @@
 #include "mlir/Parser/Parser.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/Pass/PassManager.h"
+#include "mlir/Support/Timing.h"
 #include "mlir/Target/LLVMIR/Export.h"
 #include "mlir/Transforms/Passes.h"
 #include "llvm/ADT/StringRef.h"
@@ -97,6 +98,7 @@
 // #ifdef ENABLE_GPU_TARGET
 // #include "comet/TritonConfig.h"
 // #endif
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <string>
@@ -193,12 +195,28 @@ static cl::opt<int> GPUNumStages("gpu-num-stages", cl::init(1), cl::desc("GPU nu
 static cl::opt<bool> OptMultiOpFactorization("opt-multiop-factorize",
                                              cl::desc("Multi operations factorization optimization"));
 
+static cl::opt<bool> OptMultiOpRuntimeOrder("opt-multiop-runtime-order",
+                                            cl::desc("Select at runtime the order of chains of sparse matrix multiplications, from the number of nonzeros of their operands"));
+
 static cl::opt<bool> IsSelectBestPermTTGT("opt-bestperm-ttgt",
                                           cl::desc("Select the best index permutation for TTGT, otherwise the first appropriate permutation"));
 
 static cl::opt<int> selectedPermNum("perm-num", cl::init(1),
                                     cl::ZeroOrMore, cl::desc("Select the permutation number to choose"));
 
+static cl::opt<std::string> TTGTCostProfileFile("ttgt-cost-profile", cl::init(""), cl::value_desc("filename"),
+                                            cl::desc("Rank the TTGT index permutations with the machine profile written by --ttgt-calibrate"));
+
+static cl::opt<std::string> TTGTCalibrateFile("ttgt-calibrate", cl::init(""), cl::value_desc("filename"),
+                                          cl::desc("Microbenchmark the transpose and GEMM throughput of this machine, write the TTGT cost profile and exit"));
+
+static cl::opt<mlir::comet::TCEngine> TCEngineOpt(
+    "tc-engine", cl::init(mlir::comet::TTGTEngine),
+    cl::desc("Engine for the dense tensor contractions lowered by --convert-tc-to-ttgt"),
+    cl::values(clEnumValN(mlir::comet::TTGTEngine, "ttgt", "transpose the operands, then call GEMM (default)"),
+               clEnumValN(mlir::comet::GETTEngine, "gett", "pack the GEMM micro-panels straight from the tensors (GETT)"),
+               clEnumValN(mlir::comet::AutoEngine, "auto", "pick TTGT or GETT with a cost model")));
+
 /// =============================================================================
 /// Operation based optimizations
 /// =============================================================================
@@ -206,14 +224,47 @@ static cl::opt<bool> OptMatmulTiling("opt-matmul-tiling",
                                      cl::desc("Optimize LinAlg matmul operation with tiling"));
 
 static cl::opt<bool> OptCallToMatMulMicroKernel("opt-matmul-mkernel",
-                                                cl::desc("Replace the inner linalg.matmul that introduced after tiling with the blis micro kernel"));
+                                                cl::desc("Replace linalg.matmul with the packed, multithreaded GEMM driver built on the blis micro kernel"));
 
 static cl::opt<bool> OptDenseTransposeOp("opt-dense-transpose",
                                          cl::desc("Optimize transpose operation: optimal loop ordering and tiling"));
 
+static cl::opt<bool> OptDenseVectorize("opt-dense-vectorize", cl::init(false),
+                                       cl::desc("Vectorize the loops of dense elementwise operations, fills, copies and reductions"));
+
+static cl::opt<bool> OptMemoryPlanning("opt-mem-plan", cl::init(false),
+                                       cl::desc("Free the buffers of tensors at their last use and reuse them for later tensors of the same type"));
+
+static cl::opt<bool> PrintMemoryPlanning("print-mem-plan", cl::init(false),
+                                         cl::desc("Report the peak bytes of the buffers before and after memory planning"));
+
+static cl::opt<bool> OptArenaAllocation("opt-arena-alloc", cl::init(false),
+                                        cl::desc("Allocate the temporary buffers of functions from an arena released when the function returns"));
+
 /// =============================================================================
 /// Sparse kernel optimizations
 /// =============================================================================
+static cl::opt<bool> OptUnrollStaticDims("opt-unroll-static-dims", cl::init(false),
+                                         cl::desc("Fully unroll the innermost loops over dimensions of small constant size, e.g. the dense columns of SpMM"));
+
+static cl::opt<bool> OptVectorizeInnermost("opt-vectorize-innermost", cl::init(false),
+                                           cl::desc("Emit vector operations for the innermost dense loops of sparse kernels, e.g. the dense columns of SpMM"));
+
+static cl::opt<unsigned> VectorWidth("vector-width", cl::init(4),
+                                     cl::desc("Number of elements of the vector operations emitted by the vectorizing optimizations"));
+
+static cl::opt<bool> OptDirectionSwitch("opt-direction-switch", cl::init(false),
+                                        cl::desc("Switch SpMSpV to a dense frontier at runtime when the sparse vector is dense enough"));
+
+static cl::opt<double> DirectionSwitchThreshold("direction-switch-threshold", cl::init(0.05),
+                                                cl::desc("Density of the sparse vector above which SpMSpV uses a dense frontier"));
+
+static cl::opt<bool> OptBoundOutputAlloc("opt-bound-output-alloc", cl::init(false),
+                                         cl::desc("Allocate the sparse output of SpGEMM from an upper bound of its rows and compact it, instead of a symbolic phase"));
+
+static cl::opt<double> BoundAllocMaxMB("bound-alloc-max-mb", cl::init(0),
+                                       cl::desc("Largest upper-bound allocation in MB of --opt-bound-output-alloc, above which the symbolic phase runs (0 for no limit)"));
+
 static cl::opt<bool> OptWorkspace("opt-comp-workspace", cl::init(false),
                                   cl::desc("Optimize sparse output code generation while reducing iteration space for nonzero elements"));
 
@@ -326,13 +377,21 @@ int loadAndProcessMLIR(mlir::MLIRContext &context,
   bool emitTriton_ = false;
 #endif
 
+  /// Per-pass timing with -mlir-timing, reported along with the time of the frontend
+  mlir::DefaultTimingManager tm;
+  mlir::applyDefaultTimingManagerCLOptions(tm);
+  mlir::TimingScope timing = tm.getRootScope();
+
+  mlir::TimingScope frontendTiming = timing.nest("Parser and MLIRGen");
   if (int error = loadMLIR(context, module))
     return error;
+  frontendTiming.stop();
 
   mlir::PassManager pm(module.get()->getName());
   /// Apply any generic pass manager command line options and run the pipeline.
   if (mlir::failed(mlir::applyPassManagerCLOptions(pm)))
     return 4;
+  pm.enableTiming(timing);
 
   /// Lower tensorAlgebra:FuncOp to func::FuncOp
   pm.addPass(mlir::comet::createFuncOpLoweringPass());
@@ -344,12 +403,19 @@ int loadAndProcessMLIR(mlir::MLIRContext &context,
   ///  Such as finding the optimal ordering of dense tensor contractions, or reformulating tensor contractions
   ///  operations via TTGT
   ///  =============================================================================
-  if (OptMultiOpFactorization)
+  if (OptMultiOpFactorization || OptMultiOpRuntimeOrder)
   {
     /// createFindOptimalTCFactorizationPass should be before lowering of input/output tensor declarations
     /// because this pass finds the optimal ordering of dense tensor multiplication
     /// operations before lowering them specific tc operations
-    optPM.addPass(mlir::comet::createFindOptimalTCFactorizationPass());
+    optPM.addPass(mlir::comet::createFindOptimalTCFactorizationPass(OptMultiOpRuntimeOrder));
+  }
+
+  /// Chains of elementwise operations accumulate in their output instead of declaring intermediate tensors,
+  /// partial fusion on the index tree dialect then merges the loops of the accumulations
+  if (OptKernelFusion)
+  {
+    optPM.addPass(mlir::comet::createElementwiseChainFusionPass());
   }
 
   ///  =============================================================================
@@ -416,13 +482,15 @@ int loadAndProcessMLIR(mlir::MLIRContext &context,
   if (IsLoweringTCtoTTGT)
   {
     /// Sparse input and dense input/output tensor declarations needed be lowered before for TTGT pass
-    optPM.addPass(mlir::comet::createLoweringTTGTPass(IsSelectBestPermTTGT, selectedPermNum, IsPrintFlops));
+    optPM.addPass(mlir::comet::createLoweringTTGTPass(IsSelectBestPermTTGT, selectedPermNum, IsPrintFlops, TCEngineOpt, TTGTCostProfileFile));
   }
 
   /// =============================================================================
   /// Operation based optimizations
   /// =============================================================================
-  if (OptMatmulTiling)
+  /// The packed GEMM driver used by the micro-kernel pass performs its own cache blocking,
+  /// so compile-time tiling is only applied when the matmul is not replaced as a whole
+  if (OptMatmulTiling && !OptCallToMatMulMicroKernel)
   {
     optPM.addPass(mlir::comet::createLinAlgMatmulTilingPass());
   }
@@ -459,11 +527,19 @@ int loadAndProcessMLIR(mlir::MLIRContext &context,
     optPM.addPass(mlir::comet::createLowerTensorAlgebraToSCFPass());
 
     /// Finally lowering index tree to SCF dialect
-    optPM.addPass(mlir::comet::createLowerIndexTreeToSCFPass());
+    optPM.addPass(mlir::comet::createLowerIndexTreeToSCFPass(OptUnrollStaticDims, OptVectorizeInnermost ? VectorWidth : 0,
+                                                             OptDirectionSwitch, DirectionSwitchThreshold,
+                                                             OptBoundOutputAlloc, uint64_t(std::ceil(BoundAllocMaxMB * (1 << 20)))));
     optPM.addPass(mlir::tensor::createTensorBufferizePass());
     pm.addPass(mlir::func::createFuncBufferizePass()); /// Needed for func
     pm.addPass(mlir::createConvertLinalgToLoopsPass());
 
+    /// The fills and copies are only loops once the remaining linalg operations are converted
+    if (OptDenseVectorize)
+    {
+      pm.addNestedPass<mlir::func::FuncOp>(mlir::comet::createDenseLoopVectorizationPass(VectorWidth));
+    }
+
     if (OptDenseTransposeOp) /// Optimize Dense Transpose operation
     {
       /// If it is a dense transpose ops, the rewrites rules replaces ta.transpose with linalg.transpose, then
@@ -496,6 +572,18 @@ int loadAndProcessMLIR(mlir::MLIRContext &context,
   // pm.addPass(mlir::createCanonicalizerPass());
   optPM.addPass(mlir::createCSEPass());
 
+  /// Buffer lifetimes are only complete once all the uses of the tensors are lowered to memrefs
+  if (OptMemoryPlanning)
+  {
+    optPM.addPass(mlir::comet::createMemoryPlanningPass(PrintMemoryPlanning));
+  }
+
+  /// The buffers that remain after memory planning are bumped from the arena, their deallocs are left to the return
+  if (OptArenaAllocation)
+  {
+    optPM.addPass(mlir::comet::createArenaAllocationPass());
+  }
+
 #ifdef ENABLE_GPU_TARGET
   if (CodegenTarget == TargetDevice::GPU && (emitTriton_ || emitLLVM || IsLoweringtoTriton))
   {
@@ -591,8 +679,12 @@ int main(int argc, char **argv)
   mlir::registerAllDialects(context);
 
   mlir::registerPassManagerCLOptions();
+  mlir::registerDefaultTimingManagerCLOptions();
   cl::ParseCommandLineOptions(argc, argv, "Tensor Algebra compiler\n");
 
+  if (!TTGTCalibrateFile.empty())
+    return mlir::failed(mlir::comet::calibrateTTGTCostProfile(TTGTCalibrateFile)) ? 1 : 0;
+
   if (emitAST)
     return dumpAST();
 
@@ -324,15 +324,17 @@ namespace tensorAlgebra
   {
     std::string tensor_name;
     std::string maskType;
+    bool complemented; /// <!M>: the entries in the mask are excluded instead of included
 
   public:
     MaskExprAST(Location loc, const std::string &tensor_name,
-                const std::string &maskType)
+                const std::string &maskType, bool complemented = false)
         : ExprAST(Expr_Mask, loc), tensor_name(tensor_name),
-          maskType(maskType) {}
+          maskType(maskType), complemented(complemented) {}
 
     const llvm::StringRef getTensorName() { return tensor_name; }
     const llvm::StringRef getMaskType() { return maskType; }
+    bool isComplemented() { return complemented; }
 
     /// LLVM style RTTI
     static bool classof(const ExprAST *C)
@@ -348,6 +350,9 @@ namespace tensorAlgebra
     std::unique_ptr<ExprAST> RHS;
     std::unique_ptr<ExprAST> Mask;
     int beta;
+    /// Elementwise unary map applied to the result, e.g. relu in A[i, j] = relu(B[i, k] * C[k, j])
+    std::string unaryMap;
+    std::vector<double> unaryMapParams;
 
   public:
     TensorOpExprAST(Location loc, TensorOpKind Op, std::unique_ptr<ExprAST> LHS,
@@ -377,6 +382,13 @@ namespace tensorAlgebra
     ExprAST *getRHS() { return RHS.get(); }
     ExprAST *getMask() { return Mask.get(); }
     int getBeta() { return beta; }
+    llvm::StringRef getUnaryMap() { return unaryMap; }
+    llvm::ArrayRef<double> getUnaryMapParams() { return unaryMapParams; }
+    void setUnaryMap(llvm::StringRef map, std::vector<double> params)
+    {
+      unaryMap = map.str();
+      unaryMapParams = std::move(params);
+    }
 
     /// LLVM style RTTI
     static bool classof(const ExprAST *C) { return C->getKind() == Expr_Tensor; }
@@ -479,6 +491,8 @@ namespace tensorAlgebra
 
     llvm::StringRef getCallee() { return Callee; }
     ExprAST *getArg(int index) { return Args[index].get(); }
+    /// Transfers the ownership of an argument, e.g. the operand of an elementwise unary map
+    std::unique_ptr<ExprAST> takeArg(int index) { return std::move(Args[index]); }
     size_t getNumArgs() { return Args.size(); }
     /// LLVM style RTTI
     static bool classof(const ExprAST *C) { return C->getKind() == Expr_Call; }
@@ -63,6 +63,7 @@ namespace tensorAlgebra
     tok_sbracket_close = ']',
     tok_mask_open = '<',
     tok_mask_close = '>',
+    tok_mask_not = '!',
     tok_quotation = '"',
     tok_eof = -1,
 
@@ -34,6 +34,7 @@
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <map>
@@ -133,12 +134,20 @@ namespace tensorAlgebra
     }
 
     /// C[i, j]<M, push> = ...
+    /// C[i, j]<!M, push> = ...  the complemented mask excludes the entries of M
     std::unique_ptr<ExprAST> parseMaskExpr()
     {
       comet_debug() << "in parseMaskExpr\n";
       auto loc = lexer.getLastLocation();
       lexer.consume(Token(tok_mask_open));
 
+      bool complemented = false;
+      if (lexer.getCurToken() == tok_mask_not)
+      {
+        complemented = true;
+        lexer.getNextToken(); /// eat '!'
+      }
+
       std::string theMaskVar(lexer.getId());
       comet_debug() << "The MaskVar is: " << theMaskVar << "\n";
       lexer.getNextToken(); /// eat var-name
@@ -177,7 +186,7 @@ namespace tensorAlgebra
       else
         return parseError<ExprAST>(">", " in mask expression.");
 
-      return std::make_unique<MaskExprAST>(std::move(loc), theMaskVar, theMaskType);
+      return std::make_unique<MaskExprAST>(std::move(loc), theMaskVar, theMaskType, complemented);
     }
 
     /// Parse a literal array expression.
@@ -468,6 +477,14 @@ namespace tensorAlgebra
         return std::make_unique<FileReadExprAST>(std::move(loc), name, std::move(args[0]), std::move(args[1]));
       }
 
+      if (name == "comet_random")
+      { /// It can be a builtin call to comet_random: comet_random(generator, dims..., param0, [param1,] seed)
+        comet_debug() << "comet_random\n";
+        if (args.size() < 4)
+          return parseError<ExprAST>("<generator, dims, params and seed>", "as argument to comet_random()");
+        /// CallExprAST is generated for comet_random()
+      }
+
       if (name == "random")
       {
         comet_debug() << "random\n";
@@ -1329,6 +1346,34 @@ namespace tensorAlgebra
         CallExprAST *call = llvm::cast<CallExprAST>(RHS.get());
         llvm::StringRef callee = call->getCallee();
         comet_debug() << __FILE__ << __LINE__ << " callee: " << callee << "\n";
+
+        /// Elementwise unary map of the result, e.g. A[i, j] = relu(B[i, k] * C[k, j]) or A[i, j] = clamp(B[i, k] * C[k, j], 0.0, 6.0)
+        int numParams = getUnaryMapNumParams(callee);
+        if (numParams >= 0)
+        {
+          /// The map applies to the result, which cannot be accumulated into the previous values of the output
+          if (op != TensorOpKind::Tensor_Set)
+            return parseError<ExprAST>("=", "in tensor expression with " + callee.str() + "()");
+          if (call->getNumArgs() != static_cast<size_t>(numParams) + 1)
+            return parseError<ExprAST>("<tensor expression and " + std::to_string(numParams) + " numbers>",
+                                       "as argument to " + callee.str() + "()");
+
+          std::vector<double> params;
+          for (int i = 1; i <= numParams; i++)
+          {
+            auto *param = llvm::dyn_cast<NumberExprAST>(call->getArg(i));
+            if (!param)
+              return parseError<ExprAST>("number", "as parameter of " + callee.str() + "()");
+            params.push_back(param->getValue());
+          }
+
+          std::string map = callee.str();
+          RHS = call->takeArg(0);
+          auto tensorOp = std::make_unique<TensorOpExprAST>(std::move(loc), op, std::move(LHS),
+                                                            std::move(RHS), std::move(mask), beta);
+          tensorOp->setUnaryMap(map, std::move(params));
+          return tensorOp;
+        }
       }
       else if (RHS.get()->getKind() == tensorAlgebra::ExprAST::Expr_Transpose)
       {
@@ -1662,6 +1707,16 @@ namespace tensorAlgebra
       }
     }
 
+    /// Number of scalar parameters of an elementwise unary map builtin, -1 if the callee is not one
+    static int getUnaryMapNumParams(llvm::StringRef callee)
+    {
+      return llvm::StringSwitch<int>(callee)
+          .Cases("relu", "exp", "abs", "sqrt", 0)
+          .Case("scale", 1)
+          .Case("clamp", 2)
+          .Default(-1);
+    }
+
     /// Helper function to signal errors while parsing, it takes an argument
     /// indicating the expected token and another argument giving more context.
     /// Location is retrieved from the lexer to enrich the error message.
@@ -1914,6 +1914,7 @@ namespace
 
               if (mlir::failed(mlirGenTensorOperations(*tensor_op)))
                 return mlir::success();
+              mlirGenUnaryMap(*tensor_op);
               continue;
             }
             /// A[i,j] = 1.0
@@ -2056,6 +2057,13 @@ namespace
                 if (mlir::failed(mlirGenTensorFillRandom(loc(tensor_op->loc()), tensor_name)))
                   return mlir::success();
               }
+              /// A[i,j] = comet_random(rmat, 1024, 1024, 16, 7)
+              else if (callee == "comet_random")
+              {
+                comet_debug() << " call comet_random \n";
+                if (mlir::failed(mlirGenTensorFillRandomSparse(loc(tensor_op->loc()), tensor_name, *call)))
+                  return mlir::success();
+              }
               else
               {
                 LabeledTensorExprAST *lhsLabeledTensorExprAST = llvm::cast<LabeledTensorExprAST>(tensor_op->getLHS());
@@ -2094,6 +2102,19 @@ namespace
             else if ((tensor_op->getRHS()->getKind() == ExprAST::ExprASTKind::Expr_LabeledTensor &&
                       tensor_op->getLHS()->getKind() == ExprAST::ExprASTKind::Expr_LabeledTensor))
             {
+              /// A[i,j] = relu(A[i,j])
+              if (!tensor_op->getUnaryMap().empty())
+              {
+                if (llvm::cast<LabeledTensorExprAST>(tensor_op->getLHS())->getTensorName() !=
+                    llvm::cast<LabeledTensorExprAST>(tensor_op->getRHS())->getTensorName())
+                {
+                  emitError(loc(tensor_op->loc()), "error: an elementwise unary map of a tensor is only supported "
+                                                   "in place or on the result of a tensor operation");
+                  return mlir::failure();
+                }
+                mlirGenUnaryMap(*tensor_op);
+                continue;
+              }
 
               if (mlir::failed(mlirGenTensorarithexprs(*tensor_op)))
                 return mlir::success();
@@ -2194,6 +2215,19 @@ namespace
       }
     }
 
+    /// Elementwise unary map of the result of a tensor expression, applied in place to the lhs tensor.
+    /// It is fused into the operation that produces the tensor when lowered to the index tree.
+    void mlirGenUnaryMap(TensorOpExprAST &tensor_op)
+    {
+      if (tensor_op.getUnaryMap().empty())
+        return;
+
+      LabeledTensorExprAST *lhsLT = llvm::cast<LabeledTensorExprAST>(tensor_op.getLHS());
+      mlir::Value lhs_tensor = symbolTable.lookup(lhsLT->getTensorName());
+      builder.create<TensorUnaryOp>(loc(tensor_op.loc()), lhs_tensor, builder.getStringAttr(tensor_op.getUnaryMap()),
+                                    builder.getF64ArrayAttr(tensor_op.getUnaryMapParams()));
+    }
+
     mlir::LogicalResult mlirGenTensorarithexprs(TensorOpExprAST &tensor_op)
     {
 
@@ -2307,6 +2341,9 @@ namespace
         mask = llvm::cast<MaskExprAST>(tensor_op.getMask());
         MaskingName = mask->getMaskType();
         MaskingVar_name = mask->getTensorName();
+        /// A complemented mask C<!M> keeps its masking type, e.g., "push_complement"
+        if (mask->isComplemented())
+          MaskingName += "_complement";
 
         mlir::Value maskLT_op;
         /// find the variable name in symbol table
@@ -2593,6 +2630,69 @@ namespace
       return mlir::success();
     }
 
+    /// Sparse tensors filled with a synthetic pattern: comet_random(generator, dims..., param0, [param1,] seed)
+    /// The pattern is generated at runtime in the format of the tensor (see TensorFillRandomOp).
+    mlir::LogicalResult mlirGenTensorFillRandomSparse(mlir::Location loc, StringRef tensor_name,
+                                                      CallExprAST &call)
+    {
+      mlir::Value tensorValue = symbolTable.lookup(tensor_name);
+      if (tensorValue == nullptr)
+      {
+        /// the variable was not declared by user.
+        llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: please check your variable definitions!";
+        return mlir::failure();
+      }
+
+      if (!isa<SparseTensorDeclOp>(tensorValue.getDefiningOp()))
+      {
+        emitError(loc, "comet_random() only fills sparse tensors, use random() for dense tensors");
+        return mlir::failure();
+      }
+
+      int64_t rank = tensorValue.getType().cast<mlir::TensorType>().getRank();
+      int64_t num_params = (int64_t)call.getNumArgs() - rank - 2;
+      if (num_params < 1 || num_params > 2)
+      {
+        emitError(loc, "comet_random() expects (generator, ") << rank << " dimension sizes, one or two parameters, seed)";
+        return mlir::failure();
+      }
+
+      if (call.getArg(0)->getKind() != ExprAST::ExprASTKind::Expr_Var)
+      {
+        emitError(loc, "the first argument of comet_random() must be one of uniform, rmat, banded or powerlaw");
+        return mlir::failure();
+      }
+      StringRef generator = llvm::cast<VariableExprAST>(call.getArg(0))->getName();
+      if (generator != "uniform" && generator != "rmat" && generator != "banded" && generator != "powerlaw")
+      {
+        emitError(loc, "unknown comet_random() generator '") << generator << "', expected uniform, rmat, banded or powerlaw";
+        return mlir::failure();
+      }
+
+      std::vector<double> numArgs;
+      for (size_t i = 1; i < call.getNumArgs(); i++)
+      {
+        if (call.getArg(i)->getKind() != ExprAST::ExprASTKind::Expr_Num)
+        {
+          emitError(loc, "the dimension sizes, parameters and seed of comet_random() must be numbers");
+          return mlir::failure();
+        }
+        numArgs.push_back(llvm::cast<NumberExprAST>(call.getArg(i))->getValue());
+      }
+
+      SmallVector<int64_t, 3> dims;
+      for (int64_t i = 0; i < rank; i++)
+        dims.push_back((int64_t)numArgs[i]);
+      SmallVector<double, 2> params{numArgs[rank], num_params == 2 ? numArgs[rank + 1] : 0.0};
+      int64_t seed = (int64_t)numArgs.back();
+
+      builder.create<TensorFillRandomOp>(loc, tensorValue, builder.getStringAttr(generator),
+                                         builder.getI64ArrayAttr(dims), builder.getF64ArrayAttr(params),
+                                         builder.getI64IntegerAttr(seed));
+
+      return mlir::success();
+    }
+
     mlir::LogicalResult mlirGenTensorFillFromFile(mlir::Location loc,
                                                   StringRef tensor_name, StringRef filename,
                                                   int readMode)
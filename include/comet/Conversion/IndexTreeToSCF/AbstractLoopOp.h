@@ -97,6 +97,10 @@ public:
 
   void setUpperBound(mlir::Value &upperBound);
 
+  mlir::Value getLowerBound();
+
+  mlir::Value getUpperBound();
+
   std::string getIteratorType()
   {
     return iteratorType;
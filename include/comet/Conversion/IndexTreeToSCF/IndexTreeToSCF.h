@@ -42,8 +42,16 @@ namespace mlir
 
         /// Lowers indexTree operations (e.g., IndexTreeComputeLHSOp, IndexTreeComputeRHSOp and IndexTreeComputeOp)
         /// to equivalent scf constructs including basic blocks and arithmetic
-        /// primitives).
-        std::unique_ptr<Pass> createLowerIndexTreeToSCFPass();
+        /// primitives). With unrollStaticDims, the innermost loops over dimensions of small constant size are fully unrolled.
+        /// With a vectorWidth larger than 1, the innermost loops over dense, contiguous dimensions operate on vectors.
+        /// With switchDirection, the loops over a sparse vector multiplied by a sparse matrix (SpMSpV) switch at runtime
+        /// to a dense frontier when the density of the vector is above switchThreshold.
+        /// With boundOutputAlloc, the sparse output of SpGEMM is allocated from an upper bound of the size of its rows
+        /// and compacted after the numeric phase, instead of being counted by a symbolic phase. When boundAllocMaxBytes
+        /// is not 0, the symbolic phase still runs at runtime if the bound takes more memory than boundAllocMaxBytes.
+        std::unique_ptr<Pass> createLowerIndexTreeToSCFPass(bool unrollStaticDims = false, unsigned vectorWidth = 0,
+                                                            bool switchDirection = false, double switchThreshold = 0.05,
+                                                            bool boundOutputAlloc = false, uint64_t boundAllocMaxBytes = 0);
     }
 } // namespace mlir
 
@@ -36,6 +36,9 @@ class UnitExpression
   string opType;
   llvm::StringRef semiring;
   llvm::StringRef maskType;
+  /// Elementwise unary map fused into the expression, applied to the values of the output before they are stored
+  string unaryMap;
+  vector<double> unaryMapParams;
   int numOps = 2;
 
   bool traceDomainCompute = false;
@@ -176,6 +179,9 @@ public:
   void setSemiring(const llvm::StringRef &Semiring);
   const llvm::StringRef &getMaskType() const;
   void setMaskType(const llvm::StringRef &MaskType);
+  const string &getUnaryMap() const;
+  const vector<double> &getUnaryMapParams() const;
+  void setUnaryMap(const string &UnaryMap, const vector<double> &Params);
 };
 
 #endif /// INDEXTREE_UNITEXPRESSION_H
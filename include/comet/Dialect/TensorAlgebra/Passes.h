@@ -37,6 +37,10 @@ namespace mlir
         /// Check if it is needed to add tensor declarations introduced by compound expressions
         std::unique_ptr<Pass> createTensorAlgebraCheckImplicitTensorDeclPass();
 
+        /// Create a pass to fuse chains of elementwise additions and subtractions with a dense output into
+        /// accumulations in the output, without temporary tensors for the intermediate results
+        std::unique_ptr<Pass> createElementwiseChainFusionPass();
+
         void populateDenseTensorDeclLoweringPatterns(RewritePatternSet &patterns);
         void populateSparseOutputTensorDeclLoweringPatterns(RewritePatternSet &patterns);
 
@@ -52,15 +56,43 @@ namespace mlir
         /// Create a pass to lower temporary sparse output tensor declarations - temporary sparse output is introduced in compound expressions
         std::unique_ptr<Pass> createSparseTempOutputTensorDeclLoweringPass();
 
-        std::unique_ptr<Pass> createFindOptimalTCFactorizationPass();
+        /// Create a pass to free the buffers of lowered tensors at their last use and to reuse them in place for
+        /// later buffers of the same type. With printStats, the peak bytes before and after planning are reported
+        std::unique_ptr<Pass> createMemoryPlanningPass(bool printStats = false);
+
+        /// Create a pass to allocate the temporary buffers of functions from the arena of the runtime, and to release
+        /// them all at once when the function returns
+        std::unique_ptr<Pass> createArenaAllocationPass();
+
+        /// Create a pass to vectorize the innermost loops of the dense operations lowered to loops, including
+        /// the reductions, with vectors of vectorWidth elements
+        std::unique_ptr<Pass> createDenseLoopVectorizationPass(unsigned vectorWidth);
+
+        /// Create a pass to find the best order of chains of tensor contractions. With runtimeOrder, the order of
+        /// chains of sparse matrix multiplications is selected at runtime, once the number of nonzeros is known
+        std::unique_ptr<Pass> createFindOptimalTCFactorizationPass(bool runtimeOrder = false);
         std::unique_ptr<Pass> createLowerTAMulChainPass();
 
+        /// Engines the TTGT pass can lower a dense tensor contraction through
+        enum TCEngine
+        {
+          TTGTEngine, /// transpose the operands into matrices and call GEMM
+          GETTEngine, /// pack the GEMM micro-panels straight from the tensors, without transposed copies
+          AutoEngine  /// pick the engine with the lowest estimated cost
+        };
+
         /// Create a pass for lowering TA operations to TTGT
         /// This pass selects either the best permutation among all
         /// or pass can specify the iteration order of the permutation, ith permutation
         std::unique_ptr<Pass> createLoweringTTGTPass(bool enableBestPerm,
                                                      int whatPermID = 1,
-                                                     bool printFlops = false);
+                                                     bool printFlops = false,
+                                                     TCEngine engine = TTGTEngine,
+                                                     std::string costProfilePath = "");
+
+        /// Microbenchmark the transpose and GEMM throughput of the host and write it as a cost profile
+        /// that the TTGT pass can rank index permutations with
+        LogicalResult calibrateTTGTCostProfile(StringRef profilePath);
 
         std::unique_ptr<Pass> createLinAlgMatmulTilingPass();
         std::unique_ptr<Pass> createLinAlgMatmulMicroKernelPass();
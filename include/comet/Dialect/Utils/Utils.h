@@ -29,11 +29,15 @@
 #include "mlir/Dialect/Linalg/IR/Linalg.h"
 #include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/Affine/LoopUtils.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/SetVector.h"
 
 #include "mlir/Transforms/DialectConversion.h"
 
+#include <cmath>
+#include <limits>
 #include <set>
 #include <unordered_map>
 #include <typeinfo>
@@ -222,6 +226,104 @@ namespace mlir
 
     void replaceOperands(Operation *itComputeOp, std::vector<Value> newComputeOps);
 
+    /// Throughput of the TTGT building blocks on a machine, measured by calibrateTTGTCostProfile().
+    /// ContractionPlan ranks the index permutations with it instead of its analytic cost when it is set.
+    struct TTGTCostProfile
+    {
+      struct GemmSample
+      {
+        int64_t m, n, k;
+        double flopsPerSecond;
+      };
+
+      /// Elements per second of transposes that keep the innermost dimension innermost, and of those that move it
+      double contiguousTransposeRate = 0.0;
+      double stridedTransposeRate = 0.0;
+      std::vector<GemmSample> gemmSamples;
+
+      bool isValid() const
+      {
+        return contiguousTransposeRate > 0 && stridedTransposeRate > 0 && !gemmSamples.empty();
+      }
+
+      /// Seconds to transpose mem_size elements with perm
+      double getTransposeTime(uint64_t mem_size, const IndexVector &perm) const
+      {
+        bool contiguous = perm.empty() || perm.back() == perm.size() - 1;
+        return mem_size / (contiguous ? contiguousTransposeRate : stridedTransposeRate);
+      }
+
+      /// Seconds to run an m x n x k GEMM, at the throughput of the closest measured shape
+      double getGemmTime(int64_t m, int64_t n, int64_t k) const
+      {
+        auto logDistance = [](int64_t x, int64_t y)
+        { return std::abs(std::log2((double)std::max<int64_t>(x, 1)) - std::log2((double)std::max<int64_t>(y, 1))); };
+
+        const GemmSample *closest = &gemmSamples.front();
+        double minDistance = std::numeric_limits<double>::max();
+        for (const auto &sample : gemmSamples)
+        {
+          double distance = logDistance(m, sample.m) + logDistance(n, sample.n) + logDistance(k, sample.k);
+          if (distance < minDistance)
+          {
+            minDistance = distance;
+            closest = &sample;
+          }
+        }
+        return 2.0 * m * n * k / closest->flopsPerSecond;
+      }
+    };
+
+    /// Read and write a TTGTCostProfile, return failure (after reporting an error) on I/O or syntax errors
+    LogicalResult loadTTGTCostProfile(StringRef path, TTGTCostProfile &profile);
+    LogicalResult saveTTGTCostProfile(StringRef path, const TTGTCostProfile &profile);
+
+    /// A reduction of an innermost loop into a fixed memory location: a load, a sum or a product, then a store
+    /// back to the same location
+    struct LoopReduction
+    {
+      memref::LoadOp load;
+      Operation *combiner;
+      memref::StoreOp store;
+    };
+
+    /// The values of an innermost loop that depend on its induction variable, and its reductions
+    struct VectorizableLoop
+    {
+      llvm::DenseSet<Value> variants;
+      std::vector<LoopReduction> reductions;
+    };
+
+    /// Marks the scalar remainder loop of a vectorized loop, which is not vectorized again
+    constexpr llvm::StringLiteral kVectorRemainderAttr = "comet.vector_remainder";
+
+    /// Checks that the body of an innermost loop only has loads and stores with unit stride along the induction
+    /// variable, elementwise arithmetic, loop-invariant computations and reductions into fixed locations
+    bool isVectorizableLoop(scf::ForOp forOp, VectorizableLoop &loop);
+
+    /// Emits, before an innermost loop, a loop over vectors of vectorWidth elements that covers the iterations up
+    /// to the largest multiple of vectorWidth. The original loop is kept as the remainder loop.
+    void vectorizeLoop(scf::ForOp forOp, unsigned vectorWidth, const VectorizableLoop &loop);
+
+    /// Elementwise unary map (relu, exp, abs, sqrt, scale or clamp) and its parameters, fused into the compute op
+    /// of the index tree that produces the mapped tensor
+    constexpr llvm::StringLiteral kUnaryMapAttr = "comet.unary_map";
+    constexpr llvm::StringLiteral kUnaryMapParamsAttr = "comet.unary_map_params";
+
+    /// Set to false on the compute op of a sparse output whose rows need not be sorted, since none of the consumers
+    /// of the output relies on the order of the coordinates within a row
+    constexpr llvm::StringLiteral kSortedOutputAttr = "comet.sorted";
+
+    /// Emits the elementwise unary map op with its parameters, applied to the scalar v
+    Value genUnaryMap(OpBuilder &builder, Location loc, StringRef op, ArrayRef<double> params, Value v);
+
+    /// True if the unary map keeps zero at zero, so that it can be applied to the stored values of a sparse tensor
+    /// only (not exp, nor clamp to bounds that exclude zero)
+    bool isZeroPreservingUnaryMap(StringRef op, ArrayRef<double> params);
+
+    /// Applies to the scalar v the unary map fused into computeOp, returns v if there is none
+    Value genFusedUnaryMap(OpBuilder &builder, Location loc, Operation *computeOp, Value v);
+
     // For TTGT transformations
     struct ContractionPlan
     {
@@ -239,6 +341,9 @@ namespace mlir
         std::tie(m_indices_, n_indices_, k_indices_) =
             getIndices(a_perm_, b_perm_, c_perm_);
 
+        /// batch indices appear in A, B and C, they are not part of M-N-K
+        b_indices_ = getBatchIndices(a_perm_, b_perm_, c_perm_);
+
         /// compute size map for each index
         for (size_t i = 0; i < a_perm_.size(); i++)
         {
@@ -271,6 +376,12 @@ namespace mlir
         {
           k_size_ *= size_map_[idx];
         }
+
+        b_size_ = 1;
+        for (const auto &idx : b_indices_)
+        {
+          b_size_ *= size_map_[idx];
+        }
       }
 
       std::tuple<IndexVector, IndexVector, IndexVector>
@@ -306,8 +417,35 @@ namespace mlir
         return std::make_tuple(mIndices, nIndices, kIndices);
       }
 
+      IndexVector getBatchIndices(const IndexVector &A_perm, const IndexVector &B_perm, const IndexVector &C_perm) const
+      {
+        IndexVector bIndices;
+        std::set<unsigned> A_perm_set(A_perm.begin(), A_perm.end()),
+            B_perm_set(B_perm.begin(), B_perm.end()),
+            C_perm_set(C_perm.begin(), C_perm.end());
+
+        std::set<unsigned> A_int_B;
+        std::set_intersection(A_perm_set.begin(), A_perm_set.end(),
+                              B_perm_set.begin(), B_perm_set.end(),
+                              std::inserter(A_int_B, A_int_B.begin()));
+        std::set_intersection(A_int_B.begin(), A_int_B.end(),
+                              C_perm_set.begin(), C_perm_set.end(),
+                              std::back_inserter(bIndices));
+
+        return bIndices;
+      }
+
+      /// Use the measured throughput of a machine instead of the analytic cost
+      void setCostProfile(const TTGTCostProfile *profile)
+      {
+        profile_ = profile && profile->isValid() ? profile : nullptr;
+      }
+
       double getTransposeTime(uint64_t mem_size, const IndexVector &perm) const
       {
+        if (profile_)
+          return profile_->getTransposeTime(mem_size, perm);
+
         double result;
         if (perm[0] != 0)
         {
@@ -323,12 +461,21 @@ namespace mlir
 
       double flopCount() const
       {
-        double overall_size = m_size_ * n_size_ * k_size_;
+        double overall_size = b_size_ * m_size_ * n_size_ * k_size_;
         int op_factor = n_indices_.size() == 0 ? 1 : 2;
 
         return overall_size * op_factor;
       }
 
+      /// Cost of the GEMM of TTGT, computing C^T = B^T * A^T when swapAB is set
+      double getGemmTime(bool swapAB) const
+      {
+        if (!profile_)
+          return flopCount();
+
+        return b_size_ * profile_->getGemmTime(swapAB ? n_size_ : m_size_, swapAB ? m_size_ : n_size_, k_size_);
+      }
+
       std::string contractionString(const IndexVector &a_idx,
                                     const IndexVector &b_idx,
                                     const IndexVector &c_idx) const
@@ -373,11 +520,62 @@ namespace mlir
         IndexVector a_perm, b_perm, c_perm;
         double minTime;
         std::tie(a_perm, b_perm, c_perm, minTime) = computeBestPermutations();
-        double result = flopCount() + minTime;
+        double result = getGemmTime(swapAB_) + minTime;
 
         return result;
       }
 
+      /// Estimated time of the GETT lowering, comparable with getTotalTime().
+      /// GETT never transposes: the packing routines of the GEMM driver gather the blocks of an operand straight
+      /// from the tensor, which only costs more than packing from a matrix when the modes of a group of the operand
+      /// are not adjacent. That overhead is paid each time the blocks are packed: A once per column block of C,
+      /// B once, and C is updated once per block of the summation indices.
+      double getGETTTime() const
+      {
+        double a_packs = std::ceil((double)n_size_ / kGETTBlockN);
+        double c_updates = std::ceil((double)k_size_ / kGETTBlockK);
+        double overhead = 0.0;
+
+        if (!hasAdjacentGroups(a_perm_, m_indices_, k_indices_))
+          overhead += getGatherOverhead(m_size_ * k_size_) * a_packs;
+        if (!hasAdjacentGroups(b_perm_, k_indices_, n_indices_))
+          overhead += getGatherOverhead(k_size_ * n_size_);
+        if (!hasAdjacentGroups(c_perm_, m_indices_, n_indices_))
+          overhead += getGatherOverhead(m_size_ * n_size_) * c_updates;
+
+        return getGemmTime(false) + overhead;
+      }
+
+      /// Extra time to pack mem_size elements gathered from a tensor, on top of packing them from a matrix
+      double getGatherOverhead(uint64_t mem_size) const
+      {
+        if (profile_)
+          return mem_size / profile_->stridedTransposeRate - mem_size / profile_->contiguousTransposeRate;
+
+        return mem_size / 0.71 - mem_size;
+      }
+
+      /// The modes of each group are adjacent in perm (in any order), i.e., the tensor is a strided matrix
+      bool hasAdjacentGroups(const IndexVector &perm, const IndexVector &first, const IndexVector &second) const
+      {
+        for (const IndexVector *group : {&first, &second})
+        {
+          if (group->empty())
+            continue;
+
+          size_t lo = perm.size(), hi = 0;
+          for (auto idx : *group)
+          {
+            size_t pos = std::distance(perm.begin(), std::find(perm.begin(), perm.end(), idx));
+            lo = std::min(lo, pos);
+            hi = std::max(hi, pos);
+          }
+          if (hi - lo + 1 != group->size())
+            return false;
+        }
+        return true;
+      }
+
       std::tuple<IndexVector, IndexVector, IndexVector> computePermutations(bool isbestperm, int whichpermutation)
       {
         IndexVector a_perm, b_perm, c_perm;
@@ -468,6 +666,7 @@ namespace mlir
         IndexVector a_candidate, b_candidate, c_candidate;
 
         double minTranspose = std::numeric_limits<double>::max();
+        double minTime = std::numeric_limits<double>::max();
 
         do
         {
@@ -523,12 +722,15 @@ namespace mlir
                       getTransposeTime(c_size, getPermutation(c_perm_, c_idx));
                 }
 
-                if (transposeTime < minTranspose)
+                /// The GEMM only differs between candidates with a calibrated profile, where its shape matters
+                double time = transposeTime + getGemmTime(i == 1);
+                if (time < minTime)
                 {
                   a_candidate = a_idx;
                   b_candidate = b_idx;
                   c_candidate = c_idx;
                   minTranspose = transposeTime;
+                  minTime = time;
                   swapAB_ = (i == 1) ? true : false;
                 }
               }
@@ -556,16 +758,24 @@ namespace mlir
       IndexVector m_indices_;
       IndexVector n_indices_;
       IndexVector k_indices_;
+      IndexVector b_indices_;
 
       int64_t m_size_;
       int64_t n_size_;
       int64_t k_size_;
+      int64_t b_size_;
 
       IndexSizeMap size_map_;
 
       bool swapAB_;
       bool inA_;
 
+      const TTGTCostProfile *profile_ = nullptr;
+
+      /// Block sizes of the GEMM driver assumed by the GETT cost model (the BLIS nc and kc of common x86 configurations)
+      static constexpr double kGETTBlockN = 4080;
+      static constexpr double kGETTBlockK = 256;
+
       std::string bestPermStr_;
     }; /// struct ContractionPlan
 
@@ -0,0 +1,42 @@
+//===- RandomTensorGenerator.h - Generators of comet_random() ---===//
+//
+// Copyright 2022 Battelle Memorial Institute
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+// and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+// and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the ids of the sparsity patterns of comet_random(), shared
+// by the compiler and the runtime. It has no dependency on the runtime.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef COMET_EXECUTIONENGINE_RANDOMTENSORGENERATOR_H_
+#define COMET_EXECUTIONENGINE_RANDOMTENSORGENERATOR_H_
+
+/// Synthetic sparsity patterns of the comet_random() builtin.
+/// The compiler emits these ids in SparseInputTensorDeclOpLowering.
+enum RandomTensorGenerator
+{
+    RANDOM_UNIFORM, /// Erdős–Rényi
+    RANDOM_RMAT,    /// R-MAT/Kronecker
+    RANDOM_BANDED,
+    RANDOM_POWERLAW
+};
+
+#endif // COMET_EXECUTIONENGINE_RANDOMTENSORGENERATOR_H_
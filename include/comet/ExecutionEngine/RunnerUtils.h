@@ -65,6 +65,7 @@
 
 #include "mlir/ExecutionEngine/CRunnerUtils.h"
 #include "comet/ExecutionEngine/blis_interface.h"
+#include "comet/ExecutionEngine/RandomTensorGenerator.h"
 
 using namespace std;
 
@@ -81,6 +82,26 @@ enum SparseFormatAttribute
 /**************************************/
 
 /// Read matrices and tensors
+extern "C" COMET_RUNNERUTILS_EXPORT void read_input_sizes_1D_f32(int32_t fileID,
+                                                                 int32_t A1format, int32_t A1_tile_format,
+                                                                 int A1pos_rank, void *A1pos_ptr, int32_t readMode);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void read_input_1D_f32(int32_t fileID,
+                                                           int32_t A1format, int32_t A1_tile_format,
+                                                           int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                                           int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                                           int Aval_rank, void *Aval_ptr, int32_t readMode);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void read_input_sizes_1D_f64(int32_t fileID,
+                                                                 int32_t A1format, int32_t A1_tile_format,
+                                                                 int A1pos_rank, void *A1pos_ptr, int32_t readMode);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void read_input_1D_f64(int32_t fileID,
+                                                           int32_t A1format, int32_t A1_tile_format,
+                                                           int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                                           int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                                           int Aval_rank, void *Aval_ptr, int32_t readMode);
+
 extern "C" COMET_RUNNERUTILS_EXPORT void read_input_sizes_2D_f32(int32_t fileID,
                                                                  int32_t A1format, int32_t A1_tile_format,
                                                                  int32_t A2format, int32_t A2_tile_format,
@@ -145,6 +166,75 @@ extern "C" COMET_RUNNERUTILS_EXPORT void read_input_3D_f64(int32_t fileID,
                                                            int A3tile_pos_rank, void *A3tile_pos_ptr, int A3tile_crd_rank, void *A3tile_crd_ptr,
                                                            int Aval_rank, void *Aval_ptr, int32_t readMode);
 
+/// Generate synthetic sparse matrices and tensors in the requested format (comet_random)
+extern "C" COMET_RUNNERUTILS_EXPORT void gen_random_sizes_2D_f32(int32_t generator, int64_t dim0, int64_t dim1,
+                                                                 double param0, double param1, int64_t seed,
+                                                                 int32_t A1format, int32_t A1_tile_format,
+                                                                 int32_t A2format, int32_t A2_tile_format,
+                                                                 int A1pos_rank, void *A1pos_ptr);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void gen_random_sizes_2D_f64(int32_t generator, int64_t dim0, int64_t dim1,
+                                                                 double param0, double param1, int64_t seed,
+                                                                 int32_t A1format, int32_t A1_tile_format,
+                                                                 int32_t A2format, int32_t A2_tile_format,
+                                                                 int A1pos_rank, void *A1pos_ptr);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void gen_random_2D_f32(int32_t generator, int64_t dim0, int64_t dim1,
+                                                           double param0, double param1, int64_t seed,
+                                                           int32_t A1format, int32_t A1_tile_format,
+                                                           int32_t A2format, int32_t A2_tile_format,
+                                                           int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                                           int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                                           int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                                                           int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                                                           int Aval_rank, void *Aval_ptr);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void gen_random_2D_f64(int32_t generator, int64_t dim0, int64_t dim1,
+                                                           double param0, double param1, int64_t seed,
+                                                           int32_t A1format, int32_t A1_tile_format,
+                                                           int32_t A2format, int32_t A2_tile_format,
+                                                           int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                                           int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                                           int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                                                           int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                                                           int Aval_rank, void *Aval_ptr);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void gen_random_sizes_3D_f32(int32_t generator, int64_t dim0, int64_t dim1, int64_t dim2,
+                                                                 double param0, double param1, int64_t seed,
+                                                                 int32_t A1format, int32_t A1_tile_format,
+                                                                 int32_t A2format, int32_t A2_tile_format,
+                                                                 int32_t A3format, int32_t A3_tile_format,
+                                                                 int A1pos_rank, void *A1pos_ptr);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void gen_random_sizes_3D_f64(int32_t generator, int64_t dim0, int64_t dim1, int64_t dim2,
+                                                                 double param0, double param1, int64_t seed,
+                                                                 int32_t A1format, int32_t A1_tile_format,
+                                                                 int32_t A2format, int32_t A2_tile_format,
+                                                                 int32_t A3format, int32_t A3_tile_format,
+                                                                 int A1pos_rank, void *A1pos_ptr);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void gen_random_3D_f32(int32_t A1format, int32_t A1_tile_format,
+                                                           int32_t A2format, int32_t A2_tile_format,
+                                                           int32_t A3format, int32_t A3_tile_format,
+                                                           int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                                           int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                                           int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                                                           int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                                                           int A3pos_rank, void *A3pos_ptr, int A3crd_rank, void *A3crd_ptr,
+                                                           int A3tile_pos_rank, void *A3tile_pos_ptr, int A3tile_crd_rank, void *A3tile_crd_ptr,
+                                                           int Aval_rank, void *Aval_ptr);
+
+extern "C" COMET_RUNNERUTILS_EXPORT void gen_random_3D_f64(int32_t A1format, int32_t A1_tile_format,
+                                                           int32_t A2format, int32_t A2_tile_format,
+                                                           int32_t A3format, int32_t A3_tile_format,
+                                                           int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                                           int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                                           int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                                                           int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                                                           int A3pos_rank, void *A3pos_ptr, int A3crd_rank, void *A3crd_ptr,
+                                                           int A3tile_pos_rank, void *A3tile_pos_ptr, int A3tile_crd_rank, void *A3tile_crd_ptr,
+                                                           int Aval_rank, void *Aval_ptr);
+
 // Transpose operations
 extern "C" COMET_RUNNERUTILS_EXPORT void transpose_2D_f32(int32_t A1format, int32_t A1tile_format, int32_t A2format, int32_t A2tile_format,
                                                           int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
@@ -218,6 +308,37 @@ extern "C" COMET_RUNNERUTILS_EXPORT void transpose_3D_f64(int32_t input_permutat
                                                           int B3tile_pos_rank, void *B3tile_pos_ptr, int B3tile_crd_rank, void *B3tile_crd_ptr,
                                                           int Bval_rank, void *Bval_ptr, int sizes_rank, void *sizes_ptr);
 
+///===----------------------------------------------------------------------===///
+/// Sorting the rows of sparse outputs
+///===----------------------------------------------------------------------===///
+/// Sorts the column indices of the first num_rows rows of a CSR matrix, and permutes their values accordingly
+extern "C" COMET_RUNNERUTILS_EXPORT void comet_sort_index_segments(int64_t rowptr_rank, void *rowptr_ptr,
+                                                                   int64_t col_rank, void *col_ptr,
+                                                                   int64_t val_rank, void *val_ptr, int64_t num_rows);
+
+///===----------------------------------------------------------------------===///
+/// Arena allocation of the temporary buffers of the generated code
+///===----------------------------------------------------------------------===///
+/// Returns the mark of the thread's arena, taken at the entry of a function
+extern "C" COMET_RUNNERUTILS_EXPORT int64_t comet_arena_mark();
+/// Releases all the buffers allocated from the thread's arena since mark was taken
+extern "C" COMET_RUNNERUTILS_EXPORT void comet_arena_release(int64_t mark);
+/// Allocates a buffer of bytes bytes, aligned on 64 bytes, by bumping a pointer in the thread's arena
+extern "C" COMET_RUNNERUTILS_EXPORT void _mlir_ciface_comet_arena_alloc(StridedMemRefType<int8_t, 1> *result, int64_t bytes);
+
+///===----------------------------------------------------------------------===///
+/// Runtime ordering of chains of sparse matrix multiplications
+///===----------------------------------------------------------------------===///
+/// Writes the sketch of a CSR (or dense) matrix, its number of nonzeros per row and per column, at offset in sketches
+extern "C" COMET_RUNNERUTILS_EXPORT void comet_chain_sketch_csr(int64_t sketches_rank, void *sketches_ptr, int64_t offset,
+                                                                int64_t pos_rank, void *pos_ptr, int64_t crd_rank, void *crd_ptr,
+                                                                int64_t rows, int64_t cols);
+extern "C" COMET_RUNNERUTILS_EXPORT void comet_chain_sketch_dense(int64_t sketches_rank, void *sketches_ptr, int64_t offset,
+                                                                  int64_t rows, int64_t cols);
+/// Returns the candidate contraction order of the chain with the lowest estimated cost
+extern "C" COMET_RUNNERUTILS_EXPORT int64_t comet_chain_order_select(int64_t sketches_rank, void *sketches_ptr,
+                                                                     int64_t candidates_rank, void *candidates_ptr);
+
 ///===----------------------------------------------------------------------===///
 /// Small runtime support library for timing execution, printing elapse time, printing GFLOPS
 //===----------------------------------------------------------------------===///
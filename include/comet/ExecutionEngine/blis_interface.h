@@ -53,11 +53,112 @@
 #define COMET_BLIS_INTERFACE_EXPORT
 #endif // _WIN32
 
+/// gemm micro-kernels wired for a micro-architecture, along with their register blocking (MR x NR).
+/// A null kernel means that no optimized micro-kernel is wired for the running micro-architecture:
+/// the callers then fall back to the generic micro-kernel and the block sizes of the native BLIS context.
+struct CometGemmUkrInfo
+{
+  arch_t arch;
+  sgemm_ukr_ft sgemm;
+  int smr, snr;
+  dgemm_ukr_ft dgemm;
+  int dmr, dnr;
+};
+
+/// Dispatch table keyed by bli_cpuid_query_id(). It mirrors the gemm micro-kernels registered by the BLIS
+/// sub-configurations, and an entry is only compiled in when BLIS was built with its kernel set.
+inline CometGemmUkrInfo comet_resolve_gemm_ukr()
+{
+  static const CometGemmUkrInfo table[] = {
+#ifdef BLIS_KERNELS_SKX
+      {BLIS_ARCH_SKX, bli_sgemm_skx_asm_32x12_l2, 32, 12, bli_dgemm_skx_asm_16x14, 16, 14},
+#ifdef BLIS_KERNELS_ZEN4
+      /// zen4 reuses the AVX-512 kernels of skx
+      {BLIS_ARCH_ZEN4, bli_sgemm_skx_asm_32x12_l2, 32, 12, bli_dgemm_skx_asm_16x14, 16, 14},
+#endif
+#endif
+#ifdef BLIS_KERNELS_KNL
+      {BLIS_ARCH_KNL, bli_sgemm_knl_asm_24x16, 24, 16, bli_dgemm_knl_asm_24x8, 24, 8},
+#endif
+#ifdef BLIS_KERNELS_HASWELL
+      /// zen, zen2 and zen3 have no AVX-512 units and use the AVX2 kernels of haswell
+      {BLIS_ARCH_HASWELL, bli_sgemm_haswell_asm_6x16, 6, 16, bli_dgemm_haswell_asm_6x8, 6, 8},
+      {BLIS_ARCH_ZEN, bli_sgemm_haswell_asm_6x16, 6, 16, bli_dgemm_haswell_asm_6x8, 6, 8},
+      {BLIS_ARCH_ZEN2, bli_sgemm_haswell_asm_6x16, 6, 16, bli_dgemm_haswell_asm_6x8, 6, 8},
+      {BLIS_ARCH_ZEN3, bli_sgemm_haswell_asm_6x16, 6, 16, bli_dgemm_haswell_asm_6x8, 6, 8},
+#endif
+#ifdef BLIS_KERNELS_ARMV8A
+      {BLIS_ARCH_FIRESTORM, bli_sgemm_armv8a_asm_12x8r, 12, 8, bli_dgemm_armv8a_asm_8x6r, 8, 6},
+      {BLIS_ARCH_THUNDERX2, bli_sgemm_armv8a_asm_8x12, 8, 12, bli_dgemm_armv8a_asm_6x8, 6, 8},
+      {BLIS_ARCH_CORTEXA57, bli_sgemm_armv8a_asm_8x12, 8, 12, bli_dgemm_armv8a_asm_6x8, 6, 8},
+      {BLIS_ARCH_CORTEXA53, bli_sgemm_armv8a_asm_8x12, 8, 12, bli_dgemm_armv8a_asm_6x8, 6, 8},
+#endif
+      /// Sentinel, also returned for micro-architectures without a wired micro-kernel
+      {BLIS_NUM_ARCHS, nullptr, 0, 0, nullptr, 0, 0},
+  };
+
+  arch_t arch = bli_cpuid_query_id();
+  const CometGemmUkrInfo *entry = table;
+  while (entry->arch != BLIS_NUM_ARCHS && entry->arch != arch)
+    entry++;
+  return *entry;
+}
+
+/// The micro-kernels of the running micro-architecture, resolved once on first use
+inline const CometGemmUkrInfo &comet_query_gemm_ukr()
+{
+  static const CometGemmUkrInfo info = comet_resolve_gemm_ukr();
+  return info;
+}
+
 extern "C" COMET_BLIS_INTERFACE_EXPORT void
 _mlir_ciface_linalg_matmul_viewsxsxf64_viewsxsxf64_viewsxsxf64(
     StridedMemRefType<double, 2> *A, StridedMemRefType<double, 2> *B,
     StridedMemRefType<double, 2> *C);
 
+/// C += A * B on an mr x nr tile of C, with the micro-kernel of the running micro-architecture
+extern "C" COMET_BLIS_INTERFACE_EXPORT void
+_mlir_ciface_linalg_matmul_viewsxs_viewsxs_viewsxs(
+    StridedMemRefType<double, 2> *A, StridedMemRefType<double, 2> *B,
+    StridedMemRefType<double, 2> *C, int mr, int nr);
+
+extern "C" COMET_BLIS_INTERFACE_EXPORT void
+_mlir_ciface_linalg_matmul_f32_viewsxs_viewsxs_viewsxs(
+    StridedMemRefType<float, 2> *A, StridedMemRefType<float, 2> *B,
+    StridedMemRefType<float, 2> *C, int mr, int nr);
+
+/// C += A * B with packed A and B panels and multithreaded outer loops,
+/// blocked with the BLIS block sizes mc, kc, nc, mr and nr
+extern "C" COMET_BLIS_INTERFACE_EXPORT void
+_mlir_ciface_linalg_matmul_packed_viewsxs_viewsxs_viewsxs(
+    StridedMemRefType<double, 2> *A, StridedMemRefType<double, 2> *B,
+    StridedMemRefType<double, 2> *C, int mc, int kc, int nc, int mr, int nr);
+
+extern "C" COMET_BLIS_INTERFACE_EXPORT void
+_mlir_ciface_linalg_matmul_packed_f32_viewsxs_viewsxs_viewsxs(
+    StridedMemRefType<float, 2> *A, StridedMemRefType<float, 2> *B,
+    StridedMemRefType<float, 2> *C, int mc, int kc, int nc, int mr, int nr);
+
+/// Dense tensor contraction C[M, N] += alpha * A[M, K] * B[K, N] without transposed copies (GETT),
+/// where modes describes which dimensions of A, B and C form the groups of modes M, N and K
+extern "C" COMET_BLIS_INTERFACE_EXPORT void
+_mlir_ciface_comet_gett_f64(UnrankedMemRefType<double> *A, UnrankedMemRefType<double> *B,
+                            UnrankedMemRefType<double> *C, UnrankedMemRefType<int64_t> *modes,
+                            double alpha);
+
+extern "C" COMET_BLIS_INTERFACE_EXPORT void
+_mlir_ciface_comet_gett_f32(UnrankedMemRefType<float> *A, UnrankedMemRefType<float> *B,
+                            UnrankedMemRefType<float> *C, UnrankedMemRefType<int64_t> *modes,
+                            float alpha);
+
+extern "C" COMET_BLIS_INTERFACE_EXPORT void
+comet_gett_f64(int64_t rankA, void *ptrA, int64_t rankB, void *ptrB, int64_t rankC, void *ptrC,
+               int64_t rankModes, void *ptrModes, double alpha);
+
+extern "C" COMET_BLIS_INTERFACE_EXPORT void
+comet_gett_f32(int64_t rankA, void *ptrA, int64_t rankB, void *ptrB, int64_t rankC, void *ptrC,
+               int64_t rankModes, void *ptrModes, float alpha);
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -68,10 +169,3 @@ _mlir_ciface_linalg_matmul_viewsxsxf64_viewsxsxf64_viewsxsxf64(
 
 #endif /// COMET_BLIS_INTERFACE_H_
 
-#if defined(__x86_64__) || defined(_M_X64) || defined(__i386) || defined(_M_IX86)
-#define bli_dgemm_asm_6x8 bli_dgemm_x86_ukr
-#elif defined(__aarch64__) || defined(__arm__) || defined(_M_ARM) || defined(_ARCH_PPC)
-#define bli_dgemm_asm_6x8 bli_dgemm_arm_ukr
-#else
-#define bli_dgemm_asm_6x8 dgemm_generic_noopt_mxn
-#endif
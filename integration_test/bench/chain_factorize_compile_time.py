@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Compile-time benchmark of --opt-multiop-factorize on chains of matrix multiplications.
+
+For every chain length, generates a COMET DSL program computing a chain of that many operands,
+with dimensions alternating between a large and a small extent, and reports the time
+comet-opt takes to factorize it and emit the TA dialect.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def generate_chain(num_operands):
+    labels = ["i%d" % t for t in range(num_operands + 1)]
+    sizes = [8 if t % 2 == 0 else 2 for t in range(num_operands + 1)]
+    tensors = ["t%d" % t for t in range(num_operands)]
+
+    lines = ["def main() {"]
+    for label, size in zip(labels, sizes):
+        lines.append("\tIndexLabel [%s] = [%d];" % (label, size))
+    for t in range(num_operands):
+        lines.append("\tTensor<double> %s([%s, %s], {Dense});" % (tensors[t], labels[t], labels[t + 1]))
+    lines.append("\tTensor<double> out([%s, %s], {Dense});" % (labels[0], labels[-1]))
+    for t in range(num_operands):
+        lines.append("\t%s[%s, %s] = 1.0;" % (tensors[t], labels[t], labels[t + 1]))
+    lines.append("\tout[%s, %s] = 0.0;" % (labels[0], labels[-1]))
+    chain = " * ".join("%s[%s, %s]" % (tensors[t], labels[t], labels[t + 1]) for t in range(num_operands))
+    lines.append("\tout[%s, %s] = %s;" % (labels[0], labels[-1], chain))
+    lines.append("\tprint(out);")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+def time_compile(comet_opt, path, repeat):
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        subprocess.run([comet_opt, "--opt-multiop-factorize", "--emit-ta", path],
+                       stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, check=True)
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("comet_opt", help="path to the comet-opt executable")
+    parser.add_argument("--min", type=int, default=4, help="shortest chain")
+    parser.add_argument("--max", type=int, default=24, help="longest chain")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per chain, the best one is reported")
+    args = parser.parse_args()
+
+    print("%10s %12s" % ("operands", "time (s)"))
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for num_operands in range(args.min, args.max + 1):
+            path = os.path.join(tmpdir, "chain_%d.ta" % num_operands)
+            with open(path, "w") as f:
+                f.write(generate_chain(num_operands))
+            print("%10d %12.4f" % (num_operands, time_compile(args.comet_opt, path, args.repeat)))
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Compile-time benchmark of comet-opt on generated programs with hundreds of tensor operations.
+
+For every program size, generates a COMET DSL program with that many statements, mixing dense matrix
+multiplications, sparse-dense multiplications, elementwise products, additions and transposes, each
+writing a tensor of its own. comet-opt lowers it to LLVM with -mlir-timing, and the time of every pass
+is reported, along with the time per statement, which stays flat as long as compile time is linear.
+
+With --output, the timings are written as JSON. With --baseline, they are compared against an earlier
+output, and the script fails when the total time of a program grew by more than --max-slowdown.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+def generate_program(num_statements):
+    lines = ["def main() {"]
+    lines.append("\tIndexLabel [a] = [?];")
+    lines.append("\tIndexLabel [b] = [?];")
+    lines.append("\tIndexLabel [i] = [16];")
+    lines.append("\tIndexLabel [j] = [16];")
+    lines.append("\tIndexLabel [k] = [16];")
+
+    lines.append("\tTensor<double> S([a, b], {CSR});")
+    lines.append("\tTensor<double> X([b, k], {Dense});")
+    lines.append("\tTensor<double> A([i, j], {Dense});")
+    lines.append("\tTensor<double> B([j, k], {Dense});")
+    lines.append("\tS[a, b] = comet_read(0);")
+    lines.append("\tX[b, k] = 1.0;")
+    lines.append("\tA[i, j] = 2.2;")
+    lines.append("\tB[j, k] = 3.4;")
+
+    # Every statement writes a tensor of its own, so that the number of tensors grows with the program.
+    # Each kind is (output labels, output format, right-hand side).
+    kinds = [("i, k", "Dense", "A[i, j] * B[j, k]"),
+             ("a, k", "Dense", "S[a, b] * X[b, k]"),
+             ("a, b", "CSR", "S[a, b] .* S[a, b]"),
+             ("i, j", "Dense", "A[i, j] + A[i, j]"),
+             ("j, i", "Dense", "transpose(A[i, j], {j, i})")]
+    decls, stmts = [], []
+    for s in range(num_statements):
+        labels, fmt, rhs = kinds[s % len(kinds)]
+        out = "T%d[%s]" % (s, labels)
+        decls.append("\tTensor<double> T%d([%s], {%s});" % (s, labels, fmt))
+        if fmt == "Dense":
+            stmts.append("\t%s = 0.0;" % out)
+        stmts.append("\t%s = %s;" % (out, rhs))
+
+    lines += decls + stmts
+    lines.append("\tprint(T%d);" % (num_statements - 1))
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+
+TIMING_LINE = re.compile(r"^\s*(?:[0-9.]+ \(\s*[0-9.]+%\)\s+)*([0-9.]+) \(\s*[0-9.]+%\)\s+(\S.*)$")
+
+
+def parse_timing(report):
+    """Wall time of every pass, summed over the functions, from a -mlir-timing-display=list report"""
+    passes = {}
+    for line in report.splitlines():
+        match = TIMING_LINE.match(line)
+        if match:
+            name = match.group(2).strip()
+            passes[name] = passes.get(name, 0.0) + float(match.group(1))
+    return passes
+
+
+def time_compile(comet_opt, path, flags, repeat):
+    best = None
+    for _ in range(repeat):
+        result = subprocess.run([comet_opt] + flags + ["-mlir-timing", "-mlir-timing-display=list",
+                                                       "--mlir-disable-threading", path],
+                                stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        if result.returncode != 0:
+            sys.exit("comet-opt failed on %s:\n%s" % (path, result.stderr))
+        passes = parse_timing(result.stderr)
+        if best is None or passes.get("Total", 0.0) < best.get("Total", 0.0):
+            best = passes
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("comet_opt", help="path to the comet-opt executable")
+    parser.add_argument("--sizes", type=int, nargs="+", default=[50, 100, 200, 400],
+                        help="number of statements of the generated programs")
+    parser.add_argument("--flags", default="--convert-ta-to-it --convert-to-loops --convert-to-llvm",
+                        help="comet-opt pipeline flags")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per program, the fastest one is reported")
+    parser.add_argument("--top", type=int, default=8, help="number of passes reported per program")
+    parser.add_argument("--output", help="write the timings as JSON")
+    parser.add_argument("--baseline", help="JSON timings of an earlier run to compare against")
+    parser.add_argument("--max-slowdown", type=float, default=1.25,
+                        help="largest accepted ratio of the total time over the baseline")
+    args = parser.parse_args()
+
+    results = {}
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for size in args.sizes:
+            path = os.path.join(tmpdir, "corpus_%d.ta" % size)
+            with open(path, "w") as f:
+                f.write(generate_program(size))
+            passes = time_compile(args.comet_opt, path, args.flags.split(), args.repeat)
+            results[str(size)] = passes
+
+            total = passes.get("Total", 0.0)
+            print("%d statements: %.4f s, %.3f ms per statement" % (size, total, 1000.0 * total / size))
+            ranked = sorted(((t, name) for name, t in passes.items() if name != "Total"), reverse=True)
+            for t, name in ranked[:args.top]:
+                print("  %10.4f s  %s" % (t, name))
+            sys.stdout.flush()
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        regressions = []
+        for size, passes in results.items():
+            if size not in baseline or baseline[size].get("Total", 0.0) <= 0.0:
+                continue
+            ratio = passes.get("Total", 0.0) / baseline[size]["Total"]
+            print("%s statements: %.2fx the baseline" % (size, ratio))
+            if ratio > args.max_slowdown:
+                regressions.append(size)
+        if regressions:
+            sys.exit("compile time regressed on the programs with %s statements" % ", ".join(regressions))
+
+
+if __name__ == "__main__":
+    main()
@@ -84,6 +84,34 @@ void AbstractLoopOp::setUpperBound(mlir::Value &upperBound)
   }
 }
 
+mlir::Value AbstractLoopOp::getLowerBound()
+{
+  if (iteratorType == "parallel")
+  {
+    auto handle = mlir::dyn_cast<scf::ParallelOp>(op);
+    return handle.getLowerBound()[0];
+  }
+  else
+  {
+    auto handle = mlir::dyn_cast<scf::ForOp>(op);
+    return handle.getLowerBound();
+  }
+}
+
+mlir::Value AbstractLoopOp::getUpperBound()
+{
+  if (iteratorType == "parallel")
+  {
+    auto handle = mlir::dyn_cast<scf::ParallelOp>(op);
+    return handle.getUpperBound()[0];
+  }
+  else
+  {
+    auto handle = mlir::dyn_cast<scf::ForOp>(op);
+    return handle.getUpperBound();
+  }
+}
+
 mlir::Block *AbstractLoopOp::getBody()
 {
   if (iteratorType == "parallel")
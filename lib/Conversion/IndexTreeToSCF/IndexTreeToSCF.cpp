@@ -33,15 +33,22 @@
 #include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/Bufferization/IR/Bufferization.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/SCF/Utils/Utils.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/Math/IR/Math.h"
 #include "mlir/Dialect/Tensor/IR/Tensor.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
+#include "mlir/Dialect/Vector/IR/VectorOps.h"
+#include "mlir/Interfaces/LoopLikeInterface.h"
 #include "mlir/Transforms/DialectConversion.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/IR/Dominance.h"
+#include "mlir/IR/IRMapping.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
 
 #include "llvm/Support/Debug.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/StringSet.h"
 #include <iostream>
 #include <algorithm>
@@ -178,10 +185,13 @@ namespace
     mlir::Value mask_col;
     mlir::Value mask_val;
 
+    /// A complemented mask C<!M> excludes the entries of M from the output instead of including them only
+    bool complemented;
+
     /// TODO(zhen.peng): Pull-based mask info and auxiliary variables.
 
   public:
-    MaskingInfo() : mask_type(NO_MASKING) {}
+    MaskingInfo() : mask_type(NO_MASKING), complemented(false) {}
 
     ///  MaskingInfo(MASKING_TYPE type_, mlir::Value states_) : maskType(type_), states(states_) { }
 
@@ -193,7 +203,7 @@ namespace
         std::cout << "maskType: NO_MASKING\n";
         break;
       case PUSH_BASED_MASKING:
-        std::cout << "maskType: PUSH_BASED_MASKING "
+        std::cout << "maskType: PUSH_BASED_MASKING " << (complemented ? "complemented " : "")
                   << "mask_tensor: ";
         mask_tensor.dump();
         ///        std::cout << "maskType: PUSH_BASED_MASKING " << "states: ";
@@ -296,6 +306,18 @@ namespace
 
     Value row_offset = nullptr; /// In Numeric Phase, row_offset is the insertion location in the C_col and C_val.
 
+    bool bound_output_alloc = false;    /// If C.col and C.val are allocated from an upper bound of the size of every row,
+                                        /// and compacted after the numeric phase, instead of counting the rows exactly.
+    uint64_t bound_alloc_max_bytes = 0; /// With bound_output_alloc, the largest bound allocation in bytes. A larger bound
+                                        /// falls back to the symbolic phase at runtime. 0 means no limit.
+    Value W_id_list_size = nullptr;     /// W_id_list_size, which is the end of the current row of C in the numeric phase.
+    Value mtxC_row_end = nullptr;       /// With bound_output_alloc, the end of every row of C after the numeric phase.
+
+    Block *symbolic_phase_block = nullptr;          /// The block of the symbolic and numeric outermost for-loops.
+    Operation *symbolic_phase_prev = nullptr;       /// The operation before the code of the symbolic phase, nullptr if the
+                                                    /// symbolic phase starts the block.
+    Operation *numeric_outermost_forLoop = nullptr; /// The numeric outermost for-loop, right after the symbolic phase.
+
     Value mtxC = nullptr; /// The sparse tensor
                           /// It is %55 below.
   };
@@ -386,18 +408,21 @@ namespace
   }
 
   /// ----------------- ///
-  /// Add declaration of the function comet_index_func;
+  /// Add declaration of the function comet_sort_index_segments;
   /// ----------------- ///
   void declareSortFunc(ModuleOp &module,
                        MLIRContext *ctx,
                        Location loc)
   {
     IndexType indexType = IndexType::get(ctx);
+    FloatType f64Type = FloatType::getF64(ctx);
 
-    /// Declare comet_sort_index()
+    /// Declare comet_sort_index_segments(rowptr, col, val, num_rows)
     auto sort_index_func = FunctionType::get(ctx,
-                                             {UnrankedMemRefType::get(indexType, 0), indexType, indexType} /* inputs */, {} /* return */);
-    std::string func_name = "comet_sort_index";
+                                             {UnrankedMemRefType::get(indexType, 0), UnrankedMemRefType::get(indexType, 0),
+                                              UnrankedMemRefType::get(f64Type, 0), indexType} /* inputs */,
+                                             {} /* return */);
+    std::string func_name = "comet_sort_index_segments";
     if (!hasFuncDeclaration(module, func_name /* func name */))
     {
       func::FuncOp func_declare = func::FuncOp::create(loc,
@@ -504,8 +529,9 @@ namespace
       comet_debug() << " getAllocs() -  it is dense\n";
       if (isa<ToTensorOp>(tensor.getDefiningOp()))
       {
+        /// The memref is an allocation, or the buffer of a loop-carried tensor of a TA for-loop
         Operation *tensorload = cast<ToTensorOp>(tensor.getDefiningOp());
-        auto alloc_op = cast<memref::AllocOp>(tensorload->getOperand(0).getDefiningOp());
+        Value alloc_op = tensorload->getOperand(0);
         comet_vdump(alloc_op);
         allocs.push_back(alloc_op);
       }
@@ -516,7 +542,7 @@ namespace
           if (isa<ToTensorOp>(tensor.getDefiningOp()->getOperand(i).getDefiningOp()))
           {
             Operation *tensorload = cast<ToTensorOp>(tensor.getDefiningOp()->getOperand(i).getDefiningOp());
-            auto alloc_op = cast<memref::AllocOp>(tensorload->getOperand(0).getDefiningOp());
+            Value alloc_op = tensorload->getOperand(0);
             comet_vdump(alloc_op);
             allocs.push_back(alloc_op);
           }
@@ -655,8 +681,16 @@ namespace
     if (tensor.getType().isa<mlir::RankedTensorType>())
     { /// Dense tensor
       Value upperBound;
-      auto dim = builder.create<tensor::DimOp>(loc, tensor, id);
-      upperBound = dim;
+      auto tensorType = tensor.getType().cast<mlir::RankedTensorType>();
+      if (!tensorType.isDynamicDim(id))
+      {
+        /// The size of the dimension is a constant IndexLabel, the loop gets static bounds
+        upperBound = builder.create<ConstantIndexOp>(loc, tensorType.getDimSize(id));
+      }
+      else
+      {
+        upperBound = builder.create<tensor::DimOp>(loc, tensor, id);
+      }
       // auto loop = builder.create<scf::ForOp>(loc, lowerBound, upperBound, step);
       forLoop.buildLoopOp(iteratorType.str(),
                           builder,
@@ -1281,6 +1315,34 @@ namespace
     }
   }
 
+  /// Logical and/or of floating-point operands, where a nonzero value stands for true.
+  /// The result is 1 for true and 0 for false, in the type of the operands.
+  Value getLogicalFOp(OpBuilder &builder, Location &loc, bool isOr, Value &Input0, Value &Input1)
+  {
+    Type type = Input0.getType();
+    Value const_0 = builder.create<ConstantOp>(loc, type, builder.getZeroAttr(type));
+    Value const_1 = builder.create<ConstantOp>(loc, type, builder.getFloatAttr(type, 1.0));
+    Value isTrue0 = builder.create<CmpFOp>(loc, CmpFPredicate::UNE, Input0, const_0);
+    Value isTrue1 = builder.create<CmpFOp>(loc, CmpFPredicate::UNE, Input1, const_0);
+    Value result;
+    if (isOr)
+      result = builder.create<OrIOp>(loc, isTrue0, isTrue1);
+    else
+      result = builder.create<AndIOp>(loc, isTrue0, isTrue1);
+    return builder.create<SelectOp>(loc, result, const_1, const_0);
+  }
+
+  /// The value of the first contribution to a logical reduction (lor, land) of floating-point values:
+  /// 1 for a nonzero value and 0 otherwise, as the results of getLogicalFOp.
+  Value getLogicalFValue(OpBuilder &builder, Location &loc, Value &Input)
+  {
+    Type type = Input.getType();
+    Value const_0 = builder.create<ConstantOp>(loc, type, builder.getZeroAttr(type));
+    Value const_1 = builder.create<ConstantOp>(loc, type, builder.getFloatAttr(type, 1.0));
+    Value isTrue = builder.create<CmpFOp>(loc, CmpFPredicate::UNE, Input, const_0);
+    return builder.create<SelectOp>(loc, isTrue, const_1, const_0);
+  }
+
   Value getSemiringSecondVal(OpBuilder &builder, Location &loc,
                              llvm::StringRef &semiringSecond, Value &Input0, Value &Input1,
                              bool compressedWorkspace)
@@ -1329,21 +1391,11 @@ namespace
     }
     else if (semiringSecond == "land")
     {
-      /// land requires integer type input
-      llvm::errs() << "Not supported semiring operator (only works for int datatypes): "
-                   << "land"
-                   << "\n";
-      /// we should not proceed forward from this point to avoid faulty behavior.
-      exit(1);
+      elementWiseResult = getLogicalFOp(builder, loc, false /* isOr */, Input0, Input1);
     }
     else if (semiringSecond == "lor")
     {
-      /// lor requires integer type input
-      llvm::errs() << "Not supported semiring operator (only works for int datatypes): "
-                   << "lor"
-                   << "\n";
-      /// we should not proceed forward from this point to avoid faulty behavior.
-      exit(1);
+      elementWiseResult = getLogicalFOp(builder, loc, true /* isOr */, Input0, Input1);
     }
     else if (semiringSecond == "lxor")
     {
@@ -1435,19 +1487,11 @@ namespace
     }
     else if (semiringFirst == "land")
     {
-      /// land requires integer type input
-      llvm::errs() << "Not supported semiring operator (only works for int datatypes): "
-                   << "land"
-                   << "\n";
-      /// we should not proceed forward from this point to avoid faulty behavior.
+      reduceResult = getLogicalFOp(builder, loc, false /* isOr */, Input0, Input1);
     }
     else if (semiringFirst == "lor")
     {
-      /// lor requires integer type input
-      llvm::errs() << "Not supported semiring operator (only works for int datatypes): "
-                   << "lor"
-                   << "\n";
-      /// we should not proceed forward from this point to avoid faulty behavior.
+      reduceResult = getLogicalFOp(builder, loc, true /* isOr */, Input0, Input1);
     }
     else if (semiringFirst == "any")
     {
@@ -1466,6 +1510,27 @@ namespace
     return reduceResult;
   }
 
+  /// Attribute of the scf.if that skips the contributions to an output element whose reduction is determined.
+  /// The reduction loop around it is turned into a loop that exits early by convertEarlyExitLoops().
+  const llvm::StringLiteral kEarlyExitAttr = "comet.early_exit";
+
+  /// The reductions whose result can be determined before all the contributions are reduced:
+  /// any keeps any of the contributions, lor saturates at true and land at false.
+  bool isSaturatingReduction(llvm::StringRef &semiringFirst)
+  {
+    return semiringFirst == "any" || semiringFirst == "lor" || semiringFirst == "land";
+  }
+
+  /// Generate the condition that a reduced value is not determined yet, i.e. that more contributions can still change it.
+  /// A zero output is not set yet for any, and is false for lor and land.
+  Value genReductionNotDetermined(OpBuilder &builder, Location &loc, llvm::StringRef &semiringFirst, Value &reduced)
+  {
+    Type type = reduced.getType();
+    Value const_0 = builder.create<ConstantOp>(loc, type, builder.getZeroAttr(type));
+    CmpFPredicate predicate = semiringFirst == "land" ? CmpFPredicate::UNE : CmpFPredicate::OEQ;
+    return builder.create<CmpFOp>(loc, predicate, reduced, const_0);
+  }
+
   /// Generate numeric semiring kernel if statement condition
   void genCmptOpKernelIfStatementCondition(OpBuilder &builder,
                                            Location &loc,
@@ -1482,9 +1547,12 @@ namespace
     {
       ///    if (mask_array[j] == true) {  /// C[i,k] is allowed by the mask and has not been seen yet
       ///       if (ws_bitmap[j] != true) {
+      /// A complemented mask allows the entries that are not set, if (mask_array[j] == false), so that the
+      /// excluded entries are skipped before they are computed.
       Value &mask_array = numericInfo.mask_array;
       Value ele_mask_array = builder.create<memref::LoadOp>(loc, mask_array, ValueRange{valueAccessIdx});
-      Value compare_true = builder.create<CmpIOp>(loc, CmpIPredicate::eq, ele_mask_array, const_i1_true);
+      Value compare_true = builder.create<CmpIOp>(loc, CmpIPredicate::eq, ele_mask_array,
+                                                  maskingInfo.complemented ? const_i1_false : const_i1_true);
       auto if_mask_set = builder.create<scf::IfOp>(loc, compare_true, false /* no else region */);
       builder.setInsertionPointToStart(&if_mask_set.getThenRegion().front());
       Value ele_bitmap = builder.create<memref::LoadOp>(loc, is_visited_alloc, ValueRange{valueAccessIdx});
@@ -1522,6 +1590,7 @@ namespace
                                             int main_tensor_nums,
                                             scf::IfOp &if_notAlreadySet,
                                             bool compressedWorkspace,
+                                            llvm::StringRef &semiringFirst,
                                             llvm::StringRef &semiringSecond,
                                             std::vector<std::vector<Value>> &main_tensors_all_Allocs,
                                             std::vector<std::vector<Value>> &tensors_lhs_Allocs,
@@ -1557,6 +1626,11 @@ namespace
     /// val = A[j_idx] * B[j_idx];
     /// W_data[j_idx] = val;
     Value elementWiseResult = getSemiringSecondVal(builder, loc, semiringSecond, allLoadsIf[0], allLoadsIf[1], compressedWorkspace);
+    /// The later contributions to a logical reduction yield 0 or 1, and so does the first one
+    if (semiringFirst == "lor" || semiringFirst == "land")
+    {
+      elementWiseResult = getLogicalFValue(builder, loc, elementWiseResult);
+    }
 #ifdef DEBUG_MODE_LowerIndexTreeToSCFPass
     auto store_sum = builder.create<memref::StoreOp>(loc,
                                                      elementWiseResult,
@@ -1616,6 +1690,22 @@ namespace
 
     builder.setInsertionPointToStart(&if_notAlreadySet.getElseRegion().front());
 
+    if (semiringFirst == "any")
+    {
+      /// The mark array short-circuits any: the workspace already holds one of the contributions,
+      /// so the later ones are neither loaded nor computed.
+      comet_debug() << "any reduction: nothing to compute for a workspace entry already set\n";
+      return;
+    }
+    if (isSaturatingReduction(semiringFirst))
+    {
+      ///    if (W_data[j] is not saturated) {
+      Value W_data_old = builder.create<memref::LoadOp>(loc, W_data, W_data_valueAccessIdx);
+      Value notDetermined = genReductionNotDetermined(builder, loc, semiringFirst, W_data_old);
+      auto if_notDetermined = builder.create<scf::IfOp>(loc, notDetermined, /*WithElseRegion*/ false);
+      builder.setInsertionPointToStart(&if_notDetermined.getThenRegion().front());
+    }
+
     std::vector<Value> allLoadsElse(main_tensor_nums);
     for (auto m = 0; m < main_tensor_nums; m++)
     {
@@ -1741,7 +1831,8 @@ namespace
   ///        }
   ///      }
   /// ----------------- ///
-  /// Reset mask_array at the end of numeric outermost for-loop
+  /// Reset mask_array at the end of numeric outermost for-loop.
+  /// The entries of a complemented mask are set the same way, and the kernel skips them instead.
   /// ----------------- ///
   ///      scf.for %arg1 = %j_loc_start to %j_loc_bound step %c1 {
   ///        %j_idx = memref.load %mask_col[%arg1] : memref<?xindex>
@@ -1820,6 +1911,36 @@ namespace
     builder.restoreInsertionPoint(last_insertion_point);
   }
 
+  /// ----------------- ///
+  /// Generate the body of a sampled product C<M> = A * B of dense operands (SDDMM), called by genCmptOps().
+  /// The loops of the output indices iterate over the nonzeros of the mask M, whose sparsity pattern the output has,
+  /// and the innermost loops are the dot product over the contracted indices. Only the structure of M is read.
+  /// ----------------- ///
+  ///     for (i = 0; i < M.dim0; ++i)
+  ///       for (p = M.rowptr[i]; p < M.rowptr[i + 1]; ++p) {
+  ///         j = M.col[p];
+  ///         for (k = 0; k < A.dim1; ++k)
+  ///           C.val[p] = C.val[p] + A[i, k] * B[k, j];
+  ///       }
+  /// ----------------- ///
+  void formSampledLoopBody(llvm::StringRef &semiringFirst,
+                           llvm::StringRef &semiringSecond,
+                           OpBuilder &builder, Location &loc, int lhs_loc,
+                           std::vector<std::vector<Value>> &main_tensors_all_Allocs,
+                           std::vector<std::vector<Value>> &allValueAccessIdx)
+  {
+    Value A_load = builder.create<memref::LoadOp>(loc, main_tensors_all_Allocs[0].back(), allValueAccessIdx[0]);
+    Value B_load = builder.create<memref::LoadOp>(loc, main_tensors_all_Allocs[1].back(), allValueAccessIdx[1]);
+    Value C_load = builder.create<memref::LoadOp>(loc, main_tensors_all_Allocs[lhs_loc].back(), allValueAccessIdx[lhs_loc]);
+    comet_vdump(C_load);
+
+    Value elementWiseResult = getSemiringSecondVal(builder, loc, semiringSecond, A_load, B_load,
+                                                   false /* compressedWorkspace */);
+    Value reduceResult = getSemiringFirstVal(builder, loc, semiringFirst, C_load, elementWiseResult,
+                                             false /* compressedWorkspace */);
+    builder.create<memref::StoreOp>(loc, reduceResult, main_tensors_all_Allocs[lhs_loc].back(), allValueAccessIdx[lhs_loc]);
+  }
+
   void formSemiringLoopBody(indexTree::IndexTreeComputeOp &cur_op,
                             bool comp_worksp_opt,
                             llvm::StringRef &semiringFirst,
@@ -1919,6 +2040,7 @@ namespace
                                              main_tensor_nums,
                                              if_notAlreadySet,
                                              compressedWorkspace,
+                                             semiringFirst,
                                              semiringSecond,
                                              main_tensors_all_Allocs,
                                              tensors_lhs_Allocs,
@@ -2236,6 +2358,17 @@ namespace
         /// calculate elementWise operation and reduction for general dense or mix mode computation (which has dense output)
         comet_debug()
             << "calculate elementWise operation and reduction for general dense or mix mode computation (which has dense output)\n";
+        if (isSaturatingReduction(semiringFirst))
+        {
+          /// The contributions to an output element whose reduction is determined are skipped, operand loads included
+          auto if_notDetermined = builder.create<scf::IfOp>(loc,
+                                                            genReductionNotDetermined(builder, loc, semiringFirst, allLoads[2]),
+                                                            /*WithElseRegion*/ false);
+          if_notDetermined->setAttr(kEarlyExitAttr, builder.getUnitAttr());
+          builder.setInsertionPointToStart(&if_notDetermined.getThenRegion().front());
+          allLoads[0].getDefiningOp()->moveBefore(builder.getInsertionBlock(), builder.getInsertionPoint());
+          allLoads[1].getDefiningOp()->moveBefore(builder.getInsertionBlock(), builder.getInsertionPoint());
+        }
         Value elementWiseResult = getSemiringSecondVal(builder, loc, semiringSecond, allLoads[0], allLoads[1],
                                                        compressedWorkspace);
         Value reduceResult = getSemiringFirstVal(builder, loc, semiringFirst, allLoads[2], elementWiseResult,
@@ -2247,34 +2380,165 @@ namespace
     }
   }
 
+  /// ----------------- ///
+  /// Compact the rows of the output after the numeric outermost for-loop, when C.col and C.val are allocated from
+  /// an upper bound of the size of every row (SymbolicInfo::bound_output_alloc). Row i_idx of C is in
+  /// [C.rowptr[i_idx], C_row_end[i_idx]) of the bound arrays. When the bound is exact, e.g., when the symbolic phase
+  /// ran instead, the bound arrays are kept. The new C.col and C.val replace the bound ones in the output sparse tensor.
+  /// ----------------- ///
+  ///     int C_nnz = 0;
+  ///     for (int i_idx = 0; i_idx < M; ++i_idx) {
+  ///       int start = C.rowptr[i_idx];
+  ///       int size = C_row_end[i_idx] - start;
+  ///       C.rowptr[i_idx] = C_nnz;
+  ///       C_row_end[i_idx] = start;   /// where the row starts in the bound arrays
+  ///       C_nnz += size;
+  ///     }
+  ///     C.rowptr[M] = C_nnz;
+  ///     if (C_nnz != C_val_size) {
+  ///       new_C.col = new int[C_nnz];
+  ///       new_C.val = new f64[C_nnz];
+  ///       parallel_for (int i_idx = 0; i_idx < M; ++i_idx) {
+  ///         int offset = C_row_end[i_idx] - C.rowptr[i_idx];
+  ///         for (int ptr = C.rowptr[i_idx]; ptr < C.rowptr[i_idx + 1]; ++ptr) {
+  ///           new_C.col[ptr] = C.col[ptr + offset];
+  ///           new_C.val[ptr] = C.val[ptr + offset];
+  ///         }
+  ///       }
+  ///       delete C.col; delete C.val;
+  ///     }
+  ///     delete C_row_end;
+  void genCompactOutputRows(OpBuilder &builder,
+                            Location &loc,
+                            SymbolicInfo &symbolicInfo /* output */)
+  {
+    Value const_index_0 = builder.create<ConstantIndexOp>(loc, 0);
+    Value const_index_1 = builder.create<ConstantIndexOp>(loc, 1);
+    Value &mtxC_rowptr = symbolicInfo.mtxC_rowptr;
+    Value &mtxC_row_end = symbolicInfo.mtxC_row_end;
+    Value &num_rows = symbolicInfo.mtxC_num_rows;
+    Value bound_col = symbolicInfo.mtxC_col;
+    Value bound_val = symbolicInfo.mtxC_val;
+
+    /// The new C.rowptr, and the start of every row in the bound arrays
+    scf::ForOp scan_forLoop = builder.create<scf::ForOp>(loc,
+                                                         const_index_0 /* lowerBound */,
+                                                         num_rows /* upperBound */,
+                                                         const_index_1 /* step */,
+                                                         ValueRange{const_index_0},
+                                                         [&](OpBuilder &b, Location l, Value i_idx, ValueRange nnz)
+                                                         {
+                                                           Value start = b.create<memref::LoadOp>(l, mtxC_rowptr, ValueRange{i_idx});
+                                                           Value end = b.create<memref::LoadOp>(l, mtxC_row_end, ValueRange{i_idx});
+                                                           Value size = b.create<SubIOp>(l, end, start);
+                                                           b.create<memref::StoreOp>(l, nnz[0], mtxC_rowptr, ValueRange{i_idx});
+                                                           b.create<memref::StoreOp>(l, start, mtxC_row_end, ValueRange{i_idx});
+                                                           Value new_nnz = b.create<AddIOp>(l, nnz[0], size);
+                                                           b.create<scf::YieldOp>(l, new_nnz);
+                                                         });
+    Value C_nnz = scan_forLoop.getResult(0);
+    builder.create<memref::StoreOp>(loc, C_nnz, mtxC_rowptr, ValueRange{num_rows});
+
+    /// Copy the rows to the new C.col and C.val, unless the bound is exact
+    Value not_exact = builder.create<CmpIOp>(loc, CmpIPredicate::ne, C_nnz, symbolicInfo.mtxC_val_size);
+    auto if_not_exact = builder.create<scf::IfOp>(loc,
+                                                  TypeRange{bound_col.getType(), bound_val.getType()},
+                                                  not_exact,
+                                                  true /* With Else Region */);
+    builder.setInsertionPointToStart(&if_not_exact.getThenRegion().front());
+    Value new_col = builder.create<memref::AllocOp>(loc,
+                                                    bound_col.getType().cast<MemRefType>(),
+                                                    ValueRange{C_nnz});
+    Value new_val = builder.create<memref::AllocOp>(loc,
+                                                    bound_val.getType().cast<MemRefType>(),
+                                                    ValueRange{C_nnz});
+    auto copy_loop = builder.create<scf::ParallelOp>(loc,
+                                                     ValueRange{const_index_0},
+                                                     ValueRange{num_rows},
+                                                     ValueRange{const_index_1});
+    builder.setInsertionPointToStart(copy_loop.getBody());
+    Value i_idx = copy_loop.getInductionVars()[0];
+    Value i_idx_plus_one = builder.create<AddIOp>(loc, i_idx, const_index_1);
+    Value rowptr_start = builder.create<memref::LoadOp>(loc, mtxC_rowptr, ValueRange{i_idx});
+    Value rowptr_bound = builder.create<memref::LoadOp>(loc, mtxC_rowptr, ValueRange{i_idx_plus_one});
+    Value bound_start = builder.create<memref::LoadOp>(loc, mtxC_row_end, ValueRange{i_idx});
+    Value offset = builder.create<SubIOp>(loc, bound_start, rowptr_start);
+    scf::ForOp row_forLoop = builder.create<scf::ForOp>(loc,
+                                                        rowptr_start /* lowerBound */,
+                                                        rowptr_bound /* upperBound */,
+                                                        const_index_1 /* step */);
+    builder.setInsertionPointToStart(row_forLoop.getBody());
+    Value ptr = row_forLoop.getInductionVar();
+    Value bound_ptr = builder.create<AddIOp>(loc, ptr, offset);
+    Value col = builder.create<memref::LoadOp>(loc, bound_col, ValueRange{bound_ptr});
+    Value val = builder.create<memref::LoadOp>(loc, bound_val, ValueRange{bound_ptr});
+    builder.create<memref::StoreOp>(loc, col, new_col, ValueRange{ptr});
+    builder.create<memref::StoreOp>(loc, val, new_val, ValueRange{ptr});
+    builder.setInsertionPointAfter(copy_loop);
+    builder.create<memref::DeallocOp>(loc, bound_col);
+    builder.create<memref::DeallocOp>(loc, bound_val);
+    builder.create<scf::YieldOp>(loc, ValueRange{new_col, new_val});
+    builder.setInsertionPointToStart(&if_not_exact.getElseRegion().front());
+    builder.create<scf::YieldOp>(loc, ValueRange{bound_col, bound_val});
+    builder.setInsertionPointAfter(if_not_exact);
+    builder.create<memref::DeallocOp>(loc, mtxC_row_end);
+    {
+      comet_vdump(scan_forLoop);
+      comet_vdump(if_not_exact);
+    }
+
+    /// The output sparse tensor takes the compacted C.col and C.val
+    symbolicInfo.mtxC_col = if_not_exact.getResult(0);
+    symbolicInfo.mtxC_val = if_not_exact.getResult(1);
+    symbolicInfo.mtxC_val_size = C_nnz;
+    auto is_output_tensor = [](OpOperand &use)
+    { return isa<bufferization::ToTensorOp>(use.getOwner()); };
+    bound_col.replaceUsesWithIf(symbolicInfo.mtxC_col, is_output_tensor);
+    bound_val.replaceUsesWithIf(symbolicInfo.mtxC_val, is_output_tensor);
+
+    /// Store the new C_val_size to C_col_size (A2crd_size) and C_val_size (Aval_size)
+    Value &mtxC = symbolicInfo.mtxC;
+    Value C_col_size_alloc = mtxC.getDefiningOp()->getOperand(CSR_A2CRD_SIZE).getDefiningOp()->getOperand(0);
+    Value C_val_size_alloc = mtxC.getDefiningOp()->getOperand(CSR_AVAL_SIZE).getDefiningOp()->getOperand(0);
+    builder.create<memref::StoreOp>(loc, C_nnz, C_col_size_alloc, ValueRange{const_index_0});
+    builder.create<memref::StoreOp>(loc, C_nnz, C_val_size_alloc, ValueRange{const_index_0});
+  }
+
   /// ----------------- ///
   /// Generate Cij = Wj node, gathering the results in the workspace to the sparse output C.val.
   /// Called by genCmptOps().
+  /// The rows of the output are sorted once after the numeric outermost for-loop, along with their values.
+  /// When the output is allocated from an upper bound of the size of its rows, a row ends at W_id_list_size instead
+  /// of C.rowptr[i_idx + 1], and the rows are compacted before they are sorted (genCompactOutputRows).
   /// ----------------- ///
-  ///     sort(C.col, C.rowptr[i_idx], C.rowptr[i_idx + 1]);
   ///     for (int j_loc = C.rowptr[i_idx]; j_loc < C.rowptr[i_idx + 1]; ++j_loc) {
   ///       int j_idx = C.col[j_loc];
   ///       C.val[j_idx] = W_data[j_idx];
   ///       is_visited[j_idx] = false;
   ///     }
+  ///   (after the numeric outermost for-loop)
+  ///   sort_segments(C.rowptr, C.col, C.val, C.num_rows);
   /// ----------------- ///
-  ///      %rowptr_bound = memref.load %rowptr[%c0] : memref<1xindex>
-  ///      %C_col_ptr = memref.cast %C_col : memref<?xindex> to memref<*xindex>
-  ///      func.call @comet_sort_index(%C_col_ptr, %rowptr_start, %rowptr_bound) : (memref<*xindex>, index, index) -> ()
-  ///
   ///      scf.for %ptr = %rowptr_start to %rowptr_bound step %c1 {
   ///        %c_col_id = memref.load %C_col[%ptr] : memref<?xindex>       /// c_col_id = C_col[ptr]
   ///        %data = memref.load %ws_data[%c_col_id] : memref<?xf64>      /// data = ws_data[c_col_id]
   ///        memref.store %data, %C_val[%ptr] : memref<?xf64>             /// C_val[ptr] = data
   ///        memref.store %false, %ws_bitmap[%c_col_id] : memref<?xi1>    /// ws_bitmap[c_col_id] = false
   ///      }
+  ///      (after the numeric outermost for-loop)
+  ///      %C_rowptr_ptr = memref.cast %C_rowptr : memref<?xindex> to memref<*xindex>
+  ///      %C_col_ptr = memref.cast %C_col : memref<?xindex> to memref<*xindex>
+  ///      %C_val_ptr = memref.cast %C_val : memref<?xf64> to memref<*xf64>
+  ///      func.call @comet_sort_index_segments(%C_rowptr_ptr, %C_col_ptr, %C_val_ptr, %num_rows)
+  ///          : (memref<*xindex>, memref<*xindex>, memref<*xf64>, index) -> ()
   void genWorkspaceCmptOpGatherFromWorkspaceToOutput(OpBuilder &builder,
                                                      Location &loc,
                                                      std::vector<std::vector<Value>> &tensors_rhs_Allocs,
                                                      std::vector<AbstractLoopOp> &nested_forops,
                                                      std::vector<Value> &nested_AccessIdx,
                                                      SymbolicInfo &symbolicInfo,
-                                                     NumericInfo &numericInfo)
+                                                     NumericInfo &numericInfo,
+                                                     Operation *computeOp)
   {
     /// Store the insertion point
     auto last_insertion_point = builder.saveInsertionPoint();
@@ -2295,7 +2559,20 @@ namespace
     Value i_idx_plus_one = builder.create<AddIOp>(loc, i_idx, const_index_1);
     Value &mtxC_rowptr = symbolicInfo.mtxC_rowptr;
     Value rowptr_start = builder.create<memref::LoadOp>(loc, mtxC_rowptr, ValueRange{i_idx});
-    Value rowptr_bound = builder.create<memref::LoadOp>(loc, mtxC_rowptr, ValueRange{i_idx_plus_one});
+    Value rowptr_bound;
+    if (symbolicInfo.mtxC_row_end)
+    {
+      /// C.col and C.val are allocated from an upper bound of the size of the rows, the row ends at W_id_list_size
+      /// %rowptr_bound = memref::LoadOp %W_id_list_size[%c0] : memref<1xindex>
+      /// memref::StoreOp %rowptr_bound, %C_row_end[%i_idx] : memref<?xindex>
+      Value const_index_0 = builder.create<ConstantIndexOp>(loc, 0);
+      rowptr_bound = builder.create<memref::LoadOp>(loc, symbolicInfo.W_id_list_size, ValueRange{const_index_0});
+      builder.create<memref::StoreOp>(loc, rowptr_bound, symbolicInfo.mtxC_row_end, ValueRange{i_idx});
+    }
+    else
+    {
+      rowptr_bound = builder.create<memref::LoadOp>(loc, mtxC_rowptr, ValueRange{i_idx_plus_one});
+    }
     {
       comet_vdump(parent_for_loop);
       comet_vdump(i_idx);
@@ -2303,32 +2580,54 @@ namespace
       comet_vdump(rowptr_bound);
     }
 
-    /// Generate calling comet_sort_index
-    /// %C_col_ptr = memref.cast %C_col : memref<?xindex> to memref<*xindex>
-    /// func.call @comet_sort_index(%C_col_ptr, %rowptr_start, %rowptr_bound) : (memref<*xindex>, index, index) -> ()
-    std::string func_name = "comet_sort_index";
-    Value &mtxC_col = symbolicInfo.mtxC_col;
-    IndexType indexType = IndexType::get(builder.getContext());
-    Value C_col_cast = builder.create<memref::CastOp>(loc,
-                                                      UnrankedMemRefType::get(indexType, 0),
-                                                      mtxC_col);
-    builder.create<func::CallOp>(loc,
-                                 func_name,
-                                 SmallVector<Type, 3>{},
-                                 ValueRange{C_col_cast, rowptr_start, rowptr_bound});
+    Value mtxC_col = symbolicInfo.mtxC_col;
+    Value mtxC_val = symbolicInfo.mtxC_val;
+
+    /// Compact the rows of the output after the numeric outermost for-loop, when it is allocated from an upper bound
+    builder.setInsertionPointAfter(nested_forops.back());
+    if (symbolicInfo.mtxC_row_end)
+    {
+      genCompactOutputRows(builder,
+                           loc,
+                           symbolicInfo /* output */);
+    }
+
+    /// Generate calling comet_sort_index_segments after the numeric outermost for-loop, one call sorts all the rows.
+    /// The sort is skipped when no consumer of the output relies on the order of its rows.
+    auto sortedAttr = computeOp->getAttrOfType<BoolAttr>(kSortedOutputAttr);
+    if (!sortedAttr || sortedAttr.getValue())
+    {
+      std::string func_name = "comet_sort_index_segments";
+      IndexType indexType = IndexType::get(builder.getContext());
+      Value C_rowptr_cast = builder.create<memref::CastOp>(loc,
+                                                           UnrankedMemRefType::get(indexType, 0),
+                                                           mtxC_rowptr);
+      Value C_col_cast = builder.create<memref::CastOp>(loc,
+                                                        UnrankedMemRefType::get(indexType, 0),
+                                                        symbolicInfo.mtxC_col);
+      Value C_val_cast = builder.create<memref::CastOp>(loc,
+                                                        UnrankedMemRefType::get(builder.getF64Type(), 0),
+                                                        symbolicInfo.mtxC_val);
+      builder.create<func::CallOp>(loc,
+                                   func_name,
+                                   SmallVector<Type, 4>{},
+                                   ValueRange{C_rowptr_cast, C_col_cast, C_val_cast, symbolicInfo.mtxC_num_rows});
+    }
+    builder.setInsertionPoint(curr_for_loop);
 
     /// Change current for-loop boundaries
     curr_for_loop.setLowerBound(rowptr_start);
     curr_for_loop.setUpperBound(rowptr_bound);
 
     /// Generate current for-loop body
-    Value &mtxC_val = symbolicInfo.mtxC_val;
     Value &ws_data = tensors_rhs_Allocs[0][0];
     Value &ws_bitmap = numericInfo.ws_bitmap;
     Value rowptr = curr_for_loop.getInductionVar();
     builder.setInsertionPointToStart(curr_for_loop.getBody());
     Value c_col_id = builder.create<memref::LoadOp>(loc, mtxC_col, ValueRange{rowptr});
     Value data = builder.create<memref::LoadOp>(loc, ws_data, ValueRange{c_col_id});
+    /// The values are final once gathered, the unary map fused into the compute op applies before they are stored
+    data = genFusedUnaryMap(builder, loc, computeOp, data);
     builder.create<memref::StoreOp>(loc,
                                     data,
                                     mtxC_val,
@@ -3065,6 +3364,8 @@ namespace
   ///        mark_array[j_idx] = mark + 1;  /// C[i_idx, j_idx] has been visited
   ///        W_id_list_size += 1;
   ///      }
+  /// -------Complemented push masking---------- ///
+  ///      Same as no masking, the entries of the mask are initialized to mark_array[j_idx] = mark
   void genSymbolicIfStatementCondition(OpBuilder &builder,
                                        Location &loc,
                                        AbstractLoopOp &semiringLoop, /// symbolic_nested_forops[0]
@@ -3086,7 +3387,9 @@ namespace
     /// Generate If statement condition
     Value ele_mark_val = builder.create<memref::LoadOp>(loc, mark_array_alloc, ValueRange{valueAccessIdx});
 
-    if (PUSH_BASED_MASKING == maskingInfo.mask_type)
+    /// The entries of a complemented mask are initialized to the mark, as if they were visited already,
+    /// so that the condition without masking skips them.
+    if (PUSH_BASED_MASKING == maskingInfo.mask_type && !maskingInfo.complemented)
     {
       Value equal_mask = builder.create<CmpIOp>(loc,
                                                 CmpIPredicate::eq,
@@ -3094,7 +3397,7 @@ namespace
                                                 mark_new_val);
       if_statement = builder.create<scf::IfOp>(loc, equal_mask, false /* No Else Region */);
     }
-    else if (NO_MASKING == maskingInfo.mask_type)
+    else if (NO_MASKING == maskingInfo.mask_type || PUSH_BASED_MASKING == maskingInfo.mask_type)
     {
 
       Value not_equal_mark = builder.create<CmpIOp>(loc,
@@ -3142,7 +3445,7 @@ namespace
     /// Set the insertion point to the beginning of the if statement then region
     builder.setInsertionPointToStart(&if_statement.getThenRegion().front());
 
-    if (PUSH_BASED_MASKING == maskingInfo.mask_type)
+    if (PUSH_BASED_MASKING == maskingInfo.mask_type && !maskingInfo.complemented)
     {
       /// mark_array[j_idx] = mark + 1;
       Value const_index_1 = builder.create<ConstantIndexOp>(loc, 1);
@@ -3152,7 +3455,7 @@ namespace
                                       mark_array_alloc,
                                       ValueRange{valueAccessIdx});
     }
-    else if (NO_MASKING == maskingInfo.mask_type)
+    else if (NO_MASKING == maskingInfo.mask_type || PUSH_BASED_MASKING == maskingInfo.mask_type)
     {
       /// mark_array[j_idx] = mark
       builder.create<memref::StoreOp>(loc,
@@ -3542,25 +3845,180 @@ namespace
     builder.restoreInsertionPoint(last_insertion_point);
   }
 
-  /// Generate the symbolic phase's kernel to compute the rowptr[i_idx]
-  void genSymbolicSemiringLoopBody(OpBuilder &builder,
+  /// Generate the upper bound of the size of a row of the output, instead of counting its distinct columns with the
+  /// mark-array. Every iteration of the semiring for-loop adds at most one column to the row, so that the trip count of
+  /// the semiring for-loop is added to W_id_list_size, e.g., for SpGEMM the length of row k_idx of B.
+  /// The bound is capped by the number of columns of C.
+  ///     for (k_loc = A.rowptr[i_idx]; k_loc < A.rowptr[i_idx + 1]; ++k_loc) {
+  ///       k_idx = A.col[k_loc];
+  ///       W_id_list_size += B.rowptr[k_idx + 1] - B.rowptr[k_idx];
+  ///     }
+  ///     C.rowptr[i_idx] = min(W_id_list_size, N);
+  void genSymbolicUpperBoundOfRows(OpBuilder &builder,
                                    Location &loc,
-                                   int lhs_loc,
-                                   std::vector<std::vector<Value>> &tensors_lhs_Allocs,
-                                   std::vector<AbstractLoopOp> &symbolic_nested_forops,
-                                   std::vector<Value> &symbolic_nested_AccessIdx,
-                                   std::vector<std::vector<Value>> &symbolic_allValueAccessIdx,
-                                   SymbolicInfo &symbolicInfo,
-                                   std::vector<AbstractLoopOp> &numeric_nested_forops,
-                                   MaskingInfo &maskingInfo)
+                                   Operation *outermost_forLoop,
+                                   Value i_idx,
+                                   Operation *semiringLoop,
+                                   Value semiringLoop_lowerBound,
+                                   Value semiringLoop_upperBound,
+                                   Value &W_id_list_size,
+                                   SymbolicInfo &symbolicInfo)
   {
+    /// Store the insertion point
+    auto last_insertion_point = builder.saveInsertionPoint();
 
-    AbstractLoopOp &outermost_forLoop = symbolic_nested_forops.back();
-    Value &outermost_forLoop_valueAccessIdx = symbolic_nested_AccessIdx.back();
-    AbstractLoopOp &semiringLoop = symbolic_nested_forops[0];
-    Value &mark_array = tensors_lhs_Allocs[1][0];
-    Value &W_id_list_size = tensors_lhs_Allocs[3][0];
-    Value &semiringLoop_valueAccessIdx = symbolic_allValueAccessIdx[lhs_loc][0];
+    /// W_id_list_size += upper_bound - lower_bound, before the semiring for-loop
+    builder.setInsertionPoint(semiringLoop);
+    Value const_index_0 = builder.create<ConstantIndexOp>(loc, 0);
+    Value trip_count = builder.create<SubIOp>(loc, semiringLoop_upperBound, semiringLoop_lowerBound);
+    Value old_val = builder.create<memref::LoadOp>(loc, W_id_list_size, ValueRange{const_index_0});
+    Value new_val = builder.create<AddIOp>(loc, old_val, trip_count);
+    builder.create<memref::StoreOp>(loc,
+                                    new_val,
+                                    W_id_list_size,
+                                    ValueRange{const_index_0});
+
+    /// C.rowptr[i_idx] = min(W_id_list_size, N), at the end of the outermost for-loop body
+    builder.setInsertionPoint(outermost_forLoop->getRegion(0).front().getTerminator());
+    Value const_index_0_outer = builder.create<ConstantIndexOp>(loc, 0);
+    Value row_bound = builder.create<memref::LoadOp>(loc, W_id_list_size, ValueRange{const_index_0_outer});
+    Value capped_bound = builder.create<MinUIOp>(loc, row_bound, symbolicInfo.mtxC_num_cols);
+    builder.create<memref::StoreOp>(loc,
+                                    capped_bound,
+                                    symbolicInfo.mtxC_rowptr,
+                                    ValueRange{i_idx});
+    {
+      comet_vdump(trip_count);
+      comet_vdump(capped_bound);
+      comet_pdump(outermost_forLoop);
+    }
+
+    /// Restore the insertion point
+    builder.restoreInsertionPoint(last_insertion_point);
+  }
+
+  /// Generate a copy of the symbolic for-loops before them, which computes the upper bound of the size of every row
+  /// of the output (genSymbolicUpperBoundOfRows). The for-loops of the copy that do not enclose the semiring for-loop
+  /// belong to other compute nodes and are removed, and so is the semiring for-loop, replaced by its trip count.
+  void genSymbolicUpperBoundLoops(OpBuilder &builder,
+                                  Location &loc,
+                                  AbstractLoopOp &outermost_forLoop,
+                                  AbstractLoopOp &semiringLoop,
+                                  Value &W_id_list_size,
+                                  SymbolicInfo &symbolicInfo)
+  {
+    /// Store the insertion point
+    auto last_insertion_point = builder.saveInsertionPoint();
+
+    builder.setInsertionPoint(outermost_forLoop);
+    IRMapping mapping;
+    Operation *bound_outermost_loop = builder.clone(*outermost_forLoop.getOp(), mapping);
+    Operation *bound_semiring_loop = mapping.lookup(semiringLoop.getOp());
+
+    llvm::DenseSet<Operation *> enclosing_ops;
+    for (Operation *op = bound_semiring_loop; op != bound_outermost_loop; op = op->getParentOp())
+      enclosing_ops.insert(op);
+    std::vector<Operation *> other_loops;
+    bound_outermost_loop->walk<WalkOrder::PreOrder>([&](Operation *op)
+                                                    {
+      if (op != bound_outermost_loop && isa<scf::ForOp, scf::ParallelOp>(op) && !enclosing_ops.count(op))
+      {
+        other_loops.push_back(op);
+        return WalkResult::skip();
+      }
+      return WalkResult::advance(); });
+    for (auto op : other_loops)
+      op->erase();
+
+    genSymbolicUpperBoundOfRows(builder,
+                                loc,
+                                bound_outermost_loop,
+                                mapping.lookup(outermost_forLoop.getInductionVar()),
+                                bound_semiring_loop,
+                                mapping.lookupOrDefault(semiringLoop.getLowerBound()),
+                                mapping.lookupOrDefault(semiringLoop.getUpperBound()),
+                                W_id_list_size,
+                                symbolicInfo);
+    bound_semiring_loop->erase();
+    {
+      comet_pdump(bound_outermost_loop);
+    }
+
+    /// Restore the insertion point
+    builder.restoreInsertionPoint(last_insertion_point);
+  }
+
+  /// Run the symbolic outermost for-loop only when the upper bound of the size of the output, computed by the for-loops
+  /// of genSymbolicUpperBoundLoops, takes more memory than bound_alloc_max_bytes. The symbolic outermost for-loop then
+  /// overwrites the bound of every row with its exact size.
+  ///     bound_nnz = 0;
+  ///     for (i_idx = 0; i_idx < M; ++i_idx)
+  ///       bound_nnz += C.rowptr[i_idx];
+  ///     if (bound_nnz * (sizeof(index) + sizeof(f64)) > bound_alloc_max_bytes) {
+  ///       (symbolic outermost for-loop)
+  ///     }
+  void genSymbolicPhaseIfBoundTooLarge(OpBuilder &builder,
+                                       Location &loc,
+                                       AbstractLoopOp &outermost_forLoop,
+                                       SymbolicInfo &symbolicInfo)
+  {
+    /// Store the insertion point
+    auto last_insertion_point = builder.saveInsertionPoint();
+
+    builder.setInsertionPoint(outermost_forLoop);
+    Value const_index_0 = builder.create<ConstantIndexOp>(loc, 0);
+    Value const_index_1 = builder.create<ConstantIndexOp>(loc, 1);
+    Value &mtxC_rowptr = symbolicInfo.mtxC_rowptr;
+    scf::ForOp sum_forLoop = builder.create<scf::ForOp>(loc,
+                                                        const_index_0 /* lowerBound */,
+                                                        symbolicInfo.mtxC_num_rows /* upperBound */,
+                                                        const_index_1 /* step */,
+                                                        ValueRange{const_index_0},
+                                                        [&](OpBuilder &b, Location l, Value i_idx, ValueRange sum)
+                                                        {
+                                                          Value row_bound = b.create<memref::LoadOp>(l, mtxC_rowptr, ValueRange{i_idx});
+                                                          Value new_sum = b.create<AddIOp>(l, sum[0], row_bound);
+                                                          b.create<scf::YieldOp>(l, new_sum);
+                                                        });
+    Value bytes_per_nonzero = builder.create<ConstantIndexOp>(loc, sizeof(int64_t) + sizeof(double));
+    Value bound_bytes = builder.create<MulIOp>(loc, sum_forLoop.getResult(0), bytes_per_nonzero);
+    Value max_bytes = builder.create<ConstantIndexOp>(loc, symbolicInfo.bound_alloc_max_bytes);
+    Value too_large = builder.create<CmpIOp>(loc, CmpIPredicate::ugt, bound_bytes, max_bytes);
+    auto if_too_large = builder.create<scf::IfOp>(loc, too_large, false /* No Else Region */);
+    outermost_forLoop.getOp()->moveBefore(if_too_large.thenBlock()->getTerminator());
+    {
+      comet_vdump(sum_forLoop);
+      comet_vdump(if_too_large);
+    }
+
+    /// Restore the insertion point
+    builder.restoreInsertionPoint(last_insertion_point);
+  }
+
+  /// Generate the symbolic phase's count of the distinct columns of every row of the output with the mark-array.
+  /// With bound_output_alloc, the upper bound of the size of every row is computed by a copy of the symbolic for-loops
+  /// before them.
+  void genSymbolicCountRows(OpBuilder &builder,
+                            Location &loc,
+                            AbstractLoopOp &outermost_forLoop,
+                            Value &outermost_forLoop_valueAccessIdx,
+                            AbstractLoopOp &semiringLoop,
+                            Value &mark_array,
+                            Value &W_id_list_size,
+                            Value &semiringLoop_valueAccessIdx,
+                            SymbolicInfo &symbolicInfo,
+                            MaskingInfo &maskingInfo,
+                            bool bound_output_alloc)
+  {
+    if (bound_output_alloc)
+    {
+      genSymbolicUpperBoundLoops(builder,
+                                 loc,
+                                 outermost_forLoop,
+                                 semiringLoop,
+                                 W_id_list_size,
+                                 symbolicInfo);
+    }
 
     /// Generate mark before symbolic outer-most for-loop
     Value mark_alloc;
@@ -3573,9 +4031,6 @@ namespace
 
     if (PUSH_BASED_MASKING == maskingInfo.mask_type)
     {
-      assert(symbolic_nested_forops.size() >= 2 && symbolic_allValueAccessIdx.size() >= 2 &&
-             "Error: The symbolic for-loops should be at least 2 level.\n");
-
       /// Initialize the mark-array according to the mask at the beginning of the symbolic outermost for-loop
       genSymbolicInitMarkArrayByMask(builder,
                                      loc,
@@ -3624,6 +4079,71 @@ namespace
                              symbolicInfo.mtxC_rowptr, /// mtxC_rowptr
                              i_idx,                    /// value access index i_idx
                              W_id_list_size /* W_id_list_size */);
+  }
+
+  /// Generate the symbolic phase's kernel to compute the rowptr[i_idx]
+  void genSymbolicSemiringLoopBody(OpBuilder &builder,
+                                   Location &loc,
+                                   int lhs_loc,
+                                   std::vector<std::vector<Value>> &tensors_lhs_Allocs,
+                                   std::vector<AbstractLoopOp> &symbolic_nested_forops,
+                                   std::vector<Value> &symbolic_nested_AccessIdx,
+                                   std::vector<std::vector<Value>> &symbolic_allValueAccessIdx,
+                                   SymbolicInfo &symbolicInfo,
+                                   std::vector<AbstractLoopOp> &numeric_nested_forops,
+                                   MaskingInfo &maskingInfo)
+  {
+
+    AbstractLoopOp &outermost_forLoop = symbolic_nested_forops.back();
+    Value &outermost_forLoop_valueAccessIdx = symbolic_nested_AccessIdx.back();
+    AbstractLoopOp &semiringLoop = symbolic_nested_forops[0];
+    Value &mark_array = tensors_lhs_Allocs[1][0];
+    Value &W_id_list_size = tensors_lhs_Allocs[3][0];
+    Value &semiringLoop_valueAccessIdx = symbolic_allValueAccessIdx[lhs_loc][0];
+    symbolicInfo.W_id_list_size = W_id_list_size;
+    /// The code of the symbolic phase is generated between the operation before the symbolic outermost for-loop
+    /// and the numeric outermost for-loop
+    symbolicInfo.symbolic_phase_block = outermost_forLoop.getOp()->getBlock();
+    symbolicInfo.symbolic_phase_prev = outermost_forLoop.getOp()->getPrevNode();
+    symbolicInfo.numeric_outermost_forLoop = numeric_nested_forops.back().getOp();
+    assert((PUSH_BASED_MASKING != maskingInfo.mask_type ||
+            (symbolic_nested_forops.size() >= 2 && symbolic_allValueAccessIdx.size() >= 2)) &&
+           "Error: The symbolic for-loops should be at least 2 level.\n");
+
+    /// The output of SpGEMM without masking can be allocated from an upper bound of the size of its rows, and
+    /// compacted after the numeric phase. Without a limit on the bound, the symbolic phase only computes the bound.
+    bool bound_output_alloc = symbolicInfo.bound_output_alloc &&
+                              NO_MASKING == maskingInfo.mask_type &&
+                              symbolic_nested_forops.size() >= 3;
+    if (bound_output_alloc && symbolicInfo.bound_alloc_max_bytes == 0)
+    {
+      genSymbolicUpperBoundOfRows(builder,
+                                  loc,
+                                  outermost_forLoop,
+                                  outermost_forLoop.getInductionVar(),
+                                  semiringLoop,
+                                  semiringLoop.getLowerBound(),
+                                  semiringLoop.getUpperBound(),
+                                  W_id_list_size,
+                                  symbolicInfo);
+      /// The semiring for-loop is replaced by its trip count
+      builder.setInsertionPoint(outermost_forLoop);
+      semiringLoop.getOp()->erase();
+    }
+    else
+    {
+      genSymbolicCountRows(builder,
+                           loc,
+                           outermost_forLoop,
+                           outermost_forLoop_valueAccessIdx,
+                           semiringLoop,
+                           mark_array,
+                           W_id_list_size,
+                           semiringLoop_valueAccessIdx,
+                           symbolicInfo,
+                           maskingInfo,
+                           bound_output_alloc);
+    }
 
     /// Store the insertion point
     auto last_insertion_point = builder.saveInsertionPoint();
@@ -3643,6 +4163,15 @@ namespace
                                            outermost_forLoop,
                                            symbolicInfo /* output */);
 
+    /// The numeric phase records the end of every row of C, which is compacted after the numeric phase
+    if (bound_output_alloc)
+    {
+      MemRefType memTy_alloc_dynamic_index = MemRefType::get({ShapedType::kDynamic}, builder.getIndexType());
+      symbolicInfo.mtxC_row_end = builder.create<memref::AllocOp>(loc,
+                                                                  memTy_alloc_dynamic_index,
+                                                                  ValueRange{symbolicInfo.mtxC_num_rows});
+    }
+
     /// Logistics of memory about old mtxC, mtxC.col, and mtxC.val
     /// 1. Dealloc the old C.val and C.col before the outermost_forLoop.
     /// 2. Change mtxC's old value in C_col_size (A2crd_size) and C_val_size (Aval_size) to new mtxC_val_size.
@@ -3654,25 +4183,397 @@ namespace
                             symbolicInfo,
                             numeric_outermost_forLoop);
 
+    /// With a limit on the bound, the symbolic outermost for-loop runs only when the bound is above the limit
+    if (bound_output_alloc && symbolicInfo.bound_alloc_max_bytes != 0)
+    {
+      genSymbolicPhaseIfBoundTooLarge(builder,
+                                      loc,
+                                      outermost_forLoop,
+                                      symbolicInfo);
+    }
+
     /// Restore the insertion point
     builder.restoreInsertionPoint(last_insertion_point);
   }
 
+  /// True if the user of a memref, in a loop enclosing a symbolic phase, does not change its contents
+  bool isReadOnlyMemRefUser(Operation *user)
+  {
+    if (isa<memref::LoadOp, memref::DimOp, bufferization::ToTensorOp>(user))
+      return true;
+    if (auto call = dyn_cast<func::CallOp>(user))
+      return call.getCallee().starts_with("comet_print");
+    if (isa<memref::CastOp>(user))
+      return llvm::all_of(user->getUsers(), isReadOnlyMemRefUser);
+    return false;
+  }
+
+  /// True if the operation only writes the memref, such as the linalg.fill or the loop of stores initializing it
+  bool isInitializerOf(Operation *op, Value memref)
+  {
+    if (op->getNumResults() != 0)
+      return false;
+    bool writes = false;
+    WalkResult result = op->walk([&](Operation *nested)
+                                 {
+                                   if (nested->hasTrait<OpTrait::HasRecursiveMemoryEffects>() ||
+                                       isMemoryEffectFree(nested))
+                                     return WalkResult::advance();
+                                   auto effectOp = dyn_cast<MemoryEffectOpInterface>(nested);
+                                   if (!effectOp)
+                                     return WalkResult::interrupt();
+                                   SmallVector<MemoryEffects::EffectInstance> effects;
+                                   effectOp.getEffects(effects);
+                                   for (auto &effect : effects)
+                                   {
+                                     if (!isa<MemoryEffects::Write>(effect.getEffect()) || effect.getValue() != memref)
+                                       return WalkResult::interrupt();
+                                     writes = true;
+                                   }
+                                   return WalkResult::advance(); });
+    return !result.wasInterrupted() && writes;
+  }
+
+  /// ----------------- ///
+  /// Hoist the symbolic phase of SpGEMM out of the scf.for of a TA for-loop (ta.begin_for_loop) whose iterations
+  /// leave the sparsity of the inputs unchanged, so that C.rowptr, C.col, and C.val are computed and allocated once,
+  /// and every iteration only runs the numeric phase, e.g.,
+  ///     for (t = 0; t < T; ++t) {            symbolic phase: C.rowptr, alloc C.col and C.val
+  ///       symbolic phase            ==>      for (t = 0; t < T; ++t) {
+  ///       numeric phase                        numeric phase
+  ///     }                                    }
+  /// The symbolic phase is hoisted when
+  /// 1. all the values it uses are defined before the loop, or computed in the loop from them by operations
+  ///    without side effects and loads of memrefs the loop never changes, which are cloned before the loop;
+  /// 2. the memrefs it only reads (the structures of the inputs) are never changed in the loop, except by operations
+  ///    initializing them before the symbolic phase, which are cloned before the loop;
+  /// 3. the memrefs it writes are only changed in the loop by the following numeric phase, or by operations only
+  ///    initializing them before the symbolic phase (e.g., the fill of the mark array), which are moved before
+  ///    the loop with it.
+  /// ----------------- ///
+  void hoistLoopInvariantSymbolicPhase(SymbolicInfo &symbolicInfo)
+  {
+    if (!symbolicInfo.has_symbolic_phase || symbolicInfo.symbolic_phase_block == nullptr ||
+        symbolicInfo.mtxC_row_end != nullptr)
+    {
+      return;
+    }
+    Block *block = symbolicInfo.symbolic_phase_block;
+    auto enclosing = dyn_cast<scf::ForOp>(block->getParentOp());
+    Operation *numeric_outermost_forLoop = symbolicInfo.numeric_outermost_forLoop;
+    if (!enclosing || numeric_outermost_forLoop->getBlock() != block)
+    {
+      return;
+    }
+
+    /// The operations of the symbolic phase
+    Operation *first = symbolicInfo.symbolic_phase_prev ? symbolicInfo.symbolic_phase_prev->getNextNode()
+                                                        : &block->front();
+    llvm::DenseSet<Operation *> phaseOps;
+    for (Operation *op = first; op != numeric_outermost_forLoop; op = op->getNextNode())
+    {
+      phaseOps.insert(op);
+    }
+    if (phaseOps.empty())
+    {
+      return;
+    }
+    auto isInPhase = [&](Operation *op)
+    {
+      Operation *ancestor = block->findAncestorOpInBlock(*op);
+      return ancestor != nullptr && phaseOps.contains(ancestor);
+    };
+    auto isChangedInLoop = [&](Value memref)
+    {
+      return llvm::any_of(memref.getUsers(), [&](Operation *user)
+                          { return enclosing->isAncestor(user) && !isReadOnlyMemRefUser(user) &&
+                                   !isa<memref::DeallocOp>(user); });
+    };
+
+    /// 1. Find the operations of the loop the symbolic phase depends on, and check the memrefs it uses
+    std::vector<Value> worklist;
+    auto addOperandsFromAbove = [&](Operation *op)
+    {
+      op->walk([&](Operation *nested)
+               {
+                 for (Value operand : nested->getOperands())
+                 {
+                   Operation *owner = operand.getDefiningOp();
+                   if (!op->isAncestor(owner != nullptr ? owner : operand.getParentBlock()->getParentOp()))
+                     worklist.push_back(operand);
+                 } });
+    };
+    for (Operation *op = first; op != numeric_outermost_forLoop; op = op->getNextNode())
+    {
+      addOperandsFromAbove(op);
+    }
+    llvm::DenseSet<Operation *> clonedOps;
+    llvm::DenseSet<Operation *> movedOps = phaseOps;
+    llvm::DenseSet<Value> memrefs;
+    while (!worklist.empty())
+    {
+      Value value = worklist.back();
+      worklist.pop_back();
+      if (enclosing.isDefinedOutsideOfLoop(value))
+      {
+        if (!value.getType().isa<MemRefType>() || !memrefs.insert(value).second)
+          continue;
+        bool isWrittenInPhase = llvm::any_of(value.getUsers(), [&](Operation *user)
+                                             { return isInPhase(user) && !isReadOnlyMemRefUser(user) &&
+                                                      !isa<memref::DeallocOp>(user); });
+        /// The memrefs the symbolic phase deallocates, such as the old C.col and C.val, can only be read in the loop
+        bool isDeallocatedInPhase = llvm::any_of(value.getUsers(), [&](Operation *user)
+                                                 { return isInPhase(user) && isa<memref::DeallocOp>(user); });
+        bool isWrittenAfterPhase = false;
+        std::vector<Operation *> initializers;
+        for (Operation *user : value.getUsers())
+        {
+          if (!enclosing->isAncestor(user) || isInPhase(user) || isReadOnlyMemRefUser(user) ||
+              isa<memref::DeallocOp>(user))
+            continue;
+          Operation *ancestor = block->findAncestorOpInBlock(*user);
+          if (isDeallocatedInPhase)
+          {
+            comet_debug() << " The symbolic phase is not hoisted, a memref it deallocates is written in the loop\n";
+            return;
+          }
+          /// The initializer of the memref is the op of the loop body the user is nested in, e.g., the store
+          /// loop of a declared tensor
+          if (ancestor->isBeforeInBlock(first) && isInitializerOf(ancestor, value))
+          {
+            if (llvm::find(initializers, ancestor) == initializers.end())
+              initializers.push_back(ancestor);
+          }
+          else if (isWrittenInPhase && !ancestor->isBeforeInBlock(first))
+          {
+            isWrittenAfterPhase = true;
+          }
+          else
+          {
+            comet_debug() << " The symbolic phase is not hoisted, a memref it uses is changed in the loop\n";
+            return;
+          }
+        }
+        /// The initializations of a memref the symbolic phase only reads are cloned before the loop. The ones of
+        /// a memref it writes would overwrite its results in the loop, and are moved before the loop, unless
+        /// the memref is written again after the symbolic phase.
+        if (isWrittenInPhase && isWrittenAfterPhase && !initializers.empty())
+        {
+          comet_debug() << " The symbolic phase is not hoisted, a memref it writes is reinitialized in the loop\n";
+          return;
+        }
+        for (Operation *initializer : initializers)
+        {
+          if (isWrittenInPhase)
+            movedOps.insert(initializer);
+          else
+            clonedOps.insert(initializer);
+          addOperandsFromAbove(initializer);
+        }
+        continue;
+      }
+
+      Operation *def = value.getDefiningOp();
+      if (isInPhase(def != nullptr ? def : value.getParentBlock()->getParentOp()))
+        continue;
+      if (def == nullptr || def->getBlock() != block || def->getNumRegions() != 0)
+      {
+        comet_debug() << " The symbolic phase is not hoisted, it depends on a value computed in the loop\n";
+        return;
+      }
+      if (clonedOps.contains(def))
+        continue;
+      auto load = dyn_cast<memref::LoadOp>(def);
+      if (!isMemoryEffectFree(def) &&
+          !(load && enclosing.isDefinedOutsideOfLoop(load.getMemRef()) && !isChangedInLoop(load.getMemRef())))
+      {
+        comet_debug() << " The symbolic phase is not hoisted, it depends on a value computed in the loop\n";
+        return;
+      }
+      clonedOps.insert(def);
+      worklist.insert(worklist.end(), def->operand_begin(), def->operand_end());
+    }
+
+    /// 2. Clone the operations the symbolic phase depends on before the loop, in their order
+    comet_debug() << " Hoist the symbolic phase out of the loop\n";
+    OpBuilder builder(enclosing);
+    IRMapping mapping;
+    std::vector<Operation *> toMove;
+    for (Operation &op : *block)
+    {
+      if (clonedOps.contains(&op))
+        builder.clone(op, mapping);
+      else if (movedOps.contains(&op))
+        toMove.push_back(&op);
+    }
+
+    /// 3. Move the symbolic phase, and the initializations of the memrefs it writes, before the loop
+    for (Operation *op : toMove)
+    {
+      op->moveBefore(enclosing);
+      op->walk([&](Operation *nested)
+               {
+                 for (OpOperand &operand : nested->getOpOperands())
+                 {
+                   if (Value mapped = mapping.lookupOrNull(operand.get()))
+                     operand.set(mapped);
+                 } });
+    }
+
+    comet_pdump(enclosing->getParentOp());
+  }
+
+  /// ----------------- ///
+  /// Move the deallocations in the body of a loop of the memrefs allocated before the loop after the loop. The
+  /// allocations of the tensors declared in a TA for-loop, such as the workspaces of an index tree, are hoisted out
+  /// of the loop by PCToLoopsLoweringPass, while the lowering of the index tree frees them after their last use.
+  /// ----------------- ///
+  void moveLoopInvariantDeallocsAfterLoop(scf::ForOp loop)
+  {
+    std::vector<Operation *> deallocs;
+    for (Operation &op : loop.getBody()->without_terminator())
+    {
+      if (auto dealloc = dyn_cast<memref::DeallocOp>(op))
+      {
+        if (loop.isDefinedOutsideOfLoop(dealloc.getMemref()))
+          deallocs.push_back(dealloc);
+      }
+    }
+    Operation *insertion_point = loop;
+    for (Operation *dealloc : deallocs)
+    {
+      dealloc->moveAfter(insertion_point);
+      insertion_point = dealloc;
+    }
+  }
+
+  /// ----------------- ///
+  /// Apply the elementwise unary map fused into the compute op (e.g., relu) to the values of its output.
+  /// When the loops of the compute op have no reduction, the values are final when they are stored, and the map
+  /// applies to them right before the store. Otherwise, the values are final after the outermost reduction loop,
+  /// and the map applies after it, visiting again the output indices of the loops nested in it, e.g.,
+  /// for C[i, j] = relu(A[i, k] * B[k, j]):
+  ///     for (i = 0; i < A.dim0; ++i) {
+  ///       for (k = 0; k < A.dim1; ++k)
+  ///         for (j = 0; j < B.dim1; ++j)
+  ///           C[i, j] += A[i, k] * B[k, j];
+  ///       for (j = 0; j < C.dim1; ++j)
+  ///         C[i, j] = relu(C[i, j]);
+  ///     }
+  /// ----------------- ///
+  LogicalResult genFusedUnaryMapOfOutput(indexTree::IndexTreeComputeOp &cur_op,
+                                         OpBuilder &builder, Location &loc, int lhs_loc,
+                                         std::vector<std::vector<std::string>> &allFormats,
+                                         std::vector<std::vector<int>> &allPerms,
+                                         std::vector<AbstractLoopOp> &nested_forops /* numeric for-loops, from innermost to outermost */,
+                                         std::vector<int64_t> &nested_forops_indices,
+                                         std::vector<std::vector<Value>> &main_tensors_all_Allocs,
+                                         std::vector<std::vector<Value>> &allValueAccessIdx)
+  {
+    Operation *computeOp = cur_op.getOperation();
+    if (!computeOp->hasAttr(kUnaryMapAttr))
+      return success();
+
+    std::vector<int> &lhsPerm = allPerms[lhs_loc];
+    Value lhs_val = main_tensors_all_Allocs[lhs_loc].back();
+
+    /// The loops are from innermost to outermost, the last loop over an index the output does not have is the
+    /// outermost reduction loop
+    int reduction_loop = -1;
+    for (unsigned int l = 0; l < nested_forops_indices.size(); l++)
+    {
+      if (std::find(lhsPerm.begin(), lhsPerm.end(), nested_forops_indices[l]) == lhsPerm.end())
+        reduction_loop = l;
+    }
+
+    auto last_insertion_point = builder.saveInsertionPoint();
+    if (reduction_loop < 0)
+    {
+      /// The last store into the output in the innermost loop is the one of the compute op
+      memref::StoreOp lastStore;
+      nested_forops[0].getOp()->walk([&](memref::StoreOp store)
+                                     {
+                                       if (store.getMemRef() == lhs_val)
+                                         lastStore = store; });
+      if (!lastStore)
+      {
+        llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: No store into the output to fuse the unary map into\n";
+        return failure();
+      }
+      builder.setInsertionPoint(lastStore);
+      lastStore->setOperand(0, genFusedUnaryMap(builder, loc, computeOp, lastStore.getValueToStore()));
+      comet_debug() << " Unary map fused before the store:\n";
+      comet_vdump(lastStore);
+      builder.restoreInsertionPoint(last_insertion_point);
+      return success();
+    }
+
+    /// The output indices visited again after the reduction loop, and the access indices of the output that are
+    /// already known there (-1 for the ones of the loops nested in the reduction loop)
+    Operation *reductionLoop = nested_forops[reduction_loop].getOp();
+    bool isDenseOutput = checkIsDense(allFormats[lhs_loc]);
+    std::vector<int> revisitedDims;
+    for (unsigned int d = 0; d < lhsPerm.size(); d++)
+    {
+      auto loop = std::find(nested_forops_indices.begin(), nested_forops_indices.end(), lhsPerm[d]);
+      if (loop - nested_forops_indices.begin() < reduction_loop)
+        revisitedDims.push_back(d);
+    }
+    /// The position of a value in a sparse output is only known in the loops that visit it
+    bool isSupported = isDenseOutput || revisitedDims.empty();
+    for (unsigned int d = 0; isSupported && d < allValueAccessIdx[lhs_loc].size(); d++)
+    {
+      if (std::find(revisitedDims.begin(), revisitedDims.end(), d) != revisitedDims.end())
+        continue;
+      Value idx = allValueAccessIdx[lhs_loc][d];
+      isSupported = !reductionLoop->isAncestor(idx.getParentBlock()->getParentOp());
+    }
+    if (!isSupported)
+    {
+      llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: The unary map cannot be fused after the reduction of "
+                   << "the compute op, the output values are not accessible there\n";
+      return failure();
+    }
+
+    builder.setInsertionPointAfter(reductionLoop);
+    std::vector<Value> outputAccessIdx = allValueAccessIdx[lhs_loc];
+    if (!revisitedDims.empty())
+    {
+      Value const_index_0 = builder.create<ConstantIndexOp>(loc, 0);
+      Value const_index_1 = builder.create<ConstantIndexOp>(loc, 1);
+      for (int d : revisitedDims)
+      {
+        Value dimSize = builder.create<memref::DimOp>(loc, lhs_val, d);
+        auto forOp = builder.create<scf::ForOp>(loc, const_index_0, dimSize, const_index_1);
+        builder.setInsertionPointToStart(forOp.getBody());
+        outputAccessIdx[d] = forOp.getInductionVar();
+      }
+    }
+    Value value = builder.create<memref::LoadOp>(loc, lhs_val, outputAccessIdx);
+    Value mapped = genFusedUnaryMap(builder, loc, computeOp, value);
+    builder.create<memref::StoreOp>(loc, mapped, lhs_val, outputAccessIdx);
+    comet_debug() << " Unary map fused after the reduction loop:\n";
+    comet_pdump(reductionLoop->getParentOp());
+
+    builder.restoreInsertionPoint(last_insertion_point);
+    return success();
+  }
+
   /// 1. Get the nested loops
   /// ---1.1 the nested loops corresponding indices can be infered from ancestors_wp
   /// 2. get lhs and rhs. if only 1 rhs, then it's a fill op; otherwise, binary op
   /// Note: 1. The auxiliary arrays does not contain the perms/formats information
   ///       2. We only apply the compressed workspace on the output of the tensor, then in this case, the workspace tensors will not be in the same side with the main tensors.
   ///         (main tensors: such as A, B, C, w;  auxiliary tensors: such as w_index_list ...)
-  void genCmptOps(indexTree::IndexTreeComputeOp &cur_op,
-                  indexTree::IndexTreeOp &rootOp,
-                  ///                PatternRewriter &rewriter,
-                  OpBuilder &builder,
-                  OpsTree *opstree,
-                  std::vector<Value> &ancestorsWps,
-                  std::vector<Value> &wp_ops,
-                  SymbolicInfo &symbolicInfo,
-                  NumericInfo &numericInfo)
+  LogicalResult genCmptOps(indexTree::IndexTreeComputeOp &cur_op,
+                           indexTree::IndexTreeOp &rootOp,
+                           ///                PatternRewriter &rewriter,
+                           OpBuilder &builder,
+                           OpsTree *opstree,
+                           std::vector<Value> &ancestorsWps,
+                           std::vector<Value> &wp_ops,
+                           SymbolicInfo &symbolicInfo,
+                           NumericInfo &numericInfo)
   {
     comet_debug() << " calling genCmptOps\n";
     Location loc = rootOp.getLoc();
@@ -3956,7 +4857,8 @@ namespace
                                                           nested_forops,
                                                           nested_AccessIdx,
                                                           symbolicInfo,
-                                                          numericInfo);
+                                                          numericInfo,
+                                                          cur_op.getOperation());
             ///          }
           }
           else
@@ -4073,6 +4975,33 @@ namespace
                            symbolicInfo,
                            numericInfo,
                            maskingInfo);
+      if (!comp_worksp_opt)
+      {
+        if (failed(genFusedUnaryMapOfOutput(cur_op, builder, loc, lhs_loc, allFormats, allPerms, nested_forops,
+                                           nested_forops_indices, main_tensors_all_Allocs, allValueAccessIdx)))
+          return failure();
+      }
+    }
+    else if (main_tensors_rhs.size() == 3 && cur_op.getMaskType() == "sampled")
+    { /// Generate " a<m> = b * c" sampled product of dense operands, the nonzeros of the mask drive the loops
+
+      auto semiringParts = cur_op.getSemiring().split('_');
+      /// check validity of semiring provided by user.
+      if (!Semiring_reduceOps.contains(semiringParts.first) || !Semiring_ops.contains(semiringParts.second))
+      {
+        llvm::errs() << "Not supported semiring operator: "
+                     << semiringParts.first << " or " << semiringParts.second << " \n";
+        llvm::errs() << "Please report this error to the developers!\n";
+        /// we should not proceed forward from this point to avoid faults.
+      }
+
+      formSampledLoopBody(semiringParts.first, semiringParts.second,
+                          builder, loc, lhs_loc,
+                          main_tensors_all_Allocs,
+                          allValueAccessIdx);
+      if (failed(genFusedUnaryMapOfOutput(cur_op, builder, loc, lhs_loc, allFormats, allPerms, nested_forops,
+                                         nested_forops_indices, main_tensors_all_Allocs, allValueAccessIdx)))
+        return failure();
     }
     else if (main_tensors_rhs.size() == 3)
     { /// Generate " a<m> = b * c" binary op with masking
@@ -4092,8 +5021,10 @@ namespace
       }
 
       auto maskingAttr = cur_op.getMaskType();
-      std::string maskingAttrStr(maskingAttr.data());
-      comet_debug() << "mask attr: " << maskingAttrStr << "\n";
+      /// A complemented mask C<!M> has its masking type followed by "_complement"
+      bool complemented = maskingAttr.consume_back("_complement");
+      std::string maskingAttrStr(maskingAttr.str());
+      comet_debug() << "mask attr: " << maskingAttrStr << " complemented: " << complemented << "\n";
 
       MASKING_TYPE mask_type;
       if (maskingAttrStr == "push")
@@ -4124,6 +5055,7 @@ namespace
         MaskingInfo maskingInfo;
         maskingInfo.mask_type = PUSH_BASED_MASKING;
         maskingInfo.mask_tensor = mask_tensor;
+        maskingInfo.complemented = complemented;
 
         /// Get mask_rowptr, mask_col, and mask_val arrays
         getMaskSparseTensorInfo(maskingInfo /* contents updated after call*/);
@@ -4166,6 +5098,12 @@ namespace
                              symbolicInfo,
                              numericInfo,
                              maskingInfo);
+        if (!comp_worksp_opt)
+        {
+          if (failed(genFusedUnaryMapOfOutput(cur_op, builder, loc, lhs_loc, allFormats, allPerms, nested_forops,
+                                             nested_forops_indices, main_tensors_all_Allocs, allValueAccessIdx)))
+            return failure();
+        }
         break;
       }
       case PULL_BASED_MASKING: /// Use pull-based masking
@@ -4177,6 +5115,7 @@ namespace
       llvm::errs() << "No support for operation with greater than two operands in workspace transforms!"
                    << "\n";
     }
+    return success();
   }
 
   /// ----------------- ///
@@ -4227,17 +5166,286 @@ namespace
   /// LowerIndexTreeIRToSCF PASS
   //===----------------------------------------------------------------------===//
 
+  /// The outermost loop over the nonzeros of a sparse vector, e.g. the frontier of SpMSpV, along with the
+  /// coordinate and value arrays and the dimension size of the vector
+  struct SparseFrontierLoop
+  {
+    Operation *loop;
+    Value crd;
+    Value val;
+    Value dimSize;
+  };
+
   /// Lower the ta.tc (tensor contraction operation in TA dialect) into scf dialect.
   struct LowerIndexTreeToSCFPass
       : public PassWrapper<LowerIndexTreeToSCFPass, OperationPass<func::FuncOp>>
   {
     MLIR_DEFINE_EXPLICIT_INTERNAL_INLINE_TYPE_ID(LowerIndexTreeToSCFPass)
+    LowerIndexTreeToSCFPass(bool unrollStaticDims, unsigned vectorWidth, bool switchDirection, double switchThreshold,
+                            bool boundOutputAlloc, uint64_t boundAllocMaxBytes)
+        : unrollStaticDims(unrollStaticDims), vectorWidth(vectorWidth),
+          switchDirection(switchDirection), switchThreshold(switchThreshold),
+          boundOutputAlloc(boundOutputAlloc), boundAllocMaxBytes(boundAllocMaxBytes){};
     void runOnOperation() override;
 
+    void getDependentDialects(DialectRegistry &registry) const override
+    {
+      registry.insert<vector::VectorDialect>();
+    }
+
     void doLoweringIndexTreeToSCF(indexTree::IndexTreeOp &rootOp,
                                   OpBuilder &builder);
+
+  private:
+    /// Fully unroll the innermost generated loops whose bounds are small constants
+    bool unrollStaticDims;
+    /// Width of the vector operations emitted for the innermost dense loops, 0 to emit scalar loops only
+    unsigned vectorWidth;
+    /// Switch the loops over a sparse vector to a dense frontier when its density is above switchThreshold
+    bool switchDirection;
+    double switchThreshold;
+    /// Allocate the sparse output of SpGEMM from an upper bound of the size of its rows, instead of a symbolic phase,
+    /// when the bound takes at most boundAllocMaxBytes (0 for no limit)
+    bool boundOutputAlloc;
+    uint64_t boundAllocMaxBytes;
+    /// The loops over sparse vectors generated from the index trees of the function
+    std::vector<SparseFrontierLoop> frontierLoops;
   };
 
+  /// Adds a runtime switch between the sparse frontier of SpMSpV, i.e. the loop over the nonzeros of the
+  /// sparse vector, and a dense frontier when the density of the vector is above the threshold:
+  /// ----------------- ///
+  ///      if (nnz(x) > threshold * n) {
+  ///        x_dense[crd[m]] = val[m]; x_mask[crd[m]] = true; /// for every nonzero m of x
+  ///        for (i = 0; i < n; i++)
+  ///          if (x_mask[i])
+  ///            ... /// body of the loop, with the nonzero read from x_dense[i]
+  ///      } else {
+  ///        for (m = pos[0]; m < pos[1]; m++)
+  ///          ... /// body of the loop, with i = crd[m]
+  ///      }
+  /// ----------------- ///
+  /// The dense frontier visits the rows of the matrix in order and reads the vector without indirection.
+  /// The loop must use its induction variable only to read the coordinate and the value of the nonzero.
+  void switchToDenseFrontier(SparseFrontierLoop &frontier, double threshold)
+  {
+    auto forOp = dyn_cast<scf::ForOp>(frontier.loop);
+    if (!forOp || forOp.getNumRegionIterArgs() != 0)
+      return;
+    Value iv = forOp.getInductionVar();
+    for (Operation *user : iv.getUsers())
+    {
+      auto load = dyn_cast<memref::LoadOp>(user);
+      if (!load || (load.getMemRef() != frontier.crd && load.getMemRef() != frontier.val))
+        return;
+    }
+
+    comet_debug() << " Sparse frontier loop with a switch to a dense frontier\n";
+    comet_vdump(forOp);
+    Location loc = forOp.getLoc();
+    OpBuilder builder(forOp);
+    auto toF64 = [&](Value v) -> Value
+    {
+      Value i64 = builder.create<IndexCastOp>(loc, builder.getI64Type(), v);
+      return builder.create<SIToFPOp>(loc, builder.getF64Type(), i64);
+    };
+    Value nnz = builder.create<SubIOp>(loc, forOp.getUpperBound(), forOp.getLowerBound());
+    Value cst_threshold = builder.create<ConstantFloatOp>(loc, APFloat(threshold), builder.getF64Type());
+    Value maxSparseNnz = builder.create<MulFOp>(loc, toF64(frontier.dimSize), cst_threshold);
+    Value isDense = builder.create<CmpFOp>(loc, CmpFPredicate::OGT, toF64(nnz), maxSparseNnz);
+    auto if_dense = builder.create<scf::IfOp>(loc, isDense, /*WithElseRegion*/ true);
+    forOp->moveBefore(if_dense.elseBlock()->getTerminator());
+
+    /// Dense frontier: scatter the nonzeros of the vector into a dense vector and its mask
+    builder.setInsertionPoint(if_dense.thenBlock()->getTerminator());
+    Value const_index_0 = builder.create<ConstantIndexOp>(loc, 0);
+    Value const_index_1 = builder.create<ConstantIndexOp>(loc, 1);
+    Value const_i1_0 = builder.create<ConstantOp>(loc, builder.getI1Type(), builder.getBoolAttr(false));
+    Value const_i1_1 = builder.create<ConstantOp>(loc, builder.getI1Type(), builder.getBoolAttr(true));
+    Type valType = frontier.val.getType().cast<MemRefType>().getElementType();
+    Value denseVal = builder.create<memref::AllocOp>(loc, MemRefType::get({ShapedType::kDynamic}, valType),
+                                                     ValueRange{frontier.dimSize});
+    Value mask = builder.create<memref::AllocOp>(loc, MemRefType::get({ShapedType::kDynamic}, builder.getI1Type()),
+                                                 ValueRange{frontier.dimSize});
+
+    auto clearLoop = builder.create<scf::ForOp>(loc, const_index_0, frontier.dimSize, const_index_1);
+    builder.setInsertionPoint(clearLoop.getBody()->getTerminator());
+    builder.create<memref::StoreOp>(loc, const_i1_0, mask, ValueRange{clearLoop.getInductionVar()});
+
+    builder.setInsertionPointAfter(clearLoop);
+    auto scatterLoop = builder.create<scf::ForOp>(loc, forOp.getLowerBound(), forOp.getUpperBound(), const_index_1);
+    builder.setInsertionPoint(scatterLoop.getBody()->getTerminator());
+    Value crd = builder.create<memref::LoadOp>(loc, frontier.crd, ValueRange{scatterLoop.getInductionVar()});
+    Value val = builder.create<memref::LoadOp>(loc, frontier.val, ValueRange{scatterLoop.getInductionVar()});
+    builder.create<memref::StoreOp>(loc, val, denseVal, ValueRange{crd});
+    builder.create<memref::StoreOp>(loc, const_i1_1, mask, ValueRange{crd});
+
+    /// The body of the sparse frontier loop, run for every set element of the mask
+    builder.setInsertionPointAfter(scatterLoop);
+    auto denseLoop = builder.create<scf::ForOp>(loc, const_index_0, frontier.dimSize, const_index_1);
+    builder.setInsertionPoint(denseLoop.getBody()->getTerminator());
+    Value isSet = builder.create<memref::LoadOp>(loc, mask, ValueRange{denseLoop.getInductionVar()});
+    auto if_set = builder.create<scf::IfOp>(loc, isSet, /*WithElseRegion*/ false);
+    builder.setInsertionPoint(if_set.thenBlock()->getTerminator());
+    IRMapping mapping;
+    mapping.map(iv, denseLoop.getInductionVar());
+    mapping.map(frontier.val, denseVal);
+    for (Operation &op : forOp.getBody()->without_terminator())
+      builder.clone(op, mapping);
+
+    /// The coordinate of the nonzero is the induction variable of the dense loop
+    std::vector<memref::LoadOp> crdLoads;
+    if_set.thenBlock()->walk([&](memref::LoadOp load)
+                             {
+      if (load.getMemRef() == frontier.crd)
+        crdLoads.push_back(load); });
+    for (auto load : crdLoads)
+    {
+      load.getResult().replaceAllUsesWith(denseLoop.getInductionVar());
+      load->erase();
+    }
+
+    builder.setInsertionPointAfter(denseLoop);
+    builder.create<memref::DeallocOp>(loc, denseVal);
+    builder.create<memref::DeallocOp>(loc, mask);
+  }
+
+  /// Turns the reduction loops whose body is guarded by kEarlyExitAttr into loops that exit as soon as the reduced
+  /// output element is determined, e.g. for the any, lor and land reductions into a dense output:
+  /// ----------------- ///
+  ///      scf.while (%k = %lb) : (index) -> index {
+  ///        %in_bounds = arith.cmpi slt, %k, %ub : index
+  ///        %c = memref.load %C[%i] : memref<?xf64>
+  ///        %not_determined = arith.cmpf oeq, %c, %cst_0 : f64
+  ///        %continue = arith.andi %in_bounds, %not_determined : i1
+  ///        scf.condition(%continue) %k : index
+  ///      } do {
+  ///      ^bb0(%k: index):
+  ///        ... /// body of the reduction loop
+  ///        %k_next = arith.addi %k, %step : index
+  ///        scf.yield %k_next : index
+  ///      }
+  /// ----------------- ///
+  /// The output element must not depend on the induction variable, and the guarded reduction must be the only
+  /// side effect of the loop. The other loops keep the guard, which still skips the work of every iteration.
+  void convertEarlyExitLoops(func::FuncOp function)
+  {
+    std::vector<scf::IfOp> guards;
+    function.walk([&](scf::IfOp ifOp)
+                  {
+      if (ifOp->hasAttr(kEarlyExitAttr))
+        guards.push_back(ifOp); });
+
+    for (auto ifOp : guards)
+    {
+      ifOp->removeAttr(kEarlyExitAttr);
+      auto forOp = dyn_cast<scf::ForOp>(ifOp->getParentOp());
+      if (!forOp || forOp.getNumRegionIterArgs() != 0)
+        continue;
+
+      /// The guard compares the output element, loaded at indices defined out of the loop, with a constant
+      auto cmp = ifOp.getCondition().getDefiningOp<CmpFOp>();
+      auto load = cmp ? cmp.getLhs().getDefiningOp<memref::LoadOp>() : nullptr;
+      auto constant = cmp ? cmp.getRhs().getDefiningOp<ConstantOp>() : nullptr;
+      if (!load || !constant ||
+          !llvm::all_of(load->getOperands(), [&](Value v)
+                        { return forOp.isDefinedOutsideOfLoop(v); }))
+        continue;
+
+      bool hasOtherEffects = llvm::any_of(forOp.getBody()->without_terminator(), [&](Operation &op)
+                                          { return &op != ifOp.getOperation() && !isa<memref::LoadOp>(op) &&
+                                                   !isMemoryEffectFree(&op); });
+      if (hasOtherEffects)
+        continue;
+
+      comet_debug() << " Reduction loop turned into an early-exit loop\n";
+      comet_vdump(forOp);
+      OpBuilder builder(forOp);
+      Value upperBound = forOp.getUpperBound();
+      Value step = forOp.getStep();
+      builder.create<scf::WhileOp>(
+          forOp.getLoc(), TypeRange{forOp.getInductionVar().getType()}, ValueRange{forOp.getLowerBound()},
+          [&](OpBuilder &b, Location loc, ValueRange args)
+          {
+            Value inBounds = b.create<CmpIOp>(loc, CmpIPredicate::slt, args[0], upperBound);
+            IRMapping mapping;
+            for (Operation *op : {constant.getOperation(), load.getOperation(), cmp.getOperation()})
+              b.clone(*op, mapping);
+            Value notDetermined = mapping.lookup(cmp.getResult());
+            Value keepGoing = b.create<AndIOp>(loc, inBounds, notDetermined);
+            b.create<scf::ConditionOp>(loc, keepGoing, args);
+          },
+          [&](OpBuilder &b, Location loc, ValueRange args)
+          {
+            IRMapping mapping;
+            mapping.map(forOp.getInductionVar(), args[0]);
+            for (Operation &op : forOp.getBody()->without_terminator())
+              b.clone(op, mapping);
+            Value next = b.create<AddIOp>(loc, args[0], step);
+            b.create<scf::YieldOp>(loc, next);
+          });
+      forOp->erase();
+    }
+  }
+
+  /// The innermost loops of the function that are not in existingLoops, i.e. that were generated from the index trees
+  std::vector<scf::ForOp> getGeneratedInnermostLoops(func::FuncOp function,
+                                                     const llvm::DenseSet<Operation *> &existingLoops)
+  {
+    std::vector<scf::ForOp> innermostLoops;
+    function.walk([&](scf::ForOp forOp)
+                  {
+      if (existingLoops.contains(forOp))
+        return;
+      bool isInnermost = true;
+      forOp.getBody()->walk([&](Operation *op)
+                            {
+        if (isa<LoopLikeOpInterface>(op))
+          isInnermost = false; });
+      if (isInnermost)
+        innermostLoops.push_back(forOp); });
+    return innermostLoops;
+  }
+
+  /// Emits vector operations of vectorWidth elements for the innermost generated loops that run over a dense,
+  /// contiguous dimension, e.g. the loop over the dense columns of SpMM
+  void vectorizeInnermostLoops(func::FuncOp function, const llvm::DenseSet<Operation *> &existingLoops,
+                               unsigned vectorWidth)
+  {
+    for (auto forOp : getGeneratedInnermostLoops(function, existingLoops))
+    {
+      VectorizableLoop loop;
+      if (isVectorizableLoop(forOp, loop))
+        vectorizeLoop(forOp, vectorWidth, loop);
+    }
+  }
+
+  /// Largest trip count of the loops fully unrolled by unrollStaticDims
+  const int64_t kMaxUnrolledTripCount = 16;
+
+  /// Fully unrolls the innermost loops that are not in existingLoops and run a small, constant number of
+  /// iterations, such as the loops over dense dimensions of constant size. The unrolled bodies expose the
+  /// independent updates of the dense rows to the vectorizers, e.g. register-blocked SpMM for a small number of columns.
+  void unrollStaticLoops(func::FuncOp function, const llvm::DenseSet<Operation *> &existingLoops)
+  {
+    for (auto forOp : getGeneratedInnermostLoops(function, existingLoops))
+    {
+      std::optional<int64_t> lowerBound = getConstantIntValue(forOp.getLowerBound());
+      std::optional<int64_t> upperBound = getConstantIntValue(forOp.getUpperBound());
+      std::optional<int64_t> step = getConstantIntValue(forOp.getStep());
+      if (!lowerBound || !upperBound || !step || *step <= 0)
+        continue;
+      int64_t tripCount = (*upperBound - *lowerBound + *step - 1) / *step;
+      if (tripCount <= 1 || tripCount > kMaxUnrolledTripCount)
+        continue;
+
+      comet_debug() << " Fully unroll the loop of " << tripCount << " iterations\n";
+      comet_vdump(forOp);
+      if (failed(loopUnrollByFactor(forOp, tripCount)))
+        comet_debug() << " The loop could not be unrolled\n";
+    }
+  }
+
 } /// end anonymous namespace.
 
 /**
@@ -4366,6 +5574,8 @@ void LowerIndexTreeToSCFPass::doLoweringIndexTreeToSCF(indexTree::IndexTreeOp &r
   if (symbolicInfo.are_inputs_sparse)
   {
     symbolicInfo.has_symbolic_phase = true;
+    symbolicInfo.bound_output_alloc = boundOutputAlloc;
+    symbolicInfo.bound_alloc_max_bytes = boundAllocMaxBytes;
   }
 
   for (unsigned int i = 0; i < wp_ops.size(); i++)
@@ -4436,6 +5646,19 @@ void LowerIndexTreeToSCFPass::doLoweringIndexTreeToSCF(indexTree::IndexTreeOp &r
 
       comet_debug() << " call genForOps, i = " << i << "\n";
       genForOps(tensors, ids, formats, rootOp, builder, opstree_vec[i], symbolicInfo, iteratorType);
+
+      /// The outermost loop over the nonzeros of a sparse vector may switch to a dense frontier at runtime
+      if (switchDirection && opstree_vec[i]->parent == nullptr && tensors.size() == 1 &&
+          formats[0].compare(0, 2, "CU") == 0 && ids[0] == 0)
+      {
+        auto sp_construct = tensors[0].getDefiningOp<tensorAlgebra::SparseTensorConstructOp>();
+        if (sp_construct && sp_construct.getTensorRank() == 1)
+        {
+          std::vector<Value> allocs = getAllocs(tensors[0]);
+          frontierLoops.push_back({opstree_vec[i]->forOps.back().getOp(), allocs[1] /* crd */, allocs[4] /* val */,
+                                   sp_construct.getIndices()[sp_construct.getIndexValueSize() + 1] /* dim size */});
+        }
+      }
       {
         comet_pdump(rootOp->getParentOfType<ModuleOp>());
       }
@@ -4458,8 +5681,12 @@ void LowerIndexTreeToSCFPass::doLoweringIndexTreeToSCF(indexTree::IndexTreeOp &r
 
       comet_debug() << " call genCmptOps, i = " << i << "\n";
       /// ancestors_wp can give all the indices of the nested loops
-      genCmptOps(cur_op, rootOp, builder, opstree_vec[i], ancestors_wp,
-                 wp_ops, symbolicInfo, numericInfo);
+      if (failed(genCmptOps(cur_op, rootOp, builder, opstree_vec[i], ancestors_wp,
+                            wp_ops, symbolicInfo, numericInfo)))
+      {
+        signalPassFailure();
+        return;
+      }
       {
         comet_pdump(rootOp->getParentOfType<ModuleOp>());
       }
@@ -4472,6 +5699,13 @@ void LowerIndexTreeToSCFPass::doLoweringIndexTreeToSCF(indexTree::IndexTreeOp &r
     comet_pdump(rootOp->getParentOfType<ModuleOp>());
   }
 
+  /// The symbolic phase of SpGEMM in a TA for-loop runs once when the structures of the inputs are loop-invariant
+  hoistLoopInvariantSymbolicPhase(symbolicInfo);
+  if (auto loop = dyn_cast<scf::ForOp>(rootOp->getParentOp()))
+  {
+    moveLoopInvariantDeallocsAfterLoop(loop);
+  }
+
   comet_debug() << "Cleaning up IndexTree Operations\n";
   comet_vdump(rootOp);
   std::vector<Operation *> operations_dumpster;
@@ -4529,11 +5763,20 @@ void LowerIndexTreeToSCFPass::runOnOperation()
   auto module = function.getOperation()->getParentOfType<ModuleOp>();
   auto *ctx = &getContext();
 
-  /// Declare comet_sort_index()
+  /// Declare comet_sort_index_segments()
   declareSortFunc(module,
                   ctx,
                   function.getLoc());
 
+  /// Only the loops generated from the index trees are vectorized and unrolled
+  llvm::DenseSet<Operation *> existingLoops;
+  if (unrollStaticDims || vectorWidth > 1)
+  {
+    function.walk([&](scf::ForOp forOp)
+                  { existingLoops.insert(forOp); });
+  }
+
+  frontierLoops.clear();
   std::vector<indexTree::IndexTreeOp> iTreeRoots;
   getIndexTreeOps(function, iTreeRoots /* output */);
   for (auto root : iTreeRoots)
@@ -4542,10 +5785,25 @@ void LowerIndexTreeToSCFPass::runOnOperation()
     OpBuilder builder(root);
     doLoweringIndexTreeToSCF(root, builder);
   }
+
+  if (switchDirection)
+  {
+    for (auto &frontier : frontierLoops)
+      switchToDenseFrontier(frontier, switchThreshold);
+  }
+
+  convertEarlyExitLoops(function);
+  if (vectorWidth > 1)
+    vectorizeInnermostLoops(function, existingLoops, vectorWidth);
+  if (unrollStaticDims)
+    unrollStaticLoops(function, existingLoops);
 }
 
 /// Lower sparse tensor algebra operation to loops
-std::unique_ptr<Pass> mlir::comet::createLowerIndexTreeToSCFPass()
+std::unique_ptr<Pass> mlir::comet::createLowerIndexTreeToSCFPass(bool unrollStaticDims, unsigned vectorWidth,
+                                                                 bool switchDirection, double switchThreshold,
+                                                                 bool boundOutputAlloc, uint64_t boundAllocMaxBytes)
 {
-  return std::make_unique<LowerIndexTreeToSCFPass>();
+  return std::make_unique<LowerIndexTreeToSCFPass>(unrollStaticDims, vectorWidth, switchDirection, switchThreshold,
+                                                   boundOutputAlloc, boundAllocMaxBytes);
 }
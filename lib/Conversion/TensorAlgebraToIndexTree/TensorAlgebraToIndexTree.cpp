@@ -177,6 +177,47 @@ Value getRealRhs(Operation *op)
   return op->getResult(0);
 }
 
+/// True when a consumer of the sparse tensor relies on the order of the coordinates within its rows.
+/// A product iterates over the nonzeros of a CSR row in any order, as long as the other operand is dense or does not
+/// co-iterate the same index, and a reduction sums them in any order. Any other use needs sorted rows.
+bool needsSortedRows(Value tensor)
+{
+  for (auto user : tensor.getUsers())
+  {
+    if (auto setOp = dyn_cast<TensorSetOp>(user))
+    {
+      /// The tensor is written, not read
+      if (setOp.getOperand(1) == tensor && setOp.getOperand(0) != tensor)
+        continue;
+      return true;
+    }
+    if (isa<tensorAlgebra::ReduceOp>(user))
+      continue;
+    if (auto multOp = dyn_cast<TensorMultOp>(user))
+    {
+      if (multOp.getMask() == tensor)
+        return true;
+      ArrayAttr formats = multOp.getFormatsAttr();
+      std::vector<Value> rhs1_labels = multOp.getRhs1IndexLabels();
+      std::vector<Value> rhs2_labels = multOp.getRhs2IndexLabels();
+      for (unsigned i = 0; i < 2; i++)
+      {
+        if (multOp.getOperand(i) != tensor)
+          continue;
+        StringRef format = formats[i].cast<StringAttr>().getValue();
+        StringRef otherFormat = formats[1 - i].cast<StringAttr>().getValue();
+        Value lastLabel = i == 0 ? rhs1_labels.back() : rhs2_labels.back();
+        Value otherLastLabel = i == 0 ? rhs2_labels.back() : rhs1_labels.back();
+        if (format != "CSR" || (otherFormat != "Dense" && (otherFormat != "CSR" || lastLabel == otherLastLabel)))
+          return true;
+      }
+      continue;
+    }
+    return true;
+  }
+  return false;
+}
+
 void buildDefUseInfo(UnitExpression *e)
 {
   auto lhs = e->getLHS();
@@ -275,10 +316,24 @@ void doTensorMultOp(TensorMultOp op, unique_ptr<Index_Tree> &tree, TargetDevice
   auto C = tree->getOrCreateTensor(rhs2_tensor, rhs2_labels, allFormats[1]);
   auto A = tree->getOrCreateTensor(lhs_tensor, lhs_labels, allFormats[2]);
 
+  /// A masked product of dense operands into a sparse output is a sampled product (SDDMM): the output takes
+  /// the sparsity pattern of the mask, and each of its nonzeros is a dot product over the contracted indices.
+  /// A complemented mask excludes its nonzeros instead, so it does not give the pattern of the output.
+  bool is_sampled = mask_tensor != nullptr && checkIsDense(allFormats[0]) && checkIsDense(allFormats[1]) &&
+                    !checkIsDense(allFormats[2]) &&
+                    !MaskingTypeAttr.cast<mlir::StringAttr>().getValue().ends_with("_complement");
+
   Tensor *M;
   std::unique_ptr<UnitExpression> e;
   std::vector<mlir::Value> empty;
-  if (mask_tensor != nullptr) /// mask is an optional input
+  if (is_sampled)
+  {
+    comet_debug() << "mask input provided by user, sampled product of dense operands\n";
+    /// The mask has the indices of the output, so that its nonzeros drive the iteration of the output indices
+    M = tree->getOrCreateTensor(mask_tensor, lhs_labels, allFormats[2]);
+    e = make_unique<UnitExpression>(A, B, C, M, "*");
+  }
+  else if (mask_tensor != nullptr) /// mask is an optional input
   {
     comet_debug() << "mask input provided by user\n";
     M = tree->getOrCreateTensor(mask_tensor, empty, allFormats[2]); /// We don't need indexlabel info for the mask
@@ -291,7 +346,10 @@ void doTensorMultOp(TensorMultOp op, unique_ptr<Index_Tree> &tree, TargetDevice
   }
 
   e->setSemiring(SemiringOp.cast<mlir::StringAttr>().getValue());
-  e->setMaskType(MaskingTypeAttr.cast<mlir::StringAttr>().getValue());
+  if (is_sampled)
+    e->setMaskType("sampled");
+  else
+    e->setMaskType(MaskingTypeAttr.cast<mlir::StringAttr>().getValue());
 
   e->setOperation(op);
   buildDefUseInfo(e.get());
@@ -320,6 +378,19 @@ void doTensorMultOp(TensorMultOp op, unique_ptr<Index_Tree> &tree, TargetDevice
 
   auto lhsIndices = A->getIndices();
 
+  if (is_sampled)
+  {
+    /// The output indices, iterated over the nonzeros of the mask, are outermost, and the dot product over the
+    /// contracted indices is innermost
+    IndicesType sampledIndices(lhsIndices.begin(), lhsIndices.end());
+    for (auto index : allIndices)
+    {
+      if (std::find(lhsIndices.begin(), lhsIndices.end(), index) == lhsIndices.end())
+        sampledIndices.push_back(index);
+    }
+    allIndices = sampledIndices;
+  }
+
   TreeNode *parent = tree->getRoot();
   for (unsigned long i = 0; i < allIndices.size(); ++i)
   {
@@ -511,6 +582,19 @@ IndexTreeComputeOp createComputeNodeOp(OpBuilder &builder, TreeNode *node, Locat
   {
     comet_debug() << "user has provided mask input\n";
     t_rhs.push_back(expr->getMask()->getValue()); /// add mask to IndexTreeComputeRHSOp
+
+    /// The mask of a sampled product drives loops, it carries its indices and formats like the operands
+    if (!expr->getMask()->getIndices().empty())
+    {
+      SmallVector<int64_t, 8> indices(expr->getMask()->getIndices().begin(), expr->getMask()->getIndices().end());
+      allIndices_rhs.push_back(builder.getI64ArrayAttr(indices));
+      SmallVector<StringRef, 8> formats;
+      for (auto &f : expr->getMask()->getFormats())
+      {
+        formats.push_back(f);
+      }
+      allFormats_rhs.push_back(builder.getStrArrayAttr(formats));
+    }
   }
 
   Value leafop_rhs = builder.create<indexTree::IndexTreeComputeRHSOp>(loc,
@@ -529,6 +613,20 @@ IndexTreeComputeOp createComputeNodeOp(OpBuilder &builder, TreeNode *node, Locat
   llvm::StringRef maskType = expr->getMaskType();
   auto leafop = builder.create<IndexTreeComputeOp>(loc, i64Type, leafop_rhs, leafop_lhs, builder.getBoolAttr(comp_worksp_opt), builder.getStringAttr(semiring), builder.getStringAttr(maskType));
 
+  /// The elementwise unary map fused into the expression is applied to the values of the output before they are stored
+  if (!expr->getUnaryMap().empty())
+  {
+    leafop->setAttr(kUnaryMapAttr, builder.getStringAttr(expr->getUnaryMap()));
+    leafop->setAttr(kUnaryMapParamsAttr, builder.getF64ArrayAttr(expr->getUnaryMapParams()));
+  }
+
+  /// The rows of a sparse output are left unsorted when none of its consumers relies on their order
+  if (!checkIsDense(expr->getLHS()->getFormats()) && !needsSortedRows(t_lhs))
+  {
+    comet_debug() << "sparse output with unsorted rows\n";
+    leafop->setAttr(kSortedOutputAttr, builder.getBoolAttr(false));
+  }
+
   comet_pdump(leafop);
   return leafop;
 }
@@ -609,6 +707,77 @@ void treeToDialect(Index_Tree *tree)
   }
 }
 
+/// The lowering of the index tree applies a fused unary map right before the store of an output value when the
+/// loops of the expression have no reduction, in the gather from the compressed workspace of an output with one
+/// sparse dimension, and after the reduction otherwise, where only the values of a dense output are accessible.
+/// The map of a sparse output only applies to its stored values, so it must keep zero at zero.
+bool canFuseUnaryMap(UnitExpression *e, StringRef map, const std::vector<double> &params)
+{
+  Tensor *lhs = e->getLHS();
+  auto &formats = lhs->getFormats();
+  if (llvm::all_of(formats, [](const string &format)
+                   { return format == "D"; }))
+    return true;
+  if (!isZeroPreservingUnaryMap(map, params))
+    return false;
+
+  const IndicesType &outputIndices = lhs->getIndices();
+  bool hasReduction = false;
+  for (auto operand : e->getOperands())
+  {
+    if (operand == nullptr)
+      continue;
+    for (auto index : operand->getIndices())
+    {
+      if (std::find(outputIndices.begin(), outputIndices.end(), index) == outputIndices.end())
+        hasReduction = true;
+    }
+  }
+  if (!hasReduction)
+    return true;
+
+  /// The workspace transformation gathers the final values of an output with one sparse dimension, e.g. SpGEMM
+  return llvm::count_if(formats, [](const string &format)
+                        { return format != "D"; }) == 1;
+}
+
+/// The compressed workspace gathers the nonzeros of a sparse output one row at a time, under the loop of the row.
+/// A sparse vector output, e.g. of SpMSpV, has no such loop, its gather would have to follow the whole reduction.
+bool hasSparseVectorOutput(TensorMultOp op)
+{
+  auto allPerms = getAllPerms(op.getIndexingMaps());
+  auto allFormats = getAllFormats(op.getFormatsAttr(), allPerms);
+  return allFormats[2].size() == 1 && !checkIsDense(allFormats[2]);
+}
+
+/// Fuses an elementwise unary map into the expression of the tree that produces its tensor,
+/// when the map directly follows the operation of the expression and its lowering can apply the map
+bool fuseUnaryMap(TensorUnaryOp op, Index_Tree *tree)
+{
+  auto setOp = dyn_cast_or_null<TensorSetOp>(op->getPrevNode());
+  if (!setOp || setOp.getOperand(1) != op.getTensor())
+    return false;
+
+  Operation *producer = setOp.getOperand(0).getDefiningOp();
+  for (auto e : tree->getExpressions())
+  {
+    if (e->getOperation() != producer)
+      continue;
+    std::vector<double> params;
+    for (auto p : op.getParams().getAsValueRange<FloatAttr>())
+    {
+      params.push_back(p.convertToDouble());
+    }
+    if (!canFuseUnaryMap(e, op.getMap(), params))
+      return false;
+
+    comet_debug() << "Fuse unary map " << op.getMap() << " into its producer\n";
+    e->setUnaryMap(op.getMap().str(), params);
+    return true;
+  }
+  return false;
+}
+
 void LowerTensorAlgebraToIndexTreePass::runOnOperation()
 {
   unique_ptr<Index_Tree> tree;
@@ -620,13 +789,20 @@ void LowerTensorAlgebraToIndexTreePass::runOnOperation()
 
   tree = Index_Tree::createTreeWithRoot();
   bool formIndexTreeDialect = false;
+  bool unsupportedOutput = false;
+  std::vector<Operation *> fusedUnaryOps;
 
   comet_debug() << "IndexTree pass running on Function\n";
-  for (Block &B : func.getBody())
+  /// Nested TA operations, such as the ones of the candidate orders of a chain selected at runtime, are lowered in place
+  func.walk<WalkOrder::PreOrder>([&](Operation *nestedOp)
   {
-    for (Operation &op : B)
-    {
-      if (isa<TensorMultOp>(&op))
+      Operation &op = *nestedOp;
+      if (isa<TensorMultOp>(&op) && hasSparseVectorOutput(cast<TensorMultOp>(&op)))
+      {
+        llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: The multiplication into a sparse vector is not supported, declare its output Dense\n";
+        unsupportedOutput = true;
+      }
+      else if (isa<TensorMultOp>(&op))
       {
         doTensorMultOp(cast<TensorMultOp>(&op), tree, device);
         formIndexTreeDialect = true;
@@ -659,7 +835,17 @@ void LowerTensorAlgebraToIndexTreePass::runOnOperation()
         }
         formIndexTreeDialect = true;
       }
-    }
+      else if (isa<TensorUnaryOp>(&op))
+      {
+        if (fuseUnaryMap(cast<TensorUnaryOp>(&op), tree.get()))
+          fusedUnaryOps.push_back(&op);
+      }
+  });
+
+  if (unsupportedOutput)
+  {
+    signalPassFailure();
+    return;
   }
 
   if (formIndexTreeDialect)
@@ -668,6 +854,13 @@ void LowerTensorAlgebraToIndexTreePass::runOnOperation()
     /// only do this for TensorMultOp or TensorElewsMultOp
     treeToDialect(tree.get());
   }
+
+  /// The unary maps fused into their producers are applied by the lowering of the index tree. The other ones are
+  /// left to UnaryOpLowering, which lowers them to a separate loop over the values of their tensor.
+  for (auto op : fusedUnaryOps)
+  {
+    op->erase();
+  }
 }
 
 /// create all the passes.
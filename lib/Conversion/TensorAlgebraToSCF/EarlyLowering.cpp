@@ -247,6 +247,7 @@ namespace
 
       target.addLegalOp<tensorAlgebra::PrintOp,
                         tensorAlgebra::ReduceOp,
+                        tensorAlgebra::TensorUnaryOp,
                         tensorAlgebra::TransposeOp,
                         tensorAlgebra::TensorFillOp,
                         tensorAlgebra::GetTimeOp,
@@ -125,8 +125,9 @@ namespace
           /// If the Input type is tensor
           if (inputType.isa<TensorType>())
           {
+            /// The memref is an allocation, or the result of a TA for-loop carrying the tensor
             auto rhs = op->getOperand(0).getDefiningOp();
-            auto alloc_op = cast<memref::AllocOp>(rhs->getOperand(0).getDefiningOp());
+            Value alloc_op = rhs->getOperand(0);
             comet_vdump(alloc_op);
             auto u = rewriter.create<memref::CastOp>(loc, unrankedMemrefType_f64, alloc_op);
             rewriter.create<func::CallOp>(loc, comet_print_f64Str, SmallVector<Type, 2>{}, ValueRange{u});
@@ -29,7 +29,9 @@
 #include "comet/Dialect/IndexTree/IR/IndexTreeDialect.h"
 #include "comet/Dialect/Utils/Utils.h"
 
+#include "mlir/Dialect/Bufferization/IR/Bufferization.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
 #include "mlir/Pass/Pass.h"
 
 #include <queue>
@@ -37,6 +39,7 @@
 
 using namespace mlir;
 using namespace mlir::arith;
+using namespace mlir::bufferization;
 using namespace mlir::tensorAlgebra;
 using namespace mlir::indexTree;
 
@@ -62,10 +65,16 @@ namespace
 
     // find all ops to be placed inside the loop body.
     std::vector<Operation *> ProcessLoopOps(tensorAlgebra::ForLoopBeginOp op_start, tensorAlgebra::ForLoopEndOp op_end);
+  };
 
-    // replicates Ops for loop-body
-    // pre-condition: some ops require previously generated ops.
-    void replicateOpsForLoopBody(Location loc, OpBuilder &builder, Operation *op, Value &rhs, Value &lhs, Value &compute, Value &indices, Value &transpose);
+  /// A copy of the tensor y into the tensor x at the end of a loop body, x[i, j] = transpose(y[i, j], {i, j}),
+  /// replaced by a swap of their buffers
+  struct CopyBack
+  {
+    Operation *transpose;
+    Operation *set;
+    Value x_buffer;
+    Value y_buffer;
   };
 } // end anonymous namespace.
 
@@ -102,7 +111,7 @@ std::vector<Operation *> PCToLoopsLoweringPass::ProcessLoopOps(tensorAlgebra::Fo
     }
 
     if (match)
-    { // add to list of ops to be replicated
+    { // add to list of ops to be placed in the loop body
       loop_blk.push_back(&op);
     }
   }
@@ -111,85 +120,235 @@ std::vector<Operation *> PCToLoopsLoweringPass::ProcessLoopOps(tensorAlgebra::Fo
   return loop_blk;
 }
 
-// replicates Ops for loop-body
-// pre-condition: some ops require previously generated ops.
-void PCToLoopsLoweringPass::replicateOpsForLoopBody(Location loc, OpBuilder &builder, Operation *op,
-                                                    Value &rhs, Value &lhs, Value &compute, Value &indices, Value &transpose)
+/// True for the allocations of the arrays of a sparse tensor, which the lowering of the index trees replaces
+/// when it computes the sparse tensor
+static bool isSparseTensorArray(memref::AllocOp alloc)
 {
-  IntegerType i64Type = IntegerType::get(builder.getContext(), 64);
-
-  if (isa<tensorAlgebra::TransposeOp>(op))
+  for (Operation *user : alloc->getUsers())
   {
-    comet_debug() << "creating TransposeOp\n";
-    tensorAlgebra::TransposeOp ta_transpose_op = llvm::dyn_cast<tensorAlgebra::TransposeOp>(op);
-    std::vector<Value> lhs_lbls_value = {ta_transpose_op.getOperand(1), ta_transpose_op.getOperand(2)};
-    transpose = builder.create<tensorAlgebra::TransposeOp>(loc, ta_transpose_op.getOperand(0).getType(), ta_transpose_op.getOperand(0),
-                                                           lhs_lbls_value, ta_transpose_op.getIndexingMaps(), ta_transpose_op.getFormats());
+    if (isa<ToTensorOp>(user) &&
+        llvm::any_of(user->getUsers(), [](Operation *u)
+                     { return isa<tensorAlgebra::SparseTensorConstructOp>(u); }))
+      return true;
   }
+  return false;
+}
 
-  // TensorSetOp goes with TransposeOp at this stage of the lowering.
-  if (isa<tensorAlgebra::TensorSetOp>(op) && transpose != NULL)
+/// True for the operations whose result does not change across iterations once their operands are defined before
+/// the loop: the allocations of dense tensors, their tensors, and the computations of scalars without side effects
+static bool isLoopInvariantOp(Operation *op)
+{
+  if (op->getNumRegions() != 0 || op->getNumResults() == 0)
+    return false;
+  if (auto alloc = dyn_cast<memref::AllocOp>(op))
+    return !isSparseTensorArray(alloc);
+  if (isa<ToTensorOp>(op))
+    return true;
+  auto isTensor = [](Type type)
+  { return type.isa<TensorType, tensorAlgebra::SparseTensorType>(); };
+  return isMemoryEffectFree(op) && llvm::none_of(op->getOperandTypes(), isTensor) &&
+         llvm::none_of(op->getResultTypes(), isTensor);
+}
+
+/// Hoists the allocations of the tensors declared in the loop body, and the loop-invariant values they depend on,
+/// before the loop, so that the tensors are allocated once. Their initializations (e.g., the fills of the
+/// declarations) stay in the body and reset them every iteration. The deallocations of the memrefs allocated
+/// before the loop are moved after the loop.
+static void hoistLoopInvariantAllocations(scf::ForOp loop)
+{
+  for (Operation &op : llvm::make_early_inc_range(loop.getBody()->without_terminator()))
   {
-    comet_debug() << "creating SetOp after TransposeOp\n";
-    tensorAlgebra::TensorSetOp ta_set_op = llvm::dyn_cast<tensorAlgebra::TensorSetOp>(op);
-    builder.create<TensorSetOp>(loc, transpose, ta_set_op.getOperand(1));
+    if (isLoopInvariantOp(&op) &&
+        llvm::all_of(op.getOperands(), [&](Value operand)
+                     { return loop.isDefinedOutsideOfLoop(operand); }))
+    {
+      comet_debug() << "Hoisting out of the loop:\n";
+      comet_pdump(&op);
+      op.moveBefore(loop);
+    }
   }
 
-  // create IndexTreeComputeRHSOp, no dependency to earlier replications
-  if (isa<indexTree::IndexTreeComputeRHSOp>(op))
+  Operation *insertion_point = loop;
+  for (Operation &op : llvm::make_early_inc_range(loop.getBody()->without_terminator()))
   {
-    indexTree::IndexTreeComputeRHSOp it_compute_rhs_op = llvm::dyn_cast<indexTree::IndexTreeComputeRHSOp>(op);
-    ArrayAttr op_formats_ArrayAttr = it_compute_rhs_op.getAllFormats();
-    ArrayAttr op_perms_ArrayAttr = it_compute_rhs_op.getAllPerms();
-
-    rhs = builder.create<indexTree::IndexTreeComputeRHSOp>(loc, mlir::UnrankedTensorType::get(builder.getF64Type()),
-                                                           it_compute_rhs_op->getOperands(), // tensors
-                                                           op_perms_ArrayAttr, op_formats_ArrayAttr);
+    auto dealloc = dyn_cast<memref::DeallocOp>(op);
+    if (dealloc && loop.isDefinedOutsideOfLoop(dealloc.getMemref()))
+    {
+      op.moveAfter(insertion_point);
+      insertion_point = &op;
+    }
   }
+}
 
-  // create IndexTreeComputeLHSOp, no dependency to earlier replications
-  if (isa<indexTree::IndexTreeComputeLHSOp>(op))
+/// The users of a buffer and of the tensors of the buffer
+static std::vector<Operation *> getBufferUsers(Value buffer)
+{
+  std::vector<Operation *> users;
+  for (Operation *user : buffer.getUsers())
   {
-    indexTree::IndexTreeComputeLHSOp it_compute_lhs_op = llvm::dyn_cast<indexTree::IndexTreeComputeLHSOp>(op);
-    ArrayAttr op_formats_ArrayAttr = it_compute_lhs_op.getAllFormats();
-    ArrayAttr op_perms_ArrayAttr = it_compute_lhs_op.getAllPerms();
-
-    lhs = builder.create<indexTree::IndexTreeComputeLHSOp>(loc, mlir::UnrankedTensorType::get(builder.getF64Type()),
-                                                           it_compute_lhs_op->getOperands(), /// tensors
-                                                           op_perms_ArrayAttr, op_formats_ArrayAttr);
+    users.push_back(user);
+    if (isa<ToTensorOp>(user))
+      users.insert(users.end(), user->getUsers().begin(), user->getUsers().end());
   }
+  return users;
+}
 
-  /// create IndexTreeComputeOp only if rhs and lhs are ready
-  if (isa<indexTree::IndexTreeComputeOp>(op) && rhs != NULL && lhs != NULL)
+/// Finds the copy x = y at the end of the loop body whose buffers can be swapped instead:
+/// 1. x and y are dense tensors allocated before the loop, in buffers of the same type, and the copy is an identity
+///    transpose;
+/// 2. neither x nor y is used in the body after the copy;
+/// 3. y is filled at the beginning of every iteration, before any other use, so its values from the previous
+///    iteration, in the buffer of x after the swap, are never read;
+/// 4. y is not used after the loop, where it would hold the values of x.
+static bool getCopyBack(scf::ForOp loop, TensorSetOp set, CopyBack &copy)
+{
+  Block *body = loop.getBody();
+  auto transpose = set.getOperand(0).getDefiningOp<TransposeOp>();
+  if (!transpose || transpose->getBlock() != body || !transpose->hasOneUse())
+    return false;
+  ArrayAttr maps = transpose.getIndexingMaps();
+  if (maps[0] != maps[1] || !llvm::all_of(transpose.getFormats(), [](Attribute format)
+                                         { return format.cast<StringAttr>().getValue() == "Dense"; }))
+    return false;
+
+  auto x = set.getOperand(1).getDefiningOp<ToTensorOp>();
+  auto y = transpose.getOperand(0).getDefiningOp<ToTensorOp>();
+  if (!x || !y || !loop.isDefinedOutsideOfLoop(x) || !loop.isDefinedOutsideOfLoop(y) ||
+      !loop.isDefinedOutsideOfLoop(x.getMemref()) || x.getMemref() == y.getMemref())
+    return false;
+  /// The loop carries both buffers in the iter_args of the same type
+  if (x.getMemref().getType() != y.getMemref().getType())
+    return false;
+
+  Operation *first_y_use = nullptr;
+  for (Value buffer : {x.getMemref(), y.getMemref()})
   {
-    indexTree::IndexTreeComputeOp it_compute_op = llvm::dyn_cast<indexTree::IndexTreeComputeOp>(op);
-    compute = builder.create<indexTree::IndexTreeComputeOp>(loc, i64Type, rhs, lhs,
-                                                            it_compute_op.getCompWorkspOpt(), it_compute_op.getSemiring(), it_compute_op.getMaskType());
+    for (Operation *user : getBufferUsers(buffer))
+    {
+      if (user == transpose || user == set || isa<ToTensorOp>(user))
+        continue;
+      if (loop->isAncestor(user))
+      {
+        Operation *ancestor = body->findAncestorOpInBlock(*user);
+        if (set->isBeforeInBlock(ancestor))
+          return false;
+        if (buffer == y.getMemref() && (!first_y_use || ancestor->isBeforeInBlock(first_y_use)))
+          first_y_use = ancestor;
+      }
+      else if (buffer == y.getMemref() && !isa<memref::DeallocOp>(user))
+      {
+        Operation *ancestor = loop->getBlock()->findAncestorOpInBlock(*user);
+        if (!ancestor || loop->isBeforeInBlock(ancestor))
+          return false;
+      }
+    }
   }
+  auto fill = dyn_cast_or_null<linalg::FillOp>(first_y_use);
+  if (!fill || fill.getOutputs()[0] != y.getMemref())
+    return false;
+
+  copy = {transpose, set, x.getMemref(), y.getMemref()};
+  return true;
+}
 
-  /// create IndexTreeIndicesOp from existing IndexTreeIndicesOp (checks condition: indices != NULL)
-  if (isa<indexTree::IndexTreeIndicesOp>(op) && indices != NULL)
+/// Replaces the copies x = y at the end of the loop body by swaps of the buffers of x and y, which the loop
+/// carries, e.g., for an iteration x = f(x) of a power method:
+///     for (t = 0; t < T; ++t) {             for (t = 0, bx = x, by = y; t < T; ++t) {
+///       y = 0; y = A * x;          ==>        by = 0; by = A * bx;
+///       x = y;                                swap(bx, by);
+///     }                                     }
+/// After the loop, x is the buffer of x the loop returns.
+static void swapCopyBackBuffers(scf::ForOp &loop)
+{
+  std::vector<CopyBack> copies;
+  llvm::DenseSet<Value> buffers;
+  for (Operation &op : loop.getBody()->without_terminator())
   {
-    indexTree::IndexTreeIndicesOp it_indices_op = llvm::dyn_cast<indexTree::IndexTreeIndicesOp>(op);
-    Value indices_op_new = builder.create<indexTree::IndexTreeIndicesOp>(loc, i64Type, indices, it_indices_op.getIndices(), it_indices_op.getIteratorType());
+    CopyBack copy;
+    if (isa<TensorSetOp>(op) && getCopyBack(loop, cast<TensorSetOp>(op), copy) &&
+        !buffers.contains(copy.x_buffer) && !buffers.contains(copy.y_buffer))
+    {
+      buffers.insert(copy.x_buffer);
+      buffers.insert(copy.y_buffer);
+      copies.push_back(copy);
+    }
+  }
+  if (copies.empty())
+    return;
 
-    indices = indices_op_new; /// for subsequent IndexTreeIndicesOp creation
+  comet_debug() << "Swapping the buffers of " << copies.size() << " copies at the end of the loop body\n";
+  Location loc = loop.getLoc();
+  OpBuilder builder(loop);
+  std::vector<Value> init_buffers;
+  for (auto &copy : copies)
+  {
+    init_buffers.push_back(copy.x_buffer);
+    init_buffers.push_back(copy.y_buffer);
   }
+  auto new_loop = builder.create<scf::ForOp>(loc, loop.getLowerBound(), loop.getUpperBound(), loop.getStep(),
+                                             init_buffers);
+  Block *new_body = new_loop.getBody();
+  new_body->getOperations().splice(new_body->end(), loop.getBody()->getOperations(),
+                                   loop.getBody()->begin(), std::prev(loop.getBody()->end()));
+  loop.getInductionVar().replaceAllUsesWith(new_loop.getInductionVar());
+
+  auto isInLoop = [&](OpOperand &use)
+  { return new_loop->isProperAncestor(use.getOwner()); };
+  auto isAfterLoop = [&](OpOperand &use)
+  {
+    Operation *ancestor = new_loop->getBlock()->findAncestorOpInBlock(*use.getOwner());
+    return ancestor && new_loop->isBeforeInBlock(ancestor);
+  };
 
-  /// create the first instance of IndexTreeIndicesOp from IndexTreeComputeOp
-  if (isa<indexTree::IndexTreeIndicesOp>(op) && compute != NULL && indices == NULL)
+  /// In the body, the tensors are the ones of the buffers the loop carries
+  std::vector<Value> yields;
+  for (unsigned i = 0; i < copies.size(); i++)
   {
-    indexTree::IndexTreeIndicesOp it_indices_op = llvm::dyn_cast<indexTree::IndexTreeIndicesOp>(op);
-    indices = builder.create<indexTree::IndexTreeIndicesOp>(loc, i64Type, compute, it_indices_op.getIndices(), it_indices_op.getIteratorType());
+    CopyBack &copy = copies[i];
+    Value x_arg = new_loop.getRegionIterArgs()[2 * i];
+    Value y_arg = new_loop.getRegionIterArgs()[2 * i + 1];
+    builder.setInsertionPointToStart(new_body);
+    for (auto [buffer, arg] : {std::make_pair(copy.x_buffer, x_arg), std::make_pair(copy.y_buffer, y_arg)})
+    {
+      Value tensor = builder.create<ToTensorOp>(loc, arg);
+      for (Operation *user : buffer.getUsers())
+      {
+        if (isa<ToTensorOp>(user))
+          user->getResult(0).replaceUsesWithIf(tensor, isInLoop);
+      }
+      buffer.replaceUsesWithIf(arg, isInLoop);
+    }
+    copy.set->erase();
+    copy.transpose->erase();
+    yields.push_back(y_arg);
+    yields.push_back(x_arg);
   }
+  builder.setInsertionPointToEnd(new_body);
+  builder.create<scf::YieldOp>(loc, yields);
 
-  if (isa<indexTree::IndexTreeOp>(op) && indices != NULL)
+  /// After the loop, x is the buffer the loop returns
+  builder.setInsertionPointAfter(new_loop);
+  for (unsigned i = 0; i < copies.size(); i++)
   {
-    builder.create<indexTree::IndexTreeOp>(loc, i64Type, indices);
+    CopyBack &copy = copies[i];
+    Value x_result = new_loop.getResult(2 * i);
+    Value x_tensor = builder.create<ToTensorOp>(loc, x_result);
+    for (Operation *user : copy.x_buffer.getUsers())
+    {
+      if (isa<ToTensorOp>(user))
+        user->getResult(0).replaceUsesWithIf(x_tensor, isAfterLoop);
+    }
+    copy.x_buffer.replaceUsesWithIf(x_result, isAfterLoop);
+    copy.y_buffer.replaceUsesWithIf(new_loop.getResult(2 * i + 1), isAfterLoop);
   }
+
+  loop->erase();
+  loop = new_loop;
 }
 
 /// lowers ForLoopBeginOp and ForLoopEndOp to scf.for, one loop at a time.
+/// The ops between them are moved into the loop body, in order. The allocations in the body are then hoisted out of
+/// the loop, and the copies x = y at the end of the body become swaps of buffers.
 void PCToLoopsLoweringPass::PCToLoopsLowering(tensorAlgebra::ForLoopBeginOp op, tensorAlgebra::ForLoopEndOp op_end, std::vector<Operation *> &listOps)
 {
   comet_debug() << "PCToLoopsLowering start\n";
@@ -198,7 +357,6 @@ void PCToLoopsLoweringPass::PCToLoopsLowering(tensorAlgebra::ForLoopBeginOp op,
   comet_pdump(op);
   comet_pdump(op_end);
 
-  auto loc = op->getLoc();
   auto ForLoopStart = cast<tensorAlgebra::ForLoopBeginOp>(op);
 
   /// get info of loop
@@ -209,69 +367,37 @@ void PCToLoopsLoweringPass::PCToLoopsLowering(tensorAlgebra::ForLoopBeginOp op,
   auto loop = builder.create<scf::ForOp>(op_end->getLoc(), lowerBound, upperBound, step);
   comet_vdump(loop);
 
-  auto insertPt = builder.saveInsertionPoint();
-  builder.setInsertionPointToStart(loop.getBody());
-
   /// loop-body: listOps contains all ops obtained thru ProcessLoopOps()
   ///            to be placed inside 'one' loop-body.
-  /// TODO(gkestor): verify all ops are covered here!
-  Value new_rhs_op, new_lhs_op, new_compute_op, indices_op;
-  Value transpose_op;
-  std::vector<Value> loop_bounds; /// carries loop bounds
-  for (unsigned int i = 0; i < listOps.size(); i++)
+  Operation *terminator = loop.getBody()->getTerminator();
+  for (auto bodyOp : listOps)
   {
-    comet_pdump(listOps[i]);
+    comet_pdump(bodyOp);
+    bodyOp->moveBefore(terminator);
+  }
 
-    replicateOpsForLoopBody(loc, builder, listOps[i], new_rhs_op, new_lhs_op, new_compute_op, indices_op, transpose_op);
+  /// remove ForLoopBeginOp and ForLoopEndOp
+  op->erase();
+  op_end->erase();
 
-    /// nested loop
-    if (isa<ConstantIndexOp>(listOps[i]))
-    {
-      ConstantIndexOp constant_index = llvm::dyn_cast<ConstantIndexOp>(listOps[i]);
-      loop_bounds.push_back(builder.create<ConstantIndexOp>(loc, constant_index.value()));
-    }
+  hoistLoopInvariantAllocations(loop);
+  swapCopyBackBuffers(loop);
 
-    /// scf::for op
-    /// the inner loop bodies have already been created. preserve them.
-    /// the loop_bounds array should have lowerBound, upperBound and step Values.
-    if (isa<scf::ForOp>(listOps[i]) && loop_bounds.size() == 3)
+  /// The tensors used after the loop have to be declared before the loop, or in the body with their allocations
+  /// hoisted out of it
+  for (Operation &bodyOp : loop.getBody()->without_terminator())
+  {
+    for (Operation *user : bodyOp.getUsers())
     {
-      scf::ForOp scf_for_op = llvm::dyn_cast<scf::ForOp>(listOps[i]);
-      scf::ForOp nested_scf_for_op = builder.create<scf::ForOp>(loc, loop_bounds[0], loop_bounds[1], loop_bounds[2]);
-
-      auto insertPt_nested = builder.saveInsertionPoint();
-      builder.setInsertionPointToStart(nested_scf_for_op.getBody());
-
-      Block *B = scf_for_op.getBody();
-      Value nested_rhs_op, nested_lhs_op, nested_compute_op, nested_indices_op;
-      Value nested_transpose_op;
-      comet_debug() << "going to replicate ops inside nested loop...\n";
-      for (Operation &op_for : *B)
+      if (!loop->isAncestor(user))
       {
-        replicateOpsForLoopBody(loc, builder, &op_for, nested_rhs_op, nested_lhs_op, nested_compute_op, nested_indices_op, nested_transpose_op);
+        llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: A value defined in the body of a for-loop is used after the loop\n";
+        signalPassFailure();
+        return;
       }
-      /// need to restore the insertion point to the previous point
-      builder.restoreInsertionPoint(insertPt_nested);
-      builder.setInsertionPoint(op_end); /// TODO(gkestor): need to re-visit this for nested loops.
     }
   }
-
-  /// remove old ops, since now we are done with the clone inside loop-body.
-  /// this is done in reverse order.
-  comet_debug() << "Removing ops that have been cloned\n";
-  for (unsigned int i = 0; i < listOps.size(); i++)
-  {
-    comet_pdump(listOps[listOps.size() - i - 1]);
-    listOps[listOps.size() - i - 1]->erase();
-  }
-
-  /// need to restore the insertion point to the previous point
-  builder.restoreInsertionPoint(insertPt);
-  builder.setInsertionPoint(op_end);
-
-  /// remove ForLoopBeginOp and ForLoopEndOp
-  op->erase();
-  op_end->erase();
+  comet_vdump(loop);
 
   comet_debug() << "PCToLoopsLowering end\n";
 }
@@ -32,6 +32,7 @@
 #include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/Bufferization/IR/Bufferization.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Math/IR/Math.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 
@@ -100,9 +101,8 @@ namespace
         if (isa<ToTensorOp>(setnewop.getOperand(1).getDefiningOp()))
         {
           Operation *tensorload = cast<ToTensorOp>(setnewop.getOperand(1).getDefiningOp());
-          auto alloc_op = cast<memref::AllocOp>(tensorload->getOperand(0).getDefiningOp());
-          comet_vdump(alloc_op);
-          alloc = alloc_op;
+          alloc = tensorload->getOperand(0);
+          comet_vdump(alloc);
         }
         else {
           alloc = rewriter.create<memref::AllocOp>(loc, memRefType);
@@ -464,6 +464,59 @@ namespace
     }   /// Tensor TransposeLowering
   };
 
+  /// The value array of a sparse tensor and the number of its values, to loop over the stored values of the tensor
+  void getSparseTensorValues(Value tensor, Location loc, PatternRewriter &rewriter, Value &valueAlloc, Value &numValues)
+  {
+    assert(isa<tensorAlgebra::SparseTensorConstructOp>(tensor.getDefiningOp()));
+    tensorAlgebra::SparseTensorConstructOp sp_op = cast<tensorAlgebra::SparseTensorConstructOp>(tensor.getDefiningOp());
+
+    int tensorRanks = sp_op.getTensorRank();
+    comet_debug() << " tensorRank: " << tensorRanks << " \n";
+    comet_debug() << "Sparse tensor:\n";
+    comet_pdump(tensor.getDefiningOp());
+
+    ///  create the lowerBound, upperbound and step for loop
+    int indexValueSize = sp_op.getIndexValueSize();
+    comet_debug() << "indexValueSize in SparseTensorConstructOp:" << indexValueSize << "\n";
+
+    auto loadOpForNNZ = tensor.getDefiningOp()->getOperand(indexValueSize);
+    comet_debug() << "Corresponding AllocOp from SparseTensorConstructOp:\n";
+    comet_vdump(loadOpForNNZ);
+    auto memAllocForNNZ = loadOpForNNZ.getDefiningOp()->getOperand(0);
+    comet_debug() << "Corresponding MemAllocOp for NNZ:\n";
+    comet_vdump(memAllocForNNZ);
+
+    MemRefType resultMemTy = memAllocForNNZ.getDefiningOp()->getResult(0).getType().cast<MemRefType>();
+    auto memRefRank = resultMemTy.getRank();
+    comet_debug() << "memRefRank for alloc: " << memRefRank << "\n";
+    assert(memRefRank == 1); /// Memref rank should be 1
+
+    auto memRefDimSize = resultMemTy.getDimSize(memRefRank - 1);
+    comet_debug() << "memRefDimSize for alloc: " << memRefDimSize << "\n";
+
+    if (memRefDimSize == 1) /// size of value array comes from temporary sparse tensor and Dimsize of alloc is one
+    {
+      Value cst_zero = rewriter.create<ConstantIndexOp>(loc, 0);
+      numValues = rewriter.create<memref::LoadOp>(loc, memAllocForNNZ, ValueRange{cst_zero});
+    }
+    else
+    {
+      /// size of value array comes from read_input_sizes_2D_f64, and alloc dimsize can be only expected size
+      auto expectedMemRefSize = sp_op.getTotalParamCount();
+      comet_debug() << "tensorRanks: " << tensorRanks << "\n";
+      comet_debug() << "expectedMemRefSize: " << expectedMemRefSize << "\n";
+      assert(memRefDimSize == expectedMemRefSize);
+      numValues = tensor.getDefiningOp()->getOperand(indexValueSize);
+    }
+    comet_debug() << "Number of values:\n";
+    comet_vdump(numValues);
+
+    int indexValuePtr = (tensorRanks * 4); /// 4 corresponding to pos, crd
+    valueAlloc = tensor.getDefiningOp()->getOperand(indexValuePtr).getDefiningOp()->getOperand(0);
+    comet_debug() << " ValueAllocOp";
+    comet_vdump(valueAlloc);
+  }
+
   //===----------------------------------------------------------------------===//
   /// ReduceOptoSCF RewritePatterns: Reduction operation lowering for sparse and dense tensors
   //===----------------------------------------------------------------------===//
@@ -538,49 +591,8 @@ namespace
         comet_debug() << "Input Tensor is sparse\n";
 
         comet_pdump(op);
-        assert(isa<tensorAlgebra::SparseTensorConstructOp>(op->getOperand(0).getDefiningOp()));
-        tensorAlgebra::SparseTensorConstructOp sp_op = cast<tensorAlgebra::SparseTensorConstructOp>(op->getOperand(0).getDefiningOp());
-
-        int tensorRanks = sp_op.getTensorRank();
-        comet_debug() << " tensorRank: " << tensorRanks << " \n";
-        comet_debug() << "Tensor to reduce:\n";
-        comet_pdump(op->getOperand(0).getDefiningOp());
-
-        ///  create the lowerBound, upperbound and step for loop
-        int indexValueSize = sp_op.getIndexValueSize();
-        comet_debug() << "indexValueSize in SparseTensorConstructOp:" << indexValueSize << "\n";
-
-        auto loadOpForNNZ = op->getOperand(0).getDefiningOp()->getOperand(indexValueSize);
-        comet_debug() << "Corresponding AllocOp from SparseTensorConstructOp:\n";
-        comet_vdump(loadOpForNNZ);
-        auto memAllocForNNZ = loadOpForNNZ.getDefiningOp()->getOperand(0);
-        comet_debug() << "Corresponding MemAllocOp for NNZ:\n";
-        comet_vdump(memAllocForNNZ);
-
-        MemRefType resultMemTy = memAllocForNNZ.getDefiningOp()->getResult(0).getType().cast<MemRefType>();
-        auto memRefRank = resultMemTy.getRank();
-        comet_debug() << "memRefRank for alloc: " << memRefRank << "\n";
-        assert(memRefRank == 1); /// Memref rank should be 1
-
-        auto memRefDimSize = resultMemTy.getDimSize(memRefRank - 1);
-        comet_debug() << "memRefDimSize for alloc: " << memRefDimSize << "\n";
-
-        Value upperBound;
-        if (memRefDimSize == 1) /// size of value array comes from temporary sparse tensor and Dimsize of alloc is one
-        {
-          upperBound = rewriter.create<memref::LoadOp>(loc, memAllocForNNZ, alloc_zero_loc);
-        }
-        else
-        {
-          /// size of value array comes from read_input_sizes_2D_f64, and alloc dimsize can be only expected size
-          auto expectedMemRefSize = sp_op.getTotalParamCount();
-          comet_debug() << "tensorRanks: " << tensorRanks << "\n";
-          comet_debug() << "expectedMemRefSize: " << expectedMemRefSize << "\n";
-          assert(memRefDimSize == expectedMemRefSize);
-          upperBound = op->getOperand(0).getDefiningOp()->getOperand(indexValueSize);
-        }
-        comet_debug() << "Upper Bound:\n";
-        comet_vdump(upperBound);
+        Value alloc_op, upperBound;
+        getSparseTensorValues(op->getOperand(0), loc, rewriter, alloc_op, upperBound);
         auto lowerBound = rewriter.create<ConstantIndexOp>(loc, 0);
         auto step = rewriter.create<ConstantIndexOp>(loc, 1);
 
@@ -591,10 +603,6 @@ namespace
         rewriter.setInsertionPointToStart(loop.getBody());
 
         /// Build loop body
-        int indexValuePtr = (tensorRanks * 4); /// 4 corresponding to pos, crd
-        auto alloc_op = op->getOperand(0).getDefiningOp()->getOperand(indexValuePtr).getDefiningOp()->getOperand(0);
-        comet_debug() << " ValueAllocOp";
-        comet_vdump(alloc_op);
         std::vector<Value> indices = {loop.getInductionVar()};
         auto load_rhs = rewriter.create<memref::LoadOp>(loc, alloc_op, indices);
         auto res_load = rewriter.create<memref::LoadOp>(loc, res, alloc_zero_loc);
@@ -614,6 +622,76 @@ namespace
     }
   }; /// ReduceOpLowering
 
+  //===----------------------------------------------------------------------===//
+  /// UnaryOptoSCF RewritePatterns: elementwise unary map lowering for sparse and dense tensors, when the map could not
+  /// be fused into the operation producing the tensor
+  //===----------------------------------------------------------------------===//
+  struct UnaryOpLowering : public OpRewritePattern<tensorAlgebra::TensorUnaryOp>
+  {
+    using OpRewritePattern<tensorAlgebra::TensorUnaryOp>::OpRewritePattern;
+    LogicalResult matchAndRewrite(tensorAlgebra::TensorUnaryOp op,
+                                  PatternRewriter &rewriter) const final
+    {
+      comet_debug() << "Lowering unary map " << op.getMap() << " to SCF\n";
+
+      Location loc = op.getLoc();
+      auto inputType = op.getTensor().getType();
+      std::vector<double> params;
+      for (auto p : op.getParams().getAsValueRange<FloatAttr>())
+      {
+        params.push_back(p.convertToDouble());
+      }
+
+      Value alloc_op;
+      std::vector<Value> upperBounds;
+      if (inputType.isa<TensorType>())
+      { /// tensor is dense, map all its values
+        comet_debug() << "Input Tensor is dense\n";
+        alloc_op = op.getTensor().getDefiningOp()->getOperand(0);
+        for (unsigned rank = 0; rank < inputType.cast<mlir::TensorType>().getRank(); rank++)
+        {
+          upperBounds.push_back(rewriter.create<memref::DimOp>(loc, alloc_op, rank));
+        }
+      }
+      else
+      { /// sparse tensor type, map its stored values
+        assert(inputType.isa<SparseTensorType>());
+        comet_debug() << "Input Tensor is sparse\n";
+        /// The implicit zeros of the tensor are not mapped
+        if (!isZeroPreservingUnaryMap(op.getMap(), params))
+        {
+          llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: The unary map " << op.getMap()
+                       << " does not keep zero at zero, it cannot be applied to a sparse tensor\n";
+          return failure();
+        }
+        Value numValues;
+        getSparseTensorValues(op.getTensor(), loc, rewriter, alloc_op, numValues);
+        upperBounds.push_back(numValues);
+      }
+      comet_vdump(alloc_op);
+
+      auto lowerBound = rewriter.create<ConstantIndexOp>(loc, 0);
+      auto step = rewriter.create<ConstantIndexOp>(loc, 1);
+      auto insertPt = rewriter.saveInsertionPoint();
+      std::vector<Value> indices;
+      for (Value upperBound : upperBounds)
+      {
+        auto loop = rewriter.create<scf::ForOp>(loc, lowerBound, upperBound, step);
+        indices.push_back(loop.getInductionVar());
+        rewriter.setInsertionPointToStart(loop.getBody());
+      }
+
+      /// Build loop body
+      Value value = rewriter.create<memref::LoadOp>(loc, alloc_op, indices);
+      Value mapped = genUnaryMap(rewriter, loc, op.getMap(), params, value);
+      rewriter.create<memref::StoreOp>(loc, mapped, alloc_op, indices);
+
+      rewriter.restoreInsertionPoint(insertPt);
+      rewriter.eraseOp(op);
+      return success();
+    }
+  }; /// UnaryOpLowering
+
   struct ScalarOpsLowering : public OpRewritePattern<tensorAlgebra::ScalarOp>
   {
     using OpRewritePattern<tensorAlgebra::ScalarOp>::OpRewritePattern;
@@ -738,6 +816,120 @@ namespace
     }
   }; /// ScalarOpsLowering
 
+  /// Lowers the runtime selection of the contraction order of a chain of matrix multiplications to
+  /// calls to the runtime, which sketch the operands (nonzeros per row and per column) and estimate every candidate
+  struct ChainOrderSelectOpLowering : public OpRewritePattern<tensorAlgebra::ChainOrderSelectOp>
+  {
+    using OpRewritePattern<tensorAlgebra::ChainOrderSelectOp>::OpRewritePattern;
+    LogicalResult matchAndRewrite(tensorAlgebra::ChainOrderSelectOp op,
+                                  PatternRewriter &rewriter) const final
+    {
+      comet_debug() << "ChainOrderSelectOpLowering starts\n";
+      Location loc = op.getLoc();
+      auto module = op->getParentOfType<ModuleOp>();
+      IndexType indexType = rewriter.getIndexType();
+      auto f64Type = rewriter.getF64Type();
+      Type unrankedMemTy_f64 = UnrankedMemRefType::get(f64Type, 0);
+      Type unrankedMemTy_index = UnrankedMemRefType::get(indexType, 0);
+
+      declareChainOrderFuncs(module, loc, unrankedMemTy_f64, unrankedMemTy_index, indexType);
+
+      /// The sketch of an operand holds its sizes, its number of nonzeros per row and per column
+      Value cst_index_0 = rewriter.create<ConstantIndexOp>(loc, 0);
+      Value cst_index_2 = rewriter.create<ConstantIndexOp>(loc, 2);
+      std::vector<Value> offsets, rows, cols;
+      Value sketchesSize = cst_index_0;
+      for (Value operand : op.getOperands())
+      {
+        Operation *defOp = operand.getDefiningOp();
+        if (auto sp_op = dyn_cast<tensorAlgebra::SparseTensorConstructOp>(defOp))
+        {
+          /// dimension sizes come right after the size of the value array
+          rows.push_back(sp_op->getOperand(sp_op.getIndexValueSize() + 1));
+          cols.push_back(sp_op->getOperand(sp_op.getIndexValueSize() + 2));
+        }
+        else
+        {
+          Value memref = cast<ToTensorOp>(defOp).getMemref();
+          rows.push_back(rewriter.create<memref::DimOp>(loc, memref, 0));
+          cols.push_back(rewriter.create<memref::DimOp>(loc, memref, 1));
+        }
+        offsets.push_back(sketchesSize);
+        Value sketchSize = rewriter.create<AddIOp>(loc, rewriter.create<AddIOp>(loc, rows.back(), cols.back()), cst_index_2);
+        sketchesSize = rewriter.create<AddIOp>(loc, sketchesSize, sketchSize);
+      }
+
+      Value sketches = rewriter.create<memref::AllocOp>(loc, MemRefType::get({ShapedType::kDynamic}, f64Type), ValueRange{sketchesSize});
+      Value sketchesCast = rewriter.create<memref::CastOp>(loc, unrankedMemTy_f64, sketches);
+      for (unsigned t = 0; t < op.getNumOperands(); t++)
+      {
+        Operation *defOp = op.getOperand(t).getDefiningOp();
+        if (isa<tensorAlgebra::SparseTensorConstructOp>(defOp))
+        {
+          /// CSR: pos and crd arrays of the second (compressed) dimension
+          Value pos = cast<ToTensorOp>(defOp->getOperand(4).getDefiningOp()).getMemref();
+          Value crd = cast<ToTensorOp>(defOp->getOperand(5).getDefiningOp()).getMemref();
+          Value posCast = rewriter.create<memref::CastOp>(loc, unrankedMemTy_index, pos);
+          Value crdCast = rewriter.create<memref::CastOp>(loc, unrankedMemTy_index, crd);
+          rewriter.create<func::CallOp>(loc, "comet_chain_sketch_csr", SmallVector<Type, 1>{},
+                                        ValueRange{sketchesCast, offsets[t], posCast, crdCast, rows[t], cols[t]});
+        }
+        else
+        {
+          rewriter.create<func::CallOp>(loc, "comet_chain_sketch_dense", SmallVector<Type, 1>{},
+                                        ValueRange{sketchesCast, offsets[t], rows[t], cols[t]});
+        }
+      }
+
+      /// [#operands, #candidates, steps of every candidate]
+      ArrayAttr candidatesAttr = op.getCandidates();
+      int64_t numOperands = op.getNumOperands();
+      int64_t numCandidates = candidatesAttr.size() / (2 * (numOperands - 1));
+      std::vector<int64_t> candidates = {numOperands, numCandidates};
+      for (auto step : candidatesAttr)
+      {
+        candidates.push_back(step.cast<IntegerAttr>().getInt());
+      }
+      Value candidatesAlloc = rewriter.create<memref::AllocOp>(loc, MemRefType::get({(int64_t)candidates.size()}, indexType));
+      for (size_t i = 0; i < candidates.size(); i++)
+      {
+        Value pos = rewriter.create<ConstantIndexOp>(loc, i);
+        Value val = rewriter.create<ConstantIndexOp>(loc, candidates[i]);
+        rewriter.create<memref::StoreOp>(loc, val, candidatesAlloc, ValueRange{pos});
+      }
+      Value candidatesCast = rewriter.create<memref::CastOp>(loc, unrankedMemTy_index, candidatesAlloc);
+
+      auto selectCall = rewriter.create<func::CallOp>(loc, "comet_chain_order_select", SmallVector<Type, 1>{indexType},
+                                                      ValueRange{sketchesCast, candidatesCast});
+      rewriter.create<memref::DeallocOp>(loc, sketches);
+      rewriter.create<memref::DeallocOp>(loc, candidatesAlloc);
+
+      rewriter.replaceOp(op, selectCall.getResult(0));
+      return success();
+    }
+
+  private:
+    static void declareChainOrderFuncs(ModuleOp &module, Location loc, Type unrankedMemTy_f64,
+                                       Type unrankedMemTy_index, IndexType indexType)
+    {
+      MLIRContext *ctx = module.getContext();
+      std::vector<std::pair<std::string, FunctionType>> funcs = {
+          {"comet_chain_sketch_csr", FunctionType::get(ctx, {unrankedMemTy_f64, indexType, unrankedMemTy_index, unrankedMemTy_index, indexType, indexType}, {})},
+          {"comet_chain_sketch_dense", FunctionType::get(ctx, {unrankedMemTy_f64, indexType, indexType, indexType}, {})},
+          {"comet_chain_order_select", FunctionType::get(ctx, {unrankedMemTy_f64, unrankedMemTy_index}, {indexType})}};
+
+      for (auto &func : funcs)
+      {
+        if (!hasFuncDeclaration(module, func.first))
+        {
+          func::FuncOp func_declare = func::FuncOp::create(loc, func.first, func.second, ArrayRef<NamedAttribute>{});
+          func_declare.setPrivate();
+          module.push_back(func_declare);
+        }
+      }
+    }
+  }; /// ChainOrderSelectOpLowering
+
 } /// end anonymous namespace.
 
 /// This is a partial lowering to linear algebra of the tensor algebra operations that are
@@ -778,9 +970,12 @@ void LowerTensorAlgebraToSCFPass::runOnOperation()
                          scf::SCFDialect,
                          ArithDialect,
                          memref::MemRefDialect,
+                         math::MathDialect,
                          bufferization::BufferizationDialect>();
 
   target.addLegalOp<func::CallOp>();
+  /// A unary map that cannot be lowered fails the pass, instead of being left unapplied
+  target.addIllegalOp<tensorAlgebra::TensorUnaryOp>();
 
   /// Now that the conversion target has been defined, we just need to provide
   /// the set of patterns that will lower the TA operations.
@@ -788,8 +983,10 @@ void LowerTensorAlgebraToSCFPass::runOnOperation()
   RewritePatternSet patterns(&getContext());
   patterns.insert<TensorTransposeLowering,
                   ReduceOpLowering,
+                  UnaryOpLowering,
                   ScalarOpsLowering,
-                  ConstantOpLowering>(&getContext());
+                  ConstantOpLowering,
+                  ChainOrderSelectOpLowering>(&getContext());
   /// With the target and rewrite patterns defined, we can now attempt the
   /// conversion. The conversion will signal failure if any of our `illegal`
   /// operations were not converted successfully.
@@ -87,6 +87,10 @@ namespace
 
     static int getIndicesOpsIndex(mlir::Operation *op);
 
+    static std::vector<mlir::Value> getIteratedSparseTensors(mlir::Operation *op);
+
+    static bool haveSameIterationSpace(mlir::Operation *op0, mlir::Operation *op1);
+
     static std::vector<mlir::Operation *> getPathFromRoot(mlir::Operation *op);
 
     static std::vector<mlir::Operation *> getLongestCommonPrefix(std::vector<std::vector<mlir::Operation *>> &paths);
@@ -255,6 +259,65 @@ int IndexTreeKernelFusionPass::getIndicesOpsIndex(mlir::Operation *op)
   return index;
 }
 
+/// The sparse input tensors whose nonzeros the loop of an indices op iterates over, for any compute op under it.
+/// The loop of an index that is dense in all the inputs iterates over the whole dimension.
+std::vector<mlir::Value> IndexTreeKernelFusionPass::getIteratedSparseTensors(mlir::Operation *op)
+{
+  int index = getIndicesOpsIndex(op);
+  std::vector<mlir::Value> sparseTensors;
+  std::vector<mlir::Operation *> worklist = {op};
+  while (!worklist.empty())
+  {
+    mlir::Operation *node = worklist.back();
+    worklist.pop_back();
+    if (!llvm::isa<indexTree::IndexTreeComputeOp>(node))
+    {
+      for (auto operand : node->getOperands())
+      {
+        worklist.push_back(operand.getDefiningOp());
+      }
+      continue;
+    }
+
+    std::vector<std::vector<std::string>> opFormats;
+    std::vector<std::vector<int>> opPerms;
+    std::vector<std::vector<bool>> inputOutputMapping;
+    getFormatsPermsOfComputeOp(node->getResult(0), opFormats, opPerms, inputOutputMapping);
+    std::vector<mlir::Value> inputTensors;
+    getInputTensorsOfComputeOp(node->getResult(0), inputTensors);
+    for (unsigned int i = 0; i < inputTensors.size() && i < opPerms.size(); i++)
+    {
+      unsigned int pos = findIndexInVector<int>(opPerms[i], index);
+      if (pos < opPerms[i].size() && opFormats[i][pos].compare("D") != 0 &&
+          std::find(sparseTensors.begin(), sparseTensors.end(), inputTensors[i]) == sparseTensors.end())
+      {
+        sparseTensors.push_back(inputTensors[i]);
+      }
+    }
+  }
+  return sparseTensors;
+}
+
+/// Two indices ops of the same index generate the same loop when they iterate over the same sparse tensors.
+/// Otherwise, the fused loop would iterate over the nonzeros of one tensor for the compute ops of the other one.
+bool IndexTreeKernelFusionPass::haveSameIterationSpace(mlir::Operation *op0, mlir::Operation *op1)
+{
+  std::vector<mlir::Value> sparseTensors0 = getIteratedSparseTensors(op0);
+  std::vector<mlir::Value> sparseTensors1 = getIteratedSparseTensors(op1);
+  if (sparseTensors0.size() != sparseTensors1.size())
+  {
+    return false;
+  }
+  for (auto tensor : sparseTensors0)
+  {
+    if (std::find(sparseTensors1.begin(), sparseTensors1.end(), tensor) == sparseTensors1.end())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
 std::vector<mlir::Operation *> IndexTreeKernelFusionPass::getPathFromRoot(mlir::Operation *op)
 {
   std::vector<mlir::Operation *> path;
@@ -938,25 +1001,24 @@ void IndexTreeKernelFusionPass::doKernelFusion(
       is_clustered[host_i] = true;
       int host_index = getIndicesOpsIndex(host);
 
-      /// Cluster other nodes to the host
+      /// Cluster the nodes right before the host to the host. A node is not fused past a node that cannot
+      /// be fused, whose computation may depend on it or may be overwritten by it.
       std::vector<mlir::Operation *> cluster;
-      for (int node_i = 0; node_i < host_i; ++node_i)
+      for (int node_i = host_i - 1; node_i >= 0; --node_i)
       {
-        if (is_clustered[node_i])
-        {
-          continue;
-        }
         mlir::Operation *node = operands[node_i];
         int node_index = getIndicesOpsIndex(node);
         comet_debug() << "node\n";
         comet_pdump(node);
         /// Check if node_i can be fused with host_i
-        if (node_index == host_index)
+        if (is_clustered[node_i] || node_index != host_index || !haveSameIterationSpace(node, host))
         {
-          cluster.push_back(node);
-          is_clustered[node_i] = true;
+          break;
         }
+        cluster.push_back(node);
+        is_clustered[node_i] = true;
       }
+      std::reverse(cluster.begin(), cluster.end());
       cluster.push_back(host);
 
       /// Set the operands of the host to the operands of nodes in the cluster
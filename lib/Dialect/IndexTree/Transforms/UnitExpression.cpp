@@ -220,4 +220,20 @@ const llvm::StringRef &UnitExpression::getMaskType() const
 void UnitExpression::setMaskType(const llvm::StringRef &MaskType)
 {
   maskType = MaskType;
+}
+
+const string &UnitExpression::getUnaryMap() const
+{
+  return unaryMap;
+}
+
+const vector<double> &UnitExpression::getUnaryMapParams() const
+{
+  return unaryMapParams;
+}
+
+void UnitExpression::setUnaryMap(const string &UnaryMap, const vector<double> &Params)
+{
+  unaryMap = UnaryMap;
+  unaryMapParams = Params;
 }
\ No newline at end of file
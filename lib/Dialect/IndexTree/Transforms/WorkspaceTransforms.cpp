@@ -1029,6 +1029,13 @@ void IndexTreeWorkspaceTransformationsPass::CompressedWorkspaceTransforms(mlir::
 
                 indexTree::IndexTreeComputeOp itComputeOp = dyn_cast<indexTree::IndexTreeComputeOp>(computeOp.getDefiningOp());
 
+                /// A sampled product writes its output in the sparsity pattern of its mask, it needs no workspace
+                if (itComputeOp.getMaskType() == "sampled")
+                {
+                  comet_debug() << __FILE__ << __LINE__ << " Sampled product, no need to apply workspace transformation\n";
+                  return;
+                }
+
                 /// Check the input tensors, and the output tensor, to see if it contains sparse dimensions
                 /// get the dim ids
                 std::vector<int> sparseDimsOutput = getSparseDimsOutput(opFormats, opPerms);
@@ -1059,6 +1066,21 @@ void IndexTreeWorkspaceTransformationsPass::CompressedWorkspaceTransforms(mlir::
                 if (sparseDimsOutput.size() == 1)
                 {
                   newComputeOps = CompressedWorkspaceOutput(sparseDimsOutput, itComputeOp, opFormats, opPerms, indexValueMap, builder, op);
+
+                  /// The values are final when gathered from the workspace into the output (Cij = Wj),
+                  /// the fused unary map moves to that compute op
+                  if (itComputeOp->hasAttr(kUnaryMapAttr) && !newComputeOps.empty())
+                  {
+                    Operation *gather = newComputeOps.back().getDefiningOp();
+                    gather->setAttr(kUnaryMapAttr, itComputeOp->getAttr(kUnaryMapAttr));
+                    gather->setAttr(kUnaryMapParamsAttr, itComputeOp->getAttr(kUnaryMapParamsAttr));
+                  }
+                  /// So does the order of the rows of the output, which is set when gathering
+                  if (itComputeOp->hasAttr(kSortedOutputAttr) && !newComputeOps.empty())
+                  {
+                    Operation *gather = newComputeOps.back().getDefiningOp();
+                    gather->setAttr(kSortedOutputAttr, itComputeOp->getAttr(kSortedOutputAttr));
+                  }
                 }
     /// initially here workspaceOutput content
 
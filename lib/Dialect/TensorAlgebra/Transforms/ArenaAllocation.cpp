@@ -0,0 +1,191 @@
+//===- ArenaAllocation.cpp - Allocate the temporary buffers of functions from an arena ---===//
+//
+// Copyright 2022 Battelle Memorial Institute
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+// and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+// and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//===----------------------------------------------------------------------===//
+//
+/// This file implements a pass that allocates the temporary buffers of a function, e.g., the workspaces, the mark
+/// arrays and the transposed copies of tensors, from the arena of the runtime instead of malloc. Every buffer is a
+/// view of the bytes the arena bumps, and all the buffers of a call are released at once when the function returns.
+//===----------------------------------------------------------------------===//
+
+#include "comet/Dialect/TensorAlgebra/Passes.h"
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/Bufferization/IR/Bufferization.h"
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Dialect/LLVMIR/LLVMDialect.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+#include "mlir/Pass/Pass.h"
+
+#include <vector>
+
+using namespace mlir;
+
+#define DEBUG_TYPE "arena-allocation"
+
+// *********** For debug purpose *********//
+// #define COMET_DEBUG_MODE
+#include "comet/Utils/debug.h"
+#undef COMET_DEBUG_MODE
+// *********** For debug purpose *********//
+
+namespace
+{
+  struct ArenaAllocationPass
+      : public PassWrapper<ArenaAllocationPass, OperationPass<func::FuncOp>>
+  {
+    MLIR_DEFINE_EXPLICIT_INTERNAL_INLINE_TYPE_ID(ArenaAllocationPass)
+    void runOnOperation() override;
+  };
+} /// namespace
+
+/// Size in bytes of the elements of a buffer of the arena, 0 for the element types it does not allocate
+static int64_t getElementBytes(Type type)
+{
+  if (type.isa<IndexType>())
+    return 8;
+  if (type.isIntOrFloat())
+    return (type.getIntOrFloatBitWidth() + 7) / 8;
+  return 0;
+}
+
+/// A result of any type but scalars and vectors may alias the buffers of the operation, e.g., the memref of a view
+/// or the !ta.sparse_tensor a SparseTensorConstructOp builds from the tensors of its arrays
+static bool mayAliasBuffers(Type type)
+{
+  return !type.isIntOrIndexOrFloat() && !type.isa<VectorType>();
+}
+
+/// A temporary buffer lives until the function returns at the latest: it is not returned, yielded out of a region
+/// or captured by an operation the pass does not know about, and only the buffer itself is released
+static bool isTemporaryBuffer(memref::AllocOp alloc)
+{
+  MemRefType type = alloc.getType();
+  if (!type.getLayout().isIdentity() || type.getMemorySpace() || getElementBytes(type.getElementType()) == 0)
+    return false;
+
+  std::vector<Value> aliases = {alloc.getResult()};
+  while (!aliases.empty())
+  {
+    Value alias = aliases.back();
+    aliases.pop_back();
+    for (Operation *user : alias.getUsers())
+    {
+      if (isa<memref::DeallocOp>(user))
+      {
+        if (alias != alloc.getResult())
+          return false;
+      }
+      else if (isa<ViewLikeOpInterface, bufferization::ToTensorOp, bufferization::ToMemrefOp>(user))
+      {
+        aliases.insert(aliases.end(), user->getResults().begin(), user->getResults().end());
+      }
+      else if (user->hasTrait<OpTrait::ReturnLike>() || llvm::any_of(user->getResultTypes(), mayAliasBuffers))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Declares a function of the runtime, if the module does not declare it yet
+static void declareArenaFunc(ModuleOp module, StringRef name, FunctionType type, bool emitCInterface = false)
+{
+  if (module.lookupSymbol<func::FuncOp>(name))
+    return;
+  OpBuilder builder(module.getBodyRegion());
+  auto func = builder.create<func::FuncOp>(module.getLoc(), name, type);
+  func.setPrivate();
+  /// The runtime returns the buffer through the C interface, as a pointer to its descriptor
+  if (emitCInterface)
+    func->setAttr(LLVM::LLVMDialect::getEmitCWrapperAttrName(), builder.getUnitAttr());
+}
+
+void ArenaAllocationPass::runOnOperation()
+{
+  func::FuncOp func = getOperation();
+  if (func.isExternal())
+    return;
+
+  /// The buffers allocated in loops would accumulate in the arena until the function returns
+  std::vector<memref::AllocOp> allocs;
+  for (auto alloc : func.getBody().front().getOps<memref::AllocOp>())
+  {
+    if (isTemporaryBuffer(alloc))
+      allocs.push_back(alloc);
+  }
+  if (allocs.empty())
+    return;
+  comet_debug() << "Allocate " << allocs.size() << " buffers of " << func.getName() << " from the arena\n";
+
+  MLIRContext *ctx = &getContext();
+  ModuleOp module = func->getParentOfType<ModuleOp>();
+  Type i64Type = IntegerType::get(ctx, 64);
+  IndexType indexType = IndexType::get(ctx);
+  MemRefType bytesType = MemRefType::get({ShapedType::kDynamic}, IntegerType::get(ctx, 8));
+  declareArenaFunc(module, "comet_arena_mark", FunctionType::get(ctx, {}, {i64Type}));
+  declareArenaFunc(module, "comet_arena_release", FunctionType::get(ctx, {i64Type}, {}));
+  declareArenaFunc(module, "comet_arena_alloc", FunctionType::get(ctx, {indexType}, {bytesType}), true);
+
+  Location loc = func.getLoc();
+  OpBuilder builder = OpBuilder::atBlockBegin(&func.getBody().front());
+  Value mark = builder.create<func::CallOp>(loc, "comet_arena_mark", TypeRange{i64Type}).getResult(0);
+
+  for (auto alloc : allocs)
+  {
+    comet_pdump(alloc);
+    builder.setInsertionPoint(alloc);
+    MemRefType type = alloc.getType();
+    Value bytes = builder.create<arith::ConstantIndexOp>(alloc.getLoc(), getElementBytes(type.getElementType()));
+    unsigned dynamicDim = 0;
+    for (int64_t dim : type.getShape())
+    {
+      Value size = ShapedType::isDynamic(dim) ? alloc.getDynamicSizes()[dynamicDim++]
+                                              : builder.create<arith::ConstantIndexOp>(alloc.getLoc(), dim);
+      bytes = builder.create<arith::MulIOp>(alloc.getLoc(), bytes, size);
+    }
+    Value buffer = builder.create<func::CallOp>(alloc.getLoc(), "comet_arena_alloc", TypeRange{bytesType},
+                                                ValueRange{bytes})
+                       .getResult(0);
+    Value offset = builder.create<arith::ConstantIndexOp>(alloc.getLoc(), 0);
+    Value view = builder.create<memref::ViewOp>(alloc.getLoc(), type, buffer, offset, alloc.getDynamicSizes());
+
+    for (Operation *user : llvm::make_early_inc_range(alloc->getUsers()))
+    {
+      if (isa<memref::DeallocOp>(user))
+        user->erase();
+    }
+    alloc.getResult().replaceAllUsesWith(view);
+    alloc->erase();
+  }
+
+  /// Bulk release of the buffers when the function returns
+  func.walk([&](func::ReturnOp returnOp)
+            {
+              builder.setInsertionPoint(returnOp);
+              builder.create<func::CallOp>(returnOp.getLoc(), "comet_arena_release", TypeRange{}, ValueRange{mark}); });
+}
+
+std::unique_ptr<Pass> mlir::comet::createArenaAllocationPass()
+{
+  return std::make_unique<ArenaAllocationPass>();
+}
@@ -64,7 +64,6 @@ template <typename t>
 bool isNeedTensorDecl(t op)
 {
   bool isUsedInSetSource = true;
-  std::string op_str = dump2str(op);
   mlir::Value result = op.getOperation()->getResult(0);
   comet_debug() << " ";
   comet_vdump(result);
@@ -80,8 +79,7 @@ bool isNeedTensorDecl(t op)
       for (unsigned int i = 0; i < p->getNumOperands(); i++)
       {
         comet_debug() << " the " << i << "th operand\n";
-        std::string n_str = dump2str(p->getOperand(i));
-        if (n_str.compare(0, op_str.size(), op_str) == 0)
+        if (p->getOperand(i) == result)
         {
           comet_debug() << " FIND IT: " << i << "\n";
           if (i == 0)
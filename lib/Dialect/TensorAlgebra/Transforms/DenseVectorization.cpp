@@ -0,0 +1,100 @@
+//===- DenseVectorization.cpp - Vectorize the innermost loops of dense operations------------------===//
+//
+// Copyright 2022 Battelle Memorial Institute
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+// and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+// and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//===----------------------------------------------------------------------===//
+//
+/// This file implements a pass that vectorizes the innermost loops of the lowered dense operations, such as the
+/// elementwise operations, the fills, the copies and the reductions, once they are all converted to loops.
+//===----------------------------------------------------------------------===//
+
+#include "comet/Dialect/TensorAlgebra/Passes.h"
+#include "comet/Dialect/Utils/Utils.h"
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Dialect/Vector/IR/VectorOps.h"
+#include "mlir/Interfaces/LoopLikeInterface.h"
+#include "mlir/Pass/Pass.h"
+
+#include <vector>
+
+using namespace mlir;
+using namespace mlir::tensorAlgebra;
+
+#define DEBUG_TYPE "dense-vectorization"
+
+// *********** For debug purpose *********//
+// #define COMET_DEBUG_MODE
+#include "comet/Utils/debug.h"
+#undef COMET_DEBUG_MODE
+// *********** For debug purpose *********//
+
+namespace
+{
+  struct DenseLoopVectorizationPass
+      : public PassWrapper<DenseLoopVectorizationPass, OperationPass<func::FuncOp>>
+  {
+    MLIR_DEFINE_EXPLICIT_INTERNAL_INLINE_TYPE_ID(DenseLoopVectorizationPass)
+    DenseLoopVectorizationPass(unsigned vectorWidth) : vectorWidth(vectorWidth){};
+    void runOnOperation() override;
+
+    void getDependentDialects(DialectRegistry &registry) const override
+    {
+      registry.insert<vector::VectorDialect>();
+    }
+
+  private:
+    /// Number of elements of the vector operations
+    unsigned vectorWidth;
+  };
+} /// namespace
+
+void DenseLoopVectorizationPass::runOnOperation()
+{
+  if (vectorWidth < 2)
+    return;
+
+  std::vector<scf::ForOp> innermostLoops;
+  getOperation().walk([&](scf::ForOp forOp)
+                      {
+    bool isInnermost = true;
+    forOp.getBody()->walk([&](Operation *op)
+                          {
+      if (isa<LoopLikeOpInterface>(op))
+        isInnermost = false; });
+    if (isInnermost)
+      innermostLoops.push_back(forOp); });
+
+  for (auto forOp : innermostLoops)
+  {
+    VectorizableLoop loop;
+    if (isVectorizableLoop(forOp, loop))
+    {
+      comet_debug() << " Vectorize the loop:\n";
+      comet_vdump(forOp);
+      vectorizeLoop(forOp, vectorWidth, loop);
+    }
+  }
+}
+
+std::unique_ptr<Pass> mlir::comet::createDenseLoopVectorizationPass(unsigned vectorWidth)
+{
+  return std::make_unique<DenseLoopVectorizationPass>(vectorWidth);
+}
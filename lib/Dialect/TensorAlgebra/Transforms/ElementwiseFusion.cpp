@@ -0,0 +1,251 @@
+//===- ElementwiseFusion.cpp - Fuse chains of elementwise operations into their output------------------===//
+//
+// Copyright 2022 Battelle Memorial Institute
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+// and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+// and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//===----------------------------------------------------------------------===//
+//
+/// This file implements a pass that fuses chains of elementwise additions and subtractions with a dense output,
+/// such as D = A + B - C, into accumulations of every term in the output, so that no temporary tensor is declared
+/// for the intermediate results. The index trees of the accumulations share their loops after partial fusion.
+//===----------------------------------------------------------------------===//
+
+#include "comet/Dialect/TensorAlgebra/IR/TADialect.h"
+#include "comet/Dialect/TensorAlgebra/Passes.h"
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Pass/Pass.h"
+
+#include <vector>
+
+using namespace mlir;
+using namespace mlir::tensorAlgebra;
+
+#define DEBUG_TYPE "elementwise-fusion"
+
+// *********** For debug purpose *********//
+// #define COMET_DEBUG_MODE
+#include "comet/Utils/debug.h"
+#undef COMET_DEBUG_MODE
+// *********** For debug purpose *********//
+
+namespace
+{
+  struct ElementwiseChainFusionPass
+      : public PassWrapper<ElementwiseChainFusionPass, OperationPass<func::FuncOp>>
+  {
+    MLIR_DEFINE_EXPLICIT_INTERNAL_INLINE_TYPE_ID(ElementwiseChainFusionPass)
+    void runOnOperation() override;
+  };
+
+  /// A term of a chain, added to or subtracted from the output
+  struct ChainTerm
+  {
+    Value tensor;
+    std::string format;
+    bool negated;
+  };
+} /// namespace
+
+/// Formats and indexing maps of an addition or a subtraction
+static ArrayAttr getFormats(Operation *op)
+{
+  if (auto addOp = dyn_cast<TensorAddOp>(op))
+    return addOp.getFormats();
+  return cast<TensorSubtractOp>(op).getFormats();
+}
+
+static ArrayAttr getIndexingMaps(Operation *op)
+{
+  if (auto addOp = dyn_cast<TensorAddOp>(op))
+    return addOp.getIndexingMaps();
+  return cast<TensorSubtractOp>(op).getIndexingMaps();
+}
+
+/// True for a standard elementwise addition or subtraction whose operands and result have the same index order
+static bool isChainOp(Operation *op)
+{
+  if (!op || !isa<TensorAddOp, TensorSubtractOp>(op))
+    return false;
+
+  StringAttr semiring = op->getAttrOfType<StringAttr>("semiring");
+  StringAttr maskType = op->getAttrOfType<StringAttr>("MaskType");
+  if (!semiring || (semiring.getValue() != "noop_plusxy" && semiring.getValue() != "noop_minus"))
+    return false;
+  if (maskType && maskType.getValue() != "none")
+    return false;
+
+  return llvm::all_of(getIndexingMaps(op), [](Attribute map)
+                      { return map.cast<AffineMapAttr>().getValue().isIdentity(); });
+}
+
+/// Flattens the chain rooted at op into its terms, in the order of evaluation. The operands that are the
+/// results of other operations of the chain, with no other use, are expanded in place.
+static void collectChainTerms(Operation *op, bool negated, std::vector<ChainTerm> &terms,
+                              std::vector<Operation *> &chainOps)
+{
+  chainOps.push_back(op);
+  ArrayAttr formats = getFormats(op);
+  for (unsigned i = 0; i < 2; i++)
+  {
+    Value operand = op->getOperand(i);
+    bool operandNegated = negated ^ (i == 1 && isa<TensorSubtractOp>(op));
+    if (isChainOp(operand.getDefiningOp()) && operand.hasOneUse())
+    {
+      collectChainTerms(operand.getDefiningOp(), operandNegated, terms, chainOps);
+    }
+    else
+    {
+      terms.push_back({operand, formats[i].cast<StringAttr>().getValue().str(), operandNegated});
+    }
+  }
+}
+
+/// A product that can be written straight into the output: identity indexing maps and at most one sparse operand,
+/// so that its lowering with a dense output iterates over the nonzeros of that operand
+static TensorElewsMultOp getFusableProduct(const ChainTerm &term, Value output)
+{
+  auto product = term.tensor.getDefiningOp<TensorElewsMultOp>();
+  if (!product || term.negated || !term.tensor.hasOneUse())
+    return nullptr;
+  if (product.getRhs1() == output || product.getRhs2() == output)
+    return nullptr;
+  if (product.getMaskTypeAttr() && product.getMaskTypeAttr().getValue() != "none")
+    return nullptr;
+  if (!llvm::all_of(product.getIndexingMaps(), [](Attribute map)
+                    { return map.cast<AffineMapAttr>().getValue().isIdentity(); }))
+    return nullptr;
+
+  ArrayAttr formats = product.getFormats();
+  if (formats[0].cast<StringAttr>().getValue() != "Dense" && formats[1].cast<StringAttr>().getValue() != "Dense")
+    return nullptr;
+  return product;
+}
+
+/// Creates output = lhs +/- rhs, with the index labels and identity maps of the chain
+static void createAccumulation(OpBuilder &builder, Location loc, Operation *root, Value output,
+                               Value lhs, StringRef lhsFormat, const ChainTerm &term)
+{
+  std::vector<Value> labels;
+  std::vector<Value> outputLabels;
+  if (auto addOp = dyn_cast<TensorAddOp>(root))
+    outputLabels = addOp.getResultIndexLabels();
+  else
+    outputLabels = cast<TensorSubtractOp>(root).getResultIndexLabels();
+  for (unsigned i = 0; i < 3; i++)
+    labels.insert(labels.end(), outputLabels.begin(), outputLabels.end());
+
+  ArrayAttr formats = builder.getStrArrayAttr({lhsFormat, term.format, "Dense"});
+  ArrayAttr maps = getIndexingMaps(root);
+  Type resultType = root->getResult(0).getType();
+
+  Value result;
+  if (term.negated)
+  {
+    result = builder.create<TensorSubtractOp>(loc, resultType, lhs, term.tensor, labels, maps, formats,
+                                              builder.getStringAttr("noop_minus"), builder.getStringAttr("none"));
+  }
+  else
+  {
+    result = builder.create<TensorAddOp>(loc, resultType, lhs, term.tensor, labels, maps, formats,
+                                         builder.getStringAttr("noop_plusxy"), builder.getStringAttr("none"));
+  }
+  builder.create<TensorSetOp>(loc, result, output);
+}
+
+/// Rewrites output = t0 +/- t1 +/- ... +/- tn into a sequence of accumulations in the output:
+///   output = 0; output = output + t0; output = output - t1; ...
+/// A leading product of the chain is written straight into the output after the fill, and when the first two
+/// terms are dense the first accumulation is output = t0 +/- t1, without the fill.
+static bool fuseChain(TensorSetOp setOp)
+{
+  Operation *root = setOp.getOperand(0).getDefiningOp();
+  Value output = setOp.getOperand(1);
+  if (!isChainOp(root) || !root->getResult(0).hasOneUse() || !output.getDefiningOp<DenseTensorDeclOp>())
+    return false;
+
+  std::vector<ChainTerm> terms;
+  std::vector<Operation *> chainOps;
+  collectChainTerms(root, false, terms, chainOps);
+  TensorElewsMultOp product = getFusableProduct(terms[0], output);
+  /// A single operation of leaf tensors has no intermediate result to fuse
+  if (chainOps.size() < 2 && !product)
+    return false;
+  for (auto &term : terms)
+  {
+    if (term.tensor == output)
+      return false;
+  }
+
+  comet_debug() << "Fuse a chain of " << chainOps.size() << " elementwise operations with " << terms.size() << " terms\n";
+  OpBuilder builder(setOp);
+  Location loc = setOp.getLoc();
+
+  unsigned first = 0;
+  if (!product && !terms[0].negated && terms[0].format == "Dense" && terms[1].format == "Dense" &&
+      !terms[0].tensor.getDefiningOp<TensorElewsMultOp>() && !terms[1].tensor.getDefiningOp<TensorElewsMultOp>())
+  {
+    createAccumulation(builder, loc, root, output, terms[0].tensor, "Dense", terms[1]);
+    first = 2;
+  }
+  else
+  {
+    builder.create<TensorFillOp>(loc, output, builder.getF64FloatAttr(0));
+    if (product)
+    {
+      /// The product is computed after the fill, and only writes the output at the nonzeros of its sparse operand
+      ArrayAttr formats = product.getFormats();
+      product->setAttr("formats", builder.getStrArrayAttr({formats[0].cast<StringAttr>().getValue(),
+                                                           formats[1].cast<StringAttr>().getValue(), "Dense"}));
+      product->moveBefore(setOp);
+      builder.create<TensorSetOp>(loc, product.getResult(), output);
+      first = 1;
+    }
+  }
+
+  for (unsigned i = first; i < terms.size(); i++)
+  {
+    createAccumulation(builder, loc, root, output, output, "Dense", terms[i]);
+  }
+
+  setOp->erase();
+  /// chainOps lists every operation before the operations of its operands
+  for (auto op : chainOps)
+  {
+    op->erase();
+  }
+  return true;
+}
+
+void ElementwiseChainFusionPass::runOnOperation()
+{
+  func::FuncOp func = getOperation();
+  std::vector<TensorSetOp> setOps;
+  func.walk([&](TensorSetOp setOp)
+            { setOps.push_back(setOp); });
+
+  for (auto setOp : setOps)
+  {
+    fuseChain(setOp);
+  }
+}
+
+std::unique_ptr<Pass> mlir::comet::createElementwiseChainFusionPass()
+{
+  return std::make_unique<ElementwiseChainFusionPass>();
+}
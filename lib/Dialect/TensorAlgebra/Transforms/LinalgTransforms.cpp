@@ -28,6 +28,7 @@
 #include "comet/Dialect/TensorAlgebra/IR/TADialect.h"
 #include "comet/Dialect/TensorAlgebra/Passes.h"
 #include "comet/Dialect/Utils/Utils.h"
+#include "comet/ExecutionEngine/blis_interface.h"
 
 #include "mlir/Dialect/Affine/IR/AffineOps.h"
 #include "mlir/Dialect/Linalg/IR/Linalg.h"
@@ -77,6 +78,9 @@ namespace
   // Marker used as attribute name in generated Linalg rewriting transformations.
   const StringLiteral kLinalgTransformMarker = "__with_tiling__";
   std::string linalgMatmulUkrFname = "linalg_matmul_viewsxs_viewsxs_viewsxs";
+  std::string linalgMatmulPackedFname = "linalg_matmul_packed_viewsxs_viewsxs_viewsxs";
+  std::string linalgMatmulUkrF32Fname = "linalg_matmul_f32_viewsxs_viewsxs_viewsxs";
+  std::string linalgMatmulPackedF32Fname = "linalg_matmul_packed_f32_viewsxs_viewsxs_viewsxs";
 
   /// Helper class to control application of linalg transformation patterns.
   /// Control comes in 2 forms:
@@ -247,23 +251,46 @@ void get_level3_blocksizes(int *mc, int *kc, int *nc, int *mr, int *nr, int size
 {
   /// Query a native context.
   const cntx_t *cntx = bli_gks_query_nat_cntx();
+  num_t dt = size_dt == sizeof(float) ? BLIS_FLOAT : BLIS_DOUBLE;
 
-  *mc = (int)bli_cntx_get_blksz_def_dt(BLIS_DOUBLE, BLIS_MC, cntx);
-  *kc = (int)bli_cntx_get_blksz_def_dt(BLIS_DOUBLE, BLIS_KC, cntx);
-  *nc = (int)bli_cntx_get_blksz_def_dt(BLIS_DOUBLE, BLIS_NC, cntx);
-  *mr = (int)bli_cntx_get_blksz_def_dt(BLIS_DOUBLE, BLIS_MR, cntx);
-  *nr = (int)bli_cntx_get_blksz_def_dt(BLIS_DOUBLE, BLIS_NR, cntx);
+  *mc = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_MC, cntx);
+  *kc = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_KC, cntx);
+  *nc = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_NC, cntx);
+  *mr = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_MR, cntx);
+  *nr = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_NR, cntx);
+
+  /// The register blocking has to match the micro-kernel that the runtime dispatches to
+  const CometGemmUkrInfo &ukr = comet_query_gemm_ukr();
+  if (dt == BLIS_FLOAT && ukr.sgemm)
+  {
+    *mr = ukr.smr;
+    *nr = ukr.snr;
+  }
+  else if (dt == BLIS_DOUBLE && ukr.dgemm)
+  {
+    *mr = ukr.dmr;
+    *nr = ukr.dnr;
+  }
 
   /// printf("mc= %d, kc= %d, nc=%d, mr=%d, nr=%d\n", *mc, *kc, *nc, *mr, *nr);
   return;
 }
 
+/// Element type of the output of a linalg.matmul, i.e., its last operand
+static Type getOutputElementType(Operation *op)
+{
+  if (!isa<MatmulOp>(op) || op->getNumOperands() == 0)
+    return Type();
+  return getElementTypeOrSelf(op->getOperand(op->getNumOperands() - 1).getType());
+}
+
 static void addPatternForTiling(MLIRContext *context,
                                 RewritePatternSet &patterns,
                                 StringRef filterName,
                                 StringRef updatedFilterName,
                                 ArrayRef<int64_t> tileSizes,
-                                ArrayRef<int64_t> interchange = {})
+                                ArrayRef<int64_t> interchange = {},
+                                Type elementType = Type())
 {
   scf::SCFTilingOptions tilingOptions;
   SmallVector<OpFoldResult> tileSizesOfr =
@@ -271,6 +298,10 @@ static void addPatternForTiling(MLIRContext *context,
   tilingOptions.setTileSizes(tileSizesOfr).setInterchange(interchange);
   LinalgTransformationFilter filter(StringAttr::get(context, filterName),
                                     StringAttr::get(context, updatedFilterName));
+  /// The block sizes depend on the datatype, only tile the operations of elementType
+  if (elementType)
+    filter.addFilter([elementType](Operation *op)
+                     { return success(getOutputElementType(op) == elementType); });
   patterns.add<LinalgTilingLoops>(context, tilingOptions, filter);
 }
 
@@ -286,11 +317,15 @@ namespace
       MLIRContext *ctx = func.getContext();
       RewritePatternSet tilingPatterns(ctx);
 
-      int mc, kc, nc, mr, nr = 0;
-      get_level3_blocksizes(&mc, &kc, &nc, &mr, &nr, sizeof(double));
+      /// Tile sizes of the single- and double-precision micro-kernels of the running micro-architecture
+      for (Type elementType : {(Type)Float32Type::get(ctx), (Type)Float64Type::get(ctx)})
+      {
+        int mc, kc, nc, mr, nr = 0;
+        get_level3_blocksizes(&mc, &kc, &nc, &mr, &nr, elementType.getIntOrFloatBitWidth() / 8);
 
-      addPatternForTiling(ctx, tilingPatterns, "__with_tiling__", "__L2__with_tiling__", {mc, nc, kc}, {1, 2, 0});
-      addPatternForTiling(ctx, tilingPatterns, "__L2__with_tiling__", "__micro_kernel__", {mr, nr, kc}, {1, 0, 2});
+        addPatternForTiling(ctx, tilingPatterns, "__with_tiling__", "__L2__with_tiling__", {mc, nc, kc}, {1, 2, 0}, elementType);
+        addPatternForTiling(ctx, tilingPatterns, "__L2__with_tiling__", "__micro_kernel__", {mr, nr, kc}, {1, 0, 2}, elementType);
+      }
 
       if (failed(applyPatternsAndFoldGreedily(getOperation(),
                                               std::move(tilingPatterns))))
@@ -320,11 +355,19 @@ static MemRefType makeStridedLayoutDynamic(MemRefType type)
       SmallVector<int64_t>(type.getRank(), ShapedType::kDynamic)));
 }
 
+/// Same as makeStridedLayoutDynamic, but also drops the static sizes so that
+/// matmuls of different shapes share a single library function declaration.
+static MemRefType makeShapeAndStridedLayoutDynamic(MemRefType type)
+{
+  SmallVector<int64_t> dynamicShape(type.getRank(), ShapedType::kDynamic);
+  return MemRefType::Builder(makeStridedLayoutDynamic(type)).setShape(dynamicShape);
+}
+
 /// Helper function to extract the operand types that are passed to the
 /// generated CallOp. MemRefTypes have their layout canonicalized since the
 /// information is not used in signature generation.
-/// Note that static size information is not modified.
-static SmallVector<Type, 4> extractOperandTypes(Operation *op)
+/// Note that static size information is not modified, unless dynamicShape is set.
+static SmallVector<Type, 4> extractOperandTypes(Operation *op, bool dynamicShape = false)
 {
   SmallVector<Type, 4> result;
   result.reserve(op->getNumOperands());
@@ -334,7 +377,8 @@ static SmallVector<Type, 4> extractOperandTypes(Operation *op)
     /// information. Canonicalizing the type at the level of std when going into
     /// a library call avoids needing to introduce DialectCastOp.
     if (auto memrefType = type.dyn_cast<MemRefType>())
-      result.push_back(makeStridedLayoutDynamic(memrefType));
+      result.push_back(dynamicShape ? makeShapeAndStridedLayoutDynamic(memrefType)
+                                    : makeStridedLayoutDynamic(memrefType));
     else
       result.push_back(type);
   }
@@ -344,7 +388,7 @@ static SmallVector<Type, 4> extractOperandTypes(Operation *op)
 
 static SmallVector<Value, 4>
 createTypeCanonicalizedMemRefOperands(OpBuilder &b, Location loc,
-                                      ValueRange operands)
+                                      ValueRange operands, bool dynamicShape = false)
 {
   SmallVector<Value, 4> res;
   res.reserve(operands.size());
@@ -357,7 +401,9 @@ createTypeCanonicalizedMemRefOperands(OpBuilder &b, Location loc,
       continue;
     }
     Value cast =
-        b.create<memref::CastOp>(loc, makeStridedLayoutDynamic(memrefType), op);
+        b.create<memref::CastOp>(loc, dynamicShape ? makeShapeAndStridedLayoutDynamic(memrefType)
+                                                   : makeStridedLayoutDynamic(memrefType),
+                                 op);
     res.push_back(cast);
   }
   return res;
@@ -365,9 +411,12 @@ createTypeCanonicalizedMemRefOperands(OpBuilder &b, Location loc,
 
 /// Get a SymbolRefAttr containing the library function name for the LinalgOp.
 /// If the library function does not exist, insert a declaration.
-static FailureOr<FlatSymbolRefAttr> getLibraryCallSymbolRef(Operation *op, PatternRewriter &rewriter)
+/// numBlockSizes i32 block size arguments (e.g., mr and nr) follow the operands.
+static FailureOr<FlatSymbolRefAttr> getLibraryCallSymbolRef(Operation *op, PatternRewriter &rewriter,
+                                                            const std::string &fnName,
+                                                            unsigned numBlockSizes,
+                                                            bool dynamicShape = false)
 {
-  auto fnName = linalgMatmulUkrFname;
   if (fnName.empty())
     return rewriter.notifyMatchFailure(op, "No library call defined for: ");
 
@@ -378,11 +427,11 @@ static FailureOr<FlatSymbolRefAttr> getLibraryCallSymbolRef(Operation *op, Patte
   if (module.lookupSymbol(fnNameAttr.getAttr()))
     return fnNameAttr;
 
-  SmallVector<Type, 4> inputTypes(extractOperandTypes(op));
+  SmallVector<Type, 4> inputTypes(extractOperandTypes(op, dynamicShape));
 
-  /// Add inputTypes for mr and nr
-  inputTypes.push_back(IntegerType::get(rewriter.getContext(), 32));
-  inputTypes.push_back(IntegerType::get(rewriter.getContext(), 32));
+  /// Add inputTypes for the block sizes
+  for (unsigned i = 0; i < numBlockSizes; i++)
+    inputTypes.push_back(IntegerType::get(rewriter.getContext(), 32));
 
   if (op->getNumResults() != 0)
   {
@@ -414,28 +463,55 @@ LogicalResult LinalgMatMulOpToLibraryCallPattern::matchAndRewrite(
   if (!isa<MatmulOp>(op))
     return failure();
 
-  auto libraryCallName = getLibraryCallSymbolRef(op, rewriter);
+  /// A matmul that still carries the marker set by the TTGT lowering was not tiled by the matmul tiling pass.
+  /// It is replaced as a whole with the packed GEMM driver, which performs the cache blocking, the packing of
+  /// the A and B panels and the multithreading of the BLIS five-loop structure at runtime.
+  /// Tiles produced by the tiling pass are replaced with a direct call to the micro-kernel instead.
+  auto marker = op->getAttrOfType<StringAttr>(kLinalgTransformMarker);
+  bool isUntiled = marker && marker.getValue() == kLinalgTransformMarker;
+
+  /// The runtime provides single- and double-precision micro-kernels
+  Type elementType = getOutputElementType(op);
+  if (!elementType || !(elementType.isF32() || elementType.isF64()))
+    return rewriter.notifyMatchFailure(op, "The micro-kernels only support f32 and f64 matrices");
+  for (auto type : op->getOperandTypes())
+  {
+    auto memrefType = type.dyn_cast<MemRefType>();
+    if (!memrefType || memrefType.getElementType() != elementType)
+      return rewriter.notifyMatchFailure(op, "The micro-kernels expect memref operands of a single element type");
+  }
+
+  bool isF32 = elementType.isF32();
+  auto libraryCallName = isUntiled ? getLibraryCallSymbolRef(op, rewriter, isF32 ? linalgMatmulPackedF32Fname : linalgMatmulPackedFname, 5, true)
+                                   : getLibraryCallSymbolRef(op, rewriter, isF32 ? linalgMatmulUkrF32Fname : linalgMatmulUkrFname, 2);
   if (failed(libraryCallName))
     return failure();
 
   int mc, kc, nc, mr, nr = 0;
-  get_level3_blocksizes(&mc, &kc, &nc, &mr, &nr, sizeof(double));
+  get_level3_blocksizes(&mc, &kc, &nc, &mr, &nr, isF32 ? sizeof(float) : sizeof(double));
 
   IntegerType i32Type = IntegerType::get(rewriter.getContext(), 32);
-  Value mrValue = rewriter.create<ConstantOp>(op->getLoc(), i32Type, rewriter.getIntegerAttr(i32Type, mr));
-  Value nrValue = rewriter.create<ConstantOp>(op->getLoc(), i32Type, rewriter.getIntegerAttr(i32Type, nr));
-
-  comet_vdump(mrValue);
-  comet_vdump(nrValue);
+  auto createBlockSize = [&](int value) -> Value
+  {
+    return rewriter.create<ConstantOp>(op->getLoc(), i32Type, rewriter.getIntegerAttr(i32Type, value));
+  };
 
   std::vector<Value> operands;
   operands.insert(operands.end(), op->getOperands().begin(), op->getOperands().end());
-  operands.push_back(mrValue);
-  operands.push_back(nrValue);
+  if (isUntiled)
+  {
+    operands.push_back(createBlockSize(mc));
+    operands.push_back(createBlockSize(kc));
+    operands.push_back(createBlockSize(nc));
+  }
+  operands.push_back(createBlockSize(mr));
+  operands.push_back(createBlockSize(nr));
+
+  comet_debug() << "Replacing linalg.matmul with a call to " << libraryCallName->getValue() << "\n";
 
   rewriter.replaceOpWithNewOp<func::CallOp>(
       op, libraryCallName->getValue(), TypeRange(),
-      createTypeCanonicalizedMemRefOperands(rewriter, op->getLoc(), operands));
+      createTypeCanonicalizedMemRefOperands(rewriter, op->getLoc(), operands, isUntiled));
   return success();
 }
 
@@ -452,7 +528,7 @@ namespace
 
       RewritePatternSet patterns(&getContext());
 
-      /// Replace the inner linalg.matmul with the blis microkernel
+      /// Replace the inner linalg.matmul with the blis microkernel, or an untiled linalg.matmul with the packed GEMM driver
       patterns.insert<LinalgMatMulOpToLibraryCallPattern>(ctx);
       (void)applyPatternsAndFoldGreedily(func, std::move(patterns));
     }
@@ -0,0 +1,278 @@
+//===- MemoryPlanning.cpp - Liveness-based reuse and release of temporary buffers------------------===//
+//
+// Copyright 2022 Battelle Memorial Institute
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+// and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+// and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//===----------------------------------------------------------------------===//
+//
+/// This file implements a pass that plans the memory of the buffers allocated by the lowering of tensor declarations
+/// and of the TTGT transposes: a buffer is freed right after its last use, and a buffer whose lifetime has ended is
+/// reused by a later allocation of the same type, instead of every buffer living until the end of the function.
+//===----------------------------------------------------------------------===//
+
+#include "comet/Dialect/TensorAlgebra/Passes.h"
+#include "mlir/Dialect/Bufferization/IR/Bufferization.h"
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Interfaces/ControlFlowInterfaces.h"
+#include "mlir/Interfaces/ViewLikeInterface.h"
+#include "mlir/Pass/Pass.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace mlir;
+
+#define DEBUG_TYPE "memory-planning"
+
+// *********** For debug purpose *********//
+// #define COMET_DEBUG_MODE
+#include "comet/Utils/debug.h"
+#undef COMET_DEBUG_MODE
+// *********** For debug purpose *********//
+
+namespace
+{
+  /// A buffer allocated in the entry block of a function. Its lifetime spans the positions, in the entry block,
+  /// of its allocation and of the last operation that uses it or one of its views.
+  struct BufferLifetime
+  {
+    memref::AllocOp alloc;
+    unsigned begin, end;
+    /// The dealloc of the buffer, if it is released
+    memref::DeallocOp dealloc;
+    /// The buffer is returned, yielded out of a region or captured by an operation the pass does not know about
+    bool escapes = false;
+  };
+
+  struct MemoryPlanningPass
+      : public PassWrapper<MemoryPlanningPass, OperationPass<func::FuncOp>>
+  {
+    MLIR_DEFINE_EXPLICIT_INTERNAL_INLINE_TYPE_ID(MemoryPlanningPass)
+    MemoryPlanningPass(bool printStats) : printStats(printStats){};
+    void runOnOperation() override;
+
+  private:
+    /// Report the peak bytes of the statically sized buffers before and after planning
+    bool printStats;
+  };
+} /// namespace
+
+/// Size in bytes of a statically shaped buffer, 0 for a dynamically shaped one
+static uint64_t getStaticBufferBytes(MemRefType type)
+{
+  if (!type.hasStaticShape())
+    return 0;
+
+  Type elType = type.getElementType();
+  uint64_t elBytes = elType.isIndex() ? 8 : (elType.getIntOrFloatBitWidth() + 7) / 8;
+  return type.getNumElements() * elBytes;
+}
+
+/// Computes the lifetime of a buffer allocated in the entry block, following the views of the buffer
+static BufferLifetime getBufferLifetime(memref::AllocOp alloc, Block &entry,
+                                        const llvm::DenseMap<Operation *, unsigned> &positions)
+{
+  BufferLifetime lifetime;
+  lifetime.alloc = alloc;
+  lifetime.begin = lifetime.end = positions.lookup(alloc);
+
+  std::vector<Value> aliases = {alloc.getResult()};
+  while (!aliases.empty())
+  {
+    Value alias = aliases.back();
+    aliases.pop_back();
+    for (OpOperand &use : alias.getUses())
+    {
+      Operation *user = use.getOwner();
+      Operation *ancestor = entry.findAncestorOpInBlock(*user);
+      if (ancestor == nullptr)
+      {
+        lifetime.escapes = true;
+        continue;
+      }
+
+      if (auto dealloc = dyn_cast<memref::DeallocOp>(user))
+      {
+        /// Only the unconditional release of the buffer itself is moved
+        if (ancestor == user && alias == alloc.getResult())
+          lifetime.dealloc = dealloc;
+        else
+          lifetime.escapes = true;
+        continue;
+      }
+
+      lifetime.end = std::max(lifetime.end, positions.lookup(ancestor));
+      if (isa<ViewLikeOpInterface, bufferization::ToTensorOp, bufferization::ToMemrefOp>(user))
+      {
+        for (Value result : user->getResults())
+          aliases.push_back(result);
+      }
+      else if (user->hasTrait<OpTrait::ReturnLike>() ||
+               llvm::any_of(user->getResultTypes(), [](Type type)
+                            { return type.isa<BaseMemRefType, TensorType>(); }))
+      {
+        /// The buffer may outlive the operation, through its results
+        lifetime.escapes = true;
+      }
+    }
+  }
+  return lifetime;
+}
+
+/// Peak of the bytes of the statically sized buffers live at the same time
+static uint64_t getPeakBytes(const std::vector<BufferLifetime> &lifetimes, unsigned blockEnd)
+{
+  std::vector<std::pair<unsigned, int64_t>> events;
+  for (auto &lifetime : lifetimes)
+  {
+    int64_t bytes = getStaticBufferBytes(lifetime.alloc.getType());
+    unsigned release = lifetime.escapes ? blockEnd : (lifetime.dealloc ? lifetime.end + 1 : blockEnd);
+    events.push_back({lifetime.begin, bytes});
+    events.push_back({release, -bytes});
+  }
+  /// at the same position, releases happen before allocations
+  std::sort(events.begin(), events.end());
+
+  int64_t live = 0, peak = 0;
+  for (auto &event : events)
+  {
+    live += event.second;
+    peak = std::max(peak, live);
+  }
+  return peak;
+}
+
+void MemoryPlanningPass::runOnOperation()
+{
+  func::FuncOp func = getOperation();
+  if (func.isExternal())
+    return;
+
+  Block &entry = func.getBody().front();
+  llvm::DenseMap<Operation *, unsigned> positions;
+  std::vector<Operation *> ops;
+  for (Operation &op : entry)
+  {
+    positions[&op] = ops.size();
+    ops.push_back(&op);
+  }
+  unsigned blockEnd = ops.size();
+
+  std::vector<BufferLifetime> lifetimes;
+  unsigned numDynamicBuffers = 0;
+  for (Operation &op : entry)
+  {
+    if (auto alloc = dyn_cast<memref::AllocOp>(&op))
+    {
+      lifetimes.push_back(getBufferLifetime(alloc, entry, positions));
+      numDynamicBuffers += !alloc.getType().hasStaticShape();
+    }
+  }
+
+  /// The existing deallocs are where the buffers are released, the peak is computed on that basis
+  std::vector<BufferLifetime> before = lifetimes;
+  for (auto &lifetime : before)
+  {
+    if (lifetime.dealloc)
+      lifetime.end = positions.lookup(lifetime.dealloc);
+  }
+  uint64_t peakBefore = getPeakBytes(before, blockEnd);
+
+  /// Reuse in place: an allocation takes the buffer of an earlier allocation of the same type and sizes,
+  /// whose last use precedes it. lifetimes are in the order of the allocations.
+  unsigned numReused = 0;
+  std::vector<bool> isReused(lifetimes.size(), false);
+  for (size_t i = 0; i < lifetimes.size(); i++)
+  {
+    BufferLifetime &receiver = lifetimes[i];
+    if (receiver.escapes || receiver.end == receiver.begin)
+      continue;
+
+    for (size_t j = 0; j < i; j++)
+    {
+      BufferLifetime &donor = lifetimes[j];
+      if (isReused[j] || donor.escapes || donor.end >= receiver.begin ||
+          donor.alloc.getType() != receiver.alloc.getType() ||
+          !llvm::equal(donor.alloc.getDynamicSizes(), receiver.alloc.getDynamicSizes()) ||
+          donor.alloc.getAlignmentAttr() != receiver.alloc.getAlignmentAttr())
+        continue;
+
+      comet_debug() << "Buffer reused in place:\n";
+      comet_pdump(receiver.alloc);
+      /// The donor takes over the lifetime of the receiver
+      if (donor.dealloc)
+        donor.dealloc->erase();
+      donor.dealloc = receiver.dealloc;
+      donor.end = receiver.end;
+      receiver.alloc.getResult().replaceAllUsesWith(donor.alloc.getResult());
+      receiver.alloc->erase();
+      isReused[i] = true;
+      numReused++;
+      break;
+    }
+  }
+
+  /// Release every buffer right after its last use. The positions are the ones before the reuse, whose erased
+  /// allocations and deallocs are never the last use of a buffer.
+  OpBuilder builder(func.getContext());
+  std::vector<BufferLifetime> after;
+  unsigned numReleased = 0;
+  for (size_t i = 0; i < lifetimes.size(); i++)
+  {
+    BufferLifetime &lifetime = lifetimes[i];
+    if (isReused[i])
+      continue;
+    if (!lifetime.escapes)
+    {
+      Operation *lastUse = ops[lifetime.end];
+      if (lastUse->hasTrait<OpTrait::IsTerminator>())
+      {
+        lifetime.escapes = true;
+      }
+      else
+      {
+        if (lifetime.dealloc)
+          lifetime.dealloc->erase();
+        builder.setInsertionPointAfter(lastUse);
+        lifetime.dealloc = builder.create<memref::DeallocOp>(lifetime.alloc.getLoc(), lifetime.alloc.getResult());
+        numReleased++;
+      }
+    }
+    after.push_back(lifetime);
+  }
+  uint64_t peakAfter = getPeakBytes(after, blockEnd);
+
+  if (printStats)
+  {
+    llvm::errs() << "Memory planning of " << func.getName() << ": peak " << peakBefore << " -> " << peakAfter
+                 << " bytes, " << numReused << " buffers reused, " << numReleased << " buffers released at their last use";
+    if (numDynamicBuffers > 0)
+      llvm::errs() << " (" << numDynamicBuffers << " dynamically sized buffers not counted in the peak)";
+    llvm::errs() << "\n";
+  }
+}
+
+std::unique_ptr<Pass> mlir::comet::createMemoryPlanningPass(bool printStats)
+{
+  return std::make_unique<MemoryPlanningPass>(printStats);
+}
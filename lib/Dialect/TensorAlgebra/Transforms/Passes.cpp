@@ -29,12 +29,16 @@
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 #include "mlir/Dialect/Linalg/IR/Linalg.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
 #include "mlir/Dialect/Bufferization/IR/Bufferization.h"
 
+#include "llvm/ADT/bit.h"
+
 #include <algorithm>
 #include <map>
 #include <set>
 #include <stack>
+#include <unordered_map>
 // #include <iostream>
 #define DEBUG_TYPE "comet-passes"
 
@@ -57,9 +61,14 @@ namespace
   {
   public:
     MLIR_DEFINE_EXPLICIT_INTERNAL_INLINE_TYPE_ID(FindOptimalTCFactorizationPass)
+    FindOptimalTCFactorizationPass(bool runtimeOrder) : runtimeOrder(runtimeOrder){};
     void runOnOperation() override;
 
     void FindOptimalTCFactorization(tensorAlgebra::TensorSetOp op);
+
+  private:
+    /// Select at runtime the order of chains of sparse matrix multiplications
+    bool runtimeOrder;
   }; ///  class FindOptimalTCFactorizationPass
 } ///  End anonymous namespace
 
@@ -135,86 +144,435 @@ std::vector<Operation *> findOutput(const std::vector<Operation *> &rhs1Labels,
   return result_labels;
 }
 
-std::tuple<IndexVector, std::vector<std::vector<Operation *>>, std::vector<std::vector<int64_t>>>
-optimalOrder(ArrayRef<Operation *> inLTOps, Operation *outLTOp,
-             const std::map<Operation *, int64_t> &lblSizes,
-             const std::map<Operation *, std::vector<Operation *>> &lblMaps)
+/// A contraction tree over the operands of a chain of multiplications. Nodes [0, #operands) are the operands,
+/// and step s contracts nodes lhs and rhs into node #operands + s, whose labels and shape are given.
+struct ContractionStep
 {
-  IndexVector result;
-  for (size_t i = 0; i < inLTOps.size(); i++)
-  {
-    result.push_back(i);
-  }
-
-  double minCost = std::numeric_limits<double>::max();
-  std::vector<unsigned> minResult;
-  std::vector<std::vector<Operation *>> minSumLabels;
-  std::vector<std::vector<int64_t>> minLHSTensorShapes;
-  double totalCost = 0;
-  std::map<Operation *, unsigned> labelIdMap;
+  unsigned lhs, rhs;
+  std::vector<Operation *> labels;
+  std::vector<int64_t> shape;
+};
 
-  unsigned id = 0;
-  for (auto op_size_pair : lblSizes)
+namespace
+{
+  /// Search of the cheapest contraction tree, bushy trees included, by dynamic programming over subsets of operands:
+  /// the best tree of a subset combines the memoized best trees of two disjoint subsets. Only subsets that share a
+  /// label are combined, so for chains the subsets are intervals and the search is polynomial in the chain length.
+  /// Partial trees that already cost more than the best tree of their subset, or than the original order of the chain
+  /// (an upper bound on the optimum), are pruned.
+  class ContractionTreeSearch
   {
-    auto op = op_size_pair.first;
-    labelIdMap[op] = id++;
-  }
+  public:
+    ContractionTreeSearch(ArrayRef<Operation *> inLTOps, Operation *outLTOp,
+                          const std::map<Operation *, int64_t> &lblSizes,
+                          const std::map<Operation *, std::vector<Operation *>> &lblMaps)
+        : inLTOps(inLTOps), outLTOp(outLTOp), lblSizes(lblSizes), lblMaps(lblMaps)
+    {
+      unsigned id = 0;
+      for (auto op_size_pair : lblSizes)
+      {
+        labelIdMap[op_size_pair.first] = id++;
+      }
+    }
 
-  ///  go through each and every permutation of result vector.
-  do
-  {
-    totalCost = 0;
+    /// Cost of the tree, and the tree itself, contracting the operands in the order of the chain
+    std::pair<double, std::vector<ContractionStep>> getOriginalTree() const
+    {
+      /// The operands are collected from the end of the chain
+      std::vector<ContractionStep> steps;
+      double cost = 0.0;
+      unsigned n = inLTOps.size();
+      uint64_t subset = 1ull << (n - 1);
+      std::vector<Operation *> labels = lblMaps.at(inLTOps[n - 1]);
+      unsigned node = n - 1;
+      for (unsigned i = n - 1; i-- > 0;)
+      {
+        uint64_t next = subset | (1ull << i);
+        std::vector<Operation *> outLabels = getOutputLabels(next, labels, lblMaps.at(inLTOps[i]));
+        cost += getContractionCost(labels, lblMaps.at(inLTOps[i]), outLabels);
+        steps.push_back({node, i, outLabels, getTensorShape(outLabels, lblSizes)});
+        node = n + steps.size() - 1;
+        labels = outLabels;
+        subset = next;
+      }
+      return {cost, steps};
+    }
 
-    std::vector<std::vector<Operation *>> sumLabels;
-    std::vector<std::vector<int64_t>> lhsTensorShapes;
-    std::vector<Operation *> rhs1Labels = lblMaps.at(inLTOps[result[0]]);
-    for (size_t i = 1; i < result.size(); i++)
+    /// The cheapest tree, or an empty one if no tree is cheaper than the original order of the chain
+    std::vector<ContractionStep> findBestTree(double upperBound)
     {
-      std::vector<Operation *> rhs2Labels = lblMaps.at(inLTOps[result[i]]);
+      unsigned n = inLTOps.size();
+      std::vector<std::vector<uint64_t>> subsetsBySize(n + 1);
+      for (unsigned i = 0; i < n; i++)
+      {
+        best[1ull << i] = {0.0, 0, 0, lblMaps.at(inLTOps[i])};
+        subsetsBySize[1].push_back(1ull << i);
+      }
 
-      std::set<Operation *> remainingLabels(lblMaps.at(outLTOp).begin(),
-                                            lblMaps.at(outLTOp).end());
+      for (unsigned size = 2; size <= n; size++)
+      {
+        for (unsigned lhsSize = 1; lhsSize <= size / 2; lhsSize++)
+        {
+          for (uint64_t lhs : subsetsBySize[lhsSize])
+          {
+            for (uint64_t rhs : subsetsBySize[size - lhsSize])
+            {
+              if ((lhs & rhs) || (lhsSize == size - lhsSize && lhs > rhs))
+                continue;
+
+              const SubsetPlan &lhsPlan = best.at(lhs);
+              const SubsetPlan &rhsPlan = best.at(rhs);
+              double partialCost = lhsPlan.cost + rhsPlan.cost;
+              uint64_t subset = lhs | rhs;
+              auto it = best.find(subset);
+              if (partialCost >= upperBound || (it != best.end() && partialCost >= it->second.cost))
+                continue;
+              if (!shareLabel(lhsPlan.labels, rhsPlan.labels))
+                continue;
+
+              std::vector<Operation *> outLabels = getOutputLabels(subset, lhsPlan.labels, rhsPlan.labels);
+              double cost = partialCost + getContractionCost(lhsPlan.labels, rhsPlan.labels, outLabels);
+              if (cost >= upperBound)
+                continue;
+
+              if (it == best.end())
+              {
+                best[subset] = {cost, lhs, rhs, outLabels};
+                subsetsBySize[size].push_back(subset);
+              }
+              else if (cost < it->second.cost)
+              {
+                it->second = {cost, lhs, rhs, outLabels};
+              }
+            }
+          }
+        }
+      }
 
-      for (size_t j = i + 1; j < result.size(); j++)
+      std::vector<ContractionStep> steps;
+      uint64_t all = n == 64 ? ~0ull : (1ull << n) - 1;
+      if (best.count(all))
+        buildSteps(all, steps);
+      return steps;
+    }
+
+  private:
+    struct SubsetPlan
+    {
+      double cost;
+      uint64_t lhs, rhs;
+      std::vector<Operation *> labels;
+    };
+
+    /// Labels of the contraction of the operands in subset: those still needed by the other operands or the output.
+    /// The contraction of all the operands keeps the labels, and their order, of the output.
+    std::vector<Operation *> getOutputLabels(uint64_t subset, const std::vector<Operation *> &rhs1Labels,
+                                             const std::vector<Operation *> &rhs2Labels) const
+    {
+      const std::vector<Operation *> &outLabels = lblMaps.at(outLTOp);
+      std::set<Operation *> remainingLabels(outLabels.begin(), outLabels.end());
+      bool isAll = true;
+      for (size_t i = 0; i < inLTOps.size(); i++)
       {
-        auto lblSet = lblMaps.at(inLTOps[result[j]]);
+        if (subset & (1ull << i))
+          continue;
+        isAll = false;
+        auto lblSet = lblMaps.at(inLTOps[i]);
         remainingLabels.insert(lblSet.begin(), lblSet.end());
       }
 
-      ///  find intersection of {rhs1Labels, rhs2Labels}, {remainingLabels}
-      auto lhsLabels = findOutput(rhs1Labels, rhs2Labels, remainingLabels);
-      ///  find difference of {rhs1Labels, rhs2Labels}, {lhsLabels}
-      sumLabels.push_back(getSumLabels(rhs1Labels, rhs2Labels, lhsLabels));
-      auto permA = getLabelPerm(rhs1Labels, labelIdMap);
-      auto permB = getLabelPerm(rhs2Labels, labelIdMap);
-      auto permC = getLabelPerm(lhsLabels, labelIdMap);
+      if (isAll)
+        return outLabels;
+      return findOutput(rhs1Labels, rhs2Labels, remainingLabels);
+    }
 
+    static bool shareLabel(const std::vector<Operation *> &a, const std::vector<Operation *> &b)
+    {
+      for (auto lbl : a)
+      {
+        if (std::find(b.begin(), b.end(), lbl) != b.end())
+          return true;
+      }
+      return false;
+    }
+
+    double getContractionCost(const std::vector<Operation *> &rhs1Labels, const std::vector<Operation *> &rhs2Labels,
+                              const std::vector<Operation *> &lhsLabels) const
+    {
       auto tensorShapeA = getTensorShape(rhs1Labels, lblSizes);
       auto tensorShapeB = getTensorShape(rhs2Labels, lblSizes);
       auto tensorShapeC = getTensorShape(lhsLabels, lblSizes);
-      lhsTensorShapes.push_back(tensorShapeC);
-
-      ContractionPlan plan{permA, tensorShapeA,
-                           permB, tensorShapeB,
-                           permC, tensorShapeC};
+      ContractionPlan plan{getLabelPerm(rhs1Labels, labelIdMap), tensorShapeA,
+                           getLabelPerm(rhs2Labels, labelIdMap), tensorShapeB,
+                           getLabelPerm(lhsLabels, labelIdMap), tensorShapeC};
       ///  make getTotal optional to include only the operation count or
       ///  plus the cost  operation transpose
-      totalCost += plan.getTotalTime();
-      rhs1Labels = lhsLabels;
+      return plan.getTotalTime();
+    }
+
+    /// Post-order traversal of the best tree of subset, returns the node of its root
+    unsigned buildSteps(uint64_t subset, std::vector<ContractionStep> &steps) const
+    {
+      const SubsetPlan &plan = best.at(subset);
+      if (plan.lhs == 0)
+        return llvm::countr_zero(subset);
+
+      unsigned lhs = buildSteps(plan.lhs, steps);
+      unsigned rhs = buildSteps(plan.rhs, steps);
+      steps.push_back({lhs, rhs, plan.labels, getTensorShape(plan.labels, lblSizes)});
+      return inLTOps.size() + steps.size() - 1;
+    }
+
+    ArrayRef<Operation *> inLTOps;
+    Operation *outLTOp;
+    const std::map<Operation *, int64_t> &lblSizes;
+    const std::map<Operation *, std::vector<Operation *>> &lblMaps;
+    std::map<Operation *, unsigned> labelIdMap;
+    std::unordered_map<uint64_t, SubsetPlan> best;
+  };
+} ///  namespace
+
+/// The cheapest contraction tree of the chain, or an empty tree if the original order of the chain is the cheapest
+std::vector<ContractionStep> optimalOrder(ArrayRef<Operation *> inLTOps, Operation *outLTOp,
+                                          const std::map<Operation *, int64_t> &lblSizes,
+                                          const std::map<Operation *, std::vector<Operation *>> &lblMaps)
+{
+  /// Subsets of operands are bitmasks
+  if (inLTOps.size() < 3 || inLTOps.size() > 64)
+    return {};
+
+  ContractionTreeSearch search(inLTOps, outLTOp, lblSizes, lblMaps);
+  double originalCost = search.getOriginalTree().first;
+  comet_debug() << "Cost of the original order: " << originalCost << "\n";
+
+  return search.findBestTree(originalCost);
+}
+
+/// Format of the tensor of a node of a contraction tree
+static StringRef getTensorFormat(Value tensor)
+{
+  if (auto decl = dyn_cast<DenseTensorDeclOp>(tensor.getDefiningOp()))
+    return decl.getFormat();
+  if (auto decl = dyn_cast<SparseTensorDeclOp>(tensor.getDefiningOp()))
+    return decl.getFormat();
+
+  mlir::ArrayAttr formats = cast<tensorAlgebra::TensorMultOp>(tensor.getDefiningOp()).getFormats();
+  return formats[formats.size() - 1].cast<mlir::StringAttr>().getValue();
+}
+
+/// Format of an intermediate tensor of a contraction tree, as the frontend infers it:
+/// the product of two CSR matrices is CSR, any other product is dense
+static StringRef getProductFormat(StringRef rhs1Format, StringRef rhs2Format)
+{
+  if (rhs1Format == "CSR" && rhs2Format == "CSR")
+    return "CSR";
+  return "Dense";
+}
+
+/// Emits the contractions of a contraction tree and returns its root. nodeValues and nodeLabels hold
+/// the values and labels of the operands of the tree, outFormat is the format of the root.
+static Value emitContractionTree(OpBuilder &builder, Location loc, ArrayRef<ContractionStep> steps,
+                                 std::vector<Value> nodeValues, std::vector<std::vector<Operation *>> nodeLabels,
+                                 std::map<Operation *, Value> &labelValues, StringRef outFormat)
+{
+  auto context = builder.getContext();
+  for (const auto &step : steps)
+  {
+    Value newRhs1 = nodeValues[step.lhs];
+    Value newRhs2 = nodeValues[step.rhs];
+    const std::vector<Operation *> &rhs1Labels = nodeLabels[step.lhs];
+    const std::vector<Operation *> &rhs2Labels = nodeLabels[step.rhs];
+    auto elType = newRhs1.getType().dyn_cast<RankedTensorType>().getElementType();
+    auto newType = RankedTensorType::get(step.shape, elType);
+
+    ///  the dimensions of the affine maps follow the first appearance of the labels in rhs1, then rhs2
+    std::vector<Operation *> dimLabels;
+    std::vector<Value> all_labels;
+    for (auto lbl : rhs1Labels)
+    {
+      all_labels.push_back(labelValues[lbl]);
+      if (std::find(dimLabels.begin(), dimLabels.end(), lbl) == dimLabels.end())
+        dimLabels.push_back(lbl);
+    }
+    for (auto lbl : rhs2Labels)
+    {
+      all_labels.push_back(labelValues[lbl]);
+      if (std::find(dimLabels.begin(), dimLabels.end(), lbl) == dimLabels.end())
+        dimLabels.push_back(lbl);
+    }
+    for (auto lbl : step.labels)
+    {
+      all_labels.push_back(labelValues[lbl]);
+    }
+
+    auto getExprs = [&](const std::vector<Operation *> &labels)
+    {
+      std::vector<mlir::AffineExpr> exprs;
+      for (auto lbl : labels)
+      {
+        unsigned dim = std::find(dimLabels.begin(), dimLabels.end(), lbl) - dimLabels.begin();
+        exprs.push_back(getAffineDimExpr(dim, context));
+      }
+      return exprs;
+    };
+
+    SmallVector<mlir::AffineMap, 8> affine_maps{
+        mlir::AffineMap::get(dimLabels.size(), 0, getExprs(rhs1Labels), context),
+        mlir::AffineMap::get(dimLabels.size(), 0, getExprs(rhs2Labels), context),
+        mlir::AffineMap::get(dimLabels.size(), 0, getExprs(step.labels), context)};
+    auto affineMapArrayAttr = builder.getAffineMapArrayAttr(affine_maps);
+
+    ///  formats of rhs1, rhs2 and of the result
+    StringRef rhs1Format = getTensorFormat(newRhs1);
+    StringRef rhs2Format = getTensorFormat(newRhs2);
+    StringRef lhsFormat = &step == &steps.back() ? outFormat : getProductFormat(rhs1Format, rhs2Format);
+    SmallVector<mlir::StringRef, 8> formats{rhs1Format, rhs2Format, lhsFormat};
+    auto strAttr = builder.getStrArrayAttr(formats);
+
+    auto SemiringAttr = builder.getStringAttr("plusxy_times");
+    auto MaskingAttr = builder.getStringAttr("none");
+    Value tcop = builder.create<tensorAlgebra::TensorMultOp>(loc, newType, newRhs1, newRhs2,
+                                                             all_labels, affineMapArrayAttr, strAttr, SemiringAttr,
+                                                             MaskingAttr, nullptr);
+    tcop.getDefiningOp()->setAttr("__alpha__", builder.getF64FloatAttr(1.0));
+    tcop.getDefiningOp()->setAttr("__beta__", builder.getF64FloatAttr(0.0));
+    comet_debug() << "New operation " << tcop << "\n";
+
+    nodeValues.push_back(tcop);
+    nodeLabels.push_back(step.labels);
+  }
+  return nodeValues.back();
+}
+
+/// Longest chain whose orders are all candidates of the runtime selection (14 orders)
+static const unsigned kMaxRuntimeOrderedChain = 5;
+
+/// Every order of the chain of matrices [first, last], as the splits (first, mid, last) of its
+/// intervals in post-order, where interval [first, last] is the product of [first, mid] and [mid + 1, last]
+static std::vector<std::vector<std::tuple<unsigned, unsigned, unsigned>>> getChainOrders(unsigned first, unsigned last)
+{
+  std::vector<std::vector<std::tuple<unsigned, unsigned, unsigned>>> orders;
+  if (first == last)
+  {
+    orders.push_back({});
+    return orders;
+  }
+
+  for (unsigned mid = first; mid < last; mid++)
+  {
+    for (const auto &lhsOrder : getChainOrders(first, mid))
+    {
+      for (const auto &rhsOrder : getChainOrders(mid + 1, last))
+      {
+        std::vector<std::tuple<unsigned, unsigned, unsigned>> order(lhsOrder);
+        order.insert(order.end(), rhsOrder.begin(), rhsOrder.end());
+        order.push_back({first, mid, last});
+        orders.push_back(order);
+      }
+    }
+  }
+  return orders;
+}
+
+/// The best order of a chain of sparse matrix multiplications depends on the number of nonzeros of its
+/// operands and intermediate products, which is only known at runtime. Emits every order of the chain,
+/// in the cases of a switch on the order selected at runtime by ta.chain_order_select.
+/// Returns false if the chain is not a chain of CSR and dense matrices.
+static bool emitRuntimeOrderedChain(OpBuilder &builder, Location loc, ArrayRef<Operation *> inLTOps,
+                                    std::map<Operation *, Value> &inLTValues, Operation *outLTOp,
+                                    const std::map<Operation *, int64_t> &lblSizes,
+                                    std::map<Operation *, Value> &labelValues,
+                                    const std::map<Operation *, std::vector<Operation *>> &lblMaps,
+                                    Value outTensor)
+{
+  /// The operands are collected from the end of the chain
+  std::vector<Operation *> chain(inLTOps.rbegin(), inLTOps.rend());
+  unsigned n = chain.size();
+  if (n < 3 || n > kMaxRuntimeOrderedChain)
+    return false;
+
+  for (unsigned t = 0; t < n; t++)
+  {
+    if (!isa<DenseTensorDeclOp, SparseTensorDeclOp>(chain[t]) || lblMaps.count(chain[t]) == 0)
+      return false;
+    StringRef format = getTensorFormat(inLTValues[chain[t]]);
+    const std::vector<Operation *> &labels = lblMaps.at(chain[t]);
+    if ((format != "CSR" && format != "Dense") || labels.size() != 2 ||
+        (t > 0 && lblMaps.at(chain[t - 1])[1] != labels[0]))
+      return false;
+  }
+  const std::vector<Operation *> &outLabels = lblMaps.at(outLTOp);
+  if (outLabels.size() != 2 || outLabels[0] != lblMaps.at(chain[0])[0] || outLabels[1] != lblMaps.at(chain[n - 1])[1])
+    return false;
+
+  /// The original order of the chain, left-deep, is enumerated last and becomes the default candidate
+  auto orders = getChainOrders(0, n - 1);
+  std::reverse(orders.begin(), orders.end());
+
+  std::vector<std::vector<ContractionStep>> candidates;
+  std::vector<int64_t> candidateSteps;
+  for (const auto &order : orders)
+  {
+    std::map<std::pair<unsigned, unsigned>, unsigned> intervalNodes;
+    for (unsigned t = 0; t < n; t++)
+    {
+      intervalNodes[{t, t}] = t;
     }
 
-    ///  update global
-    if (totalCost <= minCost)
+    std::vector<ContractionStep> steps;
+    for (const auto &[first, mid, last] : order)
     {
-      minCost = totalCost;
-      minResult = result;
-      minSumLabels = sumLabels;
-      minLHSTensorShapes = lhsTensorShapes;
+      std::vector<Operation *> labels{lblMaps.at(chain[first])[0], lblMaps.at(chain[last])[1]};
+      std::vector<int64_t> shape;
+      for (auto lbl : labels)
+      {
+        shape.push_back(lblSizes.count(lbl) ? lblSizes.at(lbl) : ShapedType::kDynamic);
+      }
+      unsigned lhs = intervalNodes[{first, mid}];
+      unsigned rhs = intervalNodes[{mid + 1, last}];
+      steps.push_back({lhs, rhs, labels, shape});
+      intervalNodes[{first, last}] = n + steps.size() - 1;
+      candidateSteps.push_back(lhs);
+      candidateSteps.push_back(rhs);
     }
+    candidates.push_back(steps);
+  }
+
+  std::vector<Value> chainValues;
+  std::vector<std::vector<Operation *>> chainLabels;
+  for (auto op : chain)
+  {
+    chainValues.push_back(inLTValues[op]);
+    chainLabels.push_back(lblMaps.at(op));
+  }
+  Value selected = builder.create<tensorAlgebra::ChainOrderSelectOp>(loc, builder.getIndexType(), chainValues,
+                                                                     builder.getI64ArrayAttr(candidateSteps));
 
-  } while (std::next_permutation(result.begin(), result.end()));
+  std::vector<int64_t> cases;
+  for (unsigned c = 1; c < candidates.size(); c++)
+  {
+    cases.push_back(c);
+  }
+  auto switchOp = builder.create<scf::IndexSwitchOp>(loc, TypeRange{}, selected, cases, cases.size());
+
+  StringRef outFormat = getTensorFormat(outLTOp->getResult(0));
+  auto emitCandidate = [&](Region &region, unsigned c)
+  {
+    OpBuilder::InsertionGuard guard(builder);
+    builder.setInsertionPointToStart(&region.emplaceBlock());
+    Value result = emitContractionTree(builder, loc, candidates[c], chainValues, chainLabels, labelValues, outFormat);
+    mlir::tensorAlgebra::TensorSetOp newSetOp = builder.create<tensorAlgebra::TensorSetOp>(loc, result, outTensor);
+    newSetOp->setAttr("__beta__", builder.getF64FloatAttr(0.0));
+    builder.create<scf::YieldOp>(loc);
+  };
+  emitCandidate(switchOp.getDefaultRegion(), 0);
+  for (unsigned c = 1; c < candidates.size(); c++)
+  {
+    emitCandidate(switchOp.getCaseRegions()[c - 1], c);
+  }
+  comet_debug() << "Chain with " << candidates.size() << " candidate orders selected at runtime\n";
 
-  return std::make_tuple(minResult, minSumLabels, minLHSTensorShapes);
+  return true;
 }
 
 void FindOptimalTCFactorizationPass::FindOptimalTCFactorization(tensorAlgebra::TensorSetOp op)
@@ -273,11 +631,17 @@ void FindOptimalTCFactorizationPass::FindOptimalTCFactorization(tensorAlgebra::T
                 lblSizes[lblOp] = multop.getRhs2().getType().cast<TensorType>().getDimSize(i);
               }
             }
+            else if (isa<tensorAlgebra::SparseTensorDeclOp>(multop.getRhs2().getDefiningOp()) &&
+                     !multop.getRhs2().getType().cast<TensorType>().isDynamicDim(i))
+            {
+              /// The dynamic dimensions of sparse tensors are only known once they are read
+              lblSizes[lblOp] = multop.getRhs2().getType().cast<TensorType>().getDimSize(i);
+            }
             labelValues[lblOp] = labels[i];
           }
           labelVec.push_back(lblOp);
         }
-        if (isa<tensorAlgebra::DenseTensorDeclOp>(multop.getRhs2().getDefiningOp()))
+        if (isa<tensorAlgebra::DenseTensorDeclOp, tensorAlgebra::SparseTensorDeclOp>(multop.getRhs2().getDefiningOp()))
         {
           lblMaps[multop.getRhs2().getDefiningOp()] = labelVec;
         }
@@ -303,13 +667,19 @@ void FindOptimalTCFactorizationPass::FindOptimalTCFactorization(tensorAlgebra::T
                 lblSizes[lblOp] = multop.getRhs1().getType().cast<TensorType>().getDimSize(i);
               }
             }
+            else if (isa<tensorAlgebra::SparseTensorDeclOp>(multop.getRhs1().getDefiningOp()) &&
+                     !multop.getRhs1().getType().cast<TensorType>().isDynamicDim(i))
+            {
+              /// The dynamic dimensions of sparse tensors are only known once they are read
+              lblSizes[lblOp] = multop.getRhs1().getType().cast<TensorType>().getDimSize(i);
+            }
 
             labelValues[lblOp] = labels[i];
           }
           labelVec.push_back(lblOp);
         }
 
-        if (isa<tensorAlgebra::DenseTensorDeclOp>(multop.getRhs1().getDefiningOp()))
+        if (isa<tensorAlgebra::DenseTensorDeclOp, tensorAlgebra::SparseTensorDeclOp>(multop.getRhs1().getDefiningOp()))
         {
           lblMaps[multop.getRhs1().getDefiningOp()] = labelVec;
         }
@@ -339,217 +709,40 @@ void FindOptimalTCFactorizationPass::FindOptimalTCFactorization(tensorAlgebra::T
   }
   lblMaps[lhsOp] = outLabelVec;
 
-  IndexVector order;
-  std::vector<std::vector<Operation *>> sumLabels;
-  std::vector<std::vector<int64_t>> lhsTensorShapes;
-  std::tie(order, sumLabels, lhsTensorShapes) = optimalOrder(inLTOps, lhsOp, lblSizes, lblMaps);
-
-  bool same_order = hasSameOrder(getReverseIdentityPermutation(order.size()), order);
-
-  comet_debug() << "Same order " << same_order << "\n";
-  ///  updated ta dialect generation.
-  if (!same_order)
+  bool isRewritten = false;
+  bool isDenseChain = std::all_of(inLTOps.begin(), inLTOps.end(), [](Operation *inLTOp)
+                                  { return isa<DenseTensorDeclOp>(inLTOp); });
+  if (isDenseChain)
   {
+    std::vector<ContractionStep> steps = optimalOrder(inLTOps, lhsOp, lblSizes, lblMaps);
 
-    Value newRhs1, newRhs2;
-    std::vector<Value> ___newSumLabels; ///  needed for intermediate tensor information
-
-    newRhs1 = inLTValues[inLTOps[order[0]]]; ///  updated later for subsequent ta.tc ops in the chain
-    for (size_t i = 1; i < order.size(); i++)
+    comet_debug() << "Same order " << steps.empty() << "\n";
+    ///  updated ta dialect generation.
+    if (!steps.empty())
     {
-      newRhs2 = inLTValues[inLTOps[order[i]]];
-      auto elType = newRhs1.getType().dyn_cast<RankedTensorType>().getElementType();
-      auto newType = RankedTensorType::get(lhsTensorShapes[i - 1], elType);
-      std::vector<Value> newSumLabels;
-
-      std::vector<Operation *> rhs1Labels = lblMaps.at(inLTOps[order[i - 1]]);
-      std::vector<Operation *> rhs2Labels = lblMaps.at(inLTOps[order[i]]);
-      std::set<Operation *> remainingLabels(lblMaps.at(lhsOp).begin(),
-                                            lblMaps.at(lhsOp).end());
-      for (size_t j = i + 1; j < order.size(); j++)
-      {
-        auto lblSet = lblMaps.at(inLTOps[order[j]]);
-        remainingLabels.insert(lblSet.begin(), lblSet.end());
-      }
-      auto lhsLabels = findOutput(rhs1Labels, rhs2Labels, remainingLabels);
-      ///  find difference of {rhs1Labels, rhs2Labels}, {lhsLabels}
-      auto tempLabelsOps = getSumLabels(rhs1Labels, rhs2Labels, lhsLabels);
-
-      for (auto lbl : lhsLabels)
-      {
-        newSumLabels.push_back(labelValues[lbl]);
-      }
-      if (!isa<tensorAlgebra::TensorMultOp>(newRhs1.getDefiningOp()))
-      { ///  store the output label values for subsequent ta.tc ops
-        ___newSumLabels = newSumLabels;
-      }
-
-      std::vector<Value> new_all_lbls_value;
-      std::vector<Value> new_lhs_lbls_value;
-      std::vector<Value> new_rhs_lbls_value;
-
-      if (isa<tensorAlgebra::TensorMultOp>(newRhs1.getDefiningOp()))
-      { ///  retrieve the labels from prev iteration.
-        new_rhs_lbls_value = ___newSumLabels;
-        for (auto lbl : new_rhs_lbls_value)
-        {
-          comet_vdump(lbl);
-
-          auto result1 = std::find(new_all_lbls_value.begin(), new_all_lbls_value.end(), lbl);
-          if (result1 == new_all_lbls_value.end())
-          {
-            new_all_lbls_value.push_back(lbl);
-          }
-        }
-      }
-      else
-      { ///  retrieve the labels from lblMaps
-        for (auto lbl : rhs1Labels)
-        {
-          comet_pdump(lbl);
-          comet_debug() << labelValues[lbl] << "\n";
-          if (labelValues.find(lbl) == labelValues.end())
-          {
-            exit(11);
-          }
-          new_rhs_lbls_value.push_back(labelValues[lbl]);
-          auto result1 = std::find(new_all_lbls_value.begin(), new_all_lbls_value.end(), labelValues[lbl]);
-          if (result1 == new_all_lbls_value.end())
-          {
-            new_all_lbls_value.push_back(labelValues[lbl]);
-          }
-        }
-      }
-
-      for (auto lbl : rhs2Labels)
-      {
-        comet_pdump(lbl);
-        comet_debug() << labelValues[lbl] << "\n";
-
-        if (labelValues.find(lbl) == labelValues.end())
-        {
-          exit(11);
-        }
-        new_lhs_lbls_value.push_back(labelValues[lbl]);
-        auto result1 = std::find(new_all_lbls_value.begin(), new_all_lbls_value.end(), labelValues[lbl]);
-        if (result1 == new_all_lbls_value.end())
-        {
-          new_all_lbls_value.push_back(labelValues[lbl]);
-        }
-      }
-
-      ///  formats
-      SmallVector<mlir::StringRef, 8> formats;
-      if (isa<DenseTensorDeclOp>(newRhs2.getDefiningOp()))
-      {
-        auto lhs_format = dyn_cast<DenseTensorDeclOp>(newRhs2.getDefiningOp()).getFormat();
-        formats.push_back(lhs_format);
-      }
-      if (isa<DenseTensorDeclOp>(newRhs1.getDefiningOp()))
-      {
-        auto rhs_format = dyn_cast<DenseTensorDeclOp>(newRhs1.getDefiningOp()).getFormat();
-        formats.push_back(rhs_format);
-      }
-      if (isa<DenseTensorDeclOp>(newRhs1.getDefiningOp()) &&
-          isa<DenseTensorDeclOp>(newRhs2.getDefiningOp()))
-      {
-        auto rhs_format = dyn_cast<DenseTensorDeclOp>(newRhs1.getDefiningOp()).getFormat();
-        formats.push_back(rhs_format);
-      }
-      if (isa<tensorAlgebra::TensorMultOp>(newRhs1.getDefiningOp()))
-      { ///  for series of ta.mul case
-        auto lhs_format = dyn_cast<DenseTensorDeclOp>(newRhs2.getDefiningOp()).getFormat();
-        formats.push_back(lhs_format);
-        formats.push_back(lhs_format);
-      }
-      auto strAttr = builder.getStrArrayAttr(formats);
-
-      std::vector<int> lhs_lbls;
-      std::vector<int> rhs_lbls;
-      std::vector<Value> all_labels;
-
-      for (auto e : new_rhs_lbls_value)
-      {
-        all_labels.push_back(e);
-        auto index = std::find(new_all_lbls_value.begin(), new_all_lbls_value.end(), e) - new_all_lbls_value.begin();
-        comet_debug() << index << " " << new_all_lbls_value[index] << "\n";
-
-        rhs_lbls.push_back(index);
-      }
-
-      for (auto e : new_lhs_lbls_value)
+      ///  values and labels of the nodes of the contraction tree
+      std::vector<Value> nodeValues;
+      std::vector<std::vector<Operation *>> nodeLabels;
+      for (auto inLTOp : inLTOps)
       {
-        all_labels.push_back(e);
-        auto index = std::find(new_all_lbls_value.begin(), new_all_lbls_value.end(), e) - new_all_lbls_value.begin();
-        comet_debug() << index << " " << new_all_lbls_value[index] << "\n";
-        lhs_lbls.push_back(index);
+        nodeValues.push_back(inLTValues[inLTOp]);
+        nodeLabels.push_back(lblMaps.at(inLTOp));
       }
+      Value newRhs1 = emitContractionTree(builder, loc, steps, nodeValues, nodeLabels, labelValues, "Dense");
 
-      std::vector<int> ret_lbls;
-
-      for (auto e : newSumLabels)
-      {
-        all_labels.push_back(e);
-        auto index = std::find(new_all_lbls_value.begin(), new_all_lbls_value.end(), e) - new_all_lbls_value.begin();
-        comet_debug() << index << " " << new_all_lbls_value[index] << "\n";
-
-        ret_lbls.push_back(index);
-      }
-
-      comet_debug() << "\n";
-      auto sorted_lhs = lhs_lbls;
-      std::sort(sorted_lhs.begin(), sorted_lhs.end());
-      auto sorted_rhs = rhs_lbls;
-      std::sort(sorted_rhs.begin(), sorted_rhs.end());
-      std::vector<int> all_lbls;
-      std::set_union(sorted_lhs.begin(), sorted_lhs.end(), sorted_rhs.begin(), sorted_rhs.end(), std::back_inserter(all_lbls));
-
-      std::map<int, mlir::AffineExpr> expr_map;
-      unsigned dim = 0;
-      for (const auto &lbl : all_lbls)
-      {
-        comet_debug() << "All LBLS: " << lbl << "\n";
-        expr_map[lbl] = getAffineDimExpr(dim++, builder.getContext());
-      }
-
-      std::vector<mlir::AffineExpr> lhs_exprs;
-      std::vector<mlir::AffineExpr> rhs_exprs;
-      std::vector<mlir::AffineExpr> ret_exprs;
-      for (const auto &lbl : lhs_lbls)
-      {
-        lhs_exprs.push_back(expr_map[lbl]);
-      }
-
-      for (const auto &lbl : rhs_lbls)
-      {
-        rhs_exprs.push_back(expr_map[lbl]);
-      }
-
-      for (const auto &lbl : ret_lbls)
-      {
-        ret_exprs.push_back(expr_map[lbl]);
-      }
-
-      auto context = builder.getContext();
-      SmallVector<mlir::AffineMap, 8> affine_maps{
-          mlir::AffineMap::get(dim, 0, rhs_exprs, context),
-          mlir::AffineMap::get(dim, 0, lhs_exprs, context),
-          mlir::AffineMap::get(dim, 0, ret_exprs, context)};
-      auto affineMapArrayAttr = builder.getAffineMapArrayAttr(affine_maps);
-      auto SemiringAttr = builder.getStringAttr("plusxy_times");
-      auto MaskingAttr = builder.getStringAttr("none");
-      Value tcop = builder.create<tensorAlgebra::TensorMultOp>(loc, newType, newRhs1, newRhs2,
-                                                               all_labels, affineMapArrayAttr, strAttr, SemiringAttr,
-                                                               MaskingAttr, nullptr);
-      tcop.getDefiningOp()->setAttr("__alpha__", builder.getF64FloatAttr(1.0));
-      tcop.getDefiningOp()->setAttr("__beta__", builder.getF64FloatAttr(0.0));
-      comet_debug() << "New operation " << tcop << "\n";
-      newRhs1 = tcop;
+      mlir::tensorAlgebra::TensorSetOp newSetOp = builder.create<tensorAlgebra::TensorSetOp>(loc, newRhs1, operands[1]);
+      newSetOp->setAttr("__beta__", builder.getF64FloatAttr(0.0));
+      isRewritten = true;
     }
+  }
+  else if (runtimeOrder)
+  {
+    ///  the sizes of sparse operands are not known at compile time, nor is the cost of their products
+    isRewritten = emitRuntimeOrderedChain(builder, loc, inLTOps, inLTValues, lhsOp, lblSizes, labelValues, lblMaps, operands[1]);
+  }
 
-    mlir::tensorAlgebra::TensorSetOp newSetOp = builder.create<tensorAlgebra::TensorSetOp>(loc, newRhs1, operands[1]);
-    newSetOp->setAttr("__beta__", builder.getF64FloatAttr(0.0));
-
+  if (isRewritten)
+  {
     comet_debug() << "are they previous multop\n";
     for (auto oldTcOp : MultOpsToRemove)
     {
@@ -591,9 +784,9 @@ void STCRemoveDeadOpsPass::runOnOperation()
   }
 }
 
-std::unique_ptr<Pass> mlir::comet::createFindOptimalTCFactorizationPass()
+std::unique_ptr<Pass> mlir::comet::createFindOptimalTCFactorizationPass(bool runtimeOrder)
 {
-  return std::make_unique<FindOptimalTCFactorizationPass>();
+  return std::make_unique<FindOptimalTCFactorizationPass>(runtimeOrder);
 }
 
 ///  Lower sparse tensor algebra operation to loops
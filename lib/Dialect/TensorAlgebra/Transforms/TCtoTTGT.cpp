@@ -27,6 +27,7 @@
 #include "comet/Dialect/TensorAlgebra/IR/TADialect.h"
 #include "comet/Dialect/TensorAlgebra/Passes.h"
 #include "comet/Dialect/Utils/Utils.h"
+#include "comet/ExecutionEngine/blis_interface.h"
 
 #include "mlir/Dialect/Linalg/IR/Linalg.h"
 #include "mlir/Dialect/Linalg/Transforms/Transforms.h"
@@ -34,12 +35,14 @@
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 #include "mlir/Dialect/Bufferization/IR/Bufferization.h"
 
+#include <chrono>
 #include <limits>
 #include <map>
 #include <set>
 #include <unordered_map>
 
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
 
 using namespace mlir;
 using namespace mlir::linalg;
@@ -114,6 +117,415 @@ static IndexVector getIndexRange(unsigned lo, unsigned hi, unsigned step = 1)
   return result;
 }
 
+//===----------------------------------------------------------------------===//
+/// Batched contractions
+//===----------------------------------------------------------------------===//
+
+/// Contractions with batch indices, i.e., indices that appear in both inputs and in the output
+/// (e.g., C[b, i, j] = A[b, i, k] * B[b, k, j]), are lowered to a loop nest over the batch modes
+/// around a GEMM on strided views of the operands. An operand is only transposed into a copy
+/// when its slices cannot be viewed as a matrix without copies.
+
+/// Modes of perm that belong to group, in the order of perm
+static IndexVector getModesInOrder(const IndexVector &perm, const IndexVector &group)
+{
+  IndexVector result;
+  for (auto idx : perm)
+  {
+    if (std::find(group.begin(), group.end(), idx) != group.end())
+      result.push_back(idx);
+  }
+  return result;
+}
+
+/// A slice of an operand over its batch modes can be collapsed into a (first x second) matrix
+/// when its other modes are exactly the modes of first followed by the modes of second,
+/// and the modes of each group are adjacent in memory.
+static bool isViewableAsMatrix(const IndexVector &perm, const IndexVector &first, const IndexVector &second)
+{
+  IndexVector expected(first);
+  expected.insert(expected.end(), second.begin(), second.end());
+
+  IndexVector nonBatch;
+  std::vector<size_t> positions;
+  for (size_t d = 0; d < perm.size(); d++)
+  {
+    if (std::find(expected.begin(), expected.end(), perm[d]) != expected.end())
+    {
+      nonBatch.push_back(perm[d]);
+      positions.push_back(d);
+    }
+  }
+  if (nonBatch != expected)
+    return false;
+
+  for (size_t i = 1; i < positions.size(); i++)
+  {
+    if (i != first.size() && positions[i] != positions[i - 1] + 1)
+      return false;
+  }
+  return true;
+}
+
+/// Rank-reduced view of the slice of memref at the current batch indices, with the modes
+/// of each non-empty GEMM dimension collapsed into one dimension
+static Value createBatchSliceView(Location loc, Value memref, const IndexVector &perm,
+                                  const IndexVector &first, const IndexVector &second,
+                                  std::map<unsigned, Value> &batchIVs,
+                                  ConversionPatternRewriter &rewriter)
+{
+  auto memrefType = memref.getType().cast<MemRefType>();
+  SmallVector<OpFoldResult> offsets, sizes, strides;
+  SmallVector<int64_t> viewShape;
+  for (size_t d = 0; d < perm.size(); d++)
+  {
+    strides.push_back(rewriter.getIndexAttr(1));
+    if (batchIVs.count(perm[d]))
+    {
+      offsets.push_back(batchIVs[perm[d]]);
+      sizes.push_back(rewriter.getIndexAttr(1));
+      continue;
+    }
+
+    offsets.push_back(rewriter.getIndexAttr(0));
+    if (memrefType.isDynamicDim(d))
+      sizes.push_back(rewriter.create<memref::DimOp>(loc, memref, d).getResult());
+    else
+      sizes.push_back(rewriter.getIndexAttr(memrefType.getDimSize(d)));
+    viewShape.push_back(memrefType.getDimSize(d));
+  }
+
+  auto viewType = llvm::cast<MemRefType>(memref::SubViewOp::inferRankReducedResultType(
+      viewShape, memrefType, offsets, sizes, strides));
+  Value view = rewriter.create<memref::SubViewOp>(loc, viewType, memref, offsets, sizes, strides);
+  comet_vdump(view);
+
+  SmallVector<ReassociationIndices> reassociationIndices;
+  int64_t pos = 0;
+  for (size_t groupSize : {first.size(), second.size()})
+  {
+    if (groupSize == 0)
+      continue;
+    ReassociationIndices group;
+    for (size_t i = 0; i < groupSize; i++)
+      group.push_back(pos++);
+    reassociationIndices.push_back(group);
+  }
+
+  if (reassociationIndices.size() == (size_t)viewType.getRank())
+    return view;
+
+  return rewriter.create<memref::CollapseShapeOp>(loc, view, reassociationIndices);
+}
+
+static LogicalResult lowerBatchedContraction(Operation *op, const ContractionPlan &plan,
+                                             const std::vector<IndexVector> &allPerms,
+                                             Value rhs1Memref, Value rhs2Memref, Value lhsMemref,
+                                             Attribute alphaAttr, Attribute betaAttr,
+                                             ConversionPatternRewriter &rewriter)
+{
+  auto loc = op->getLoc();
+
+  if (plan.k_indices_.empty())
+    return rewriter.notifyMatchFailure(op, "Batched contractions without summation indices are not supported in TTGT");
+
+  /// A is M x K, B is K x N and C is M x N. The order of the M and N modes is the one of C,
+  /// the order of the K modes is the one of A.
+  IndexVector mModes = getModesInOrder(allPerms[2], plan.m_indices_);
+  IndexVector nModes = getModesInOrder(allPerms[2], plan.n_indices_);
+  IndexVector kModes = getModesInOrder(allPerms[0], plan.k_indices_);
+
+  /// Transpose an operand into a copy with the batch modes first, followed by the modes of first and second
+  auto transposeIfNeeded = [&](Value memref, const IndexVector &perm, const IndexVector &first,
+                               const IndexVector &second, bool isOutput) -> std::pair<Value, IndexVector>
+  {
+    if (isViewableAsMatrix(perm, first, second))
+      return {memref, perm};
+
+    IndexVector copyPerm(plan.b_indices_);
+    copyPerm.insert(copyPerm.end(), first.begin(), first.end());
+    copyPerm.insert(copyPerm.end(), second.begin(), second.end());
+    IndexVector transposePerm = plan.getPermutation(perm, copyPerm);
+
+    auto memrefType = memref.getType().cast<MemRefType>();
+    std::vector<Value> dynamicSizes;
+    std::vector<int64_t> copyDims;
+    for (auto idx : transposePerm)
+    {
+      copyDims.push_back(memrefType.getDimSize(idx));
+      if (memrefType.isDynamicDim(idx))
+        dynamicSizes.push_back(rewriter.create<memref::DimOp>(loc, memref, idx));
+    }
+    Value copy = insertAllocAndDeallocDynamic(MemRefType::get(copyDims, memrefType.getElementType()),
+                                              dynamicSizes, loc, rewriter);
+
+    std::vector<int64_t> transposePerm_int64(transposePerm.begin(), transposePerm.end());
+    if (isOutput && betaAttr.cast<FloatAttr>().getValueAsDouble() == 0)
+    {
+      Value zero = rewriter.create<ConstantOp>(loc, rewriter.getFloatAttr(memrefType.getElementType(), 0.0));
+      rewriter.create<linalg::FillOp>(loc, zero, copy);
+    }
+    else
+    {
+      rewriter.create<linalg::TransposeOp>(loc, memref, copy, llvm::ArrayRef<int64_t>(transposePerm_int64));
+    }
+    return {copy, copyPerm};
+  };
+
+  Value rhs1Batched, rhs2Batched, lhsBatched;
+  IndexVector rhs1BatchedPerm, rhs2BatchedPerm, lhsBatchedPerm;
+  std::tie(rhs1Batched, rhs1BatchedPerm) = transposeIfNeeded(rhs1Memref, allPerms[0], mModes, kModes, false);
+  std::tie(rhs2Batched, rhs2BatchedPerm) = transposeIfNeeded(rhs2Memref, allPerms[1], kModes, nModes, false);
+  std::tie(lhsBatched, lhsBatchedPerm) = transposeIfNeeded(lhsMemref, allPerms[2], mModes, nModes, true);
+
+  /// Loop nest over the batch modes
+  Value c0 = rewriter.create<ConstantIndexOp>(loc, 0);
+  Value c1 = rewriter.create<ConstantIndexOp>(loc, 1);
+  std::map<unsigned, Value> batchIVs;
+  scf::ForOp outermostLoop;
+  for (auto idx : plan.b_indices_)
+  {
+    auto rhs1Type = rhs1Batched.getType().cast<MemRefType>();
+    unsigned dim = std::distance(rhs1BatchedPerm.begin(),
+                                 std::find(rhs1BatchedPerm.begin(), rhs1BatchedPerm.end(), idx));
+    Value upperBound;
+    if (rhs1Type.isDynamicDim(dim))
+      upperBound = rewriter.create<memref::DimOp>(loc, rhs1Batched, dim);
+    else
+      upperBound = rewriter.create<ConstantIndexOp>(loc, rhs1Type.getDimSize(dim));
+
+    auto loop = rewriter.create<scf::ForOp>(loc, c0, upperBound, c1);
+    if (!outermostLoop)
+      outermostLoop = loop;
+    rewriter.setInsertionPointToStart(loop.getBody());
+    batchIVs[idx] = loop.getInductionVar();
+  }
+
+  Value rhs1View = createBatchSliceView(loc, rhs1Batched, rhs1BatchedPerm, mModes, kModes, batchIVs, rewriter);
+  Value rhs2View = createBatchSliceView(loc, rhs2Batched, rhs2BatchedPerm, kModes, nModes, batchIVs, rewriter);
+  Value lhsView = createBatchSliceView(loc, lhsBatched, lhsBatchedPerm, mModes, nModes, batchIVs, rewriter);
+
+  Operation *gemmOp;
+  if (mModes.empty() && nModes.empty())
+    gemmOp = rewriter.create<linalg::DotOp>(loc, ValueRange{rhs1View, rhs2View}, ValueRange{lhsView});
+  else if (mModes.empty())
+    gemmOp = rewriter.create<linalg::VecmatOp>(loc, ValueRange{rhs1View, rhs2View}, ValueRange{lhsView});
+  else if (nModes.empty())
+    gemmOp = rewriter.create<linalg::MatvecOp>(loc, ValueRange{rhs1View, rhs2View}, ValueRange{lhsView});
+  else
+  {
+    gemmOp = rewriter.create<linalg::MatmulOp>(loc, ValueRange{rhs1View, rhs2View}, ValueRange{lhsView});
+    /// Add attribute to the linalg.matmul operations
+    gemmOp->setAttr(kLinalgTransformMarker, rewriter.getStringAttr(kLinalgTransformMarker));
+  }
+  gemmOp->setAttr("__alpha__", alphaAttr);
+  gemmOp->setAttr("__beta__", betaAttr);
+  comet_pdump(gemmOp);
+
+  /// Copy back the result if needed
+  rewriter.setInsertionPointAfter(outermostLoop);
+  if (lhsBatched != lhsMemref)
+  {
+    IndexVector revPerm = plan.getPermutation(lhsBatchedPerm, allPerms[2]);
+    std::vector<int64_t> revPerm_int64(revPerm.begin(), revPerm.end());
+    rewriter.create<linalg::TransposeOp>(loc, lhsBatched, lhsMemref, llvm::ArrayRef<int64_t>(revPerm_int64));
+  }
+
+  return success();
+}
+
+//===----------------------------------------------------------------------===//
+/// GETT
+//===----------------------------------------------------------------------===//
+
+/// The GETT (GEMM-like Tensor-Tensor contraction) engine lowers a contraction to a call to the comet_gett_*
+/// runtime function, which runs the packed GEMM driver on matrix views of the tensors: the micro-panels of A and B
+/// are packed straight from the tensors and the micro-tiles of C are written back in place, so no transposed copy of
+/// an operand is ever materialized. The groups of modes of the views are passed in a descriptor
+/// {#M, #N, #K, (dim in A, dim in C) of each M mode, (dim in B, dim in C) of each N mode, (dim in A, dim in B) of each K mode}.
+
+static std::string getGETTFuncName(Type elementType)
+{
+  return elementType.isF32() ? "comet_gett_f32" : "comet_gett_f64";
+}
+
+static void lowerContractionGETT(Operation *op, const ContractionPlan &plan,
+                                 const std::vector<IndexVector> &allPerms,
+                                 Value rhs1Memref, Value rhs2Memref, Value lhsMemref,
+                                 Attribute alphaAttr, Attribute betaAttr,
+                                 ConversionPatternRewriter &rewriter)
+{
+  auto loc = op->getLoc();
+  auto elementType = lhsMemref.getType().cast<MemRefType>().getElementType();
+  auto indexType = rewriter.getIndexType();
+
+  /// The M and N modes follow the order of C, and the K modes the order of A, so that the last
+  /// mode of each group, the one varying the fastest in the views, is the fastest one in those tensors
+  IndexVector mModes = getModesInOrder(allPerms[2], plan.m_indices_);
+  IndexVector nModes = getModesInOrder(allPerms[2], plan.n_indices_);
+  IndexVector kModes = getModesInOrder(allPerms[0], plan.k_indices_);
+
+  auto dimOf = [](const IndexVector &perm, unsigned idx) -> int64_t
+  {
+    return std::distance(perm.begin(), std::find(perm.begin(), perm.end(), idx));
+  };
+
+  std::vector<int64_t> modes{(int64_t)mModes.size(), (int64_t)nModes.size(), (int64_t)kModes.size()};
+  for (auto idx : mModes)
+  {
+    modes.push_back(dimOf(allPerms[0], idx));
+    modes.push_back(dimOf(allPerms[2], idx));
+  }
+  for (auto idx : nModes)
+  {
+    modes.push_back(dimOf(allPerms[1], idx));
+    modes.push_back(dimOf(allPerms[2], idx));
+  }
+  for (auto idx : kModes)
+  {
+    modes.push_back(dimOf(allPerms[0], idx));
+    modes.push_back(dimOf(allPerms[1], idx));
+  }
+
+  Value modesAlloc = rewriter.create<memref::AllocOp>(loc, MemRefType::get({(int64_t)modes.size()}, indexType));
+  for (size_t i = 0; i < modes.size(); i++)
+  {
+    Value mode = rewriter.create<ConstantIndexOp>(loc, modes[i]);
+    Value pos = rewriter.create<ConstantIndexOp>(loc, i);
+    rewriter.create<memref::StoreOp>(loc, mode, modesAlloc, ValueRange{pos});
+  }
+
+  /// The runtime accumulates into C
+  if (betaAttr.cast<FloatAttr>().getValueAsDouble() == 0)
+  {
+    Value zero = rewriter.create<ConstantOp>(loc, rewriter.getFloatAttr(elementType, 0.0));
+    rewriter.create<linalg::FillOp>(loc, zero, lhsMemref);
+  }
+
+  auto unrankedMemrefType = UnrankedMemRefType::get(elementType, 0);
+  Value rhs1Cast = rewriter.create<memref::CastOp>(loc, unrankedMemrefType, rhs1Memref);
+  Value rhs2Cast = rewriter.create<memref::CastOp>(loc, unrankedMemrefType, rhs2Memref);
+  Value lhsCast = rewriter.create<memref::CastOp>(loc, unrankedMemrefType, lhsMemref);
+  Value modesCast = rewriter.create<memref::CastOp>(loc, UnrankedMemRefType::get(indexType, 0), modesAlloc);
+  Value alpha = rewriter.create<ConstantOp>(
+      loc, rewriter.getFloatAttr(elementType, alphaAttr.cast<FloatAttr>().getValueAsDouble()));
+
+  rewriter.create<func::CallOp>(loc, getGETTFuncName(elementType), SmallVector<Type, 2>{},
+                                ValueRange{rhs1Cast, rhs2Cast, lhsCast, modesCast, alpha});
+  rewriter.create<memref::DeallocOp>(loc, modesAlloc);
+}
+
+/// Report the flops of a contraction timed from startTime
+static void insertFlopsReport(Location loc, Operation *startTime, const ContractionPlan &plan,
+                              ConversionPatternRewriter &rewriter)
+{
+  std::string getTimeStr = "getTime";
+  auto f64Type = rewriter.getF64Type();
+  auto endTime = rewriter.create<func::CallOp>(
+      loc, getTimeStr, SmallVector<Type, 2>{f64Type});
+
+  auto start = startTime->getResult(0);
+  auto end = endTime.getResult(0);
+
+  Value totalTimeValue =
+      rewriter.create<SubFOp>(loc, f64Type, end, start);
+
+  double opNums = 2.0 * plan.b_size_ * plan.m_size_ * plan.n_size_ * plan.k_size_;
+
+  Value numFlopsOp =
+      rewriter.create<ConstantOp>(loc, FloatAttr::get(f64Type, opNums));
+
+  Value flopsOp =
+      rewriter.create<DivFOp>(loc, f64Type, numFlopsOp, totalTimeValue);
+
+  ///   call @print_flops(%flops) : (f64) -> ()
+  std::string printFlopsStr = "print_flops";
+  /// auto printFlopsCall =
+  rewriter.create<func::CallOp>(
+      loc, printFlopsStr, SmallVector<Type, 2>{}, ValueRange{flopsOp});
+}
+
+//===----------------------------------------------------------------------===//
+/// Cost profile calibration
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+  /// Best wall-clock time in seconds of a few runs of fn
+  template <typename Fn>
+  double timeBestOf(Fn fn, int runs = 3)
+  {
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0; r < runs; r++)
+    {
+      auto start = std::chrono::steady_clock::now();
+      fn();
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+    return best;
+  }
+
+  /// out = transpose(in, perm) for a 3-D row-major tensor, with the loop nest linalg.transpose is lowered to:
+  /// the loops run over the dimensions of the output, and output dimension j is input dimension perm[j]
+  void transpose3D(const double *in, double *out, const int64_t dims[3], const unsigned perm[3])
+  {
+    int64_t inStrides[3] = {dims[1] * dims[2], dims[2], 1};
+    int64_t outDims[3] = {dims[perm[0]], dims[perm[1]], dims[perm[2]]};
+    int64_t strides[3] = {inStrides[perm[0]], inStrides[perm[1]], inStrides[perm[2]]};
+
+    for (int64_t i = 0; i < outDims[0]; i++)
+      for (int64_t j = 0; j < outDims[1]; j++)
+        for (int64_t k = 0; k < outDims[2]; k++)
+          *out++ = in[i * strides[0] + j * strides[1] + k * strides[2]];
+  }
+} /// namespace
+
+/// Measure the throughput of transposes with and without moving the innermost dimension on tensors larger
+/// than the caches, and the throughput of the BLIS GEMM on a grid of shapes
+LogicalResult mlir::comet::calibrateTTGTCostProfile(StringRef profilePath)
+{
+  TTGTCostProfile profile;
+  volatile double sink = 0.0;
+
+  const int64_t dims[3] = {128, 128, 128};
+  const int64_t numElements = dims[0] * dims[1] * dims[2];
+  std::vector<double> in(numElements), out(numElements);
+  for (int64_t i = 0; i < numElements; i++)
+    in[i] = (double)(i % 1024);
+
+  const unsigned contiguousPerm[3] = {1, 0, 2};
+  const unsigned stridedPerm[3] = {0, 2, 1};
+  profile.contiguousTransposeRate =
+      numElements / timeBestOf([&]
+                               { transpose3D(in.data(), out.data(), dims, contiguousPerm); });
+  sink = sink + out[numElements - 1];
+  profile.stridedTransposeRate =
+      numElements / timeBestOf([&]
+                               { transpose3D(in.data(), out.data(), dims, stridedPerm); });
+  sink = sink + out[numElements - 1];
+
+  const int64_t gemmSizes[] = {16, 64, 256, 1024};
+  for (int64_t m : gemmSizes)
+    for (int64_t n : gemmSizes)
+      for (int64_t k : gemmSizes)
+      {
+        std::vector<double> a(m * k, 1.0), b(k * n, 1.0), c(m * n, 0.0);
+        double alpha = 1.0, beta = 1.0;
+        double time = timeBestOf([&]
+                                 { bli_dgemm(BLIS_NO_TRANSPOSE, BLIS_NO_TRANSPOSE, m, n, k,
+                                             &alpha, a.data(), k, 1, b.data(), n, 1,
+                                             &beta, c.data(), n, 1); });
+        sink = sink + c[0];
+        profile.gemmSamples.push_back({m, n, k, 2.0 * m * n * k / time});
+      }
+
+  comet_debug() << "TTGT cost profile: transpose " << profile.contiguousTransposeRate << " (contiguous), "
+                << profile.stridedTransposeRate << " (strided) elements/s\n";
+
+  return saveTTGTCostProfile(profilePath, profile);
+}
+
 //===----------------------------------------------------------------------===//
 /// TAEarlyLoweringTTGTPass
 //===----------------------------------------------------------------------===//
@@ -126,9 +538,10 @@ namespace
 
   struct TensorContractionOpLoweringTTGT : public ConversionPattern
   {
-    TensorContractionOpLoweringTTGT(MLIRContext *ctx, bool isSelectBestPerm, int whatPerm, bool printFlops)
+    TensorContractionOpLoweringTTGT(MLIRContext *ctx, bool isSelectBestPerm, int whatPerm, bool printFlops, mlir::comet::TCEngine engine,
+                                    const TTGTCostProfile *costProfile)
         : ConversionPattern(tensorAlgebra::TensorMultOp::getOperationName(), 1, ctx),
-          isSelectBestPerm(isSelectBestPerm), whatPerm(whatPerm), printFlops{printFlops} {}
+          isSelectBestPerm(isSelectBestPerm), whatPerm(whatPerm), printFlops{printFlops}, engine(engine), costProfile(costProfile) {}
 
     /**
      * @brief Latest implementation with following optimizations:
@@ -213,6 +626,53 @@ namespace
 
       ContractionPlan plan{allPerms[0], allShapes[0], allPerms[1],
                            allShapes[1], allPerms[2], allShapes[2]};
+      plan.setCostProfile(costProfile);
+
+      /// Contractions with batch indices are lowered to a loop nest of GEMMs on strided views
+      if (!plan.b_indices_.empty())
+      {
+        if (failed(lowerBatchedContraction(op, plan, allPerms, rhs1Memref, rhs2Memref, lhsMemref,
+                                           alphaAttr, betaAttr, rewriter)))
+          return failure();
+
+        if (printFlops)
+          insertFlopsReport(loc, startTime, plan, rewriter);
+
+        rewriter.eraseOp(setnewop);
+        rewriter.eraseOp(op);
+        return success();
+      }
+
+      /// Lower through the GETT engine when it is selected, or when the cost model estimates it is faster than TTGT
+      Type elementType = lhsMemrefType.getElementType();
+      bool useGETT = false;
+      if (elementType.isF64() || elementType.isF32())
+      {
+        if (engine == mlir::comet::GETTEngine)
+        {
+          useGETT = true;
+        }
+        else if (engine == mlir::comet::AutoEngine)
+        {
+          double gettTime = plan.getGETTTime();
+          double ttgtTime = plan.getTotalTime();
+          comet_debug() << "Estimated time of GETT: " << gettTime << ", of TTGT: " << ttgtTime << "\n";
+          useGETT = gettTime < ttgtTime;
+        }
+      }
+
+      if (useGETT)
+      {
+        lowerContractionGETT(op, plan, allPerms, rhs1Memref, rhs2Memref, lhsMemref,
+                             alphaAttr, betaAttr, rewriter);
+
+        if (printFlops)
+          insertFlopsReport(loc, startTime, plan, rewriter);
+
+        rewriter.eraseOp(setnewop);
+        rewriter.eraseOp(op);
+        return success();
+      }
 
       /// computeBestPermutations identifies the optimal index permutation for TTGT
       /// it should enable and disable to heuristic
@@ -648,28 +1108,7 @@ namespace
 
       if (printFlops)
       {
-        auto endTime = rewriter.create<func::CallOp>(
-            loc, getTimeStr, SmallVector<Type, 2>{f64Type});
-
-        auto start = startTime->getResult(0);
-        auto end = endTime.getResult(0);
-
-        Value totalTimeValue =
-            rewriter.create<SubFOp>(loc, f64Type, end, start);
-
-        double opNums = 2.0 * plan.m_size_ * plan.n_size_ * plan.k_size_;
-
-        Value numFlopsOp =
-            rewriter.create<ConstantOp>(loc, FloatAttr::get(f64Type, opNums));
-
-        Value flopsOp =
-            rewriter.create<DivFOp>(loc, f64Type, numFlopsOp, totalTimeValue);
-
-        ///   call @print_flops(%flops) : (f64) -> ()
-        std::string printFlopsStr = "print_flops";
-        /// auto printFlopsCall =
-        rewriter.create<func::CallOp>(
-            loc, printFlopsStr, SmallVector<Type, 2>{}, ValueRange{flopsOp});
+        insertFlopsReport(loc, startTime, plan, rewriter);
       }
 
       rewriter.eraseOp(setnewop);
@@ -681,19 +1120,36 @@ namespace
     bool isSelectBestPerm;
     int whatPerm;
     bool printFlops;
+    mlir::comet::TCEngine engine;
+    const TTGTCostProfile *costProfile;
   }; /// namespace
 
   struct TALoweringTTGTPass
       : public PassWrapper<TALoweringTTGTPass, OperationPass<func::FuncOp>>
   {
     MLIR_DEFINE_EXPLICIT_INTERNAL_INLINE_TYPE_ID(TALoweringTTGTPass)
-    TALoweringTTGTPass(bool isSelectBestPerm, int whatPerm, bool printFlops) : isSelectBestPerm(isSelectBestPerm), whatPerm(whatPerm), printFlops{printFlops} {};
+    TALoweringTTGTPass(bool isSelectBestPerm, int whatPerm, bool printFlops, mlir::comet::TCEngine engine,
+                       std::string costProfilePath)
+        : isSelectBestPerm(isSelectBestPerm), whatPerm(whatPerm), printFlops{printFlops}, engine(engine),
+          costProfilePath(costProfilePath){};
+
+    /// The cost profile is read once, before the pass runs on any function
+    LogicalResult initialize(MLIRContext *context) override
+    {
+      if (costProfilePath.empty())
+        return success();
+      return loadTTGTCostProfile(costProfilePath, costProfile);
+    }
+
     void runOnOperation() override;
 
   private:
     bool isSelectBestPerm;
     int whatPerm;
     bool printFlops;
+    mlir::comet::TCEngine engine;
+    std::string costProfilePath;
+    TTGTCostProfile costProfile;
   };
 
 } /// end anonymous namespace.
@@ -725,11 +1181,32 @@ void TALoweringTTGTPass::runOnOperation()
     module.push_back(func1);
   }
 
+  /// func @comet_gett_f64(memref<*xf64>, memref<*xf64>, memref<*xf64>, memref<*xindex>, f64) -> (), and its f32 version
+  if (engine != mlir::comet::TTGTEngine)
+  {
+    for (Type elementType : {(Type)FloatType::getF64(ctx), (Type)FloatType::getF32(ctx)})
+    {
+      std::string gettFuncName = getGETTFuncName(elementType);
+      if (hasFuncDeclaration(module, gettFuncName))
+        continue;
+
+      auto unrankedMemrefType = UnrankedMemRefType::get(elementType, 0);
+      auto gettFunc = FunctionType::get(ctx, {unrankedMemrefType, unrankedMemrefType, unrankedMemrefType,
+                                              UnrankedMemRefType::get(IndexType::get(ctx), 0), elementType},
+                                        {});
+      mlir::func::FuncOp func1 = mlir::func::FuncOp::create(function.getLoc(), gettFuncName, gettFunc,
+                                                            ArrayRef<NamedAttribute>{});
+      func1.setPrivate();
+      module.push_back(func1);
+    }
+  }
+
   RewritePatternSet patterns(&getContext());
-  patterns.insert<TensorContractionOpLoweringTTGT>(&getContext(), isSelectBestPerm, whatPerm, printFlops);
+  patterns.insert<TensorContractionOpLoweringTTGT>(&getContext(), isSelectBestPerm, whatPerm, printFlops, engine,
+                                                   costProfile.isValid() ? &costProfile : nullptr);
 
   ConversionTarget target(getContext());
-  target.addLegalDialect<LinalgDialect, ArithDialect, memref::MemRefDialect>();
+  target.addLegalDialect<LinalgDialect, ArithDialect, memref::MemRefDialect, scf::SCFDialect>();
 
   if (failed(applyPartialConversion(function, target, std::move(patterns))))
   {
@@ -741,7 +1218,8 @@ void TALoweringTTGTPass::runOnOperation()
 /// Create a pass for lowering operations in the `LinAlg` and `Std` dialects,
 /// for a subset of the TA IR (e.g. matmul).
 /// ordering of permutation starts with one
-std::unique_ptr<Pass> mlir::comet::createLoweringTTGTPass(bool isSelectBestPerm, int whatPerm, bool printFlops)
+std::unique_ptr<Pass> mlir::comet::createLoweringTTGTPass(bool isSelectBestPerm, int whatPerm, bool printFlops, mlir::comet::TCEngine engine,
+                                                         std::string costProfilePath)
 {
-  return std::make_unique<TALoweringTTGTPass>(isSelectBestPerm, whatPerm, printFlops);
+  return std::make_unique<TALoweringTTGTPass>(isSelectBestPerm, whatPerm, printFlops, engine, costProfilePath);
 }
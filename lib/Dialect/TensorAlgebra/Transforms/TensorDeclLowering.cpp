@@ -28,6 +28,7 @@
 #include "comet/Dialect/TensorAlgebra/Passes.h"
 #include "comet/Dialect/IndexTree/IR/IndexTreeDialect.h"
 #include "comet/Dialect/Utils/Utils.h"
+#include "comet/ExecutionEngine/RandomTensorGenerator.h"
 
 #include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
@@ -66,7 +67,8 @@ namespace
                                                     std::vector<Value> &dimSizes,
                                                     std::vector<Value> &tensorload_sizes_vec,
                                                     std::vector<Value> &array_sizes_vec,
-                                                    PatternRewriter &rewriter)
+                                                    PatternRewriter &rewriter,
+                                                    bool copyIndexArrays = false)
   {
 
     IndexType indexType = IndexType::get(computeOp.getContext());
@@ -96,6 +98,12 @@ namespace
     {
       sparse_inputtensor_id = 1;
     }
+    else if (rhsComputeOp->getNumOperands() > 2 &&
+             isa<tensorAlgebra::SparseTensorConstructOp>(rhsComputeOp->getOperand(2).getDefiningOp()))
+    {
+      /// The mask of a sampled product of dense operands
+      sparse_inputtensor_id = 2;
+    }
     else
     {
       llvm::errs() << "ERROR: SparseTensorConstructOp was not found as one of the operands for itCompute\n";
@@ -122,6 +130,11 @@ namespace
       {
         /// Memory allocation for position and coordinate arrays in sparse tensor contractions
         output_alloc_op = insertAllocAndInitialize(loc, dynamicmemTy_1d_index, ValueRange{input_alloc_op_param}, rewriter);
+        if (copyIndexArrays)
+        {
+          /// The output has the sparsity pattern of the sparse input
+          rewriter.create<memref::CopyOp>(loc, input_alloc_op, output_alloc_op);
+        }
       }
       else
       {
@@ -313,7 +326,44 @@ namespace
     auto unrankedMemref_f32 = mlir::UnrankedMemRefType::get(f64Type, 0);
     auto unrankedMemref_index = mlir::UnrankedMemRefType::get(indexType, 0);
 
-    if (rank_size == 2)
+    if (rank_size == 1)
+    {
+      comet_debug() << " Rank Size is 1\n";
+      auto readInput1DF32Func = FunctionType::get(ctx, {i32Type, indexType, indexType,              /// A1_format, A1_tile_format
+                                                        unrankedMemref_index, unrankedMemref_index, /// A1_pos, A1_crd
+                                                        unrankedMemref_index, unrankedMemref_index, /// A1_tile_pos, A1_tile_crd
+                                                        unrankedMemref_f32, i32Type},
+                                                  {});                                              /// last arg (i32Type): readMode
+      auto readInput1DF64Func = FunctionType::get(ctx, {i32Type, indexType, indexType,              /// A1_format, A1_tile_format
+                                                        unrankedMemref_index, unrankedMemref_index, /// A1_pos, A1_crd
+                                                        unrankedMemref_index, unrankedMemref_index, /// A1_tile_pos, A1_tile_crd
+                                                        unrankedMemref_f64, i32Type},
+                                                  {});
+
+      std::string func_name = VALUETYPE.compare("f32") == 0 ? "read_input_1D_f32" : "read_input_1D_f64";
+      if (!hasFuncDeclaration(module, func_name))
+      {
+        comet_debug() << "Adding " << func_name << " to the module\n";
+        func::FuncOp func1 = func::FuncOp::create(function.getLoc(), func_name,
+                                                  VALUETYPE.compare("f32") == 0 ? readInput1DF32Func : readInput1DF64Func,
+                                                  ArrayRef<NamedAttribute>{});
+        func1.setPrivate();
+        module.push_back(func1);
+      }
+
+      auto readInputSizes1DF64Func = FunctionType::get(ctx, {i32Type, indexType, indexType, unrankedMemref_index, i32Type}, {}); /// last arg (i32Type): readMode
+
+      std::string sizes_func_name = VALUETYPE.compare("f32") == 0 ? "read_input_sizes_1D_f32" : "read_input_sizes_1D_f64";
+      if (!hasFuncDeclaration(module, sizes_func_name))
+      {
+        comet_debug() << "Adding " << sizes_func_name << " to the module\n";
+        func::FuncOp func1 = func::FuncOp::create(function.getLoc(), sizes_func_name,
+                                                  readInputSizes1DF64Func, ArrayRef<NamedAttribute>{});
+        func1.setPrivate();
+        module.push_back(func1);
+      }
+    }
+    else if (rank_size == 2)
     {
       comet_debug() << " Rank Size is 2\n";
       auto readInput2DF32Func = FunctionType::get(ctx, {i32Type, indexType, indexType,              /// A1_format, A1_tile_format
@@ -464,6 +514,77 @@ namespace
     }
   }
 
+  /// Map a comet_random() generator name to the id used by the runtime (RandomTensorGenerator), -1 if unknown
+  int32_t getRandomGeneratorID(StringRef generator)
+  {
+    if (generator == "uniform")
+      return RANDOM_UNIFORM;
+    else if (generator == "rmat")
+      return RANDOM_RMAT;
+    else if (generator == "banded")
+      return RANDOM_BANDED;
+    else if (generator == "powerlaw")
+      return RANDOM_POWERLAW;
+
+    return -1;
+  }
+
+  /// Declare the runtime generators used by comet_random() (gen_random_sizes_{2D,3D}, gen_random_{2D,3D}).
+  /// They mirror the read_input_* functions, with the generator, dimension sizes, parameters and seed
+  /// instead of the file ID and read mode. The rank is checked by SparseInputTensorDeclOpLowering.
+  void insertRandomGenLibCall(int rank_size, MLIRContext *ctx, ModuleOp &module, func::FuncOp function)
+  {
+    comet_debug() << "Inserting insertRandomGenLibCall\n";
+    std::string suffix = VALUETYPE.compare("f32") == 0 ? "_f32" : "_f64";
+
+    IndexType indexType = IndexType::get(function.getContext());
+    IntegerType i32Type = IntegerType::get(ctx, 32);
+    FloatType f64Type = FloatType::getF64(ctx);
+    /// TODO(gkestor): there is an issue with F32 UnrankedMemRefType, values are allocated as f64 as in read_input_*
+    auto unrankedMemref_f64 = mlir::UnrankedMemRefType::get(f64Type, 0);
+    auto unrankedMemref_index = mlir::UnrankedMemRefType::get(indexType, 0);
+
+    assert((rank_size == 2 || rank_size == 3) && "comet_random() only generates 2D and 3D tensors");
+
+    /// generator, dims, param0, param1, seed
+    SmallVector<Type, 32> sizesArgs{i32Type};
+    for (int i = 0; i < rank_size; i++)
+      sizesArgs.push_back(indexType);
+    sizesArgs.append({f64Type, f64Type, indexType});
+    SmallVector<Type, 32> genArgs(sizesArgs.begin(), sizesArgs.end());
+
+    /// A1_format, A1_tile_format, ...
+    for (int i = 0; i < 2 * rank_size; i++)
+      sizesArgs.push_back(indexType);
+    sizesArgs.push_back(unrankedMemref_index);
+
+    /// the 3D generator reuses the pattern generated by gen_random_sizes_3D
+    if (rank_size == 3)
+      genArgs.clear();
+    for (int i = 0; i < 2 * rank_size; i++)
+      genArgs.push_back(indexType);
+    for (int i = 0; i < 4 * rank_size; i++)
+      genArgs.push_back(unrankedMemref_index); /// pos, crd, tile_pos, tile_crd per dimension
+    genArgs.push_back(unrankedMemref_f64);
+
+    std::string dim_str = std::to_string(rank_size) + "D";
+    std::vector<std::pair<std::string, FunctionType>> funcs{
+        {"gen_random_sizes_" + dim_str + suffix, FunctionType::get(ctx, sizesArgs, {})},
+        {"gen_random_" + dim_str + suffix, FunctionType::get(ctx, genArgs, {})}};
+
+    for (auto &f : funcs)
+    {
+      if (!hasFuncDeclaration(module, f.first))
+      {
+        comet_debug() << "Adding " << f.first << " to the module\n";
+        func::FuncOp func1 = func::FuncOp::create(function.getLoc(), f.first,
+                                                  f.second, ArrayRef<NamedAttribute>{});
+        func1.setPrivate();
+        module.push_back(func1);
+      }
+    }
+  }
+
   /// This a common lowering function used to lower SparseOutputTensorDeclOp and TempSparseOutputTensorDeclOp
   template <typename T>
   void lowerSparseOutputTensorDec(T op, PatternRewriter &rewriter)
@@ -823,7 +944,19 @@ namespace
             bool isMixedMode = checkIsMixedMode(rhsFormats);
 
             comet_debug() << "IsElementWise: " << isElementwise << " isMixedMode: " << isMixedMode << "\n";
-            if (isElementwise && isMixedMode)
+            if (computeOp.getMaskType() == "sampled")
+            {
+              comet_debug() << "It is a sampled product, the output has the sparsity pattern of the mask\n";
+              /// The mask is the third operand of the RHS, it is the only sparse one
+              mixModeEltWiseMultSparseTensorOutputLowering(computeOp,
+                                                           loc,
+                                                           rhsPerms,
+                                                           dimSizes,
+                                                           tensorload_sizes_vec,
+                                                           array_sizes_vec, rewriter,
+                                                           true /* copyIndexArrays */);
+            }
+            else if (isElementwise && isMixedMode)
             {
               comet_debug() << "It is an elementwise multiplication in mixed Mode sparse = sparse * dense\n";
               if (isMixedMode)
@@ -883,6 +1016,11 @@ namespace
           /// Can get filename, from "filename" attribute of fillfromfileop
           rewriter.eraseOp(fillfromfileop);
         }
+        else if (isa<tensorAlgebra::TensorFillRandomOp>(u))
+        {
+          comet_debug() << " Sparse output is used in TensorFillRandomOp\n";
+          rewriter.eraseOp(u);
+        }
         else if (isa<indexTree::IndexTreeComputeRHSOp>(u))
         {
           comet_debug() << "The tensor is in IndexTreeComputeRHSOp, no action taken\n";
@@ -898,6 +1036,11 @@ namespace
           comet_debug() << "The tensor is in sum op,  no action taken\n";
           continue;
         }
+        else if (isa<tensorAlgebra::TensorUnaryOp>(u))
+        {
+          comet_debug() << "The tensor is in unary map op,  no action taken\n";
+          continue;
+        }
         else if (isa<tensorAlgebra::TensorDimOp>(u))
         {
           comet_debug() << "The tensor is in dim op,  no action taken\n";
@@ -1151,7 +1294,7 @@ namespace
       auto function = cast<func::FuncOp>(op->getParentOp());
       auto module = function.getOperation()->getParentOfType<ModuleOp>();
 
-      std::string op_str = dump2str(op);
+      mlir::Value decl = op.getResult();
       bool isOutputTensor = false;
 
       auto loc = op.getLoc();
@@ -1189,10 +1332,7 @@ namespace
           auto p = cast<tensorAlgebra::TensorMultOp>(u1).getOperation();
           for (unsigned int i = 0; i < p->getNumOperands(); i++)
           {
-            /// comet_vdump(n);
-            std::string n_str = dump2str(p->getOperand(i));
-            comet_debug() << "the operands: " << n_str << "\n";
-            if (n_str.compare(0, op_str.size(), op_str) == 0)
+            if (p->getOperand(i) == decl)
             {
               comet_debug() << " FIND IT: " << i << "\n";
               if (i == 2)
@@ -1208,8 +1348,7 @@ namespace
           auto p = cast<tensorAlgebra::TensorElewsMultOp>(u1).getOperation();
           for (unsigned int i = 0; i < p->getNumOperands(); i++)
           {
-            std::string n_str = dump2str(p->getOperand(i));
-            if (n_str.compare(0, op_str.size(), op_str) == 0)
+            if (p->getOperand(i) == decl)
             {
               comet_debug() << " FIND IT: " << i << "\n";
               if (i == 2)
@@ -1226,8 +1365,7 @@ namespace
           for (unsigned int i = 0; i < p->getNumOperands(); i++)
           {
             comet_debug() << " the " << i << "th operand\n";
-            std::string n_str = dump2str(p->getOperand(i));
-            if (n_str.compare(0, op_str.size(), op_str) == 0)
+            if (p->getOperand(i) == decl)
             {
               comet_debug() << " FIND IT: " << i << "\n";
               if (i == 1)
@@ -1244,8 +1382,7 @@ namespace
           auto p = cast<tensorAlgebra::TransposeOp>(u1).getOperation();
           for (unsigned int i = 0; i < p->getNumOperands(); i++)
           {
-            std::string n_str = dump2str(p->getOperand(i));
-            if (n_str.compare(0, op_str.size(), op_str) == 0)
+            if (p->getOperand(i) == decl)
             {
               comet_debug() << " FIND IT: " << i << "\n";
               if (i == 2)
@@ -1271,6 +1408,11 @@ namespace
           /// do nothing
           comet_debug() << " the tensor is in fill_from_file op\n";
         }
+        else if (isa<tensorAlgebra::TensorFillRandomOp>(u1))
+        {
+          /// do nothing
+          comet_debug() << " the tensor is in fill_random op\n";
+        }
         else if (isa<tensorAlgebra::PrintOp>(u1))
         {
           comet_debug() << " the tensor is in PrintOp\n";
@@ -1279,6 +1421,10 @@ namespace
         {
           comet_debug() << " the tensor is in ReduceOp\n";
         }
+        else if (isa<tensorAlgebra::TensorUnaryOp>(u1))
+        {
+          comet_debug() << " the tensor is in TensorUnaryOp\n";
+        }
         else if (isa<tensorAlgebra::TensorElewsMultOp>(u1))
         {
           comet_debug() << " the tensor is in Elementwise multiplication\n";
@@ -1292,6 +1438,10 @@ namespace
         {
           comet_debug() << " the tensor has use in TensorDimOp and this use will be ignored!\n";
         }
+        else if (isa<tensorAlgebra::ChainOrderSelectOp>(u1))
+        {
+          comet_debug() << " the tensor is an operand of a chain whose order is selected at runtime\n";
+        }
         else
         {
           u1->dump();
@@ -1319,6 +1469,11 @@ namespace
         /// Currently, has no filename
         std::string input_filename;
         int readModeVal = -1;
+        bool isRandomFill = false;
+        int32_t randomGenerator = 0;
+        std::vector<int64_t> randomDims;
+        std::vector<double> randomParams;
+        int64_t randomSeed = 0;
         for (auto u : op.getOperation()->getUsers())
         {
 
@@ -1340,6 +1495,31 @@ namespace
             readModeVal = readModeAttr.getInt();
             comet_debug() << " readMode: " << readModeVal << "\n";
           }
+          /// Used in TensorFillRandomOp: the tensor is generated at runtime instead of read from a file
+          else if (isa<tensorAlgebra::TensorFillRandomOp>(u))
+          {
+            auto fillrandomop = cast<tensorAlgebra::TensorFillRandomOp>(u);
+            isRandomFill = true;
+            randomGenerator = getRandomGeneratorID(fillrandomop.getGenerator());
+            if (randomGenerator == -1)
+            {
+              llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: unknown comet_random generator " << fillrandomop.getGenerator() << "\n";
+              return failure();
+            }
+            if (rank_size != 2 && rank_size != 3)
+            {
+              llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: comet_random() only generates 2D and 3D tensors, not " << rank_size << "D\n";
+              return failure();
+            }
+            for (auto dim : fillrandomop.getDims())
+              randomDims.push_back(dim.cast<IntegerAttr>().getInt());
+            for (auto param : fillrandomop.getParams())
+              randomParams.push_back(param.cast<FloatAttr>().getValueAsDouble());
+            randomSeed = fillrandomop.getSeed();
+            comet_debug() << " generator: " << fillrandomop.getGenerator() << "\n";
+
+            rewriter.eraseOp(fillrandomop);
+          }
         }
 
         comet_debug() << "sp_decl.getParameterCount(): " << sp_decl.getParameterCount() << "\n";
@@ -1357,22 +1537,41 @@ namespace
         IntegerType i32Type = IntegerType::get(op.getContext(), 32);
         Value sparseFileID;
         std::size_t pos = input_filename.find("SPARSE_FILE_NAME");
-        if (pos == std::string::npos) /// not found
+        if (isRandomFill)
+        {
+          /// no file is read for generated tensors
+        }
+        else if (pos == std::string::npos) /// not found
         {
           /// currently, reading of file when path of file is provided as arg is not supported at runtime.
           sparseFileID = rewriter.create<ConstantOp>(loc, i32Type, rewriter.getIntegerAttr(i32Type, -1));
         }
-        /// 16 is the length of SPARSE_FILE_NAME
-        std::string fileID = input_filename.substr(pos + 16, 1); /// this will only catch 0..9
-        if (fileID.empty())
-        { /// SPARSE_FILE_NAME
-          sparseFileID = rewriter.create<ConstantOp>(loc, i32Type, rewriter.getIntegerAttr(i32Type, 9999));
-        }
         else
-        { /// SPARSE_FILE_NAME{int}
-          comet_debug() << " Parsed fileID: " << fileID << "\n";
-          int intFileID = std::stoi(fileID);
-          sparseFileID = rewriter.create<ConstantOp>(loc, i32Type, rewriter.getIntegerAttr(i32Type, intFileID));
+        {
+          /// 16 is the length of SPARSE_FILE_NAME
+          std::string fileID = input_filename.substr(pos + 16, 1); /// this will only catch 0..9
+          if (fileID.empty())
+          { /// SPARSE_FILE_NAME
+            sparseFileID = rewriter.create<ConstantOp>(loc, i32Type, rewriter.getIntegerAttr(i32Type, 9999));
+          }
+          else
+          { /// SPARSE_FILE_NAME{int}
+            comet_debug() << " Parsed fileID: " << fileID << "\n";
+            int intFileID = std::stoi(fileID);
+            sparseFileID = rewriter.create<ConstantOp>(loc, i32Type, rewriter.getIntegerAttr(i32Type, intFileID));
+          }
+        }
+
+        /// generator, dims, param0, param1, seed of the runtime generators
+        std::vector<Value> randomGenArgs;
+        if (isRandomFill)
+        {
+          randomGenArgs.push_back(rewriter.create<ConstantOp>(loc, i32Type, rewriter.getIntegerAttr(i32Type, randomGenerator)));
+          for (auto dim : randomDims)
+            randomGenArgs.push_back(rewriter.create<ConstantIndexOp>(loc, dim));
+          for (auto param : randomParams)
+            randomGenArgs.push_back(rewriter.create<ConstantFloatOp>(loc, APFloat(param), rewriter.getF64Type()));
+          randomGenArgs.push_back(rewriter.create<ConstantIndexOp>(loc, randomSeed));
         }
 
         Value readModeConst;
@@ -1386,7 +1585,39 @@ namespace
         }
 
         ///  Now, setup the runtime calls to read sizes related to the input matrices (e.g., read_input_sizes_2D_f32)
-        if (rank_size == 2)
+        if (isRandomFill)
+        { /// comet_random(): generate the tensor at runtime (e.g., gen_random_sizes_2D_f64)
+          insertRandomGenLibCall(rank_size, ctx, module, function);
+
+          std::string gen_random_sizes_str = "gen_random_sizes_" + std::to_string(rank_size) + "D" +
+                                             (VALUETYPE.compare(0, 3, "f32") == 0 ? "_f32" : "_f64");
+          std::vector<Value> args(randomGenArgs.begin(), randomGenArgs.end());
+          args.insert(args.end(), dim_format.begin(), dim_format.end());
+          args.push_back(alloc_sizes_cast);
+          rewriter.create<func::CallOp>(loc, gen_random_sizes_str, SmallVector<Type, 2>{}, ValueRange{args});
+        }
+        else if (rank_size == 1)
+        { /// 1D, sparse vector
+          comet_debug() << " 1D\n";
+          /// Add function definition to the module
+          insertReadFileLibCall(rank_size, ctx, module, function);
+
+          std::string read_input_sizes_str;
+          if (VALUETYPE.compare(0, 3, "f32") == 0)
+          {
+            read_input_sizes_str = "read_input_sizes_1D_f32";
+          }
+          else
+          {
+            read_input_sizes_str = "read_input_sizes_1D_f64";
+          }
+          auto read_input_sizes_Call = rewriter.create<func::CallOp>(loc, read_input_sizes_str, SmallVector<Type, 2>{},
+                                                                     ValueRange{sparseFileID,
+                                                                                dim_format[0], dim_format[1],
+                                                                                alloc_sizes_cast, readModeConst});
+          read_input_sizes_Call.getOperation()->setAttr("filename", rewriter.getStringAttr(input_filename));
+        }
+        else if (rank_size == 2)
         { /// 2D
           comet_debug() << " 2D\n";
           /// Add function definition to the module
@@ -1433,7 +1664,7 @@ namespace
         }
         else
         {
-          assert(false && " Utility functions to read sparse tensors are supported up to 3 dimensions\n");
+          assert(false && " Utility functions to read sparse tensors are supported from 1 up to 3 dimensions\n");
         }
 
         std::vector<Value> array_sizes;
@@ -1475,7 +1706,42 @@ namespace
         }
 
         /// Now, setup the runtime calls to read the input matrices (e.g., read_input_3D_f64)
-        if (rank_size == 2)
+        if (isRandomFill)
+        { /// comet_random(): fill the arrays with the generated tensor (e.g., gen_random_2D_f64)
+          std::string gen_random_str = "gen_random_" + std::to_string(rank_size) + "D" +
+                                       (VALUETYPE.compare(0, 3, "f32") == 0 ? "_f32" : "_f64");
+          std::vector<Value> args;
+          if (rank_size == 2)
+          {
+            /// the 3D generator hands over the tensor from gen_random_sizes_3D
+            args.insert(args.end(), randomGenArgs.begin(), randomGenArgs.end());
+          }
+          args.insert(args.end(), dim_format.begin(), dim_format.end());
+          args.insert(args.end(), alloc_sizes_cast_vec.begin(), alloc_sizes_cast_vec.end());
+          rewriter.create<func::CallOp>(loc, gen_random_str, SmallVector<Type, 2>{}, ValueRange{args});
+        }
+        else if (rank_size == 1)
+        { /// 1D, sparse vector
+          std::string read_input_str;
+          if (VALUETYPE.compare(0, 3, "f32") == 0)
+          {
+            read_input_str = "read_input_1D_f32";
+          }
+          else
+          {
+            read_input_str = "read_input_1D_f64";
+          }
+          auto read_input_f64Call = rewriter.create<func::CallOp>(loc, read_input_str, SmallVector<Type, 2>{},
+                                                                  ValueRange{sparseFileID,
+                                                                             dim_format[0], dim_format[1], /// A1_format, A1_tile_format
+                                                                             alloc_sizes_cast_vec[0],      /// A1_pos
+                                                                             alloc_sizes_cast_vec[1],      /// A1_crd
+                                                                             alloc_sizes_cast_vec[2],      /// A1_tile_pos
+                                                                             alloc_sizes_cast_vec[3],      /// A1_tile_crd
+                                                                             alloc_sizes_cast_vec[4], readModeConst});
+          read_input_f64Call.getOperation()->setAttr("filename", rewriter.getStringAttr(input_filename));
+        }
+        else if (rank_size == 2)
         { /// 2D
           std::string read_input_str;
           if (VALUETYPE.compare(0, 3, "f32") == 0)
@@ -1553,7 +1819,14 @@ namespace
         auto ty = tensorAlgebra::SparseTensorType::get(elementTypes);
 
         Value sptensor;
-        if (rank_size == 2)
+        if (rank_size == 1)
+        {
+          sptensor = rewriter.create<tensorAlgebra::SparseTensorConstructOp>(loc, ty, ValueRange{alloc_tensor_vec[0], alloc_tensor_vec[1], /// A1
+                                                                                                 alloc_tensor_vec[2], alloc_tensor_vec[3], /// A1_tile
+                                                                                                 alloc_tensor_vec[4], array_sizes[0], array_sizes[1], array_sizes[2], array_sizes[3], array_sizes[4], array_sizes[5]},
+                                                                             1);
+        }
+        else if (rank_size == 2)
         {
           sptensor = rewriter.create<tensorAlgebra::SparseTensorConstructOp>(loc, ty, ValueRange{alloc_tensor_vec[0], alloc_tensor_vec[1], /// A1
                                                                                                  alloc_tensor_vec[2], alloc_tensor_vec[3], /// A1_tile
@@ -1692,6 +1965,7 @@ namespace
 
       target.addLegalOp<tensorAlgebra::PrintOp,
                         tensorAlgebra::ReduceOp,
+                        tensorAlgebra::TensorUnaryOp,
                         tensorAlgebra::TransposeOp,
                         tensorAlgebra::TensorFillOp,
                         tensorAlgebra::GetTimeOp,
@@ -1737,6 +2011,7 @@ namespace
                         tensorAlgebra::GetTimeOp,
                         tensorAlgebra::PrintElapsedTimeOp,
                         tensorAlgebra::ReduceOp,
+                        tensorAlgebra::TensorUnaryOp,
                         tensorAlgebra::TransposeOp,
                         tensorAlgebra::TensorFillOp,
                         tensorAlgebra::SparseTensorConstructOp,
@@ -1785,6 +2060,7 @@ namespace
                         tensorAlgebra::GetTimeOp,
                         tensorAlgebra::PrintElapsedTimeOp,
                         tensorAlgebra::ReduceOp,
+                        tensorAlgebra::TensorUnaryOp,
                         tensorAlgebra::TransposeOp,
                         tensorAlgebra::TensorFillOp,
                         tensorAlgebra::SparseTensorConstructOp,
@@ -1836,6 +2112,7 @@ namespace
                         tensorAlgebra::GetTimeOp,
                         tensorAlgebra::PrintElapsedTimeOp,
                         tensorAlgebra::ReduceOp,
+                        tensorAlgebra::TensorUnaryOp,
                         tensorAlgebra::TransposeOp,
                         tensorAlgebra::TensorFillOp,
                         tensorAlgebra::SparseTensorConstructOp,
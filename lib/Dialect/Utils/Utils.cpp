@@ -31,8 +31,17 @@
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/Affine/IR/AffineOps.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
+#include "mlir/Dialect/Math/IR/Math.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
+#include "mlir/Dialect/Vector/IR/VectorOps.h"
+#include "mlir/IR/IRMapping.h"
+#include "mlir/Interfaces/SideEffectInterfaces.h"
 
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include <set>
 
@@ -547,6 +556,11 @@ namespace mlir
           allFormats[i].push_back("D");
           allFormats[i].push_back("CU");
         }
+        else if (formats_str.compare("SparseVector") == 0)
+        {
+          assert(tensorDims == 1 && "formst is SparseVector, should be a 1D tensor.\n");
+          allFormats[i].push_back("CU");
+        }
         else if (formats_str.compare("ModeGeneric") == 0)
         {
           /// Currently only support modegeneric on 3 D tensor
@@ -694,6 +708,11 @@ namespace mlir
       else if (format.size() == 2 && (format[0].compare("CU") == 0 && format[1].compare("CU") == 0))
         format_ret = "DCSR";
 
+      else if (format.size() == 1 && format[0].compare("SparseVector") == 0)
+        format_ret = "SparseVector";
+      else if (format.size() == 1 && format[0].compare("CU") == 0)
+        format_ret = "SparseVector";
+
       else if (format.size() == 1 && format[0].compare("ELL") == 0)
         format_ret = "ELL";
       /// TODO(gkestor): Individual attributes
@@ -842,7 +861,20 @@ namespace mlir
       comet_debug() << "\n";
       std::vector<Value> dim_format;
 
-      if (rank_size == 2)
+      if (rank_size == 1)
+      { /// 1D
+        comet_debug() << " 1D\n";
+        if (formats_str.compare(0, 12, "SparseVector") == 0 || formats_str.compare("CU") == 0)
+        {
+          dim_format.push_back(format_compressed);
+          dim_format.push_back(format_unk);
+        }
+        else
+        {
+          llvm::errs() << __FILE__ << ":" << __LINE__ << "ERROR: Unsupported formats: " << formats_str << " (tensor dimes: " << rank_size << ") \n";
+        }
+      }
+      else if (rank_size == 2)
       { /// 2D
         comet_debug() << " 2D\n";
         /// Value dim0_format, dim1_format;
@@ -1005,7 +1037,20 @@ namespace mlir
       comet_debug() << "\n";
       std::vector<Value> dim_format;
 
-      if (rank_size == 2)
+      if (rank_size == 1)
+      { /// 1D
+        comet_debug() << " 1D\n";
+        if (formats_str.compare(0, 12, "SparseVector") == 0 || formats_str.compare("CU") == 0)
+        {
+          dim_format.push_back(format_compressed);
+          dim_format.push_back(format_unk);
+        }
+        else
+        {
+          llvm::errs() << __FILE__ << ":" << __LINE__ << "ERROR: Unsupported formats: " << formats_str << " (tensor dimes: " << rank_size << ") \n";
+        }
+      }
+      else if (rank_size == 2)
       { /// 2D
         comet_debug() << " 2D\n";
         /// Value dim0_format, dim1_format;
@@ -2097,6 +2142,477 @@ namespace mlir
       return reassociation;
     }
 
+    /// TTGTCostProfile files are text files with one measurement per line:
+    ///   transpose contiguous <elements/s>
+    ///   transpose strided <elements/s>
+    ///   gemm <m> <n> <k> <flops/s>
+    /// Lines starting with '#' are comments.
+    LogicalResult loadTTGTCostProfile(StringRef path, TTGTCostProfile &profile)
+    {
+      auto buffer = llvm::MemoryBuffer::getFile(path);
+      if (!buffer)
+      {
+        llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: Cannot read the TTGT cost profile " << path << ": "
+                     << buffer.getError().message() << "\n";
+        return failure();
+      }
+
+      profile = TTGTCostProfile();
+      SmallVector<StringRef> lines;
+      (*buffer)->getBuffer().split(lines, '\n', -1, false);
+      for (auto line : lines)
+      {
+        line = line.trim();
+        if (line.empty() || line.starts_with("#"))
+          continue;
+
+        SmallVector<StringRef> fields;
+        line.split(fields, ' ', -1, false);
+        bool valid = false;
+        if (fields.size() == 3 && fields[0] == "transpose")
+        {
+          double rate;
+          valid = !fields[2].getAsDouble(rate) && (fields[1] == "contiguous" || fields[1] == "strided");
+          if (valid)
+            (fields[1] == "contiguous" ? profile.contiguousTransposeRate : profile.stridedTransposeRate) = rate;
+        }
+        else if (fields.size() == 5 && fields[0] == "gemm")
+        {
+          TTGTCostProfile::GemmSample sample;
+          valid = !fields[1].getAsInteger(10, sample.m) && !fields[2].getAsInteger(10, sample.n) &&
+                  !fields[3].getAsInteger(10, sample.k) && !fields[4].getAsDouble(sample.flopsPerSecond) &&
+                  sample.flopsPerSecond > 0;
+          if (valid)
+            profile.gemmSamples.push_back(sample);
+        }
+
+        if (!valid)
+        {
+          llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: Invalid line in the TTGT cost profile " << path << ": "
+                       << line << "\n";
+          return failure();
+        }
+      }
+
+      if (!profile.isValid())
+      {
+        llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: Incomplete TTGT cost profile " << path << "\n";
+        return failure();
+      }
+      return success();
+    }
+
+    LogicalResult saveTTGTCostProfile(StringRef path, const TTGTCostProfile &profile)
+    {
+      std::error_code ec;
+      llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_Text);
+      if (ec)
+      {
+        llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: Cannot write the TTGT cost profile " << path << ": "
+                     << ec.message() << "\n";
+        return failure();
+      }
+
+      os << "# COMET TTGT cost profile\n";
+      os << "transpose contiguous " << llvm::format("%e", profile.contiguousTransposeRate) << "\n";
+      os << "transpose strided " << llvm::format("%e", profile.stridedTransposeRate) << "\n";
+      for (const auto &sample : profile.gemmSamples)
+        os << "gemm " << sample.m << " " << sample.n << " " << sample.k << " "
+           << llvm::format("%e", sample.flopsPerSecond) << "\n";
+      return success();
+    }
+
+    /// Checks that a load or a store of a vectorizable loop accesses the memory with unit stride: the induction
+    /// variable may only be the last index, and the other indices must be invariant in the loop.
+    /// Returns whether the access depends on the induction variable.
+    static FailureOr<bool> getUnitStrideAccess(MemRefType type, ValueRange indices, Value iv,
+                                               const llvm::DenseSet<Value> &variants)
+    {
+      if (!type.getElementType().isIntOrFloat() || !isLastMemrefDimUnitStride(type))
+        return failure();
+      for (size_t d = 0; d + 1 < indices.size(); d++)
+      {
+        if (variants.contains(indices[d]))
+          return failure();
+      }
+      if (indices.empty() || !variants.contains(indices.back()))
+        return false;
+      if (indices.back() != iv)
+        return failure();
+      return true;
+    }
+
+    /// Matches a reduction into the location stored by store: the stored value is the sum or the product of
+    /// a load of the same location and of another value, and the location does not change in the loop
+    static std::optional<LoopReduction> matchLoopReduction(scf::ForOp forOp, memref::StoreOp store)
+    {
+      if (!llvm::all_of(store.getIndices(), [&](Value index)
+                        { return forOp.isDefinedOutsideOfLoop(index); }))
+        return std::nullopt;
+      Operation *combiner = store.getValueToStore().getDefiningOp();
+      if (!combiner || combiner->getBlock() != forOp.getBody() || !isa<arith::AddFOp, arith::MulFOp>(combiner) ||
+          !combiner->hasOneUse())
+        return std::nullopt;
+      for (Value operand : combiner->getOperands())
+      {
+        auto load = operand.getDefiningOp<memref::LoadOp>();
+        if (load && load->getBlock() == forOp.getBody() && load->hasOneUse() &&
+            load.getMemRef() == store.getMemRef() && llvm::equal(load.getIndices(), store.getIndices()) &&
+            load->isBeforeInBlock(store))
+          return LoopReduction{load, combiner, store};
+      }
+      return std::nullopt;
+    }
+
+    bool isVectorizableLoop(scf::ForOp forOp, VectorizableLoop &loop)
+    {
+      if (forOp->hasAttr(kVectorRemainderAttr))
+        return false;
+      std::optional<int64_t> step = getConstantIntValue(forOp.getStep());
+      if (!step || *step != 1 || forOp.getNumRegionIterArgs() != 0)
+        return false;
+
+      /// The reductions, whose memrefs are not accessed otherwise in the loop
+      llvm::DenseSet<Operation *> reductionOps;
+      llvm::DenseSet<Value> reductionMemrefs;
+      for (Operation &op : forOp.getBody()->without_terminator())
+      {
+        if (auto store = dyn_cast<memref::StoreOp>(op))
+        {
+          if (auto reduction = matchLoopReduction(forOp, store))
+          {
+            if (!reductionMemrefs.insert(store.getMemRef()).second)
+              return false;
+            loop.reductions.push_back(*reduction);
+            reductionOps.insert({reduction->load, reduction->combiner, reduction->store});
+          }
+        }
+      }
+
+      Value iv = forOp.getInductionVar();
+      llvm::DenseSet<Value> &variants = loop.variants;
+      variants.insert(iv);
+      /// Indices of the vectorized stores, every other access to the stored memrefs must use the same indices
+      llvm::DenseMap<Value, ValueRange> storedIndices;
+      for (Operation &op : forOp.getBody()->without_terminator())
+      {
+        if (op.getNumRegions() != 0)
+          return false;
+
+        if (reductionOps.contains(&op))
+        {
+          if (op.hasTrait<OpTrait::Vectorizable>() && llvm::is_contained(op.getOperands(), iv))
+            return false;
+          continue;
+        }
+
+        if (auto load = dyn_cast<memref::LoadOp>(op))
+        {
+          auto access = getUnitStrideAccess(load.getMemRefType(), load.getIndices(), iv, variants);
+          if (failed(access) || reductionMemrefs.contains(load.getMemRef()))
+            return false;
+          if (*access)
+            variants.insert(load.getResult());
+          continue;
+        }
+        if (auto store = dyn_cast<memref::StoreOp>(op))
+        {
+          auto access = getUnitStrideAccess(store.getMemRefType(), store.getIndices(), iv, variants);
+          if (failed(access) || !*access || reductionMemrefs.contains(store.getMemRef()))
+            return false;
+          auto stored = storedIndices.find(store.getMemRef());
+          if (stored != storedIndices.end() && !llvm::equal(stored->second, store.getIndices()))
+            return false;
+          storedIndices[store.getMemRef()] = store.getIndices();
+          continue;
+        }
+
+        bool isVariant = llvm::any_of(op.getOperands(), [&](Value operand)
+                                      { return variants.contains(operand); });
+        if (!isVariant)
+        {
+          if (!isMemoryEffectFree(&op))
+            return false;
+          continue;
+        }
+        /// The induction variable itself is only used as an index of the loads and the stores
+        if (llvm::is_contained(op.getOperands(), iv) || !op.hasTrait<OpTrait::Vectorizable>() ||
+            !llvm::all_of(op.getResultTypes(), [](Type type)
+                          { return type.isIntOrFloat(); }))
+          return false;
+        for (Value result : op.getResults())
+          variants.insert(result);
+      }
+      if (storedIndices.empty() && loop.reductions.empty())
+        return false;
+
+      for (Operation &op : forOp.getBody()->without_terminator())
+      {
+        if (auto load = dyn_cast<memref::LoadOp>(op))
+        {
+          auto stored = storedIndices.find(load.getMemRef());
+          if (stored != storedIndices.end() && !llvm::equal(stored->second, load.getIndices()))
+            return false;
+        }
+      }
+      return true;
+    }
+
+    /// Loads and stores at the induction variable become vector.transfer_read and vector.transfer_write,
+    /// loop-invariant scalars are broadcast, a multiplication feeding an addition becomes a vector.fma and
+    /// the reductions accumulate into vectors that are reduced once after the vector loop.
+    void vectorizeLoop(scf::ForOp forOp, unsigned vectorWidth, const VectorizableLoop &loop)
+    {
+      const llvm::DenseSet<Value> &variants = loop.variants;
+      OpBuilder builder(forOp);
+      Location loc = forOp.getLoc();
+      Value lowerBound = forOp.getLowerBound();
+      Value upperBound = forOp.getUpperBound();
+      auto getVectorType = [&](Type type)
+      { return VectorType::get({vectorWidth}, type); };
+
+      /// The end of the vector loop, lowerBound + (upperBound - lowerBound) / vectorWidth * vectorWidth
+      Value vectorEnd;
+      std::optional<int64_t> constLowerBound = getConstantIntValue(lowerBound);
+      std::optional<int64_t> constUpperBound = getConstantIntValue(upperBound);
+      if (constLowerBound && constUpperBound)
+      {
+        int64_t tripCount = std::max<int64_t>(*constUpperBound - *constLowerBound, 0);
+        vectorEnd = builder.create<arith::ConstantIndexOp>(loc, *constLowerBound + tripCount / vectorWidth * vectorWidth);
+      }
+      else
+      {
+        Value width = builder.create<arith::ConstantIndexOp>(loc, vectorWidth);
+        Value tripCount = builder.create<arith::SubIOp>(loc, upperBound, lowerBound);
+        Value remainder = builder.create<arith::RemSIOp>(loc, tripCount, width);
+        vectorEnd = builder.create<arith::SubIOp>(loc, upperBound, remainder);
+      }
+      Value vectorStep = builder.create<arith::ConstantIndexOp>(loc, vectorWidth);
+
+      /// The reductions accumulate into vectors initialized with the neutral element
+      SmallVector<Value> accumulatorInits;
+      llvm::DenseMap<Operation *, unsigned> combiners;
+      for (auto &reduction : loop.reductions)
+      {
+        Type elementType = reduction.load.getMemRefType().getElementType();
+        double neutral = isa<arith::AddFOp>(reduction.combiner) ? 0.0 : 1.0;
+        Value init = builder.create<arith::ConstantOp>(loc, builder.getFloatAttr(elementType, neutral));
+        combiners[reduction.combiner] = accumulatorInits.size();
+        accumulatorInits.push_back(builder.create<vector::BroadcastOp>(loc, getVectorType(elementType), init));
+      }
+      auto vectorLoop = builder.create<scf::ForOp>(loc, lowerBound, vectorEnd, vectorStep, accumulatorInits,
+                                                   [](OpBuilder &b, Location l, Value iv, ValueRange accumulators)
+                                                   { b.create<scf::YieldOp>(l, accumulators); });
+      Operation *yield = vectorLoop.getBody()->getTerminator();
+      SmallVector<Value> accumulators(vectorLoop.getRegionIterArgs().begin(), vectorLoop.getRegionIterArgs().end());
+
+      /// Multiplications whose only use is an addition are fused into a vector.fma
+      llvm::DenseSet<Operation *> fusedMuls;
+      for (Operation &op : forOp.getBody()->without_terminator())
+      {
+        if (!isa<arith::AddFOp>(op) || (!variants.contains(op.getResult(0)) && !combiners.count(&op)))
+          continue;
+        for (Value operand : op.getOperands())
+        {
+          auto mul = operand.getDefiningOp<arith::MulFOp>();
+          if (mul && mul->getBlock() == forOp.getBody() && mul->hasOneUse() && variants.contains(mul.getResult()))
+          {
+            fusedMuls.insert(mul);
+            break;
+          }
+        }
+      }
+
+      builder.setInsertionPoint(yield);
+      IRMapping mapping;
+      mapping.map(forOp.getInductionVar(), vectorLoop.getInductionVar());
+      /// The vector of a value of the loop, broadcasting it if it is invariant
+      auto getVector = [&](Value value) -> Value
+      {
+        Value mapped = mapping.lookupOrDefault(value);
+        if (variants.contains(value))
+          return mapped;
+        return builder.create<vector::BroadcastOp>(loc, getVectorType(value.getType()), mapped);
+      };
+      auto getIndices = [&](ValueRange indices)
+      {
+        return llvm::to_vector(llvm::map_range(indices, [&](Value index)
+                                               { return mapping.lookupOrDefault(index); }));
+      };
+
+      for (Operation &op : forOp.getBody()->without_terminator())
+      {
+        if (fusedMuls.contains(&op))
+          continue;
+
+        if (auto load = dyn_cast<memref::LoadOp>(op))
+        {
+          if (variants.contains(load.getResult()))
+          {
+            Type elementType = load.getMemRefType().getElementType();
+            Value padding = builder.create<arith::ConstantOp>(loc, builder.getZeroAttr(elementType));
+            Value read = builder.create<vector::TransferReadOp>(loc, getVectorType(elementType), load.getMemRef(),
+                                                                getIndices(load.getIndices()), padding,
+                                                                ArrayRef<bool>{true});
+            mapping.map(load.getResult(), read);
+            continue;
+          }
+          /// The load of a reduction is replaced by its accumulator
+          if (llvm::any_of(loop.reductions, [&](const LoopReduction &reduction)
+                           { return reduction.load == load; }))
+            continue;
+        }
+        else if (auto store = dyn_cast<memref::StoreOp>(op))
+        {
+          if (combiners.count(store.getValueToStore().getDefiningOp()))
+            continue;
+          builder.create<vector::TransferWriteOp>(loc, getVector(store.getValueToStore()), store.getMemRef(),
+                                                  getIndices(store.getIndices()), ArrayRef<bool>{true});
+          continue;
+        }
+
+        auto combiner = combiners.find(&op);
+        bool isVariant = llvm::any_of(op.getResults(), [&](Value result)
+                                      { return variants.contains(result); });
+        if (!isVariant && combiner == combiners.end())
+        {
+          /// Loop-invariant scalar computation
+          builder.clone(op, mapping);
+          continue;
+        }
+
+        /// For a reduction, the value combined with the accumulator
+        std::optional<unsigned> reduction;
+        SmallVector<Value> operands;
+        if (combiner != combiners.end())
+        {
+          reduction = combiner->second;
+          for (Value operand : op.getOperands())
+          {
+            if (operand.getDefiningOp() != loop.reductions[*reduction].load.getOperation())
+              operands.push_back(operand);
+          }
+        }
+        else
+        {
+          operands.append(op.getOperand_begin(), op.getOperand_end());
+        }
+
+        Value result;
+        if (isa<arith::AddFOp>(op))
+        {
+          for (unsigned i = 0; i < operands.size(); i++)
+          {
+            auto mul = operands[i].getDefiningOp<arith::MulFOp>();
+            if (mul && fusedMuls.contains(mul))
+            {
+              Value addend = reduction ? accumulators[*reduction] : getVector(operands[1 - i]);
+              result = builder.create<vector::FMAOp>(loc, getVector(mul.getLhs()), getVector(mul.getRhs()), addend);
+              break;
+            }
+          }
+        }
+        if (!result)
+        {
+          /// Elementwise operation on vectors
+          SmallVector<Value> vectorOperands = llvm::to_vector(llvm::map_range(operands, getVector));
+          if (reduction)
+            vectorOperands.push_back(accumulators[*reduction]);
+          SmallVector<Type> resultTypes = llvm::to_vector(llvm::map_range(op.getResultTypes(), getVectorType));
+          result = builder.create(loc, op.getName().getIdentifier(), vectorOperands, resultTypes, op.getAttrs())
+                       ->getResult(0);
+        }
+
+        if (reduction)
+          accumulators[*reduction] = result;
+        else
+          mapping.map(op.getResult(0), result);
+      }
+      yield->setOperands(accumulators);
+
+      /// The accumulators are reduced and combined with the memory locations of the reductions
+      builder.setInsertionPointAfter(vectorLoop);
+      for (auto &reduction : loop.reductions)
+      {
+        unsigned r = combiners[reduction.combiner];
+        auto kind = isa<arith::AddFOp>(reduction.combiner) ? vector::CombiningKind::ADD : vector::CombiningKind::MUL;
+        Value reduced = builder.create<vector::ReductionOp>(loc, kind, vectorLoop.getResult(r));
+        Value current = builder.create<memref::LoadOp>(loc, reduction.load.getMemRef(), reduction.load.getIndices());
+        Value combined = isa<arith::AddFOp>(reduction.combiner)
+                             ? builder.create<arith::AddFOp>(loc, current, reduced).getResult()
+                             : builder.create<arith::MulFOp>(loc, current, reduced).getResult();
+        builder.create<memref::StoreOp>(loc, combined, reduction.store.getMemRef(), reduction.store.getIndices());
+      }
+
+      /// The original loop runs the remaining iterations
+      forOp.setLowerBound(vectorEnd);
+      forOp->setAttr(kVectorRemainderAttr, builder.getUnitAttr());
+      comet_debug() << " Vectorized loop:\n";
+      comet_vdump(vectorLoop);
+    }
+
+    Value genUnaryMap(OpBuilder &builder, Location loc, StringRef op, ArrayRef<double> params, Value v)
+    {
+      Type type = v.getType();
+      auto getConstant = [&](double c) -> Value
+      {
+        return builder.create<arith::ConstantOp>(loc, type, builder.getFloatAttr(type, c));
+      };
+
+      if (op == "relu")
+      {
+        Value zero = getConstant(0.0);
+        Value isPositive = builder.create<arith::CmpFOp>(loc, arith::CmpFPredicate::OGT, v, zero);
+        return builder.create<arith::SelectOp>(loc, isPositive, v, zero);
+      }
+      else if (op == "exp")
+        return builder.create<math::ExpOp>(loc, v);
+      else if (op == "abs")
+        return builder.create<math::AbsFOp>(loc, v);
+      else if (op == "sqrt")
+        return builder.create<math::SqrtOp>(loc, v);
+      else if (op == "scale" && params.size() == 1)
+        return builder.create<arith::MulFOp>(loc, v, getConstant(params[0]));
+      else if (op == "clamp" && params.size() == 2)
+      {
+        Value lo = getConstant(params[0]);
+        Value hi = getConstant(params[1]);
+        Value isBelow = builder.create<arith::CmpFOp>(loc, arith::CmpFPredicate::OLT, v, lo);
+        Value clamped = builder.create<arith::SelectOp>(loc, isBelow, lo, v);
+        Value isAbove = builder.create<arith::CmpFOp>(loc, arith::CmpFPredicate::OGT, clamped, hi);
+        return builder.create<arith::SelectOp>(loc, isAbove, hi, clamped);
+      }
+
+      llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: Unsupported unary map " << op << " with "
+                   << params.size() << " parameters\n";
+      return v;
+    }
+
+    bool isZeroPreservingUnaryMap(StringRef op, ArrayRef<double> params)
+    {
+      if (op == "exp")
+        return false;
+      if (op == "clamp")
+        return params.size() == 2 && params[0] <= 0.0 && params[1] >= 0.0;
+      return true;
+    }
+
+    Value genFusedUnaryMap(OpBuilder &builder, Location loc, Operation *computeOp, Value v)
+    {
+      auto op = computeOp->getAttrOfType<StringAttr>(kUnaryMapAttr);
+      if (!op)
+        return v;
+
+      std::vector<double> params;
+      if (auto paramsAttr = computeOp->getAttrOfType<ArrayAttr>(kUnaryMapParamsAttr))
+      {
+        for (auto p : paramsAttr.getAsValueRange<FloatAttr>())
+          params.push_back(p.convertToDouble());
+      }
+      comet_debug() << " Fused unary map " << op.getValue() << "\n";
+      return genUnaryMap(builder, loc, op.getValue(), params, v);
+    }
+
   } //// namespace tensorAlgebra
 } //// namespace mlir
 
@@ -0,0 +1,143 @@
+//===- ArenaUtils.cpp - Arena allocator for the temporary buffers of kernels ---===//
+//
+// Copyright 2022 Battelle Memorial Institute
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of conditions
+// and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions
+// and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+// WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a thread-local arena from which the generated code allocates the temporary buffers of a
+// function, e.g., workspaces, mark arrays and transposed copies. Allocations bump a pointer in large chunks, and
+// the buffers of a call are released all at once when the function returns, by resetting the arena to the mark
+// taken at its entry. The chunks are kept for the next calls, so that repeated calls of a kernel allocate nothing.
+//===----------------------------------------------------------------------===//
+
+#include "comet/ExecutionEngine/RunnerUtils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+  /// Alignment of every buffer of the arena, the size of a cache line
+  constexpr size_t kArenaAlignment = 64;
+  /// Size of the first chunk of an arena, later chunks double in size
+  constexpr size_t kArenaChunkBytes = size_t(1) << 22;
+  /// A mark stores the index of the current chunk above the bytes used in the chunk
+  constexpr unsigned kArenaMarkChunkShift = 40;
+
+  struct ArenaChunk
+  {
+    char *data;
+    size_t size;
+    size_t used;
+  };
+
+  /// The chunks of the arena of a thread. Chunks after the current one are free.
+  struct Arena
+  {
+    std::vector<ArenaChunk> chunks;
+    size_t current = 0;
+
+    ~Arena()
+    {
+      for (auto &chunk : chunks)
+        free(chunk.data);
+    }
+
+    void *allocate(size_t bytes)
+    {
+      bytes = std::max(kArenaAlignment, (bytes + kArenaAlignment - 1) / kArenaAlignment * kArenaAlignment);
+      if (chunks.empty() || chunks[current].used + bytes > chunks[current].size)
+      {
+        size_t next = chunks.empty() ? 0 : current + 1;
+        /// The free chunks too small for the buffer are replaced with a larger one
+        if (next < chunks.size() && chunks[next].size < bytes)
+        {
+          for (size_t i = next; i < chunks.size(); i++)
+            free(chunks[i].data);
+          chunks.resize(next);
+        }
+        if (next == chunks.size())
+        {
+          size_t size = std::max(bytes, chunks.empty() ? kArenaChunkBytes : 2 * chunks.back().size);
+          char *data = static_cast<char *>(aligned_alloc(kArenaAlignment, size));
+          if (data == nullptr)
+          {
+            fprintf(stderr, "Error: the arena failed to allocate a chunk of %zu bytes\n", size);
+            exit(1);
+          }
+          chunks.push_back({data, size, 0});
+        }
+        current = next;
+        chunks[current].used = 0;
+      }
+
+      ArenaChunk &chunk = chunks[current];
+      void *buffer = chunk.data + chunk.used;
+      chunk.used += bytes;
+      return buffer;
+    }
+
+    int64_t mark() const
+    {
+      if (chunks.empty())
+        return 0;
+      return (int64_t(current) << kArenaMarkChunkShift) | int64_t(chunks[current].used);
+    }
+
+    void release(int64_t mark)
+    {
+      if (chunks.empty())
+        return;
+      current = size_t(mark) >> kArenaMarkChunkShift;
+      chunks[current].used = size_t(mark) & ((size_t(1) << kArenaMarkChunkShift) - 1);
+    }
+  };
+
+  thread_local Arena arena;
+} // namespace
+
+//===----------------------------------------------------------------------===//
+/// Arena allocation of the temporary buffers of the generated code
+//===----------------------------------------------------------------------===//
+/// Returns the mark of the arena at the entry of a function
+extern "C" int64_t comet_arena_mark()
+{
+  return arena.mark();
+}
+
+/// Releases all the buffers allocated since mark was taken
+extern "C" void comet_arena_release(int64_t mark)
+{
+  arena.release(mark);
+}
+
+/// Allocates a buffer of bytes bytes aligned on 64 bytes, returned as a memref<?xi8>
+extern "C" void _mlir_ciface_comet_arena_alloc(StridedMemRefType<int8_t, 1> *result, int64_t bytes)
+{
+  int8_t *buffer = static_cast<int8_t *>(arena.allocate(size_t(bytes)));
+  result->basePtr = buffer;
+  result->data = buffer;
+  result->offset = 0;
+  result->sizes[0] = bytes;
+  result->strides[0] = 1;
+}
@@ -31,10 +31,15 @@
 #include <math.h>
 #include <cstdio>
 #include <limits>
+#include <numeric>
 #include <iomanip>
 
 #include <random>
 #include <map>
+#include <tuple>
+#include <atomic>
+#include <thread>
+#include <memory>
 
 enum MatrixReadOption
 {
@@ -1626,6 +1631,85 @@ uint64_t getNumNonZeros(CooMatrix<T> *coo_matrix, int32_t readMode)
 /// Sparse Utility Functions
 //===----------------------------------------------------------------------===//
 
+/// Read input vectors: a sparse vector is stored in a Matrix Market file of n x 1 or 1 x n,
+/// and its single dimension is compressed (SparseVector format)
+template <typename T>
+void read_input_sizes_1D(int32_t fileID,
+                         int32_t A1format, int32_t A1_tile_format,
+                         int sizes_rank, void *sizes_ptr, int32_t readMode)
+{
+  auto *desc_sizes = static_cast<StridedMemRefType<int64_t, 1> *>(sizes_ptr);
+
+  FileReaderWrapper<T> FileReader(fileID); /// init of COO
+
+  if (A1format == Compressed_unique)
+  {
+    if (FileReader.coo_matrix->num_rows != 1 && FileReader.coo_matrix->num_cols != 1)
+    {
+      llvm::errs() << __FILE__ << ":" << __LINE__ << "ERROR: the input of a sparse vector is not a n x 1 or 1 x n matrix\n";
+    }
+    uint64_t NumNonZeros = FileReader.coo_matrix->num_nonzeros;
+
+    desc_sizes->data[0] = 2;           /// A1_pos
+    desc_sizes->data[1] = NumNonZeros; /// A1_crd
+    desc_sizes->data[2] = 0;           /// A1_tile_pos
+    desc_sizes->data[3] = 0;           /// A1_tile_crd
+    desc_sizes->data[4] = NumNonZeros;
+    desc_sizes->data[5] = FileReader.coo_matrix->num_cols == 1 ? FileReader.coo_matrix->num_rows : FileReader.coo_matrix->num_cols;
+  }
+  else
+  {
+    llvm::errs() << __FILE__ << ":" << __LINE__ << "ERROR: unsupported vector format\n";
+  }
+}
+
+template <typename T>
+void read_input_1D(int32_t fileID,
+                   int32_t A1format, int32_t A1_tile_format,
+                   int A1pos_rank, void *A1pos_ptr,
+                   int A1crd_rank, void *A1crd_ptr,
+                   int A1tile_pos_rank, void *A1tile_pos_ptr,
+                   int A1tile_crd_rank, void *A1tile_crd_ptr,
+                   int Aval_rank, void *Aval_ptr,
+                   int32_t readMode)
+{
+  auto *desc_A1pos = static_cast<StridedMemRefType<int64_t, 1> *>(A1pos_ptr);
+  auto *desc_A1crd = static_cast<StridedMemRefType<int64_t, 1> *>(A1crd_ptr);
+  auto *desc_Aval = static_cast<StridedMemRefType<T, 1> *>(Aval_ptr);
+
+  FileReaderWrapper<T> FileReader(fileID); /// init of COO
+
+  if (A1format == Compressed_unique)
+  {
+    CooMatrix<T> *coo_matrix = FileReader.coo_matrix;
+    /// The coordinates of the vector are the rows of a n x 1 matrix, the columns of a 1 x n one
+    bool isColumn = coo_matrix->num_cols == 1;
+    std::vector<std::pair<uint64_t, T>> entries(coo_matrix->num_nonzeros);
+    for (uint64_t i = 0; i < coo_matrix->num_nonzeros; i++)
+    {
+      entries[i] = {isColumn ? coo_matrix->coo_tuples[i].row : coo_matrix->coo_tuples[i].col,
+                    coo_matrix->coo_tuples[i].val};
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const std::pair<uint64_t, T> &a, const std::pair<uint64_t, T> &b)
+                     { return a.first < b.first; });
+
+    desc_A1pos->data[0] = 0;
+    desc_A1pos->data[1] = entries.size();
+    for (uint64_t i = 0; i < entries.size(); i++)
+    {
+      desc_A1crd->data[i] = entries[i].first;
+      desc_Aval->data[i] = entries[i].second;
+    }
+
+    FileReader.FileReaderWrapperFinalize(); /// clear coo_matrix
+  }
+  else
+  {
+    llvm::errs() << __FILE__ << ":" << __LINE__ << "ERROR: unsupported vector format\n";
+  }
+}
+
 /// Read input matrices based on the datatype
 template <typename T>
 void read_input_sizes_2D(int32_t fileID,
@@ -2349,6 +2433,51 @@ void read_input_3D(int32_t fileID,
   }
 }
 
+/// Utility functions to read sparse vectors and fill in the pos and crd arrays of their dimension
+extern "C" void read_input_1D_f32(int32_t fileID,
+                                  int32_t A1format, int32_t A1_tile_format,
+                                  int A1pos_rank, void *A1pos_ptr,
+                                  int A1crd_rank, void *A1crd_ptr,
+                                  int A1tile_pos_rank, void *A1tile_pos_ptr,
+                                  int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                  int Aval_rank, void *Aval_ptr,
+                                  int32_t readMode)
+{
+  read_input_1D<float>(fileID, A1format, A1_tile_format,
+                       A1pos_rank, A1pos_ptr, A1crd_rank, A1crd_ptr,
+                       A1tile_pos_rank, A1tile_pos_ptr, A1tile_crd_rank, A1tile_crd_ptr,
+                       Aval_rank, Aval_ptr, readMode);
+}
+
+extern "C" void read_input_1D_f64(int32_t fileID,
+                                  int32_t A1format, int32_t A1_tile_format,
+                                  int A1pos_rank, void *A1pos_ptr,
+                                  int A1crd_rank, void *A1crd_ptr,
+                                  int A1tile_pos_rank, void *A1tile_pos_ptr,
+                                  int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                  int Aval_rank, void *Aval_ptr,
+                                  int32_t readMode)
+{
+  read_input_1D<double>(fileID, A1format, A1_tile_format,
+                        A1pos_rank, A1pos_ptr, A1crd_rank, A1crd_ptr,
+                        A1tile_pos_rank, A1tile_pos_ptr, A1tile_crd_rank, A1tile_crd_ptr,
+                        Aval_rank, Aval_ptr, readMode);
+}
+
+extern "C" void read_input_sizes_1D_f32(int32_t fileID,
+                                        int32_t A1format, int32_t A1_tile_format,
+                                        int A1pos_rank, void *A1pos_ptr, int32_t readMode)
+{
+  read_input_sizes_1D<float>(fileID, A1format, A1_tile_format, A1pos_rank, A1pos_ptr, readMode);
+}
+
+extern "C" void read_input_sizes_1D_f64(int32_t fileID,
+                                        int32_t A1format, int32_t A1_tile_format,
+                                        int A1pos_rank, void *A1pos_ptr, int32_t readMode)
+{
+  read_input_sizes_1D<double>(fileID, A1format, A1_tile_format, A1pos_rank, A1pos_ptr, readMode);
+}
+
 /// Utility functions to read sparse matrices and fill in the pos and crd arrays per dimension
 extern "C" void read_input_2D_f32(int32_t fileID,
                                   int32_t A1format, int32_t A1_tile_format,
@@ -2493,6 +2622,677 @@ extern "C" void read_input_sizes_3D_f64(int32_t fileID,
                               A1pos_rank, A1pos_ptr, readMode);
 }
 
+//===----------------------------------------------------------------------===//
+/// Synthetic sparse matrices/tensors (comet_random builtin)
+///
+/// The generators build the sparsity pattern row by row (mode-0 slice by
+/// mode-0 slice for 3D tensors, which are viewed as a d0 x (d1*d2) matrix)
+/// directly in memory. Each row, or each block of R-MAT edges, draws from its
+/// own random stream derived from the user seed, so the generated tensor only
+/// depends on the seed and not on the number of threads.
+//===----------------------------------------------------------------------===//
+
+/// splitmix64 finalizer, used to derive an independent stream per row/block
+static inline uint64_t mixRandomSeed(uint64_t seed, uint64_t stream)
+{
+  uint64_t z = seed + 0x9E3779B97F4A7C15ULL * (stream + 1);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/// Run fn(begin, end) over [0, n) on all hardware threads. Chunks are handed
+/// out dynamically since row lengths of power-law/R-MAT matrices are skewed.
+template <typename Fn>
+static void parallelForRange(uint64_t n, Fn fn)
+{
+  uint64_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+  if (num_threads == 1 || n < 4096)
+  {
+    fn((uint64_t)0, n);
+    return;
+  }
+
+  uint64_t grain = std::max((uint64_t)256, n / (num_threads * 16));
+  std::atomic<uint64_t> next(0);
+  auto worker = [&]()
+  {
+    for (;;)
+    {
+      uint64_t begin = next.fetch_add(grain);
+      if (begin >= n)
+        break;
+      fn(begin, std::min(n, begin + grain));
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (uint64_t t = 1; t < num_threads; t++)
+    workers.emplace_back(worker);
+  worker();
+  for (auto &w : workers)
+    w.join();
+}
+
+/// Draw k distinct column ids from [0, n) and write them sorted to out
+static void sampleDistinctSorted(std::mt19937_64 &rng, uint64_t k, uint64_t n, uint64_t *out)
+{
+  if (2 * k >= n)
+  { /// dense row: selection sampling (Knuth, Algorithm S) is one sorted pass over [0, n)
+    uint64_t selected = 0;
+    for (uint64_t c = 0; c < n && selected < k; c++)
+    {
+      std::uniform_int_distribution<uint64_t> dist(0, n - c - 1);
+      if (dist(rng) < k - selected)
+        out[selected++] = c;
+    }
+    return;
+  }
+
+  /// sparse row: draw with replacement, then sort, unique and top up the duplicates
+  std::uniform_int_distribution<uint64_t> dist(0, n - 1);
+  uint64_t filled = 0;
+  while (filled < k)
+  {
+    for (uint64_t i = filled; i < k; i++)
+      out[i] = dist(rng);
+    std::sort(out, out + k);
+    filled = std::unique(out, out + k) - out;
+  }
+}
+
+/// Row-sorted, duplicate-free pattern produced by the generators
+template <typename T>
+struct RandomSparsePattern
+{
+  uint64_t num_rows;
+  uint64_t num_cols;
+  std::vector<uint64_t> row_offsets;
+  std::vector<uint64_t> col_indices;
+  std::vector<T> values;
+
+  uint64_t num_nonzeros() const { return col_indices.size(); }
+
+  /// Fill the values of every row from the row's own stream
+  void fillValues(uint64_t seed)
+  {
+    values.resize(col_indices.size());
+    parallelForRange(num_rows, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t i = begin; i < end; i++)
+      {
+        std::mt19937_64 rng(mixRandomSeed(seed ^ 0x5DEECE66DULL, i));
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        for (uint64_t p = row_offsets[i]; p < row_offsets[i + 1]; p++)
+          values[p] = (T)dist(rng);
+      } });
+  }
+
+  /// Row-wise generators: the length and the columns of row i only depend on (seed, i),
+  /// so the lengths are drawn in a first pass and the same stream is replayed to fill the row.
+  template <typename LengthFn, typename FillFn>
+  void generateRowWise(uint64_t seed, LengthFn rowLength, FillFn fillRow)
+  {
+    row_offsets.assign(num_rows + 1, 0);
+    parallelForRange(num_rows, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t i = begin; i < end; i++)
+      {
+        std::mt19937_64 rng(mixRandomSeed(seed, i));
+        row_offsets[i + 1] = rowLength(rng, i);
+      } });
+
+    for (uint64_t i = 0; i < num_rows; i++)
+      row_offsets[i + 1] += row_offsets[i];
+    col_indices.resize(row_offsets[num_rows]);
+
+    parallelForRange(num_rows, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t i = begin; i < end; i++)
+      {
+        std::mt19937_64 rng(mixRandomSeed(seed, i));
+        uint64_t len = rowLength(rng, i);
+        fillRow(rng, i, len, col_indices.data() + row_offsets[i]);
+      } });
+  }
+
+  /// R-MAT/Kronecker generator (Graph500 probabilities a=0.57, b=0.19, c=0.19, d=0.05).
+  /// Edges are drawn in fixed-size blocks, bucketed by row and deduplicated per row.
+  void generateRmat(uint64_t seed, double edge_factor)
+  {
+    const double a = 0.57, b = 0.19, c = 0.19;
+    const uint64_t block_size = 1 << 16;
+    /// no edge fits in a matrix without columns
+    uint64_t num_edges = num_cols == 0 ? 0 : (uint64_t)llround(edge_factor * num_rows);
+    unsigned row_scale = 0, col_scale = 0;
+    while ((1ULL << row_scale) < num_rows)
+      row_scale++;
+    while ((1ULL << col_scale) < num_cols)
+      col_scale++;
+    unsigned levels = std::max(row_scale, col_scale);
+
+    std::vector<uint64_t> edge_rows(num_edges), edge_cols(num_edges);
+    uint64_t num_blocks = (num_edges + block_size - 1) / block_size;
+    parallelForRange(num_blocks, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t blk = begin; blk < end; blk++)
+      {
+        std::mt19937_64 rng(mixRandomSeed(seed, blk));
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        for (uint64_t e = blk * block_size; e < std::min(num_edges, (blk + 1) * block_size); e++)
+        {
+          uint64_t r, col;
+          do
+          { /// reject edges that fall outside of a non power-of-two matrix
+            r = 0;
+            col = 0;
+            for (unsigned l = 0; l < levels; l++)
+            {
+              bool has_row_bit = l < row_scale, has_col_bit = l < col_scale;
+              double u = dist(rng);
+              bool bottom, right;
+              if (has_row_bit && has_col_bit)
+              {
+                bottom = u >= a + b;
+                right = bottom ? (u >= a + b + c) : (u >= a);
+              }
+              else
+              { /// only one of the dimensions is left: split with the marginal probabilities
+                bottom = has_row_bit && u >= a + b;
+                right = has_col_bit && u >= a + c;
+              }
+              r = (r << (has_row_bit ? 1 : 0)) | (bottom ? 1 : 0);
+              col = (col << (has_col_bit ? 1 : 0)) | (right ? 1 : 0);
+            }
+          } while (r >= num_rows || col >= num_cols);
+          edge_rows[e] = r;
+          edge_cols[e] = col;
+        }
+      } });
+
+    /// bucket the edges by row
+    std::unique_ptr<std::atomic<uint64_t>[]> cursor(new std::atomic<uint64_t>[num_rows + 1]);
+    for (uint64_t i = 0; i <= num_rows; i++)
+      cursor[i].store(0, std::memory_order_relaxed);
+    parallelForRange(num_edges, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t e = begin; e < end; e++)
+        cursor[edge_rows[e] + 1].fetch_add(1, std::memory_order_relaxed); });
+
+    std::vector<uint64_t> bucket_offsets(num_rows + 1, 0);
+    for (uint64_t i = 0; i < num_rows; i++)
+    {
+      bucket_offsets[i + 1] = bucket_offsets[i] + cursor[i + 1].load(std::memory_order_relaxed);
+      cursor[i].store(bucket_offsets[i], std::memory_order_relaxed);
+    }
+
+    std::vector<uint64_t> bucket_cols(num_edges);
+    parallelForRange(num_edges, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t e = begin; e < end; e++)
+        bucket_cols[cursor[edge_rows[e]].fetch_add(1, std::memory_order_relaxed)] = edge_cols[e]; });
+    std::vector<uint64_t>().swap(edge_rows);
+    std::vector<uint64_t>().swap(edge_cols);
+
+    /// sort and deduplicate every row, then compact
+    row_offsets.assign(num_rows + 1, 0);
+    parallelForRange(num_rows, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t i = begin; i < end; i++)
+      {
+        uint64_t *first = bucket_cols.data() + bucket_offsets[i];
+        uint64_t *last = bucket_cols.data() + bucket_offsets[i + 1];
+        std::sort(first, last);
+        row_offsets[i + 1] = std::unique(first, last) - first;
+      } });
+
+    for (uint64_t i = 0; i < num_rows; i++)
+      row_offsets[i + 1] += row_offsets[i];
+    col_indices.resize(row_offsets[num_rows]);
+
+    parallelForRange(num_rows, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t i = begin; i < end; i++)
+        std::copy(bucket_cols.data() + bucket_offsets[i],
+                  bucket_cols.data() + bucket_offsets[i] + (row_offsets[i + 1] - row_offsets[i]),
+                  col_indices.data() + row_offsets[i]); });
+  }
+
+  RandomSparsePattern(int32_t generator, uint64_t rows, uint64_t cols,
+                      double param0, double param1, uint64_t seed)
+      : num_rows(rows), num_cols(cols)
+  {
+    if (generator == RANDOM_UNIFORM)
+    { /// Erdős–Rényi G(n, p): param0 is the edge probability, or the average row length if >= 1
+      double p = param0 < 1.0 ? param0 : param0 / num_cols;
+      p = std::min(1.0, std::max(0.0, p));
+      generateRowWise(
+          seed,
+          [&](std::mt19937_64 &rng, uint64_t)
+          { return (uint64_t)std::binomial_distribution<uint64_t>(num_cols, p)(rng); },
+          [&](std::mt19937_64 &rng, uint64_t, uint64_t len, uint64_t *out)
+          { sampleDistinctSorted(rng, len, num_cols, out); });
+    }
+    else if (generator == RANDOM_BANDED)
+    { /// every entry with |i - j| <= param0 (half bandwidth)
+      uint64_t bw = (uint64_t)std::max(0.0, param0);
+      generateRowWise(
+          seed,
+          [&](std::mt19937_64 &, uint64_t i)
+          {
+            if (num_cols == 0 || i >= num_cols + bw)
+              return (uint64_t)0;
+            uint64_t first = i > bw ? i - bw : 0;
+            uint64_t last = std::min(num_cols - 1, i + bw);
+            return last - first + 1;
+          },
+          [&](std::mt19937_64 &, uint64_t i, uint64_t len, uint64_t *out)
+          {
+            uint64_t first = i > bw ? i - bw : 0;
+            for (uint64_t p = 0; p < len; p++)
+              out[p] = first + p;
+          });
+    }
+    else if (generator == RANDOM_POWERLAW)
+    { /// Pareto row lengths with mean param0 and exponent param1 (> 2, default 2.5)
+      double alpha = param1 > 2.0 ? param1 : 2.5;
+      double xmin = std::max(1e-9, param0 * (alpha - 2.0) / (alpha - 1.0));
+      generateRowWise(
+          seed,
+          [&](std::mt19937_64 &rng, uint64_t)
+          {
+            double u = 1.0 - std::uniform_real_distribution<double>(0.0, 1.0)(rng); /// (0, 1]
+            double len = std::floor(xmin * std::pow(u, -1.0 / (alpha - 1.0)) + 0.5);
+            return (uint64_t)std::min((double)num_cols, len);
+          },
+          [&](std::mt19937_64 &rng, uint64_t, uint64_t len, uint64_t *out)
+          { sampleDistinctSorted(rng, len, num_cols, out); });
+    }
+    else if (generator == RANDOM_RMAT)
+    { /// param0 is the edge factor: num_rows * param0 edges before deduplication
+      generateRmat(seed, param0);
+    }
+    else
+    {
+      llvm::errs() << __FILE__ << ":" << __LINE__ << "ERROR: unknown random tensor generator " << generator << "\n";
+      row_offsets.assign(num_rows + 1, 0);
+    }
+
+    fillValues(seed);
+  }
+};
+
+using RandomPatternKey = std::tuple<int32_t, uint64_t, uint64_t, uint64_t, double, double, uint64_t>;
+
+/// Patterns generated by gen_random_sizes_* and consumed by the matching gen_random_* call.
+/// assumption: like the file reader, the sizes call is issued before the fill call of the same tensor.
+template <typename T>
+static std::map<RandomPatternKey, RandomSparsePattern<T> *> RandomPatternTracking;
+
+/// fileID under which generated tensors are handed to the format converters of the file reader
+static const int32_t RANDOM_TENSOR_FILE_ID = -2;
+
+template <typename T>
+static RandomSparsePattern<T> *getRandomPattern(int32_t generator, uint64_t dim0, uint64_t dim1, uint64_t dim2,
+                                                double param0, double param1, uint64_t seed, bool release)
+{
+  RandomPatternKey key(generator, dim0, dim1, dim2, param0, param1, seed);
+  RandomSparsePattern<T> *pattern;
+  auto it = RandomPatternTracking<T>.find(key);
+  if (it == RandomPatternTracking<T>.end())
+  {
+    pattern = new RandomSparsePattern<T>(generator, dim0, dim1 * dim2, param0, param1, seed);
+    if (!release)
+      RandomPatternTracking<T>[key] = pattern;
+  }
+  else
+  {
+    pattern = it->second;
+    if (release)
+      RandomPatternTracking<T>.erase(it);
+  }
+  return pattern;
+}
+
+/// Hand a generated matrix to the COO based converters (CSC, DCSR, ELLPACK)
+template <typename T>
+static void trackRandomCooMatrix(RandomSparsePattern<T> *pattern)
+{
+  if (CooTracking<T>.count(RANDOM_TENSOR_FILE_ID) == 1)
+  {
+    CooTracking<T>[RANDOM_TENSOR_FILE_ID]->Clear();
+    delete CooTracking<T>[RANDOM_TENSOR_FILE_ID];
+  }
+
+  CooMatrix<T> *coo_matrix = new CooMatrix<T>();
+  coo_matrix->num_rows = pattern->num_rows;
+  coo_matrix->num_cols = pattern->num_cols;
+  coo_matrix->num_nonzeros = pattern->num_nonzeros();
+  coo_matrix->coo_tuples = new CooTuple<T>[pattern->num_nonzeros()];
+  parallelForRange(pattern->num_rows, [&](uint64_t begin, uint64_t end)
+                   {
+    for (uint64_t i = begin; i < end; i++)
+      for (uint64_t p = pattern->row_offsets[i]; p < pattern->row_offsets[i + 1]; p++)
+        coo_matrix->coo_tuples[p] = CooTuple<T>(i, pattern->col_indices[p], pattern->values[p]); });
+
+  CooTracking<T>[RANDOM_TENSOR_FILE_ID] = coo_matrix;
+}
+
+/// Hand a generated 3D tensor to the COO based converters (COO, CSF, Mode-Generic)
+template <typename T>
+static void trackRandomCoo3DTensor(RandomSparsePattern<T> *pattern, uint64_t dim1, uint64_t dim2)
+{
+  typedef typename Coo3DTensor<T>::Coo3DTuple Coo3DTuple;
+  if (Coo3DTracking<T>.count(RANDOM_TENSOR_FILE_ID) == 1)
+  {
+    Coo3DTracking<T>[RANDOM_TENSOR_FILE_ID]->Clear();
+    delete Coo3DTracking<T>[RANDOM_TENSOR_FILE_ID];
+  }
+
+  Coo3DTensor<T> *coo_3dtensor = new Coo3DTensor<T>();
+  coo_3dtensor->num_index_i = pattern->num_rows;
+  coo_3dtensor->num_index_j = dim1;
+  coo_3dtensor->num_index_k = dim2;
+  coo_3dtensor->num_nonzeros = pattern->num_nonzeros();
+  coo_3dtensor->coo_3dtuples = new Coo3DTuple[pattern->num_nonzeros()];
+  parallelForRange(pattern->num_rows, [&](uint64_t begin, uint64_t end)
+                   {
+    for (uint64_t i = begin; i < end; i++)
+      for (uint64_t p = pattern->row_offsets[i]; p < pattern->row_offsets[i + 1]; p++)
+        coo_3dtensor->coo_3dtuples[p] = Coo3DTuple(i, pattern->col_indices[p] / dim2, pattern->col_indices[p] % dim2, pattern->values[p]); });
+
+  Coo3DTracking<T>[RANDOM_TENSOR_FILE_ID] = coo_3dtensor;
+}
+
+template <typename T>
+void gen_random_sizes_2D(int32_t generator, int64_t dim0, int64_t dim1,
+                         double param0, double param1, int64_t seed,
+                         int32_t A1format, int32_t A1_tile_format,
+                         int32_t A2format, int32_t A2_tile_format,
+                         int sizes_rank, void *sizes_ptr)
+{
+  auto *desc_sizes = static_cast<StridedMemRefType<int64_t, 1> *>(sizes_ptr);
+
+  /// COO and CSR are filled straight from the generated rows
+  if ((A1format == Compressed_nonunique && A2format == singleton) ||
+      (A1format == Dense && A2format == Compressed_unique))
+  {
+    RandomSparsePattern<T> *pattern = getRandomPattern<T>(generator, dim0, dim1, 1, param0, param1, seed, false);
+    uint64_t NumNonZeros = pattern->num_nonzeros();
+    bool isCOO = A1format == Compressed_nonunique;
+
+    desc_sizes->data[0] = isCOO ? 2 : 1;                        /// A1_pos
+    desc_sizes->data[1] = isCOO ? NumNonZeros : 1;              /// A1_crd
+    desc_sizes->data[2] = 0;                                    /// A1_tile_pos
+    desc_sizes->data[3] = 0;                                    /// A1_tile_crd
+    desc_sizes->data[4] = isCOO ? 1 : pattern->num_rows + 1;    /// A2_pos
+    desc_sizes->data[5] = NumNonZeros;                          /// A2_crd
+    desc_sizes->data[6] = 0;                                    /// A2_tile_pos
+    desc_sizes->data[7] = 0;                                    /// A2_tile_crd
+    desc_sizes->data[8] = NumNonZeros;
+    desc_sizes->data[9] = pattern->num_rows;
+    desc_sizes->data[10] = pattern->num_cols;
+  }
+  else
+  {
+    RandomSparsePattern<T> *pattern = getRandomPattern<T>(generator, dim0, dim1, 1, param0, param1, seed, true);
+    trackRandomCooMatrix(pattern);
+    delete pattern;
+
+    read_input_sizes_2D<T>(RANDOM_TENSOR_FILE_ID, A1format, A1_tile_format, A2format, A2_tile_format,
+                           sizes_rank, sizes_ptr, DEFAULT);
+  }
+}
+
+template <typename T>
+void gen_random_2D(int32_t generator, int64_t dim0, int64_t dim1,
+                   double param0, double param1, int64_t seed,
+                   int32_t A1format, int32_t A1_tile_format,
+                   int32_t A2format, int32_t A2_tile_format,
+                   int A1pos_rank, void *A1pos_ptr,
+                   int A1crd_rank, void *A1crd_ptr,
+                   int A1tile_pos_rank, void *A1tile_pos_ptr,
+                   int A1tile_crd_rank, void *A1tile_crd_ptr,
+                   int A2pos_rank, void *A2pos_ptr,
+                   int A2crd_rank, void *A2crd_ptr,
+                   int A2tile_pos_rank, void *A2tile_pos_ptr,
+                   int A2tile_crd_rank, void *A2tile_crd_ptr,
+                   int Aval_rank, void *Aval_ptr)
+{
+  if (!((A1format == Compressed_nonunique && A2format == singleton) ||
+        (A1format == Dense && A2format == Compressed_unique)))
+  { /// the matrix was handed over to the file reader in gen_random_sizes_2D
+    read_input_2D<T>(RANDOM_TENSOR_FILE_ID, A1format, A1_tile_format, A2format, A2_tile_format,
+                     A1pos_rank, A1pos_ptr, A1crd_rank, A1crd_ptr,
+                     A1tile_pos_rank, A1tile_pos_ptr, A1tile_crd_rank, A1tile_crd_ptr,
+                     A2pos_rank, A2pos_ptr, A2crd_rank, A2crd_ptr,
+                     A2tile_pos_rank, A2tile_pos_ptr, A2tile_crd_rank, A2tile_crd_ptr,
+                     Aval_rank, Aval_ptr, DEFAULT);
+    return;
+  }
+
+  auto *desc_A1pos = static_cast<StridedMemRefType<int64_t, 1> *>(A1pos_ptr);
+  auto *desc_A1crd = static_cast<StridedMemRefType<int64_t, 1> *>(A1crd_ptr);
+  auto *desc_A2pos = static_cast<StridedMemRefType<int64_t, 1> *>(A2pos_ptr);
+  auto *desc_A2crd = static_cast<StridedMemRefType<int64_t, 1> *>(A2crd_ptr);
+  auto *desc_A1tile_pos = static_cast<StridedMemRefType<int64_t, 1> *>(A1tile_pos_ptr);
+  auto *desc_A1tile_crd = static_cast<StridedMemRefType<int64_t, 1> *>(A1tile_crd_ptr);
+  auto *desc_A2tile_pos = static_cast<StridedMemRefType<int64_t, 1> *>(A2tile_pos_ptr);
+  auto *desc_A2tile_crd = static_cast<StridedMemRefType<int64_t, 1> *>(A2tile_crd_ptr);
+  auto *desc_Aval = static_cast<StridedMemRefType<T, 1> *>(Aval_ptr);
+
+  desc_A1pos->data[0] = -1;
+  desc_A1crd->data[0] = -1;
+  desc_A2pos->data[0] = -1;
+  desc_A2crd->data[0] = -1;
+  desc_A1tile_pos->data[0] = -1;
+  desc_A1tile_crd->data[0] = -1;
+  desc_A2tile_pos->data[0] = -1;
+  desc_A2tile_crd->data[0] = -1;
+
+  RandomSparsePattern<T> *pattern = getRandomPattern<T>(generator, dim0, dim1, 1, param0, param1, seed, true);
+
+  /// COO
+  if (A1format == Compressed_nonunique)
+  {
+    desc_A1pos->data[0] = 0;
+    desc_A1pos->data[1] = pattern->num_nonzeros();
+    parallelForRange(pattern->num_rows, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t i = begin; i < end; i++)
+        for (uint64_t p = pattern->row_offsets[i]; p < pattern->row_offsets[i + 1]; p++)
+        {
+          desc_A1crd->data[p] = i;
+          desc_A2crd->data[p] = pattern->col_indices[p];
+          desc_Aval->data[p] = pattern->values[p];
+        } });
+  }
+  /// CSR
+  else
+  {
+    desc_A1pos->data[0] = pattern->num_rows;
+    desc_A2pos->data[0] = 0;
+    parallelForRange(pattern->num_rows, [&](uint64_t begin, uint64_t end)
+                     {
+      for (uint64_t i = begin; i < end; i++)
+      {
+        desc_A2pos->data[i + 1] = pattern->row_offsets[i + 1];
+        for (uint64_t p = pattern->row_offsets[i]; p < pattern->row_offsets[i + 1]; p++)
+        {
+          desc_A2crd->data[p] = pattern->col_indices[p];
+          desc_Aval->data[p] = pattern->values[p];
+        }
+      } });
+  }
+
+  delete pattern;
+}
+
+template <typename T>
+void gen_random_sizes_3D(int32_t generator, int64_t dim0, int64_t dim1, int64_t dim2,
+                         double param0, double param1, int64_t seed,
+                         int32_t A1format, int32_t A1_tile_format,
+                         int32_t A2format, int32_t A2_tile_format,
+                         int32_t A3format, int32_t A3_tile_format,
+                         int sizes_rank, void *sizes_ptr)
+{
+  /// 3D tensors are generated as a dim0 x (dim1 * dim2) matrix and converted by the .tns reader
+  RandomSparsePattern<T> *pattern = getRandomPattern<T>(generator, dim0, dim1, dim2, param0, param1, seed, true);
+  trackRandomCoo3DTensor(pattern, dim1, dim2);
+  delete pattern;
+
+  read_input_sizes_3D<T>(RANDOM_TENSOR_FILE_ID, A1format, A1_tile_format, A2format, A2_tile_format,
+                         A3format, A3_tile_format, sizes_rank, sizes_ptr, DEFAULT);
+}
+
+template <typename T>
+void gen_random_3D(int32_t A1format, int32_t A1_tile_format,
+                   int32_t A2format, int32_t A2_tile_format,
+                   int32_t A3format, int32_t A3_tile_format,
+                   int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                   int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                   int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                   int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                   int A3pos_rank, void *A3pos_ptr, int A3crd_rank, void *A3crd_ptr,
+                   int A3tile_pos_rank, void *A3tile_pos_ptr, int A3tile_crd_rank, void *A3tile_crd_ptr,
+                   int Aval_rank, void *Aval_ptr)
+{
+  read_input_3D<T>(RANDOM_TENSOR_FILE_ID, A1format, A1_tile_format, A2format, A2_tile_format,
+                   A3format, A3_tile_format,
+                   A1pos_rank, A1pos_ptr, A1crd_rank, A1crd_ptr,
+                   A1tile_pos_rank, A1tile_pos_ptr, A1tile_crd_rank, A1tile_crd_ptr,
+                   A2pos_rank, A2pos_ptr, A2crd_rank, A2crd_ptr,
+                   A2tile_pos_rank, A2tile_pos_ptr, A2tile_crd_rank, A2tile_crd_ptr,
+                   A3pos_rank, A3pos_ptr, A3crd_rank, A3crd_ptr,
+                   A3tile_pos_rank, A3tile_pos_ptr, A3tile_crd_rank, A3tile_crd_ptr,
+                   Aval_rank, Aval_ptr, DEFAULT);
+}
+
+/// Utility functions to generate synthetic sparse matrices/tensors, mirroring read_input_sizes_* and read_input_*
+extern "C" void gen_random_sizes_2D_f32(int32_t generator, int64_t dim0, int64_t dim1,
+                                        double param0, double param1, int64_t seed,
+                                        int32_t A1format, int32_t A1_tile_format,
+                                        int32_t A2format, int32_t A2_tile_format,
+                                        int A1pos_rank, void *A1pos_ptr)
+{
+  gen_random_sizes_2D<float>(generator, dim0, dim1, param0, param1, seed,
+                             A1format, A1_tile_format, A2format, A2_tile_format, A1pos_rank, A1pos_ptr);
+}
+
+extern "C" void gen_random_sizes_2D_f64(int32_t generator, int64_t dim0, int64_t dim1,
+                                        double param0, double param1, int64_t seed,
+                                        int32_t A1format, int32_t A1_tile_format,
+                                        int32_t A2format, int32_t A2_tile_format,
+                                        int A1pos_rank, void *A1pos_ptr)
+{
+  gen_random_sizes_2D<double>(generator, dim0, dim1, param0, param1, seed,
+                              A1format, A1_tile_format, A2format, A2_tile_format, A1pos_rank, A1pos_ptr);
+}
+
+extern "C" void gen_random_2D_f32(int32_t generator, int64_t dim0, int64_t dim1,
+                                  double param0, double param1, int64_t seed,
+                                  int32_t A1format, int32_t A1_tile_format,
+                                  int32_t A2format, int32_t A2_tile_format,
+                                  int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                  int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                  int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                                  int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                                  int Aval_rank, void *Aval_ptr)
+{
+  gen_random_2D<float>(generator, dim0, dim1, param0, param1, seed,
+                       A1format, A1_tile_format, A2format, A2_tile_format,
+                       A1pos_rank, A1pos_ptr, A1crd_rank, A1crd_ptr,
+                       A1tile_pos_rank, A1tile_pos_ptr, A1tile_crd_rank, A1tile_crd_ptr,
+                       A2pos_rank, A2pos_ptr, A2crd_rank, A2crd_ptr,
+                       A2tile_pos_rank, A2tile_pos_ptr, A2tile_crd_rank, A2tile_crd_ptr,
+                       Aval_rank, Aval_ptr);
+}
+
+extern "C" void gen_random_2D_f64(int32_t generator, int64_t dim0, int64_t dim1,
+                                  double param0, double param1, int64_t seed,
+                                  int32_t A1format, int32_t A1_tile_format,
+                                  int32_t A2format, int32_t A2_tile_format,
+                                  int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                  int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                  int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                                  int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                                  int Aval_rank, void *Aval_ptr)
+{
+  gen_random_2D<double>(generator, dim0, dim1, param0, param1, seed,
+                        A1format, A1_tile_format, A2format, A2_tile_format,
+                        A1pos_rank, A1pos_ptr, A1crd_rank, A1crd_ptr,
+                        A1tile_pos_rank, A1tile_pos_ptr, A1tile_crd_rank, A1tile_crd_ptr,
+                        A2pos_rank, A2pos_ptr, A2crd_rank, A2crd_ptr,
+                        A2tile_pos_rank, A2tile_pos_ptr, A2tile_crd_rank, A2tile_crd_ptr,
+                        Aval_rank, Aval_ptr);
+}
+
+extern "C" void gen_random_sizes_3D_f32(int32_t generator, int64_t dim0, int64_t dim1, int64_t dim2,
+                                        double param0, double param1, int64_t seed,
+                                        int32_t A1format, int32_t A1_tile_format,
+                                        int32_t A2format, int32_t A2_tile_format,
+                                        int32_t A3format, int32_t A3_tile_format,
+                                        int A1pos_rank, void *A1pos_ptr)
+{
+  gen_random_sizes_3D<float>(generator, dim0, dim1, dim2, param0, param1, seed,
+                             A1format, A1_tile_format, A2format, A2_tile_format, A3format, A3_tile_format,
+                             A1pos_rank, A1pos_ptr);
+}
+
+extern "C" void gen_random_sizes_3D_f64(int32_t generator, int64_t dim0, int64_t dim1, int64_t dim2,
+                                        double param0, double param1, int64_t seed,
+                                        int32_t A1format, int32_t A1_tile_format,
+                                        int32_t A2format, int32_t A2_tile_format,
+                                        int32_t A3format, int32_t A3_tile_format,
+                                        int A1pos_rank, void *A1pos_ptr)
+{
+  gen_random_sizes_3D<double>(generator, dim0, dim1, dim2, param0, param1, seed,
+                              A1format, A1_tile_format, A2format, A2_tile_format, A3format, A3_tile_format,
+                              A1pos_rank, A1pos_ptr);
+}
+
+extern "C" void gen_random_3D_f32(int32_t A1format, int32_t A1_tile_format,
+                                  int32_t A2format, int32_t A2_tile_format,
+                                  int32_t A3format, int32_t A3_tile_format,
+                                  int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                  int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                  int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                                  int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                                  int A3pos_rank, void *A3pos_ptr, int A3crd_rank, void *A3crd_ptr,
+                                  int A3tile_pos_rank, void *A3tile_pos_ptr, int A3tile_crd_rank, void *A3tile_crd_ptr,
+                                  int Aval_rank, void *Aval_ptr)
+{
+  gen_random_3D<float>(A1format, A1_tile_format, A2format, A2_tile_format, A3format, A3_tile_format,
+                       A1pos_rank, A1pos_ptr, A1crd_rank, A1crd_ptr,
+                       A1tile_pos_rank, A1tile_pos_ptr, A1tile_crd_rank, A1tile_crd_ptr,
+                       A2pos_rank, A2pos_ptr, A2crd_rank, A2crd_ptr,
+                       A2tile_pos_rank, A2tile_pos_ptr, A2tile_crd_rank, A2tile_crd_ptr,
+                       A3pos_rank, A3pos_ptr, A3crd_rank, A3crd_ptr,
+                       A3tile_pos_rank, A3tile_pos_ptr, A3tile_crd_rank, A3tile_crd_ptr,
+                       Aval_rank, Aval_ptr);
+}
+
+extern "C" void gen_random_3D_f64(int32_t A1format, int32_t A1_tile_format,
+                                  int32_t A2format, int32_t A2_tile_format,
+                                  int32_t A3format, int32_t A3_tile_format,
+                                  int A1pos_rank, void *A1pos_ptr, int A1crd_rank, void *A1crd_ptr,
+                                  int A1tile_pos_rank, void *A1tile_pos_ptr, int A1tile_crd_rank, void *A1tile_crd_ptr,
+                                  int A2pos_rank, void *A2pos_ptr, int A2crd_rank, void *A2crd_ptr,
+                                  int A2tile_pos_rank, void *A2tile_pos_ptr, int A2tile_crd_rank, void *A2tile_crd_ptr,
+                                  int A3pos_rank, void *A3pos_ptr, int A3crd_rank, void *A3crd_ptr,
+                                  int A3tile_pos_rank, void *A3tile_pos_ptr, int A3tile_crd_rank, void *A3tile_crd_ptr,
+                                  int Aval_rank, void *Aval_ptr)
+{
+  gen_random_3D<double>(A1format, A1_tile_format, A2format, A2_tile_format, A3format, A3_tile_format,
+                        A1pos_rank, A1pos_ptr, A1crd_rank, A1crd_ptr,
+                        A1tile_pos_rank, A1tile_pos_ptr, A1tile_crd_rank, A1tile_crd_ptr,
+                        A2pos_rank, A2pos_ptr, A2crd_rank, A2crd_ptr,
+                        A2tile_pos_rank, A2tile_pos_ptr, A2tile_crd_rank, A2tile_crd_ptr,
+                        A3pos_rank, A3pos_ptr, A3crd_rank, A3crd_ptr,
+                        A3tile_pos_rank, A3tile_pos_ptr, A3tile_crd_rank, A3tile_crd_ptr,
+                        Aval_rank, Aval_ptr);
+}
+
 //===----------------------------------------------------------------------===//
 ///  Sort a vector within a range [first, last).
 //===----------------------------------------------------------------------===//
@@ -2505,4 +3305,294 @@ extern "C" void comet_sort_index(int64_t rank, void *ptr, int64_t index_first, i
 {
   UnrankedMemRefType<int64_t> descriptor = {rank, ptr};
   _milr_ciface_comet_sort(&descriptor, index_first, index_last);
-}
\ No newline at end of file
+}
+
+//===----------------------------------------------------------------------===//
+///  Sort the column indices of every row of a CSR matrix, along with their values, in one call.
+///  Short rows are sorted by insertion, medium rows by comparison, and long rows by an LSD radix
+///  sort on the bytes of the indices. The rows are distributed over the hardware threads.
+//===----------------------------------------------------------------------===//
+static const int64_t kInsertionSortMaxSegment = 32;
+static const int64_t kRadixSortMinSegment = 1024;
+
+/// Buffers of the sorts of the longer rows, reused across the rows of a thread
+struct SegmentSortScratch
+{
+  std::vector<std::pair<int64_t, double>> pairs;
+  std::vector<int64_t> idx;
+  std::vector<double> val;
+};
+
+static void insertionSortSegment(int64_t *idx, double *val, int64_t n)
+{
+  for (int64_t i = 1; i < n; i++)
+  {
+    int64_t key = idx[i];
+    double v = val[i];
+    int64_t j = i - 1;
+    for (; j >= 0 && idx[j] > key; j--)
+    {
+      idx[j + 1] = idx[j];
+      val[j + 1] = val[j];
+    }
+    idx[j + 1] = key;
+    val[j + 1] = v;
+  }
+}
+
+static void comparisonSortSegment(int64_t *idx, double *val, int64_t n, SegmentSortScratch &scratch)
+{
+  scratch.pairs.resize(n);
+  for (int64_t i = 0; i < n; i++)
+    scratch.pairs[i] = {idx[i], val[i]};
+  std::sort(scratch.pairs.begin(), scratch.pairs.end(),
+            [](const std::pair<int64_t, double> &a, const std::pair<int64_t, double> &b)
+            { return a.first < b.first; });
+  for (int64_t i = 0; i < n; i++)
+  {
+    idx[i] = scratch.pairs[i].first;
+    val[i] = scratch.pairs[i].second;
+  }
+}
+
+/// One stable counting pass per byte of the largest index, so that a row of a matrix with up to 65536 columns
+/// takes two passes
+static void radixSortSegment(int64_t *idx, double *val, int64_t n, SegmentSortScratch &scratch)
+{
+  int64_t max_idx = *std::max_element(idx, idx + n);
+  scratch.idx.resize(n);
+  scratch.val.resize(n);
+  int64_t *src_idx = idx, *dst_idx = scratch.idx.data();
+  double *src_val = val, *dst_val = scratch.val.data();
+  for (int shift = 0; shift < 64 && (max_idx >> shift) > 0; shift += 8)
+  {
+    int64_t count[257] = {0};
+    for (int64_t i = 0; i < n; i++)
+      count[((src_idx[i] >> shift) & 0xFF) + 1]++;
+    for (int d = 0; d < 256; d++)
+      count[d + 1] += count[d];
+    for (int64_t i = 0; i < n; i++)
+    {
+      int64_t pos = count[(src_idx[i] >> shift) & 0xFF]++;
+      dst_idx[pos] = src_idx[i];
+      dst_val[pos] = src_val[i];
+    }
+    std::swap(src_idx, dst_idx);
+    std::swap(src_val, dst_val);
+  }
+  if (src_idx != idx)
+  {
+    std::copy(src_idx, src_idx + n, idx);
+    std::copy(src_val, src_val + n, val);
+  }
+}
+
+extern "C" void _mlir_ciface_comet_sort_index_segments(UnrankedMemRefType<int64_t> *rowptr, UnrankedMemRefType<int64_t> *col,
+                                                       UnrankedMemRefType<double> *val, int64_t num_rows)
+{
+  DynamicMemRefType<int64_t> rowptrRef(*rowptr);
+  DynamicMemRefType<int64_t> colRef(*col);
+  DynamicMemRefType<double> valRef(*val);
+  const int64_t *row_ptr = rowptrRef.data + rowptrRef.offset;
+  int64_t *col_idx = colRef.data + colRef.offset;
+  double *values = valRef.data + valRef.offset;
+
+  parallelForRange(num_rows, [&](uint64_t begin, uint64_t end)
+                   {
+    SegmentSortScratch scratch;
+    for (uint64_t i = begin; i < end; i++)
+    {
+      int64_t first = row_ptr[i];
+      int64_t n = row_ptr[i + 1] - first;
+      if (n <= kInsertionSortMaxSegment)
+        insertionSortSegment(col_idx + first, values + first, n);
+      else if (n < kRadixSortMinSegment)
+        comparisonSortSegment(col_idx + first, values + first, n, scratch);
+      else
+        radixSortSegment(col_idx + first, values + first, n, scratch);
+    } });
+}
+
+extern "C" void comet_sort_index_segments(int64_t rowptr_rank, void *rowptr_ptr, int64_t col_rank, void *col_ptr,
+                                          int64_t val_rank, void *val_ptr, int64_t num_rows)
+{
+  UnrankedMemRefType<int64_t> rowptr = {rowptr_rank, rowptr_ptr};
+  UnrankedMemRefType<int64_t> col = {col_rank, col_ptr};
+  UnrankedMemRefType<double> val = {val_rank, val_ptr};
+  _mlir_ciface_comet_sort_index_segments(&rowptr, &col, &val, num_rows);
+}
+//===----------------------------------------------------------------------===//
+///  Runtime ordering of chains of sparse matrix multiplications.
+///  Every operand of the chain is summarized by a sketch (its number of nonzeros per row and per column),
+///  from which the cost and the sparsity of every product of a candidate contraction order are estimated.
+//===----------------------------------------------------------------------===//
+
+/// Sketch of a matrix stored at offset in the sketches buffer: [rows, cols, nonzeros per row, nonzeros per column]
+struct ChainSketch
+{
+  int64_t rows, cols;
+  bool isDense; /// dense matrices are iterated in full, regardless of their zeros
+  std::vector<double> rowCounts, colCounts;
+  double nnz;
+};
+
+static ChainSketch readChainSketch(const double *sketches, int64_t &offset)
+{
+  ChainSketch sketch;
+  sketch.rows = (int64_t)sketches[offset];
+  sketch.cols = (int64_t)sketches[offset + 1];
+  sketch.rowCounts.assign(sketches + offset + 2, sketches + offset + 2 + sketch.rows);
+  sketch.colCounts.assign(sketches + offset + 2 + sketch.rows, sketches + offset + 2 + sketch.rows + sketch.cols);
+  sketch.nnz = std::accumulate(sketch.rowCounts.begin(), sketch.rowCounts.end(), 0.0);
+  sketch.isDense = sketch.nnz == (double)sketch.rows * sketch.cols;
+  offset += 2 + sketch.rows + sketch.cols;
+  return sketch;
+}
+
+/// Estimates the sketch of C = A * B and the cost of computing it.
+/// Row i of C receives about rowCounts_A[i] * (#products / nnz(A)) products, which are assumed
+/// to fall uniformly among the columns of C (and symmetrically for the columns of C).
+static ChainSketch multiplyChainSketches(const ChainSketch &A, const ChainSketch &B, double &cost)
+{
+  double products = 0.0;
+  for (int64_t k = 0; k < A.cols && k < B.rows; k++)
+  {
+    products += A.colCounts[k] * B.rowCounts[k];
+  }
+
+  ChainSketch C;
+  C.rows = A.rows;
+  C.cols = B.cols;
+  C.isDense = A.isDense || B.isDense;
+  if (C.isDense)
+  {
+    /// the product of a dense and a sparse matrix is stored, and later iterated, as a dense matrix
+    C.rowCounts.assign(C.rows, (double)C.cols);
+    C.colCounts.assign(C.cols, (double)C.rows);
+    C.nnz = (double)C.rows * C.cols;
+    cost = products + C.nnz;
+    return C;
+  }
+
+  double rowScale = A.nnz > 0 ? products / A.nnz : 0.0;
+  double colScale = B.nnz > 0 ? products / B.nnz : 0.0;
+  C.rowCounts.resize(C.rows);
+  C.colCounts.resize(C.cols);
+  for (int64_t i = 0; i < C.rows; i++)
+  {
+    C.rowCounts[i] = C.cols * (1.0 - std::exp(-A.rowCounts[i] * rowScale / std::max<int64_t>(C.cols, 1)));
+  }
+  for (int64_t j = 0; j < C.cols; j++)
+  {
+    C.colCounts[j] = C.rows * (1.0 - std::exp(-B.colCounts[j] * colScale / std::max<int64_t>(C.rows, 1)));
+  }
+  C.nnz = std::accumulate(C.rowCounts.begin(), C.rowCounts.end(), 0.0);
+  /// sparse outputs are computed by a symbolic and a numeric phase
+  cost = 2 * products + C.nnz;
+  return C;
+}
+
+extern "C" void _mlir_ciface_comet_chain_sketch_csr(UnrankedMemRefType<double> *sketches, int64_t offset,
+                                                    UnrankedMemRefType<int64_t> *pos, UnrankedMemRefType<int64_t> *crd,
+                                                    int64_t rows, int64_t cols)
+{
+  DynamicMemRefType<double> sketchesRef(*sketches);
+  DynamicMemRefType<int64_t> posRef(*pos);
+  DynamicMemRefType<int64_t> crdRef(*crd);
+  double *sketch = sketchesRef.data + sketchesRef.offset + offset;
+  const int64_t *rowPtr = posRef.data + posRef.offset;
+  const int64_t *colIdx = crdRef.data + crdRef.offset;
+
+  sketch[0] = rows;
+  sketch[1] = cols;
+  double *rowCounts = sketch + 2;
+  double *colCounts = sketch + 2 + rows;
+  std::fill(colCounts, colCounts + cols, 0.0);
+  for (int64_t i = 0; i < rows; i++)
+  {
+    rowCounts[i] = rowPtr[i + 1] - rowPtr[i];
+    for (int64_t p = rowPtr[i]; p < rowPtr[i + 1]; p++)
+    {
+      colCounts[colIdx[p]] += 1.0;
+    }
+  }
+}
+
+extern "C" void _mlir_ciface_comet_chain_sketch_dense(UnrankedMemRefType<double> *sketches, int64_t offset,
+                                                      int64_t rows, int64_t cols)
+{
+  DynamicMemRefType<double> sketchesRef(*sketches);
+  double *sketch = sketchesRef.data + sketchesRef.offset + offset;
+
+  sketch[0] = rows;
+  sketch[1] = cols;
+  std::fill(sketch + 2, sketch + 2 + rows, (double)cols);
+  std::fill(sketch + 2 + rows, sketch + 2 + rows + cols, (double)rows);
+}
+
+/// candidates holds the number of operands n, the number of candidate orders,
+/// then the n - 1 steps (lhs node, rhs node) of every candidate. Nodes [0, n) are the operands,
+/// and step s of a candidate produces node n + s. Returns the candidate with the lowest estimated cost.
+extern "C" int64_t _mlir_ciface_comet_chain_order_select(UnrankedMemRefType<double> *sketches,
+                                                         UnrankedMemRefType<int64_t> *candidates)
+{
+  DynamicMemRefType<double> sketchesRef(*sketches);
+  DynamicMemRefType<int64_t> candidatesRef(*candidates);
+  const double *sketchData = sketchesRef.data + sketchesRef.offset;
+  const int64_t *candidateData = candidatesRef.data + candidatesRef.offset;
+
+  int64_t numOperands = candidateData[0];
+  int64_t numCandidates = candidateData[1];
+  std::vector<ChainSketch> operands;
+  int64_t offset = 0;
+  for (int64_t t = 0; t < numOperands; t++)
+  {
+    operands.push_back(readChainSketch(sketchData, offset));
+  }
+
+  int64_t best = 0;
+  double bestCost = std::numeric_limits<double>::infinity();
+  for (int64_t c = 0; c < numCandidates; c++)
+  {
+    const int64_t *steps = candidateData + 2 + c * 2 * (numOperands - 1);
+    std::vector<ChainSketch> nodes(operands);
+    double totalCost = 0.0;
+    for (int64_t s = 0; s < numOperands - 1; s++)
+    {
+      double cost;
+      nodes.push_back(multiplyChainSketches(nodes[steps[2 * s]], nodes[steps[2 * s + 1]], cost));
+      totalCost += cost;
+    }
+    if (totalCost < bestCost)
+    {
+      bestCost = totalCost;
+      best = c;
+    }
+  }
+  return best;
+}
+
+extern "C" void comet_chain_sketch_csr(int64_t sketches_rank, void *sketches_ptr, int64_t offset,
+                                       int64_t pos_rank, void *pos_ptr, int64_t crd_rank, void *crd_ptr,
+                                       int64_t rows, int64_t cols)
+{
+  UnrankedMemRefType<double> sketches = {sketches_rank, sketches_ptr};
+  UnrankedMemRefType<int64_t> pos = {pos_rank, pos_ptr};
+  UnrankedMemRefType<int64_t> crd = {crd_rank, crd_ptr};
+  _mlir_ciface_comet_chain_sketch_csr(&sketches, offset, &pos, &crd, rows, cols);
+}
+
+extern "C" void comet_chain_sketch_dense(int64_t sketches_rank, void *sketches_ptr, int64_t offset,
+                                         int64_t rows, int64_t cols)
+{
+  UnrankedMemRefType<double> sketches = {sketches_rank, sketches_ptr};
+  _mlir_ciface_comet_chain_sketch_dense(&sketches, offset, rows, cols);
+}
+
+extern "C" int64_t comet_chain_order_select(int64_t sketches_rank, void *sketches_ptr,
+                                            int64_t candidates_rank, void *candidates_ptr)
+{
+  UnrankedMemRefType<double> sketches = {sketches_rank, sketches_ptr};
+  UnrankedMemRefType<int64_t> candidates = {candidates_rank, candidates_ptr};
+  return _mlir_ciface_comet_chain_order_select(&sketches, &candidates);
+}
@@ -29,70 +29,14 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
-
-#if defined(__x86_64__) || defined(_M_X64) || defined(__i386) || defined(_M_IX86)
-void bli_dgemm_x86_ukr(
-    dim_t m,
-    dim_t n,
-    dim_t k,
-    double *restrict alpha,
-    double *restrict a,
-    double *restrict b,
-    double *restrict beta,
-    double *restrict c, inc_t rs_c0, inc_t cs_c0,
-    auxinfo_t *restrict data,
-    cntx_t *restrict cntx)
-{
-  /// get the micro - arch
-  const char *arch = bli_arch_string(bli_cpuid_query_id());
-  // printf("arch: %s\n", arch);
-
-  if ((strcmp("haswell", arch) == 0) ||
-      (strcmp("zen", arch) == 0) ||
-      (strcmp("zen2", arch) == 0) ||
-      (strcmp("zen3", arch) == 0) ||
-      (strcmp("skx", arch) == 0) ||
-      (strcmp("knl", arch) == 0))
-  {
-    printf("Calling bli_dgemm_haswell_asm_6x8\n");
-    bli_dgemm_haswell_asm_6x8(m, n, k, alpha, a, b, beta, c, rs_c0, cs_c0, data, cntx);
-  }
-  else
-  {
-    llvm::errs() << __FILE__ << " " << __LINE__ << "ERROR: Undefined microkernel"
-                 << "\n";
-  }
-}
-
-#elif defined(__aarch64__) || defined(__arm__) || defined(_M_ARM) || defined(_ARCH_PPC)
-void bli_dgemm_arm_ukr(
-    dim_t m,
-    dim_t n,
-    dim_t k,
-    double *restrict alpha,
-    double *restrict a,
-    double *restrict b,
-    double *restrict beta,
-    double *restrict c, inc_t rs_c0, inc_t cs_c0,
-    auxinfo_t *restrict data,
-    cntx_t *restrict cntx)
-{
-  // get the micro - arch
-  const char *arch = bli_arch_string(bli_cpuid_query_id());
-  // printf("arch: %s\n", arch);
-
-  if ((strcmp("firestorm", arch) == 0))
-  {
-    bli_dgemm_armv8a_asm_8x6r(m, n, k, alpha, a, b, beta, c, rs_c0, cs_c0, data, cntx);
-  }
-  else
-  {
-    llvm::errs() << __FILE__ << " " << __LINE__ << "Undefined microkernel"
-                 << "\n";
-  }
-}
-#endif
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 /// generic arch-independent gemm microkernel reference implementation:
 /// https://github.com/flame/blis/blob/master/config/template/kernels/3/bli_gemm_template_noopt_mxn.c
@@ -112,14 +56,15 @@ void bli_dgemm_arm_ukr(
 ///               rs_c == 1 && cs_c == 0: means contiguous col-storage desired for C,
 ///               rs_c == 0 && cs_c == 1: means contiguous row-storage desired for C.
 
-void dgemm_generic_noopt_mxn(
+template <typename T>
+void gemm_generic_noopt_mxn(
     int64_t m,
     int64_t n,
     int64_t k,
-    double *alpha,
-    double *a, double *b,
-    double *beta,
-    double *c,
+    T *alpha,
+    T *a, T *b,
+    T *beta,
+    T *c,
     int64_t rs_c, int64_t cs_c,
     auxinfo_t *restrict data,
     cntx_t *restrict cntx)
@@ -133,16 +78,14 @@ void dgemm_generic_noopt_mxn(
   int64_t rs_ab = 1;
   int64_t cs_ab = MR;
 
-  double ai, bj;
-  double *abij;
-  double ab[MR * NR];           /// holds the computed values
-  for (i = 0; i < MR * NR; i++) /// initialization
-    ab[i] = 0.0;
+  T ai, bj;
+  T *abij;
+  std::vector<T> ab(MR * NR, (T)0); /// holds the computed values
 
   /// Perform a series of k rank-1 updates into ab.
   for (l = 0; l < k; ++l)
   {
-    abij = ab;
+    abij = ab.data();
 
     for (j = 0; j < NR; ++j)
     {
@@ -166,19 +109,56 @@ void dgemm_generic_noopt_mxn(
   }
 
   /// Scale c by beta and then add the scaled result in ab.
+  /// As in the BLIS kernels, c is not read when beta is zero.
   for (j = 0; j < NR; ++j)
   {
     for (i = 0; i < MR; ++i)
     {
-      c[i * rs_c + j * cs_c] = ab[i * rs_ab + j * cs_ab] +
-                               c[i * rs_c + j * cs_c] * (*beta);
+      if (*beta == (T)0)
+        c[i * rs_c + j * cs_c] = ab[i * rs_ab + j * cs_ab];
+      else
+        c[i * rs_c + j * cs_c] = ab[i * rs_ab + j * cs_ab] +
+                                 c[i * rs_c + j * cs_c] * (*beta);
     }
   }
-};
+}
 
-extern "C" void _mlir_ciface_linalg_matmul_viewsxs_viewsxs_viewsxs(
-    StridedMemRefType<double, 2> *A, StridedMemRefType<double, 2> *B,
-    StridedMemRefType<double, 2> *C, int mr, int nr)
+namespace
+{
+  /// Call the micro-kernel that the dispatch table wires for T on the running micro-architecture.
+  /// The generic micro-kernel is used when there is none, or when its register blocking differs from mr x nr.
+  template <typename T>
+  void callGemmUkr(int64_t mr, int64_t nr, int64_t k, T *alpha, T *a, T *b, T *beta,
+                   T *c, int64_t rs_c, int64_t cs_c, auxinfo_t *data)
+  {
+    static cntx_t *cntx = (cntx_t *)bli_gks_query_nat_cntx();
+    const CometGemmUkrInfo &ukr = comet_query_gemm_ukr();
+
+    if constexpr (std::is_same<T, double>::value)
+    {
+      if (ukr.dgemm && ukr.dmr == mr && ukr.dnr == nr)
+      {
+        ukr.dgemm(mr, nr, k, alpha, a, b, beta, c, rs_c, cs_c, data, cntx);
+        return;
+      }
+    }
+    else
+    {
+      if (ukr.sgemm && ukr.smr == mr && ukr.snr == nr)
+      {
+        ukr.sgemm(mr, nr, k, alpha, a, b, beta, c, rs_c, cs_c, data, cntx);
+        return;
+      }
+    }
+
+    gemm_generic_noopt_mxn<T>(mr, nr, k, alpha, a, b, beta, c, rs_c, cs_c, data, cntx);
+  }
+} /// namespace
+
+/// C += A * B on a tile produced by the matmul tiling pass
+template <typename T>
+static void matmulMicroKernelTile(StridedMemRefType<T, 2> *A, StridedMemRefType<T, 2> *B,
+                                  StridedMemRefType<T, 2> *C, int mr, int nr)
 {
   if (A->strides[1] != B->strides[1] || A->strides[1] != C->strides[1] ||
       A->strides[1] != 1 || A->sizes[0] < A->strides[1] ||
@@ -193,32 +173,8 @@ extern "C" void _mlir_ciface_linalg_matmul_viewsxs_viewsxs_viewsxs(
     return;
   }
 
-  // printMemRefMetaData(std::cerr, *A);
-  // printMemRefMetaData(std::cerr, *B);
-  // printMemRefMetaData(std::cerr, *C);
-
-  // printf("\n");
-  // printf("A->sizes[0]-m: %d\n", A->sizes[0]);
-  // printf("A->sizes[1]-k: %d\n", A->sizes[1]);
-  // printf("A->strides[0]: %d\n", A->strides[0]);
-  // printf("A->strides[1]: %d\n", A->strides[1]);
-
-  // printf("B->sizes[0]: %d\n", B->sizes[0]);
-  // printf("B->sizes[1]-n: %d\n", B->sizes[1]);
-  // printf("B->strides[0]: %d\n", B->strides[0]);
-  // printf("B->strides[1]: %d\n", B->strides[1]);
-  // printf("\n");
-
-  // printf("mr: %d", mr);
-  // printf("nr: %d", nr);
-
-  double alpha = 1.0f;
-  double beta = 1.0f;
-  if (beta == -1.0)
-  {
-    alpha *= -1.0;
-    beta = 1.0;
-  }
+  T alpha = 1.0f;
+  T beta = 1.0f;
 
   auxinfo_t data;
   bli_auxinfo_set_next_a(A->data + A->offset, &data);
@@ -227,35 +183,496 @@ extern "C" void _mlir_ciface_linalg_matmul_viewsxs_viewsxs_viewsxs(
   /// Partial tile
   if (A->sizes[0] < mr || B->sizes[1] < nr)
   {
-    // printf("A->sizes[0]: %d\n", A->sizes[0]);
-    // printf("B->sizes[1]: %d\n", B->sizes[1]);
-    // printf("mr: %d\n", mr);
-    // printf("nr: %d\n", nr);
-    dgemm_generic_noopt_mxn(A->sizes[0], // m
-                            B->sizes[1], // n
-                            A->sizes[1], // k
-                            &alpha,
-                            A->data + A->offset,
-                            B->data + B->offset,
-                            &beta,
-                            C->data + C->offset,
-                            C->strides[0],
-                            C->strides[1],
-                            &data, NULL);
+    gemm_generic_noopt_mxn<T>(A->sizes[0], // m
+                              B->sizes[1], // n
+                              A->sizes[1], // k
+                              &alpha,
+                              A->data + A->offset,
+                              B->data + B->offset,
+                              &beta,
+                              C->data + C->offset,
+                              C->strides[0],
+                              C->strides[1],
+                              &data, NULL);
   }
   else
   {
     assert(A->sizes[0] == mr && B->sizes[1] == nr);
-    bli_dgemm_asm_6x8(A->sizes[0], // m
-                      B->sizes[1], // n
-                      A->sizes[1], // k
-                      &alpha,
-                      A->data + A->offset,
-                      B->data + B->offset,
-                      &beta,
-                      C->data + C->offset,
-                      C->strides[0],
-                      C->strides[1],
-                      &data, NULL);
+    callGemmUkr<T>(A->sizes[0], // m
+                   B->sizes[1], // n
+                   A->sizes[1], // k
+                   &alpha,
+                   A->data + A->offset,
+                   B->data + B->offset,
+                   &beta,
+                   C->data + C->offset,
+                   C->strides[0],
+                   C->strides[1],
+                   &data);
+  }
+}
+
+extern "C" void _mlir_ciface_linalg_matmul_viewsxs_viewsxs_viewsxs(
+    StridedMemRefType<double, 2> *A, StridedMemRefType<double, 2> *B,
+    StridedMemRefType<double, 2> *C, int mr, int nr)
+{
+  matmulMicroKernelTile<double>(A, B, C, mr, nr);
+}
+
+extern "C" void _mlir_ciface_linalg_matmul_f32_viewsxs_viewsxs_viewsxs(
+    StridedMemRefType<float, 2> *A, StridedMemRefType<float, 2> *B,
+    StridedMemRefType<float, 2> *C, int mr, int nr)
+{
+  matmulMicroKernelTile<float>(A, B, C, mr, nr);
+}
+
+//===----------------------------------------------------------------------===//
+// Packed GEMM driver
+//===----------------------------------------------------------------------===//
+
+/// The driver below computes C += A * B on whole (untiled) operands following the BLIS five-loop structure:
+///   jc: nc-wide column blocks of B and C
+///     pc: kc-deep slices of A and B, the kc x nc block of B is packed once into nr-wide micro-panels
+///       ic: mc-tall row blocks of A and C, distributed over the threads; each thread packs its own mc x kc block of A
+///         jr, ir: mr x nr micro-tiles of C computed by the micro-kernel on the packed micro-panels
+/// Packing zero-pads the edges of A and B, so the micro-kernel always runs on full mr x nr micro-panels.
+/// Edge tiles are computed into a scratch tile and only their valid part is accumulated into C.
+/// The operands are accessed through layouts, so that the same driver also runs on tensors viewed as matrices (GETT).
+
+namespace
+{
+  /// Problems smaller than this many multiply-adds run on the calling thread only
+  const int64_t kGemmParallelThreshold = 64 * 64 * 64;
+
+  /// The micro-kernels load the packed micro-panels with aligned vector loads
+  const size_t kPackedBufferAlignment = 64;
+
+  template <typename T>
+  using PackedBuffer = std::unique_ptr<T, decltype(&free)>;
+
+  template <typename T>
+  PackedBuffer<T> allocPackedBuffer(int64_t count)
+  {
+    size_t bytes = count * sizeof(T);
+    bytes = (bytes + kPackedBufferAlignment - 1) / kPackedBufferAlignment * kPackedBufferAlignment;
+    return PackedBuffer<T>((T *)aligned_alloc(kPackedBufferAlignment, bytes), &free);
+  }
+
+  /// Distance between two consecutive packed micro-panels, padded so that every micro-panel stays aligned
+  template <typename T>
+  int64_t packedPanelStride(int64_t width, int64_t kc)
+  {
+    int64_t elems = kPackedBufferAlignment / sizeof(T);
+    return (width * kc + elems - 1) / elems * elems;
+  }
+
+  /// Run task(taskID, threadID) for taskID in [0, numTasks) on numThreads threads, including the calling one
+  template <typename Fn>
+  void parallelForTasks(int64_t numTasks, int64_t numThreads, Fn task)
+  {
+    numThreads = std::max<int64_t>(1, std::min(numThreads, numTasks));
+    std::atomic<int64_t> next(0);
+    auto worker = [&](int64_t threadID)
+    {
+      for (int64_t t = next.fetch_add(1); t < numTasks; t = next.fetch_add(1))
+        task(t, threadID);
+    };
+
+    std::vector<std::thread> workers;
+    for (int64_t tid = 1; tid < numThreads; tid++)
+      workers.emplace_back(worker, tid);
+    worker(0);
+    for (auto &w : workers)
+      w.join();
   }
+
+  /// Layouts the driver reads A and B from and writes C to: element (i, j) of a matrix is at
+  /// base[layout.row(i) + layout.col(j)].
+  ///
+  /// StridedLayout is a regular strided matrix.
+  struct StridedLayout
+  {
+    int64_t rs, cs;
+
+    int64_t row(int64_t i) const { return i * rs; }
+    int64_t col(int64_t j) const { return j * cs; }
+
+    /// Strides of the m x n tile at (i, j), false if the tile is not a strided matrix
+    bool tileStrides(int64_t, int64_t, int64_t, int64_t, int64_t &rs_tile, int64_t &cs_tile) const
+    {
+      rs_tile = rs;
+      cs_tile = cs;
+      return true;
+    }
+  };
+
+  /// TabulatedLayout is a tensor viewed as a matrix whose rows and columns are groups of its modes.
+  /// The offsets of the rows and of the columns are looked up in tables built from the tensor strides.
+  struct TabulatedLayout
+  {
+    const int64_t *rowOffsets, *colOffsets;
+
+    int64_t row(int64_t i) const { return rowOffsets[i]; }
+    int64_t col(int64_t j) const { return colOffsets[j]; }
+
+    bool tileStrides(int64_t i, int64_t m, int64_t j, int64_t n, int64_t &rs_tile, int64_t &cs_tile) const
+    {
+      return isStrided(rowOffsets + i, m, rs_tile) && isStrided(colOffsets + j, n, cs_tile);
+    }
+
+  private:
+    static bool isStrided(const int64_t *offsets, int64_t count, int64_t &stride)
+    {
+      stride = count > 1 ? offsets[1] - offsets[0] : 1;
+      for (int64_t i = 2; i < count; i++)
+      {
+        if (offsets[i] - offsets[i - 1] != stride)
+          return false;
+      }
+      return true;
+    }
+  };
+
+  /// Pack the mc x kc block of A at (ic, pc) into mr-tall micro-panels: for every l in [0, kc), the mr elements
+  /// of column l of a micro-panel are contiguous (column-major micro-panel), rows past mc are zero.
+  template <typename T, typename Layout>
+  void packBlockA(int64_t mc, int64_t kc, const T *a, const Layout &la, int64_t ic, int64_t pc,
+                  int64_t mr, T *packed)
+  {
+    for (int64_t ir = 0; ir < mc; ir += mr)
+    {
+      int64_t m_valid = std::min(mr, mc - ir);
+      T *dst = packed + (ir / mr) * packedPanelStride<T>(mr, kc);
+      for (int64_t l = 0; l < kc; l++)
+      {
+        const T *col = a + la.col(pc + l);
+        int64_t i = 0;
+        for (; i < m_valid; i++)
+          dst[i] = col[la.row(ic + ir + i)];
+        for (; i < mr; i++)
+          dst[i] = (T)0;
+        dst += mr;
+      }
+    }
+  }
+
+  /// Pack the nr-wide micro-panel jp of the kc x nc block of B at (pc, jc): for every l in [0, kc), the nr
+  /// elements of row l are contiguous (row-major micro-panel), columns past nc are zero.
+  template <typename T, typename Layout>
+  void packPanelB(int64_t jp, int64_t kc, int64_t nc, const T *b, const Layout &lb, int64_t pc, int64_t jc,
+                  int64_t nr, T *packed)
+  {
+    int64_t jr = jp * nr;
+    int64_t n_valid = std::min(nr, nc - jr);
+    packed += jp * packedPanelStride<T>(nr, kc);
+    for (int64_t l = 0; l < kc; l++)
+    {
+      const T *row = b + lb.row(pc + l);
+      int64_t j = 0;
+      for (; j < n_valid; j++)
+        packed[j] = row[lb.col(jc + jr + j)];
+      for (; j < nr; j++)
+        packed[j] = (T)0;
+      packed += nr;
+    }
+  }
+
+  /// The mc x nc block of C at (ic, jc) += alpha * packedA * packedB, micro-tile by micro-tile
+  template <typename T, typename Layout>
+  void gemmMacroKernel(int64_t mc, int64_t nc, int64_t kc, T alpha,
+                       T *packedA, T *packedB,
+                       T *c, const Layout &lc, int64_t ic, int64_t jc,
+                       int64_t mr, int64_t nr, T *scratch)
+  {
+    T beta = 1.0;
+    T beta_scratch = 0.0;
+    auxinfo_t data;
+    int64_t ps_a = packedPanelStride<T>(mr, kc);
+    int64_t ps_b = packedPanelStride<T>(nr, kc);
+
+    for (int64_t jr = 0; jr < nc; jr += nr)
+    {
+      int64_t n_valid = std::min(nr, nc - jr);
+      T *b = packedB + (jr / nr) * ps_b;
+      for (int64_t ir = 0; ir < mc; ir += mr)
+      {
+        int64_t m_valid = std::min(mr, mc - ir);
+        T *a = packedA + (ir / mr) * ps_a;
+
+        /// Prefetch hints: the next micro-panel of A, or the first one along with the next panel of B
+        bool last_ir = ir + mr >= mc;
+        bli_auxinfo_set_next_a(last_ir ? packedA : a + ps_a, &data);
+        bli_auxinfo_set_next_b(last_ir ? b + ps_b : b, &data);
+
+        int64_t rs_c, cs_c;
+        if (m_valid == mr && n_valid == nr &&
+            lc.tileStrides(ic + ir, mr, jc + jr, nr, rs_c, cs_c))
+        {
+          T *c_tile = c + lc.row(ic + ir) + lc.col(jc + jr);
+          callGemmUkr<T>(mr, nr, kc, &alpha, a, b, &beta, c_tile, rs_c, cs_c, &data);
+        }
+        else
+        {
+          /// Partial tile, or a tile of C that is not a strided matrix
+          callGemmUkr<T>(mr, nr, kc, &alpha, a, b, &beta_scratch, scratch, nr, 1, &data);
+          for (int64_t i = 0; i < m_valid; i++)
+          {
+            T *c_row = c + lc.row(ic + ir + i);
+            for (int64_t j = 0; j < n_valid; j++)
+              c_row[lc.col(jc + jr + j)] += scratch[i * nr + j];
+          }
+        }
+      }
+    }
+  }
+
+  /// C(m x n) += alpha * A(m x k) * B(k x n), with A, B and C read and written through their layouts
+  template <typename T, typename LayoutA, typename LayoutB, typename LayoutC>
+  void blockedGemm(int64_t m, int64_t n, int64_t k, T alpha,
+                   const T *a_base, const LayoutA &la,
+                   const T *b_base, const LayoutB &lb,
+                   T *c_base, const LayoutC &lc,
+                   int mc, int kc, int nc, int mr, int nr)
+  {
+    if (m == 0 || n == 0 || k == 0)
+      return;
+
+    int64_t num_threads = 1;
+    if (m * n * k >= kGemmParallelThreshold)
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    /// Shrink the mc blocks (keeping them a multiple of mr) until every thread has a row block of its own
+    int64_t mc_eff = std::min<int64_t>(mc, m);
+    int64_t rows_per_thread = (m + num_threads - 1) / num_threads;
+    rows_per_thread = (rows_per_thread + mr - 1) / mr * mr;
+    mc_eff = std::max<int64_t>(mr, std::min<int64_t>(mc_eff, rows_per_thread));
+    mc_eff = (mc_eff + mr - 1) / mr * mr;
+
+    int64_t kc_eff = std::min<int64_t>(kc, k);
+    int64_t nc_eff = (std::min<int64_t>(nc, n) + nr - 1) / nr * nr;
+    int64_t num_ic_blocks = (m + mc_eff - 1) / mc_eff;
+    num_threads = std::min(num_threads, num_ic_blocks);
+
+    PackedBuffer<T> packedB = allocPackedBuffer<T>(nc_eff / nr * packedPanelStride<T>(nr, kc_eff));
+    std::vector<PackedBuffer<T>> packedA;
+    std::vector<PackedBuffer<T>> scratch;
+    for (int64_t t = 0; t < num_threads; t++)
+    {
+      packedA.push_back(allocPackedBuffer<T>(mc_eff / mr * packedPanelStride<T>(mr, kc_eff)));
+      scratch.push_back(allocPackedBuffer<T>(mr * nr));
+    }
+    bool allocated = packedB != nullptr;
+    for (int64_t t = 0; t < num_threads; t++)
+      allocated = allocated && packedA[t] && scratch[t];
+    if (!allocated)
+    {
+      llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: Failed to allocate the packing buffers\n";
+      return;
+    }
+
+    for (int64_t jc = 0; jc < n; jc += nc_eff)
+    {
+      int64_t nc_cur = std::min(nc_eff, n - jc);
+      int64_t num_b_panels = (nc_cur + nr - 1) / nr;
+      for (int64_t pc = 0; pc < k; pc += kc_eff)
+      {
+        int64_t kc_cur = std::min(kc_eff, k - pc);
+
+        /// Pack the kc x nc block of B, one micro-panel per task
+        parallelForTasks(num_b_panels, num_threads, [&](int64_t jp, int64_t)
+                         { packPanelB(jp, kc_cur, nc_cur, b_base, lb, pc, jc, nr, packedB.get()); });
+
+        /// Each row block of C only depends on its own block of A, so the ic loop runs in parallel
+        parallelForTasks(num_ic_blocks, num_threads, [&](int64_t icb, int64_t tid)
+                         {
+          int64_t ic = icb * mc_eff;
+          int64_t mc_cur = std::min(mc_eff, m - ic);
+          packBlockA(mc_cur, kc_cur, a_base, la, ic, pc, mr, packedA[tid].get());
+          gemmMacroKernel(mc_cur, nc_cur, kc_cur, alpha, packedA[tid].get(), packedB.get(),
+                          c_base, lc, ic, jc, mr, nr, scratch[tid].get()); });
+      }
+    }
+  }
+
+  template <typename T>
+  void packedGemm(StridedMemRefType<T, 2> *A, StridedMemRefType<T, 2> *B,
+                  StridedMemRefType<T, 2> *C, int mc, int kc, int nc, int mr, int nr)
+  {
+    int64_t m = C->sizes[0];
+    int64_t n = C->sizes[1];
+    int64_t k = A->sizes[1];
+
+    if (A->sizes[0] != m || B->sizes[0] != k || B->sizes[1] != n ||
+        mc < mr || nc < nr || kc <= 0 || mr <= 0 || nr <= 0)
+    {
+      printMemRefMetaData(std::cerr, *A);
+      printMemRefMetaData(std::cerr, *B);
+      printMemRefMetaData(std::cerr, *C);
+
+      return;
+    }
+
+    blockedGemm<T>(m, n, k, (T)1,
+                   A->data + A->offset, StridedLayout{A->strides[0], A->strides[1]},
+                   B->data + B->offset, StridedLayout{B->strides[0], B->strides[1]},
+                   C->data + C->offset, StridedLayout{C->strides[0], C->strides[1]},
+                   mc, kc, nc, mr, nr);
+  }
+} /// namespace
+
+extern "C" void _mlir_ciface_linalg_matmul_packed_viewsxs_viewsxs_viewsxs(
+    StridedMemRefType<double, 2> *A, StridedMemRefType<double, 2> *B,
+    StridedMemRefType<double, 2> *C, int mc, int kc, int nc, int mr, int nr)
+{
+  packedGemm<double>(A, B, C, mc, kc, nc, mr, nr);
+}
+
+extern "C" void _mlir_ciface_linalg_matmul_packed_f32_viewsxs_viewsxs_viewsxs(
+    StridedMemRefType<float, 2> *A, StridedMemRefType<float, 2> *B,
+    StridedMemRefType<float, 2> *C, int mc, int kc, int nc, int mr, int nr)
+{
+  packedGemm<float>(A, B, C, mc, kc, nc, mr, nr);
+}
+
+//===----------------------------------------------------------------------===//
+// GETT: GEMM-like tensor-tensor contractions
+//===----------------------------------------------------------------------===//
+
+/// The contraction C[M, N] += alpha * A[M, K] * B[K, N], where M, N and K are groups of tensor modes, runs on the
+/// packed GEMM driver with A, B and C viewed as matrices through TabulatedLayout: the packing routines gather the
+/// micro-panels straight from the tensors, so no transposed copy of any operand is ever materialized.
+///
+/// modes describes the groups: {#M, #N, #K, then for each M mode its dimension in A and in C,
+/// for each N mode its dimension in B and in C, and for each K mode its dimension in A and in B}.
+/// The last mode of a group varies the fastest along the rows (or columns) of the matrix views.
+
+namespace
+{
+  /// Offsets of all the entries of a group of modes given as (size, stride) pairs, the last mode varying the fastest
+  std::vector<int64_t> buildModeOffsets(const std::vector<std::pair<int64_t, int64_t>> &modes)
+  {
+    std::vector<int64_t> offsets{0};
+    for (const auto &mode : modes)
+    {
+      std::vector<int64_t> next;
+      next.reserve(offsets.size() * mode.first);
+      for (auto offset : offsets)
+        for (int64_t i = 0; i < mode.first; i++)
+          next.push_back(offset + i * mode.second);
+      offsets.swap(next);
+    }
+    return offsets;
+  }
+
+  /// Block sizes of the native BLIS context, with the register blocking of the dispatched micro-kernel
+  template <typename T>
+  void queryGemmBlockSizes(int &mc, int &kc, int &nc, int &mr, int &nr)
+  {
+    const cntx_t *cntx = bli_gks_query_nat_cntx();
+    num_t dt = std::is_same<T, float>::value ? BLIS_FLOAT : BLIS_DOUBLE;
+
+    mc = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_MC, cntx);
+    kc = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_KC, cntx);
+    nc = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_NC, cntx);
+    mr = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_MR, cntx);
+    nr = (int)bli_cntx_get_blksz_def_dt(dt, BLIS_NR, cntx);
+
+    const CometGemmUkrInfo &ukr = comet_query_gemm_ukr();
+    if (std::is_same<T, float>::value && ukr.sgemm)
+    {
+      mr = ukr.smr;
+      nr = ukr.snr;
+    }
+    else if (std::is_same<T, double>::value && ukr.dgemm)
+    {
+      mr = ukr.dmr;
+      nr = ukr.dnr;
+    }
+  }
+
+  template <typename T>
+  void gett(UnrankedMemRefType<T> *A, UnrankedMemRefType<T> *B, UnrankedMemRefType<T> *C,
+            UnrankedMemRefType<int64_t> *modes, T alpha)
+  {
+    DynamicMemRefType<T> a(*A), b(*B), c(*C);
+    DynamicMemRefType<int64_t> desc(*modes);
+    const int64_t *d = desc.data + desc.offset;
+
+    /// Operands whose dimensions each group of modes refers to: M is in A and C, N in B and C, K in A and B
+    const DynamicMemRefType<T> *operands[3][2] = {{&a, &c}, {&b, &c}, {&a, &b}};
+    std::vector<std::pair<int64_t, int64_t>> groups[3][2];
+
+    bool valid = desc.rank == 1 && desc.sizes[0] >= 3 &&
+                 desc.sizes[0] == 3 + 2 * (d[0] + d[1] + d[2]);
+    int64_t pos = 3;
+    for (int g = 0; g < 3 && valid; g++)
+    {
+      for (int64_t i = 0; i < d[g] && valid; i++, pos += 2)
+      {
+        const DynamicMemRefType<T> &x = *operands[g][0];
+        const DynamicMemRefType<T> &y = *operands[g][1];
+        int64_t dx = d[pos], dy = d[pos + 1];
+        valid = dx >= 0 && dx < x.rank && dy >= 0 && dy < y.rank && x.sizes[dx] == y.sizes[dy];
+        if (!valid)
+          break;
+        groups[g][0].push_back({x.sizes[dx], x.strides[dx]});
+        groups[g][1].push_back({y.sizes[dy], y.strides[dy]});
+      }
+    }
+    if (!valid)
+    {
+      llvm::errs() << __FILE__ << ":" << __LINE__ << " ERROR: Invalid mode descriptor for the GETT contraction\n";
+      return;
+    }
+
+    std::vector<int64_t> rowsA = buildModeOffsets(groups[0][0]);
+    std::vector<int64_t> rowsC = buildModeOffsets(groups[0][1]);
+    std::vector<int64_t> colsB = buildModeOffsets(groups[1][0]);
+    std::vector<int64_t> colsC = buildModeOffsets(groups[1][1]);
+    std::vector<int64_t> colsA = buildModeOffsets(groups[2][0]);
+    std::vector<int64_t> rowsB = buildModeOffsets(groups[2][1]);
+
+    int mc, kc, nc, mr, nr;
+    queryGemmBlockSizes<T>(mc, kc, nc, mr, nr);
+
+    blockedGemm<T>(rowsA.size(), colsB.size(), colsA.size(), alpha,
+                   a.data + a.offset, TabulatedLayout{rowsA.data(), colsA.data()},
+                   b.data + b.offset, TabulatedLayout{rowsB.data(), colsB.data()},
+                   c.data + c.offset, TabulatedLayout{rowsC.data(), colsC.data()},
+                   mc, kc, nc, mr, nr);
+  }
+} /// namespace
+
+extern "C" void _mlir_ciface_comet_gett_f64(UnrankedMemRefType<double> *A, UnrankedMemRefType<double> *B,
+                                            UnrankedMemRefType<double> *C, UnrankedMemRefType<int64_t> *modes,
+                                            double alpha)
+{
+  gett<double>(A, B, C, modes, alpha);
+}
+
+extern "C" void _mlir_ciface_comet_gett_f32(UnrankedMemRefType<float> *A, UnrankedMemRefType<float> *B,
+                                            UnrankedMemRefType<float> *C, UnrankedMemRefType<int64_t> *modes,
+                                            float alpha)
+{
+  gett<float>(A, B, C, modes, alpha);
+}
+
+extern "C" void comet_gett_f64(int64_t rankA, void *ptrA, int64_t rankB, void *ptrB, int64_t rankC, void *ptrC,
+                               int64_t rankModes, void *ptrModes, double alpha)
+{
+  UnrankedMemRefType<double> A = {rankA, ptrA};
+  UnrankedMemRefType<double> B = {rankB, ptrB};
+  UnrankedMemRefType<double> C = {rankC, ptrC};
+  UnrankedMemRefType<int64_t> modes = {rankModes, ptrModes};
+  _mlir_ciface_comet_gett_f64(&A, &B, &C, &modes, alpha);
+}
+
+extern "C" void comet_gett_f32(int64_t rankA, void *ptrA, int64_t rankB, void *ptrB, int64_t rankC, void *ptrC,
+                               int64_t rankModes, void *ptrModes, float alpha)
+{
+  UnrankedMemRefType<float> A = {rankA, ptrA};
+  UnrankedMemRefType<float> B = {rankB, ptrB};
+  UnrankedMemRefType<float> C = {rankC, ptrC};
+  UnrankedMemRefType<int64_t> modes = {rankModes, ptrModes};
+  _mlir_ciface_comet_gett_f32(&A, &B, &C, &modes, alpha);
 }